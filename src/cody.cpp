@@ -4,12 +4,14 @@
 #include <parallel.h>
 #include <app.h>
 #include <file_provider.h>
+#include <file_index.h>
 #include <cryptoutil.h>
 #include <arg_parser.h>
 #include <storage.h>
 #include <security_services.h>
 #include <modal.h>
 #include <rng.h>
+#include <algorithm>
 
 typedef struct{
     bool is_remote;
@@ -155,15 +157,22 @@ std::map<const char *, ArgDesc> arg_map = {
     }
 };
 
+/*
+* Restores the files of the session without blocking, they are loaded in the pool
+* and arrive while the editor is already running. No view layout is stored so all
+* views start empty, entries are appended to StartupLoad as files are registered
+* so the list is loaded backwards, most recent first.
+*/
 void LoadStaticFilesOnStart(){
     JSON_Value *root = AppGetConfigFileRoot();
     std::string rootPath = AppGetRootDirectory();
+    std::vector<std::string> paths;
+    std::vector<std::string> entries;
 
     char folder[PATH_MAX];
     FileEntry entry;
 
     auto path_processor = [&](const char *line) -> bool{
-        uint n = (uint)strlen(line);
         std::string lineStr(line);
         SwapPathDelimiter(lineStr);
 
@@ -171,12 +180,15 @@ void LoadStaticFilesOnStart(){
         if(AppIsStoredFile(p))
             return true;
 
+        for(std::string &s : paths){
+            if(s == p) return true;
+        }
+
         int r = GuessFileEntry((char *)p.c_str(), (uint)p.size(),
                                &entry, folder);
-        int fileType = -1;
         if(!(r < 0) && entry.type == DescriptorFile){
-            if(FileProvider_Load((char *)p.c_str(), (uint)p.size(), fileType))
-                AppAddStoredFile(lineStr);
+            paths.push_back(p);
+            entries.push_back(lineStr);
         }
 
         return true;
@@ -185,6 +197,20 @@ void LoadStaticFilesOnStart(){
     JsonExtractArray<json_array_get_string, decltype(path_processor)>(
         root, "StartupLoad", path_processor
     );
+
+    std::reverse(paths.begin(), paths.end());
+    std::reverse(entries.begin(), entries.end());
+
+    FileProvider_LoadMany(paths,
+    [paths, entries](const std::string &path, int status, LineBuffer *) -> void{
+        if(status != FILE_LOAD_SUCCESS) return;
+        for(uint i = 0; i < paths.size(); i++){
+            if(paths[i] == path && !AppIsStoredFile(path)){
+                AppAddStoredFile(entries[i]);
+                return;
+            }
+        }
+    });
 }
 
 void InitializeEmptyView(BufferView **view=nullptr){
@@ -219,6 +245,8 @@ void StartWithFile(const char *path=nullptr){
 
     }else{
         LoadStaticFilesOnStart();
+        // so that the project files can be opened right away
+        FileIndex_Refresh(AppGetRootDirectory().c_str());
     }
 
     Graphics_Initialize();
@@ -259,6 +287,7 @@ int cody_entry(int argc, char **argv){
 
     DebuggerRoutines();
 
+    ParallelPool_Init();
     CommandExecutorInit();
 
     if(!args.is_remote){
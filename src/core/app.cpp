@@ -27,6 +27,10 @@
 #include <pdfview.h>
 #include <viewer_ctrl.h>
 #include <audio.h>
+#include <search.h>
+#include <trigram_index.h>
+#include <edit_batch.h>
+#include <file_watcher.h>
 
 #define DIRECTION_LEFT  0
 #define DIRECTION_UP    1
@@ -279,6 +283,7 @@ void AppEarlyInitialize(bool use_tabs){
     appGlobalConfig.pathCompression = -1;
     appGlobalConfig.displayWrongIdent = 1;
     appGlobalConfig.displayViewIndices = 0;
+    appGlobalConfig.searchFlags = SEARCH_FLAG_NONE;
     appGlobalConfig.useTabs = use_tabs ? 1 : 0;
     appGlobalConfig.defaultFontSize = 20;
     appGlobalConfig.cStyle = CURSOR_RECT;
@@ -378,6 +383,14 @@ void AppSwapUseTabs(){
     appGlobalConfig.useTabs = 1 - appGlobalConfig.useTabs;
 }
 
+int AppGetSearchFlags(){
+    return appGlobalConfig.searchFlags;
+}
+
+void AppSwapSearchFlag(int flag){
+    appGlobalConfig.searchFlags ^= flag;
+}
+
 int AppGetTabLength(int *using_tab){
     if(using_tab){
         *using_tab = appGlobalConfig.useTabs;
@@ -1490,28 +1503,29 @@ void AppCommandKillBuffer(){
             Tokenizer *tokenizer =
                     FileProvider_GetLineBufferTokenizer(lineBuffer);
 
-            DispatchExecution([&](HostDispatcher *dispatcher){
-                Tokenizer *localTokenizer = tokenizer;
-                SymbolTable *localSymTable = tokenizer->symbolTable;
-                LineBuffer *localLinebuffer = lineBuffer;
-
-                // remove from main memory before dispatch so that
-                // we dont run the risk of sync issues.
-                char *ptr = localLinebuffer->filePath;
-                uint pSize = localLinebuffer->filePathSize;
-                FileProvider_Remove(ptr, pSize);
-                BufferViewLocation_RemoveLineBuffer(localLinebuffer);
-
-                dispatcher->DispatchHost();
-
-                for(uint i = 0; i < localLinebuffer->lineCount; i++){
-                    Buffer *buffer =
-                            LineBuffer_GetBufferAt(localLinebuffer, i);
-                    Buffer_EraseSymbols(buffer, localSymTable);
+            // results of searches cannot point to it anymore
+            BaseCommand_GlobalSearchDropBuffer(lineBuffer);
+
+            // remove from main memory before dispatch so that
+            // we dont run the risk of sync issues.
+            char *ptr = lineBuffer->filePath;
+            uint pSize = lineBuffer->filePathSize;
+            FileProvider_Remove(ptr, pSize);
+            BufferViewLocation_RemoveLineBuffer(lineBuffer);
+
+            // drop the work still pending on it and only free it once the
+            // tasks that are already running return
+            SymbolTable *symTable = tokenizer->symbolTable;
+            TaskGroup *tasks = LineBuffer_GetTaskGroup(lineBuffer);
+            lineBuffer->tasks = nullptr;
+            TaskGroup_Release(tasks, [lineBuffer, symTable](){
+                for(uint i = 0; i < lineBuffer->lineCount; i++){
+                    Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, i);
+                    Buffer_EraseSymbols(buffer, symTable);
                 }
 
-                LineBuffer_Free(localLinebuffer);
-                AllocatorFree(localLinebuffer);
+                LineBuffer_Free(lineBuffer);
+                AllocatorFree(lineBuffer);
             });
         }
     }
@@ -1629,6 +1643,16 @@ void AppCommandUndo(){
                     AllocatorFree(text);
                 }
             } break;
+            case CHANGE_LINES_REPLACE:{
+                char *text = bChange->text;
+                uint size = bChange->size;
+                cursor = bChange->bufferInfo;
+                UndoRedoPopUndo(&lineBuffer->undoRedo);
+                if(text){
+                    EditBatch_Undo(lineBuffer, tokenizer, text, size);
+                    AllocatorFree(text);
+                }
+            } break;
             default:{ printf("Unknow undo command\n"); }
         }
 
@@ -1663,6 +1687,61 @@ void AppCommandHomeLine(){
     BufferView_CursorToPosition(bufferView, cursor.x, cursor.y);
 }
 
+/*
+* Replaces at once the matches of the search and replace command, either the ones
+* from the current match until the end of the file or all the ones of all opened files.
+*/
+static void AppQueryBarReplaceAll(QueryBar *bar, View *view, int allFiles){
+    QueryBarCmdSearch *searchResult = &bar->searchCmd;
+    QueryBarCmdSearchAndReplace *replace = &bar->replaceCmd;
+    BufferView *bView = View_GetBufferView(view);
+    LineBuffer *lineBuffer = bView->lineBuffer;
+    int flags = AppGetSearchFlags();
+
+    if(!allFiles){
+        EditBatch batch;
+        SearchQuery query;
+        Tokenizer *tokenizer = FileProvider_GetLineBufferTokenizer(lineBuffer);
+        vec2ui cursor = BufferView_GetCursorPosition(bView);
+
+        SearchQuery_Compile(&query, replace->toLocate, replace->toLocateLen, flags);
+        EditBatch_Begin(&batch, lineBuffer);
+        EditBatch_ReplaceMatches(&batch, &query, replace->toReplace,
+                                 replace->toReplaceLen, searchResult->lineNo,
+                                 searchResult->position);
+        SearchQuery_Release(&query);
+
+        EditBatch_Commit(&batch, tokenizer, cursor);
+    }else{
+        std::vector<LineBuffer *> lineBuffers;
+        FileBufferList *bufferList = FileProvider_GetBufferList();
+        auto fn = [&](FileBuffer *fBuffer) -> int{
+            if(fBuffer->lineBuffer){
+                lineBuffers.push_back(fBuffer->lineBuffer);
+            }
+            return 1;
+        };
+
+        List_Transverse<FileBuffer>(bufferList->fList, fn);
+        EditBatch_ReplaceInBuffers(lineBuffers.data(), lineBuffers.size(),
+                                   replace->toLocate, replace->toLocateLen, flags,
+                                   replace->toReplace, replace->toReplaceLen);
+    }
+
+    // edited lines might now be shorter than the cursors placed on them
+    ViewTreeIterator iterator;
+    ViewTree_Begin(&iterator);
+    while(iterator.value){
+        BufferView *view = &iterator.value->view->bufferView;
+        if(view->lineBuffer && (allFiles || view->lineBuffer == lineBuffer)){
+            vec2ui cursor = BufferView_GetCursorPosition(view);
+            BufferView_CursorToPosition(view, cursor.x, cursor.y);
+            BufferView_AdjustGhostCursorIfOut(view);
+        }
+        ViewTree_Next(&iterator);
+    }
+}
+
 void AppCommandQueryBarSearchAndReplace(){
     View *view = AppGetActiveView();
     ViewState state = View_GetState(view);
@@ -1679,7 +1758,12 @@ void AppCommandQueryBarSearchAndReplace(){
             // so you need to get that result too.
             QueryBarCmdSearch *searchResult = &qbar->searchCmd;
             QueryBarCmdSearchAndReplace *searchReplace = &qbar->replaceCmd;
-            if(accepted){
+            if(accepted == INTERACTIVE_SEARCH_ACCEPT_REMAINING ||
+               accepted == INTERACTIVE_SEARCH_ACCEPT_ALL_FILES)
+            {
+                AppQueryBarReplaceAll(qbar, vview,
+                                      accepted == INTERACTIVE_SEARCH_ACCEPT_ALL_FILES);
+            }else if(accepted){
                 BufferView *bView = View_GetBufferView(vview);
                 Buffer *buf = BufferView_GetBufferAt(bView, searchResult->lineNo);
                 if(buf){
@@ -1688,16 +1772,28 @@ void AppCommandQueryBarSearchAndReplace(){
                     SymbolTable *symTable = tokenizer->symbolTable;
                     vec2ui cursor = BufferView_GetCursorPosition(bView);
 
+                    SearchQuery query;
+                    std::string replacement;
+                    SearchQuery_Compile(&query, searchReplace->toLocate,
+                                        searchReplace->toLocateLen, AppGetSearchFlags());
+                    SearchQuery_Expand(&query, buf->data, buf->taken,
+                                       searchResult->position, searchResult->length,
+                                       searchReplace->toReplace,
+                                       searchReplace->toReplaceLen, replacement);
+                    SearchQuery_Release(&query);
+
                     UndoRedoUndoPushInsert(&bView->lineBuffer->undoRedo, buf, cursor);
 
                     Buffer_EraseSymbols(buf, symTable);
 
                     Buffer_RemoveRangeRaw(buf, searchResult->position,
-                                searchResult->position + searchReplace->toLocateLen, encoder);
-                    if(searchReplace->toReplaceLen > 0){
+                                searchResult->position + searchResult->length, encoder);
+                    if(replacement.size() > 0){
                         Buffer_InsertRawStringAt(buf, searchResult->position,
-                                searchReplace->toReplace, searchReplace->toReplaceLen, encoder);
+                                (char *)replacement.c_str(), replacement.size(), encoder);
                     }
+
+                    searchReplace->replacedLen = replacement.size();
                     RemountTokensBasedOn(bView, cursor.x);
                     BufferView_Dirty(bView);
                 }
@@ -1995,6 +2091,14 @@ void AppCommandSaveBufferView(){
         success = LineBuffer_SaveToStorage(bufferView->lineBuffer);
     }
 
+    if(success){
+        ProjectIndex_MarkDirty(bufferView->lineBuffer->filePath,
+                               bufferView->lineBuffer->filePathSize);
+        FileWatcher_FileSaved(bufferView->lineBuffer->filePath,
+                              bufferView->lineBuffer->filePathSize);
+        ProjectIndex_Update(AppGetRootDirectory().c_str());
+    }
+
     bufferView->lineBuffer->is_dirty = !success;
 }
 
@@ -2484,6 +2588,20 @@ void AppCommandSwapToBuildBuffer(){
         }
     }
 
+    // repeating it while a session is displayed goes through the other sessions
+    CommandSession *session = CommandSession_FromLineBuffer(bView->lineBuffer);
+    if(session){
+        uint count = CommandSession_Count();
+        for(uint i = 0; i < count; i++){
+            if(CommandSession_At(i) == session){
+                session = CommandSession_At((i + 1) % count);
+                break;
+            }
+        }
+
+        lockedBuffer = CommandSession_GetOutput(session);
+    }
+
     BufferView_SwapBuffer(bView, lockedBuffer->lineBuffer, CodeView);
 }
 
@@ -2614,12 +2732,12 @@ void AppDragAndDrop(char **paths, int count, int x, int y, void*){
     }
 }
 
-void AppCommandOpenFileWithViewType(ViewType type, int creationFlags){
-    AppRestoreCurrentBufferViewState();
+/*
+* Builds the callback that opens the file picked in a file list, shared by the
+* file opener and the project file list.
+*/
+static OnFileOpenCallback AppFileOpenCallback(ViewType type, int creationFlags){
     int localFlags = creationFlags;
-    View *view = AppGetActiveView();
-    view->bufferFlags = std::vector<char>();
-
     auto emptyFunc = [&](QueryBar *bar, View *view) -> int{ return 0; };
     auto fileOpenEncrypted = [&](QueryBar *bar, View *view) -> int{
         BufferView *bView = View_GetBufferView(view);
@@ -2702,9 +2820,26 @@ void AppCommandOpenFileWithViewType(ViewType type, int creationFlags){
         AppSetDelayedCall(AppCommandQueryBarCommit);
     };
 
-    int r = FileOpenerCommandStart(view, appContext.cwd,
-                                   strlen(appContext.cwd), fileOpen);
+    return fileOpen;
+}
+
+void AppCommandOpenFileWithViewType(ViewType type, int creationFlags){
+    AppRestoreCurrentBufferViewState();
+    View *view = AppGetActiveView();
+    view->bufferFlags = std::vector<char>();
 
+    int r = FileOpenerCommandStart(view, appContext.cwd, strlen(appContext.cwd),
+                                   AppFileOpenCallback(type, creationFlags));
+
+    if(r >= 0){
+        AppSetBindingsForState(View_SelectableList);
+    }
+}
+
+void AppCommandOpenProjectFile(){
+    AppRestoreCurrentBufferViewState();
+    View *view = AppGetActiveView();
+    int r = ProjectFileCommandStart(view, AppFileOpenCallback(CodeView, 0));
     if(r >= 0){
         AppSetBindingsForState(View_SelectableList);
     }
@@ -2902,6 +3037,7 @@ void AppInitializeFreeTypingBindings(){
     //FILE MANAGEMENT KEYS
     RegisterOnDragAndDropCallback(Graphics_GetGlobalWindow(), AppDragAndDrop, nullptr);
     RegisterRepeatableEvent(mapping, AppCommandOpenFile, Key_LeftAlt, Key_F);
+    RegisterRepeatableEvent(mapping, AppCommandOpenProjectFile, Key_LeftAlt, Key_P);
     RegisterRepeatableEvent(mapping, AppCommandKillView, Key_LeftControl,
                             Key_LeftAlt, Key_K);
     RegisterRepeatableEvent(mapping, AppCommandKillBuffer, Key_LeftControl, Key_K);
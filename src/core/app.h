@@ -37,6 +37,7 @@ typedef struct{
     int pathCompression;
     int displayWrongIdent;
     int displayViewIndices;
+    int searchFlags;
     uint defaultFontSize;
     std::string rootFolder;
     std::string configFile;
@@ -384,6 +385,16 @@ void AppReloadHistory();
 */
 void AppSwapUseTabs();
 
+/*
+* Gets the SEARCH_FLAG_* flags used by the search commands.
+*/
+int AppGetSearchFlags();
+
+/*
+* Swaps the given SEARCH_FLAG_* flag used by the search commands.
+*/
+void AppSwapSearchFlag(int flag);
+
 /* Base commands for free typing */
 void AppCommandJumpLeftArrow();
 void AppCommandJumpRightArrow();
@@ -430,6 +441,7 @@ void AppCommandQueryBarSearchAndReplace();
 void AppCommandQueryBarInteractiveCommand();
 void AppQueryBarSearchJumpToResult(QueryBar *bar, View *view);
 void AppCommandOpenFileWithViewType(ViewType type, int creationFlags);
+void AppCommandOpenProjectFile();
 
 /* Base commands for the query bar */
 void AppCommandQueryBarNext();
@@ -4,10 +4,17 @@
 #include <app.h>
 #include <control_cmds.h>
 #include <file_provider.h>
+#include <directory_cache.h>
 #include <parallel.h>
+#include <search.h>
+#include <project_search.h>
+#include <trigram_index.h>
+#include <file_index.h>
+#include <match_set.h>
 #include <bufferview.h>
 #include <sstream>
 #include <map>
+#include <unordered_set>
 #include <theme.h>
 #include <dbgapp.h>
 #include <graphics.h>
@@ -19,6 +26,8 @@
 #include <unordered_map>
 #include <set>
 #include <audio.h>
+#include <scheduler.h>
+#include <timer.h>
 
 int Mkdir(const char *path);
 char* __realpath(const char* path, char* resolved_path);
@@ -33,9 +42,158 @@ struct QueriableSearchResult{
     int count;
 };
 
-GlobalSearch results[MAX_THREADS];
+std::vector<GlobalSearch> results;
 QueriableSearchResult linearResults;
 
+// files listed by project-search, results refer to them by 'fileId'
+static std::vector<std::string> projectFiles;
+
+/*
+* Search in all files runs in background as a task of 'group', workers publish the
+* shards they finish in file/line order into 'pending' and the UI drains it a slice
+* per frame, see GlobalSearchStreamEvent. Bumping 'generation' detaches the UI from
+* a search.
+*/
+struct GlobalSearchStream{
+    std::mutex mutex;
+    std::atomic<int> cancelled;
+    std::vector<GlobalSearchResult> pending;
+    std::vector<int> finished;
+    uint published;
+    uint found;
+    int running;
+    uint generation;
+    TaskGroup *group;
+    // results taken from 'pending' not yet in the list, main thread only
+    std::vector<GlobalSearchResult> applying;
+    uint applied;
+    // buffers killed while their results are listed, main thread only
+    std::unordered_set<LineBuffer *> dropped;
+};
+
+static GlobalSearchStream searchStream;
+
+/*
+* Cancels the search and waits for its task to return, after this no worker touches
+* the buffers being searched.
+*/
+static void GlobalSearchCancel(){
+    TaskGroup *group = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(searchStream.mutex);
+        searchStream.cancelled = 1;
+        group = searchStream.group;
+        searchStream.group = nullptr;
+    }
+
+    if(group){
+        TaskGroup_Cancel(group);
+        TaskGroup_Wait(group);
+        TaskGroup_Release(group);
+    }
+
+    std::lock_guard<std::mutex> guard(searchStream.mutex);
+    searchStream.pending.clear();
+    searchStream.applying.clear();
+    searchStream.applied = 0;
+    searchStream.generation++;
+}
+
+static void GlobalSearchClear(){
+    GlobalSearchCancel();
+    linearResults.res.clear();
+    linearResults.count = 0;
+    results.clear();
+    projectFiles.clear();
+    searchStream.dropped.clear();
+}
+
+/*
+* Splits the files into shards of at most GLOBAL_SEARCH_SHARD_LINES lines, this
+* cancels any search that is still running. Files that are still loading are
+* skipped as lines are being appended to them.
+*/
+static void GlobalSearchPrepare(FileBuffer **files, uint count){
+    GlobalSearchClear();
+    for(uint i = 0; i < count; i++){
+        LineBuffer *lineBuffer = files[i]->lineBuffer;
+        if(!LineBuffer_IsWrittable(lineBuffer)) continue;
+
+        uint lineCount = lineBuffer->lineCount;
+        for(uint j = 0; j < lineCount; j += GLOBAL_SEARCH_SHARD_LINES){
+            GlobalSearch shard;
+            shard.lineBuffer = lineBuffer;
+            shard.fileId = -1;
+            shard.lineStart = j;
+            shard.lineEnd = lineCount - j > GLOBAL_SEARCH_SHARD_LINES ?
+                                j + GLOBAL_SEARCH_SHARD_LINES : lineCount;
+            shard.count = 0;
+            results.push_back(shard);
+        }
+    }
+}
+
+/*
+* Copies the lines of all shards so they can be searched in background while the
+* buffers are edited, must be called from the main thread.
+*/
+static void GlobalSearchSnapshot(){
+    for(GlobalSearch &shard : results){
+        uint size = 0;
+        for(uint j = shard.lineStart; j < shard.lineEnd; j++){
+            size += LineBuffer_GetBufferAt(shard.lineBuffer, j)->taken;
+        }
+
+        shard.text.reserve(size);
+        shard.offsets.reserve(shard.lineEnd - shard.lineStart + 1);
+        for(uint j = shard.lineStart; j < shard.lineEnd; j++){
+            Buffer *buffer = LineBuffer_GetBufferAt(shard.lineBuffer, j);
+            shard.offsets.push_back(shard.text.size());
+            shard.text.append(buffer->data, buffer->taken);
+        }
+
+        shard.offsets.push_back(shard.text.size());
+    }
+}
+
+/*
+* Runs 'fn(shard, tid)' on all shards created by GlobalSearchPrepare. Shards are
+* picked dynamically so that huge buffers do not leave threads idle. Returns the
+* total amount of results.
+*/
+template<typename Function>
+static uint GlobalSearchRun(const char *desc, const Function &fn){
+    ParallelForDynamic(desc, 0, results.size(), [&](int i, int tid){
+        fn(&results[i], tid);
+    });
+
+    uint total = 0;
+    for(GlobalSearch &shard : results){
+        total += shard.count;
+    }
+
+    return total;
+}
+
+/*
+* Marks a shard as finished and moves all results that are now contiguous in
+* file/line order into the pending list of the stream.
+*/
+static void GlobalSearchPublish(GlobalSearch *shard){
+    std::lock_guard<std::mutex> guard(searchStream.mutex);
+    searchStream.finished[shard - results.data()] = 1;
+    while(searchStream.published < results.size() &&
+          searchStream.finished[searchStream.published])
+    {
+        GlobalSearch *res = &results[searchStream.published];
+        searchStream.pending.insert(searchStream.pending.end(),
+                                    res->results.begin(), res->results.end());
+        searchStream.found += res->count;
+        searchStream.published++;
+    }
+
+    PostEmptyEvent();
+}
 
 static void InitializeMathSymbolList(){
     static bool is_lookup_symbols_inited = false;
@@ -103,12 +261,7 @@ static int SelectableListDefaultEntry(QueryBar *queryBar, View *view){
 
 static int SelectableListDefaultCancel(QueryBar *queryBar, View *view){
     SelectableListFreeLineBuffer(view);
-    linearResults.res.clear();
-    linearResults.count = 0;
-    for(int i = 0; i < MAX_THREADS; i++){
-        results[i].results.clear();
-        results[i].count = 0;
-    }
+    GlobalSearchClear();
 
     View_SetAllowPathCompression(view, true);
     return 1;
@@ -190,10 +343,26 @@ int BaseCommand_AddFileEntryIntoAutoLoader(char *entry, uint size){
     return 0;
 }
 
+void BaseCommand_CancelGlobalSearch(){
+    GlobalSearchClear();
+}
+
+void BaseCommand_GlobalSearchDropBuffer(LineBuffer *lineBuffer){
+    // results still to be listed are filtered by GlobalSearchStreamEvent, the
+    // listed ones are kept so that the entries of the list keep their indices
+    searchStream.dropped.insert(lineBuffer);
+    for(GlobalSearchResult &result : linearResults.res){
+        if(result.lineBuffer == lineBuffer){
+            result.lineBuffer = nullptr;
+            result.fileId = -1;
+        }
+    }
+}
+
 uint BaseCommand_FetchGlobalSearchData(GlobalSearch **gSearch){
     if(gSearch){
-        *gSearch = &results[0];
-        return MAX_THREADS;
+        *gSearch = results.data();
+        return results.size();
     }else{
         return 0;
     }
@@ -212,6 +381,21 @@ void BaseCommand_JumpViewToBuffer(View *view, LineBuffer *lineBuffer, vec2i p){
     BufferView_GhostCursorFollow(bView);
 }
 
+/*
+* Results from project-search only refer to a path, the file is loaded (or
+* found in case it was opened meanwhile) when the user picks the result.
+*/
+static LineBuffer *GlobalSearchLoadResultFile(GlobalSearchResult *result){
+    int fileType = -1;
+    LineBuffer *lineBuffer = nullptr;
+    std::string &path = projectFiles[result->fileId];
+    if(!FileProvider_FindByPath(&lineBuffer, (char *)path.c_str(), path.size(), nullptr)){
+        FileProvider_Load((char *)path.c_str(), path.size(), fileType, &lineBuffer, true);
+    }
+
+    return lineBuffer;
+}
+
 int GlobalSearchCommandCommit(QueryBar *queryBar, View *view){
     GlobalSearchResult *result = nullptr;
     LineBuffer *targetLineBuffer = nullptr;
@@ -227,116 +411,177 @@ int GlobalSearchCommandCommit(QueryBar *queryBar, View *view){
 
     result = &linearResults.res[active];
     targetLineBuffer = result->lineBuffer;
+    if(!targetLineBuffer && result->fileId < 0){
+        // the buffer was closed
+        goto __ret;
+    }
 
-    BaseCommand_JumpViewToBuffer(view, targetLineBuffer,
-                                 vec2i(result->line, result->col));
+    if(!targetLineBuffer){
+        targetLineBuffer = GlobalSearchLoadResultFile(result);
+    }
+
+    if(targetLineBuffer){
+        BaseCommand_JumpViewToBuffer(view, targetLineBuffer,
+                                     vec2i(result->line, result->col));
+    }else{
+        printf("Could not load file\n");
+    }
     View_SetAllowPathCompression(view, true);
 __ret:
     SelectableListFreeLineBuffer(view);
-    linearResults.res.clear();
-    linearResults.count = 0;
-    for(int i = 0; i < MAX_THREADS; i++){
-        results[i].results.clear();
-        results[i].count = 0;
-    }
+    GlobalSearchClear();
     return 1;
 }
 
-int SearchAllFilesCommandStart(View *view, std::string title){
-    AssertA(view != nullptr, "Invalid view pointer");
-    const char *header = title.c_str();
-    uint hlen = strlen(header);
-    LineBuffer *lineBuffer = AllocatorGetN(LineBuffer, 1);
-    LineBuffer_InitBlank(lineBuffer);
-    std::string root = AppGetRootDirectory();
+/*
+* Checks if a result is on the same line of the last result listed, the results
+* are sorted by file and line so repeated lines are always adjacent.
+*/
+static int GlobalSearchIsRepeated(GlobalSearchResult *result){
+    if(linearResults.count > 0){
+        GlobalSearchResult *r = &linearResults.res[linearResults.count-1];
+        return r->lineBuffer == result->lineBuffer && r->fileId == result->fileId &&
+               r->line == result->line;
+    }
 
+    return 0;
+}
+
+/*
+* Writes the entry 'file:line: content' for a result into 'm' with size 'size',
+* returns the amount of bytes written.
+*/
+static uint GlobalSearchFormatResult(GlobalSearchResult *result, std::string &root,
+                                     char *m, uint size)
+{
+    uint max_written_len = 60;
+    int pathCompression = 1;
     char *rootStr = (char *)root.c_str();
     uint rootLen = root.size();
+    char *p = nullptr;
+    uint l = 0;
+    uint at = 0;
 
-    linearResults.count = 0;
-    linearResults.res.clear();
+    if(result->lineBuffer){
+        p = (char *)result->lineBuffer->filePath;
+        l = result->lineBuffer->filePathSize;
+    }else{
+        p = (char *)projectFiles[result->fileId].c_str();
+        l = projectFiles[result->fileId].size();
+    }
 
-    View_SetAllowPathCompression(view, false);
+    if(StringStartsWith(p, l, rootStr, rootLen)){
+        at = rootLen;
+        while(at < l && (p[at] == '/' || p[at] == '\\')) at ++;
+    }
 
-    uint max_written_len = 60;
-    int pathCompression = 1;
-    for(int tid = 0; tid < MAX_THREADS; tid++){
-        GlobalSearch *res = &results[tid];
-        for(uint i = 0; i < res->count; i++){
-            if(!res->results[i].lineBuffer) continue;
-            char *p = (char *)res->results[i].lineBuffer->filePath;
-            uint l = res->results[i].lineBuffer->filePathSize;
-            uint at = 0;
-            int insert = 1;
-            for(int k = 0; k < linearResults.count; k++){
-                GlobalSearchResult *r = &linearResults.res[k];
-                if(r->lineBuffer == res->results[i].lineBuffer &&
-                   r->line == res->results[i].line)
-                {
-                    insert = 0; break;
-                }
-            }
+    char *pptr = &p[at];
+    uint pptr_size = strlen(pptr);
 
-            if(!insert) continue;
+    if(!result->lineBuffer){
+        // files that are not loaded have no tokens, simply skip the indentation
+        const char *text = result->text.c_str();
+        uint f = result->text.size();
+        uint start_loc = 0;
+        uint len = 0;
+        uint filename_start = StringCompressPath(pptr, pptr_size, pathCompression);
+        bool clipped = result->col > max_written_len * 0.4;
+        if(clipped){
+            start_loc = result->col - max_written_len * 0.4;
+        }
 
-            if(StringStartsWith(p, l, rootStr, rootLen)){
-                at = rootLen;
-                while(at < l && (p[at] == '/' || p[at] == '\\')) at ++;
-            }
+        while(start_loc < f && (text[start_loc] == ' ' || text[start_loc] == '\t')){
+            start_loc++;
+        }
 
-            LineBuffer *lBuffer = res->results[i].lineBuffer;
-            EncoderDecoder *encoder = LineBuffer_GetEncoderDecoder(lBuffer);
-            char *pptr = &(res->results[i].lineBuffer->filePath[at]);
-            uint pptr_size = strlen(pptr);
-            char m[256];
+        uint end_loc = f - start_loc > max_written_len ? start_loc + max_written_len : f;
+        len = snprintf(m, size, "%s:%d:%s%.*s%s", &pptr[filename_start], result->line,
+                       clipped ? "... " : " ",
+                       (int)(end_loc - start_loc), &text[start_loc],
+                       end_loc == f ? "" : " ...");
+        return len < size ? len : size - 1;
+    }
 
-            Buffer *buffer = LineBuffer_GetBufferAt(lBuffer, res->results[i].line);
-            uint f = buffer->taken;
-            uint start_loc = res->results[i].col;
-            uint end_loc = 0;
-            uint len = 0;
+    LineBuffer *lBuffer = result->lineBuffer;
+    EncoderDecoder *encoder = LineBuffer_GetEncoderDecoder(lBuffer);
 
-            if(start_loc > max_written_len * 0.4){
-                start_loc = start_loc - max_written_len * 0.4;
-            }else{
-                start_loc = 0;
-            }
+    // the line might be gone in case the buffer was edited during the search
+    Buffer *buffer = LineBuffer_GetBufferAt(lBuffer, result->line);
+    if(!buffer){
+        uint filename_start = StringCompressPath(pptr, pptr_size, pathCompression);
+        uint len = snprintf(m, size, "%s:%d:", &pptr[filename_start], result->line);
+        return len < size ? len : size - 1;
+    }
 
-            uint sid = Buffer_Utf8RawPositionToPosition(buffer, start_loc, encoder);
-            uint tid = Buffer_GetTokenAt(buffer, sid, encoder);
-            uint fid = Buffer_FindFirstNonEmptyToken(buffer);
-            uint pickId = 0;
-            for(pickId = tid; pickId < buffer->tokenCount; pickId++){
-                if(buffer->tokens[pickId].identifier != TOKEN_ID_SPACE){
-                    break;
-                }
-            }
+    uint f = buffer->taken;
+    uint start_loc = result->col;
+    uint end_loc = 0;
+    uint len = 0;
+
+    if(start_loc > max_written_len * 0.4){
+        start_loc = start_loc - max_written_len * 0.4;
+    }else{
+        start_loc = 0;
+    }
 
-            start_loc = buffer->tokens[pickId].position;
+    uint sid = Buffer_Utf8RawPositionToPosition(buffer, start_loc, encoder);
+    uint tid = Buffer_GetTokenAt(buffer, sid, encoder);
+    uint fid = Buffer_FindFirstNonEmptyToken(buffer);
+    uint pickId = 0;
+    for(pickId = tid; pickId < buffer->tokenCount; pickId++){
+        if(buffer->tokens[pickId].identifier != TOKEN_ID_SPACE){
+            break;
+        }
+    }
 
-            end_loc = f - start_loc > max_written_len ? start_loc + max_written_len : f;
-            char ss = buffer->data[end_loc];
-            buffer->data[end_loc] = 0;
-            uint filename_start = StringCompressPath(pptr, pptr_size, pathCompression);
-            if(filename_start > 0){
-                //len = snprintf(m, sizeof(m), "../");
-            }
+    start_loc = buffer->tokens[pickId].position;
 
-            if(start_loc == 0 || pickId == fid){
-                len += snprintf(&m[len], sizeof(m)-len, "%s:%d: ", &pptr[filename_start],
-                                res->results[i].line);
-            }else{
-                len += snprintf(&m[len], sizeof(m)-len, "%s:%d:... ", &pptr[filename_start],
-                                res->results[i].line);
-            }
+    end_loc = f - start_loc > max_written_len ? start_loc + max_written_len : f;
+    uint filename_start = StringCompressPath(pptr, pptr_size, pathCompression);
 
-            if(end_loc == f){
-                len += snprintf(&m[len], sizeof(m)-len, "%s", &buffer->data[start_loc]);
-            }else{
-                len += snprintf(&m[len], sizeof(m)-len, "%s ...", &buffer->data[start_loc]);
-            }
+    if(start_loc == 0 || pickId == fid){
+        len += snprintf(&m[len], size-len, "%s:%d: ", &pptr[filename_start],
+                        result->line);
+    }else{
+        len += snprintf(&m[len], size-len, "%s:%d:... ", &pptr[filename_start],
+                        result->line);
+    }
+
+    // the line is printed without touching the buffer as the search might
+    // still be running on other lines of it
+    len = len < size ? len : size - 1;
+    if(end_loc == f){
+        len += snprintf(&m[len], size-len, "%.*s", (int)(end_loc - start_loc),
+                        &buffer->data[start_loc]);
+    }else{
+        len += snprintf(&m[len], size-len, "%.*s ...", (int)(end_loc - start_loc),
+                        &buffer->data[start_loc]);
+    }
+
+    return len < size ? len : size - 1;
+}
 
-            buffer->data[end_loc] = ss;
+int SearchAllFilesCommandStart(View *view, std::string title){
+    AssertA(view != nullptr, "Invalid view pointer");
+    const char *header = title.c_str();
+    uint hlen = strlen(header);
+    LineBuffer *lineBuffer = AllocatorGetN(LineBuffer, 1);
+    LineBuffer_InitBlank(lineBuffer);
+    std::string root = AppGetRootDirectory();
+
+    linearResults.count = 0;
+    linearResults.res.clear();
+
+    View_SetAllowPathCompression(view, false);
+
+    for(uint shard = 0; shard < results.size(); shard++){
+        GlobalSearch *res = &results[shard];
+        for(uint i = 0; i < res->count; i++){
+            char m[256];
+            if(!res->results[i].lineBuffer && res->results[i].fileId < 0) continue;
+            if(GlobalSearchIsRepeated(&res->results[i])) continue;
+
+            uint len = GlobalSearchFormatResult(&res->results[i], root, m, sizeof(m));
 
             linearResults.res.push_back(res->results[i]);
             linearResults.count++;
@@ -353,6 +598,126 @@ int SearchAllFilesCommandStart(View *view, std::string title){
     return 0;
 }
 
+/*
+* Moves the results published by the search workers into the list of 'view' until
+* 'deadline' and updates the counter in its title, large result sets are pushed
+* across several frames. While the search runs and there is nothing new the job
+* waits for GlobalSearchPublish to wake the main loop. It is done once the search
+* 'generation' is finished, or was cancelled, and all its results are in the list.
+*/
+static FrameJobState GlobalSearchStreamEvent(View *view, const char *name,
+                                             uint generation, double deadline)
+{
+    std::vector<GlobalSearchResult> &batch = searchStream.applying;
+    int running = 0;
+    uint found = 0;
+    {
+        std::lock_guard<std::mutex> guard(searchStream.mutex);
+        if(generation != searchStream.generation) return FRAME_JOB_DONE;
+        if(searchStream.applied == batch.size()){
+            batch.clear();
+            batch.swap(searchStream.pending);
+            searchStream.applied = 0;
+        }
+        running = searchStream.running;
+        found = searchStream.found;
+    }
+
+    bool pushed = searchStream.applied < batch.size();
+    if(pushed){
+        char *content = nullptr;
+        uint contentLen = 0;
+        SearchPattern pattern;
+        SearchPattern *filter = nullptr;
+        std::string root = AppGetRootDirectory();
+        QueryBar_GetWrittenContent(View_GetQueryBar(view), &content, &contentLen);
+        if(contentLen > 0){
+            SearchPattern_Compile(&pattern, content, contentLen);
+            filter = &pattern;
+        }
+
+        // always push something so a slow frame cannot stall the list
+        uint first = searchStream.applied;
+        for(; searchStream.applied < batch.size(); searchStream.applied++){
+            char m[256];
+            GlobalSearchResult &result = batch[searchStream.applied];
+            if(searchStream.applied > first && (searchStream.applied & 31) == 0 &&
+               GetElapsedTime() >= deadline)
+            {
+                break;
+            }
+
+            if(GlobalSearchIsRepeated(&result)) continue;
+            if(result.lineBuffer && searchStream.dropped.count(result.lineBuffer)) continue;
+
+            uint len = GlobalSearchFormatResult(&result, root, m, sizeof(m));
+
+            linearResults.res.push_back(result);
+            linearResults.count++;
+
+            View_SelectableListPush(view, m, len, filter);
+        }
+
+        if(filter) SearchPattern_Release(filter);
+    }
+
+    char title[64];
+    uint len = snprintf(title, sizeof(title), "%s ( %u%s )", name,
+                        found, running ? " ..." : "");
+    QueryBar_SetTitle(View_GetQueryBar(view), title, len);
+
+    // after pushing run once more so that the new entries get rendered
+    if(pushed) return FRAME_JOB_CONTINUE;
+    return running ? FRAME_JOB_WAIT : FRAME_JOB_DONE;
+}
+
+/*
+* Opens the results list of 'view' empty and runs 'fn' in the pool, the shards it
+* publishes are streamed into the list by GlobalSearchStreamEvent. 'fn' is also
+* called in case the search is cancelled before it starts, it must check
+* 'searchStream.cancelled' and only release what it holds.
+* The shards must be prepared before calling this or by 'fn' itself while holding
+* the stream lock. Returns 0 in case the list could not be opened.
+*/
+template<typename Function>
+static int GlobalSearchStreamStart(View *view, const char *name, Function fn){
+    char title[64];
+    snprintf(title, sizeof(title), "%s ( 0 ... )", name);
+    if(SearchAllFilesCommandStart(view, title) < 0){
+        return 0;
+    }
+
+    uint generation = 0;
+    TaskGroup *group = TaskGroup_Create();
+    {
+        std::lock_guard<std::mutex> guard(searchStream.mutex);
+        searchStream.cancelled = 0;
+        searchStream.finished.assign(results.size(), 0);
+        searchStream.published = 0;
+        searchStream.found = 0;
+        searchStream.running = 1;
+        searchStream.group = group;
+        generation = searchStream.generation;
+    }
+
+    ParallelPool_Submit([fn]() mutable{
+        fn();
+
+        {
+            std::lock_guard<std::mutex> guard(searchStream.mutex);
+            searchStream.running = 0;
+        }
+
+        PostEmptyEvent();
+    }, TASK_PRIORITY_NORMAL, group);
+
+    FrameScheduler_Add([view, name, generation](double deadline) -> FrameJobState{
+        return GlobalSearchStreamEvent(view, name, generation, deadline);
+    });
+
+    return 1;
+}
+
 int BaseCommand_InsertMappedSymbol(char *cmd, uint size){
     int r = 0;
     if(cmd[0] == '\\' || cmd[0] == '/'){
@@ -430,61 +795,213 @@ int BaseCommand_SearchAllFiles(char *cmd, uint size, View *){
     FileBuffer **bufferArray = bufferptr.get();
     size = List_FetchAsArray(bufferList->fList, bufferArray, maxlen, 0);
 
-    for(int i = 0; i < MAX_THREADS; i++){
-        results[i].results.clear();
-        results[i].count = 0;
+    // regex queries keep a DFA cache so each worker needs its own copy
+    int workers = GetConcurrency();
+    int flags = AppGetSearchFlags();
+    std::vector<SearchQuery> queries(workers);
+    for(int i = 0; i < workers; i++){
+        SearchQuery_Compile(&queries[i], searchStr.c_str(), searchStr.size(), flags);
     }
 
-    const char *strPtr = searchStr.c_str();
-    uint stringLen = searchStr.size();
+    // the buffers can be edited while the search runs, workers only see a copy
+    GlobalSearchPrepare(bufferArray, size);
+    GlobalSearchSnapshot();
 
-    ParallelFor("String Seach", 0, size, [&](int i, int tid){
-        LineBuffer *lineBuffer = bufferArray[i]->lineBuffer;
-        if(tid > MAX_THREADS-1){
-            printf("Ooops cannot query, too many threads\n");
-            return;
+    View *view = AppGetActiveView();
+    int started = GlobalSearchStreamStart(view, "Search Files", [queries]() mutable{
+        GlobalSearchRun("String Seach", [&](GlobalSearch *shard, int tid){
+            SearchQuery *query = &queries[tid];
+            uint lines = shard->offsets.size() - 1;
+            for(uint j = 0; j < lines; j++){
+                if(searchStream.cancelled) break;
+
+                const char *data = &shard->text[shard->offsets[j]];
+                uint taken = shard->offsets[j+1] - shard->offsets[j];
+                if(taken > 0){
+                    int at = 0;
+                    uint start = 0;
+                    uint matchLen = 0;
+                    do{
+                        at = SearchQuery_Find(query, data, taken, start, &matchLen);
+                        if(at >= 0){
+                            shard->results.push_back({
+                                .lineBuffer = shard->lineBuffer,
+                                .line = shard->lineStart + j,
+                                .col = (uint)at,
+                            });
+                            start = at + (matchLen > 0 ? matchLen : 1);
+                            shard->count++;
+                        }
+                    }while(at >= 0);
+                }
+            }
+
+            std::string().swap(shard->text);
+            std::vector<uint>().swap(shard->offsets);
+            GlobalSearchPublish(shard);
+        });
+
+        for(SearchQuery &query : queries){
+            SearchQuery_Release(&query);
         }
+    });
 
-        GlobalSearch *threadResult = &results[tid];
-
-        for(uint j = 0; j < lineBuffer->lineCount; j++){
-            Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, j);
-            if(buffer->taken > 0){
-                int at = 0;
-                uint start = 0;
-                do{
-                    at = StringSearch((char *)strPtr, &buffer->data[start],
-                                      stringLen, buffer->taken - start);
-                    if(at >= 0){
-                        threadResult->results.push_back({
-                            .lineBuffer = lineBuffer,
-                            .line = j,
-                            .col = at + start,
-                        });
-                        start += at + stringLen;
-                        threadResult->count++;
-                    }
-                }while(at >= 0);
+    if(!started){
+        for(SearchQuery &query : queries){
+            SearchQuery_Release(&query);
+        }
+        return r;
+    }
+
+    AppSetBindingsForState(View_SelectableList);
+    return 2;
+}
+
+int BaseCommand_ProjectSearch(char *cmd, uint size, View *){
+    int r = 1;
+    std::string search(CMD_PROJECT_SEARCH_STR);
+    int e = StringFirstNonEmpty(&cmd[search.size()], size - search.size());
+    if(e < 0) return r;
+    e += search.size();
+
+    std::string searchStr(&cmd[e]);
+    std::string root = AppGetRootDirectory();
+
+    int workers = GetConcurrency();
+    int flags = AppGetSearchFlags();
+    std::vector<SearchQuery> queries(workers);
+    for(int i = 0; i < workers; i++){
+        SearchQuery_Compile(&queries[i], searchStr.c_str(), searchStr.size(), flags);
+    }
+
+    GlobalSearchClear();
+    FileIndex_Refresh(root.c_str());
+
+    // files are listed in background as well, each one becomes a shard that is
+    // mapped and scanned without creating a LineBuffer
+    View *view = AppGetActiveView();
+    int started = GlobalSearchStreamStart(view, "Project Search", [queries, root]() mutable{
+        std::vector<std::string> files;
+        std::vector<uint> candidates;
+        // the tree is only walked in case the FileIndex does not know it yet
+        if(!FileIndex_GetFiles(root.c_str(), files)){
+            ProjectSearch_ListFiles(root.c_str(), files, &searchStream.cancelled);
+        }
+
+        // the trigram index discards files that cannot contain the query
+        bool filtered = ProjectIndex_Filter(root.c_str(), &queries[0], files, candidates);
+        {
+            std::lock_guard<std::mutex> guard(searchStream.mutex);
+            projectFiles.swap(files);
+            uint count = filtered ? candidates.size() : projectFiles.size();
+            for(uint i = 0; i < count; i++){
+                GlobalSearch shard;
+                shard.lineBuffer = nullptr;
+                shard.fileId = (int)(filtered ? candidates[i] : i);
+                shard.lineStart = 0;
+                shard.lineEnd = 0;
+                shard.count = 0;
+                results.push_back(shard);
             }
+
+            searchStream.finished.assign(results.size(), 0);
+        }
+
+        GlobalSearchRun("Project Search", [&](GlobalSearch *shard, int tid){
+            if(!searchStream.cancelled){
+                ProjectSearch_File(projectFiles[shard->fileId].c_str(), &queries[tid],
+                [&](uint line, uint col, const char *text, uint len){
+                    GlobalSearchResult result = {
+                        .lineBuffer = nullptr,
+                        .line = line,
+                        .col = col,
+                        .fileId = shard->fileId,
+                        .text = std::string(text, len),
+                    };
+                    shard->results.push_back(result);
+                    shard->count++;
+                }, &searchStream.cancelled);
+            }
+
+            GlobalSearchPublish(shard);
+        });
+
+        for(SearchQuery &query : queries){
+            SearchQuery_Release(&query);
+        }
+
+        if(!searchStream.cancelled){
+            ProjectIndex_Refresh(root.c_str(), projectFiles);
         }
     });
 
-    View *view = AppGetActiveView();
-    uint count = 0;
-    for(uint i = 0; i < MAX_THREADS; i++){
-        count += results[i].count;
+    if(!started){
+        for(SearchQuery &query : queries){
+            SearchQuery_Release(&query);
+        }
+        return r;
     }
 
-    std::stringstream ss;
-    ss << "Search Files ( " << count << " )";
-    if(SearchAllFilesCommandStart(view, ss.str().c_str()) >= 0){
-        AppSetBindingsForState(View_SelectableList);
-        r = 2;
+    AppSetBindingsForState(View_SelectableList);
+    return 2;
+}
+
+int BaseCommand_RegexSearch(char *, uint, View *){
+    AppSwapSearchFlag(SEARCH_FLAG_REGEX);
+    return 1;
+}
+
+int BaseCommand_BenchSearch(char *cmd, uint size, View *){
+    std::string bench(CMD_BENCH_SEARCH_STR);
+    int e = StringFirstNonEmpty(&cmd[bench.size()], size - bench.size());
+    if(e < 0) return 1;
+    e += bench.size();
+
+    std::string searchStr(&cmd[e]);
+    std::string content;
+
+    FileBufferList *bufferList = FileProvider_GetBufferList();
+    auto fn = [&](FileBuffer *fBuffer) -> int{
+        LineBuffer *lineBuffer = fBuffer->lineBuffer;
+        for(uint i = 0; i < lineBuffer->lineCount; i++){
+            Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, i);
+            content.append(buffer->data, buffer->taken);
+            content.push_back('\n');
+        }
+        return 1;
+    };
+
+    List_Transverse<FileBuffer>(bufferList->fList, fn);
+    if(content.size() == 0) return 1;
+
+    // scan at least 256MB so the interval is not dominated by the clock resolution
+    uint rounds = (256 << 20) / content.size();
+    if(rounds == 0) rounds = 1;
+    int flags[] = { SEARCH_FLAG_NONE, SEARCH_FLAG_CASE_INSENSITIVE,
+                    SEARCH_FLAG_WHOLE_WORD };
+    const char *names[] = { "exact", "case-insensitive", "whole-word" };
+    for(uint i = 0; i < 3; i++){
+        uint matches = 0;
+        SearchPattern pattern;
+        SearchPattern_Compile(&pattern, searchStr.c_str(), searchStr.size(), flags[i]);
+        double gbs = SearchPattern_Benchmark(&pattern, content.c_str(),
+                                             content.size(), rounds, &matches);
+        printf("[PERF] Search %s ( %u matches ) in %u bytes x %u: %g GB/s\n",
+               names[i], matches, (uint)content.size(), rounds, gbs);
+        SearchPattern_Release(&pattern);
     }
 
-    return r;
+    return 1;
 }
 
+#if defined(DEBUG_BUILD)
+// spawns its own threads and only prints to stdout, not for release builds
+int BaseCommand_BenchQueue(char *, uint, View *){
+    ParallelQueue_Benchmark(1 << 21);
+    return 1;
+}
+#endif
+
 int BaseCommand_SearchFunctions(char *cmd, uint size, View *){
     int r = 1;
     char *strPtr = nullptr;
@@ -499,57 +1016,42 @@ int BaseCommand_SearchFunctions(char *cmd, uint size, View *){
     FileBuffer **bufferArray = bufferptr.get();
     size = List_FetchAsArray(bufferList->fList, bufferArray, maxlen, 0);
 
-    for(int i = 0; i < MAX_THREADS; i++){
-        results[i].results.clear();
-        results[i].count = 0;
-    }
-
     if(splits.size() > 1){
         strPtr = (char *)splits[1].c_str();
         stringLen = splits[1].size();
     }
 
-    ParallelFor("Functions Search", 0, size, [&](int i, int tid){
-        LineBuffer *lineBuffer = bufferArray[i]->lineBuffer;
-        if(tid > MAX_THREADS-1){
-            printf("Ooops cannot query, too many threads\n");
-            return;
-        }
-
-        GlobalSearch *threadResult = &results[tid];
-        for(uint j = 0; j < lineBuffer->lineCount; j++){
-            Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, j);
-            for(uint k = 0; k < buffer->tokenCount; k++){
-                Token *token = &buffer->tokens[k];
-                int found = 0;
-                if(token->identifier == TOKEN_ID_FUNCTION_DECLARATION){
-                    found = 1;
-                    if(strPtr){
-                        char *s = &buffer->data[token->position];
-                        found = StringEqual(strPtr, s, Min(token->size, stringLen));
-                    }
-                }
+    // declarations are indexed per line as lines are tokenized, only the lines
+    // that have any are visited
+    GlobalSearchPrepare(bufferArray, size);
+    uint count = GlobalSearchRun("Functions Search", [&](GlobalSearch *shard, int){
+        std::vector<LineBufferDeclaration> declarations;
+        LineBuffer *lineBuffer = shard->lineBuffer;
+        LineBuffer_GetDeclarations(lineBuffer, shard->lineStart, shard->lineEnd,
+                                   declarations);
+        for(LineBufferDeclaration &declaration : declarations){
+            Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, declaration.line);
+            Token *token = &buffer->tokens[declaration.tokenId];
+            int found = 1;
+            if(strPtr){
+                char *s = &buffer->data[token->position];
+                found = StringEqual(strPtr, s, Min(token->size, stringLen));
+            }
 
-                if(found){
-                    threadResult->results.push_back({
-                        .lineBuffer = lineBuffer,
-                        .line = j,
-                        .col = (uint)(token->position < 0 ? 0 : token->position),
-                    });
-                    threadResult->count++;
-                }
+            if(found){
+                shard->results.push_back({
+                    .lineBuffer = lineBuffer,
+                    .line = declaration.line,
+                    .col = (uint)(token->position < 0 ? 0 : token->position),
+                });
+                shard->count++;
             }
         }
     });
 
     View *view = AppGetActiveView();
-    uint count = 0;
-    for(uint i = 0; i < MAX_THREADS; i++){
-        count += results[i].count;
-    }
-
     std::stringstream ss;
-    ss << "Functions ( " << count << " )";
+    ss << "Declarations ( " << count << " )";
     if(SearchAllFilesCommandStart(view, ss.str().c_str()) >= 0){
         AppSetBindingsForState(View_SelectableList);
         r = 2;
@@ -1139,11 +1641,153 @@ int BaseCommandSetEncrypted(char *cmd, uint size, View *view){
     return 1;
 }
 
+/*
+* Swaps the next view, or 'view' if there is no other, to the output of 'session'.
+*/
+static void BaseCommand_ShowSession(View *view, CommandSession *session){
+    LockedLineBuffer *lockedBuffer = CommandSession_GetOutput(session);
+    ViewNode *vnode = AppGetNextViewNode();
+    BufferView *bView = View_GetBufferView(view);
+    if(vnode){
+        if(vnode->view){
+            BufferView *tmpBView = View_GetBufferView(vnode->view);
+            if(View_GetState(vnode->view) != View_ImageDisplay &&
+               BufferView_GetViewType(tmpBView) != ImageView)
+            {
+                bView = tmpBView; // NOTE: This will overwrite the current view
+            }
+        }
+    }
+
+    if(BufferView_GetViewType(bView) != ImageView){
+        BufferView_SwapBuffer(bView, lockedBuffer->lineBuffer, CodeView);
+        // because the parallel thread will reset the linebuffer we need
+        // to make sure the cursor is located in a valid range for rendering
+        // otherwise in case the build buffer does updates too fast it can
+        // generate a SIGSEGV. This needs to run after the swap as we need
+        // to make sure the position cache map is updated with whatever
+        // is being rendered at the moment.
+        BufferView_CursorToPosition(bView, 0, 0);
+        BufferView_GhostCursorFollow(bView);
+    }
+}
+
+/*
+* Runs the shell command 'strCmd' from the base path on 'session', a "[nv]" prefix
+* keeps the views as they are instead of showing the output.
+*/
+static int BaseCommand_RunCommand(std::string strCmd, View *view, CommandSession *session){
+    bool swapViews = true;
+    if(strCmd.size() > 4 &&
+       StringStartsWith((char *)strCmd.c_str(), strCmd.size(), (char *)"[nv]", 4))
+    {
+        strCmd = strCmd.substr(4);
+        swapViews = false;
+    }
+
+    std::string rootDir = AppGetRootDirectory() + BaseCommand_GetBasePath();
+    std::stringstream ss;
+    ss << "cd " << rootDir << " && " << strCmd;
+
+    std::string md = ss.str();
+    if(swapViews){
+        BaseCommand_ShowSession(view, session);
+    }
+
+    CommandSession_Execute(session, md);
+    return -1;
+}
+
+int BaseCommand_Session(char *cmd, uint size, View *view){
+    uint len = 0;
+    char *name = StringNextWord(cmd, size, &len);
+    if(!name || len == 0) return 1;
+
+    CommandSession *session = CommandSession_Get(std::string(name, len));
+    uint at = (name - cmd) + len;
+    int e = StringFirstNonEmpty(&cmd[at], size - at);
+    if(e < 0){
+        // no command, only switch to its output
+        BaseCommand_ShowSession(view, session);
+        return 1;
+    }
+
+    bool aliasChange = false;
+    at += e;
+    std::string strCmd = BaseCommand_Interpret_Alias(&cmd[at], size - at, aliasChange);
+    return BaseCommand_RunCommand(strCmd, view, session);
+}
+
+int BaseCommand_SessionKill(char *cmd, uint size, View *view){
+    uint len = 0;
+    CommandSession *session = nullptr;
+    char *name = StringNextWord(cmd, size, &len);
+    if(name && len > 0){
+        session = CommandSession_Find(std::string(name, len));
+    }else{
+        // the session being displayed, otherwise the last one that ran
+        session = CommandSession_FromLineBuffer(View_GetBufferView(view)->lineBuffer);
+        if(!session){
+            session = CommandSession_Last();
+        }
+    }
+
+    if(session){
+        CommandSession_Kill(session);
+    }
+    return 1;
+}
+
+int BaseCommand_SessionLimit(char *cmd, uint size, View *){
+    uint len = 0, llen = 0, blen = 0;
+    char *name = StringNextWord(cmd, size, &len);
+    if(!name || len == 0) return 1;
+
+    uint at = (name - cmd) + len;
+    char *lines = StringNextWord(&cmd[at], size - at, &llen);
+    if(!lines || llen == 0) return 1;
+
+    uint64_t maxBytes = EXECUTOR_OUTPUT_MAX_BYTES;
+    at = (lines - cmd) + llen;
+    char *bytes = StringNextWord(&cmd[at], size - at, &blen);
+    if(bytes && blen > 0){
+        maxBytes = StringToUnsigned(bytes, blen);
+    }
+
+    CommandSession *session = CommandSession_Get(std::string(name, len));
+    CommandSession_SetOutputLimit(session, StringToUnsigned(lines, llen), maxBytes);
+    return 1;
+}
+
+int BaseCommand_SessionSpill(char *cmd, uint size, View *){
+    uint len = 0, alen = 0;
+    char *name = StringNextWord(cmd, size, &len);
+    if(!name || len == 0) return 1;
+
+    uint at = (name - cmd) + len;
+    char *arg = StringNextWord(&cmd[at], size - at, &alen);
+    if(!arg || alen == 0) return 1;
+
+    CommandSession *session = CommandSession_Get(std::string(name, len));
+    if(StringEqual(arg, (char *)"on", Min(alen, 2))){
+        CommandSession_SetSpill(session, true);
+    }else if(StringEqual(arg, (char *)"off", Min(alen, 3))){
+        CommandSession_SetSpill(session, false);
+    }
+    return 1;
+}
+
 void BaseCommand_InitializeCommandMap(){
     cmdMap[CMD_DIMM_STR] = {CMD_DIMM_HELP, BaseCommand_SetDimm};
     cmdMap[CMD_SWAP_LINE_NO_RENDER_MODE_STR] = {CMD_SWAP_LINE_NO_RENDER_MODE_HELP, BaseCommand_SwapLineNoRenderMode};
     cmdMap[CMD_KILLSPACES_STR] = {CMD_KILLSPACES_HELP, BaseCommand_KillSpaces};
     cmdMap[CMD_SEARCH_STR] = {CMD_SEARCH_HELP, BaseCommand_SearchAllFiles};
+    cmdMap[CMD_PROJECT_SEARCH_STR] = {CMD_PROJECT_SEARCH_HELP, BaseCommand_ProjectSearch};
+    cmdMap[CMD_REGEX_SEARCH_STR] = {CMD_REGEX_SEARCH_HELP, BaseCommand_RegexSearch};
+    cmdMap[CMD_BENCH_SEARCH_STR] = {CMD_BENCH_SEARCH_HELP, BaseCommand_BenchSearch};
+#if defined(DEBUG_BUILD)
+    cmdMap[CMD_BENCH_QUEUE_STR] = {CMD_BENCH_QUEUE_HELP, BaseCommand_BenchQueue};
+#endif
     cmdMap[CMD_ENCODING_STR] = {CMD_ENCODING_HELP, BaseCommand_EncodingSwap};
     cmdMap[CMD_GLOBAL_ENCODING_STR] = {CMD_GLOBAL_ENCODING_HELP, BaseCommand_GlobalEncodingSwap};
     cmdMap[CMD_FUNCTIONS_STR] = {CMD_FUNCTIONS_HELP, BaseCommand_SearchFunctions};
@@ -1152,6 +1796,10 @@ void BaseCommand_InitializeCommandMap(){
     cmdMap[CMD_EXPAND_STR] = {CMD_EXPAND_HELP, BaseCommand_ExpandRestore};
     cmdMap[CMD_KILLVIEW_STR] = {CMD_KILLVIEW_HELP, BaseCommand_KillView};
     cmdMap[CMD_KILLBUFFER_STR] = {CMD_KILLBUFFER_HELP, BaseCommand_KillBuffer};
+    cmdMap[CMD_SESSION_STR] = {CMD_SESSION_HELP, BaseCommand_Session};
+    cmdMap[CMD_SESSION_KILL_STR] = {CMD_SESSION_KILL_HELP, BaseCommand_SessionKill};
+    cmdMap[CMD_SESSION_LIMIT_STR] = {CMD_SESSION_LIMIT_HELP, BaseCommand_SessionLimit};
+    cmdMap[CMD_SESSION_SPILL_STR] = {CMD_SESSION_SPILL_HELP, BaseCommand_SessionSpill};
     cmdMap[CMD_DBG_START_STR] = {CMD_DBG_START_HELP, BaseCommand_DbgStart};
     cmdMap[CMD_DBG_BREAK_STR] = {CMD_DBG_BREAK_HELP, BaseCommand_DbgBreak};
     cmdMap[CMD_DBG_EXIT_STR] = {CMD_DBG_EXIT_HELP, BaseCommand_DbgExit};
@@ -1223,56 +1871,13 @@ int BaseCommand_Interpret(char *cmd, uint size, View *view, bool recurseOnAlias)
         }
     }
 
-    bool swapViews = true;
     bool aliasChange = false;
     std::string strCmd = BaseCommand_Interpret_Alias(cmd, size, aliasChange);
     if(recurseOnAlias && aliasChange)
         return BaseCommand_Interpret((char *)strCmd.c_str(), strCmd.size(), view, false);
 
-    if(strCmd.size() > 4 &&
-       StringStartsWith((char *)strCmd.c_str(), strCmd.size(), (char *)"[nv]", 4))
-    {
-        strCmd = strCmd.substr(4);
-        swapViews = false;
-    }
-
-    std::string rootDir = AppGetRootDirectory() + BaseCommand_GetBasePath();
-    std::stringstream ss;
-    ss << "cd " << rootDir << " && " << strCmd;
-
-    std::string md = ss.str();
-    LockedLineBuffer *lockedBuffer = nullptr;
-    GetExecutorLockedLineBuffer(&lockedBuffer);
-    ViewNode *vnode = AppGetNextViewNode();
-    BufferView *bView = View_GetBufferView(view);
-    if(vnode){
-        if(vnode->view){
-            BufferView *tmpBView = View_GetBufferView(vnode->view);
-            if(View_GetState(vnode->view) != View_ImageDisplay &&
-               BufferView_GetViewType(tmpBView) != ImageView)
-            {
-                bView = tmpBView; // NOTE: This will overwrite the current view
-            }
-        }
-    }
-
-    if(swapViews && BufferView_GetViewType(bView) != ImageView){
-        BufferView_SwapBuffer(bView, lockedBuffer->lineBuffer, CodeView);
-        // because the parallel thread will reset the linebuffer we need
-        // to make sure the cursor is located in a valid range for rendering
-        // otherwise in case the build buffer does updates too fast it can
-        // generate a SIGSEGV. This needs to run after the swap as we need
-        // to make sure the position cache map is updated with whatever
-        // is being rendered at the moment.
-        BufferView_CursorToPosition(bView, 0, 0);
-        BufferView_GhostCursorFollow(bView);
-    }
-
-    // TODO: function LockedBufferStartRender() or something
-    lockedBuffer->render_state = 0;
-    ExecuteCommand(md);
-
-    return rv;
+    return BaseCommand_RunCommand(strCmd, view,
+                                  CommandSession_Get(EXECUTOR_DEFAULT_SESSION));
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -1281,13 +1886,12 @@ int BaseCommand_Interpret(char *cmd, uint size, View *view, bool recurseOnAlias)
 static int ListFileEntriesAndCheckLoaded(char *basePath, FileEntry **entries,
                                          uint *n, uint *size)
 {
-    StorageDevice *storage = FetchStorageDevice();
     std::string refPath(basePath);
     if(refPath[refPath.size()-1] != '/' && refPath[refPath.size()-1] != '\\'){
         refPath += SEPARATOR_STRING;
     }
 
-    if(storage->ListFiles((char *)refPath.c_str(), entries, n, size) < 0){
+    if(DirectoryCache_List(refPath.c_str(), entries, n, size) < 0){
         return -1;
     }
 
@@ -1577,6 +2181,154 @@ int FileOpenerCommandStart(View *view, char *basePath, ushort len,
     return 0;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+// Project file routines
+//////////////////////////////////////////////////////////////////////////////////////////
+typedef struct ProjectFileOpener{
+    FileIndexQuery query;
+    std::vector<FileIndexMatch> results;
+    uint generation; // of the FileIndex that gave 'results'
+    uint job;
+}ProjectFileOpener;
+
+static ProjectFileOpener projectFileOpener = { .generation = 0, .job = 0 };
+
+/*
+* The list only ever holds the best matches, it is rebuilt on every change of the
+* query and already comes sorted so it is not filtered.
+*/
+static void ProjectFileUpdateList(View *view){
+    char *content = nullptr;
+    uint contentLen = 0;
+    QueryBar *queryBar = View_GetQueryBar(view);
+    LineBuffer *lb = View_SelectableListGetLineBuffer(view);
+    QueryBar_GetWrittenContent(queryBar, &content, &contentLen);
+
+    projectFileOpener.generation = FileIndex_GetGeneration();
+    FileIndex_Query(&projectFileOpener.query, content, contentLen,
+                    projectFileOpener.results);
+
+    LineBuffer_SoftClear(lb);
+    LineBuffer_SoftClearReset(lb);
+
+    for(FileIndexMatch &match : projectFileOpener.results){
+        LineBuffer_InsertLine(lb, (char *)match.path, match.len);
+    }
+
+    View_SelectableListSwapList(view, lb, 0);
+}
+
+static void ProjectFileRelease(View *view){
+    SelectableListFreeLineBuffer(view);
+    FileIndex_QueryRelease(&projectFileOpener.query);
+    projectFileOpener.results.clear();
+    if(projectFileOpener.job != 0){
+        FrameScheduler_Remove(projectFileOpener.job);
+        projectFileOpener.job = 0;
+    }
+}
+
+int ProjectFileCommandEntry(QueryBar *queryBar, View *view){
+    ProjectFileUpdateList(view);
+    return 1;
+}
+
+int ProjectFileCommandCancel(QueryBar *queryBar, View *view){
+    ProjectFileRelease(view);
+    return 1;
+}
+
+int ProjectFileCommandCommit(QueryBar *queryBar, View *view){
+    Buffer *buffer = nullptr;
+    FileEntry entry;
+    FileOpener *opener = View_GetFileOpener(view);
+    int active = View_SelectableListGetActiveIndex(view);
+    std::string root = FileIndex_GetRoot(&projectFileOpener.query);
+    if(active < 0 || root.size() == 0){
+        return 0;
+    }
+
+    View_SelectableListGetItem(view, active, &buffer);
+    if(!buffer){
+        return 0;
+    }
+
+    std::string path = root;
+    if(path[path.size()-1] != '/' && path[path.size()-1] != '\\'){
+        path += SEPARATOR_STRING;
+    }
+    path += std::string(buffer->data, buffer->taken);
+
+    // the file is opened from the opener base path, splitting at the file name
+    // keeps paths deeper than a FileEntry can hold working
+    uint n = GetSimplifiedPathName((char *)path.c_str(), path.size());
+    uint nameLen = path.size() - n;
+    if(n >= PATH_MAX || nameLen >= MAX_DESCRIPTOR_LENGTH){
+        return 0;
+    }
+
+    Memcpy(opener->basePath, (char *)path.c_str(), n);
+    opener->basePath[n] = 0;
+    opener->pathLen = n;
+
+    Memcpy(entry.path, &path[n], nameLen);
+    entry.path[nameLen] = 0;
+    entry.pLen = nameLen;
+    entry.type = DescriptorFile;
+    entry.isLoaded = FileProvider_IsFileOpened((char *)path.c_str(), path.size()) ? 1 : 0;
+
+    queryBar->fileOpenCallback(view, &entry);
+    ProjectFileRelease(view);
+    return 1;
+}
+
+int ProjectFileCommandStart(View *view, OnFileOpenCallback onOpenFile){
+    AssertA(view != nullptr, "Invalid view pointer");
+    LineBuffer *lineBuffer = nullptr;
+    const char *header = "Open Project File";
+    QueryBarInputFilter filter = INPUT_FILTER_INITIALIZER;
+    uint hlen = strlen(header);
+    QueryBar *queryBar = View_GetQueryBar(view);
+    StorageDevice *storage = FetchStorageDevice();
+    if(!storage->IsLocallyStored()){
+        return -1;
+    }
+
+    std::string root = AppGetRootDirectory();
+    FileIndex_Refresh(root.c_str());
+
+    if(projectFileOpener.job != 0){
+        FrameScheduler_Remove(projectFileOpener.job);
+        projectFileOpener.job = 0;
+    }
+
+    view->bufferFlags = std::vector<char>();
+
+    lineBuffer = AllocatorGetN(LineBuffer, 1);
+    LineBuffer_InitBlank(lineBuffer);
+
+    View_SelectableListSet(view, lineBuffer, (char *)header, hlen,
+                           ProjectFileCommandEntry, ProjectFileCommandCancel,
+                           ProjectFileCommandCommit, &filter);
+
+    queryBar->fileOpenCallback = onOpenFile;
+    ProjectFileUpdateList(view);
+
+    // the tree might still be walked, query again whenever a new index arrives
+    projectFileOpener.job = FrameScheduler_Add([view](double) -> FrameJobState{
+        if(View_GetState(view) != View_SelectableList){
+            projectFileOpener.job = 0;
+            return FRAME_JOB_DONE;
+        }
+
+        if(FileIndex_GetGeneration() != projectFileOpener.generation){
+            ProjectFileUpdateList(view);
+        }
+        return FRAME_JOB_WAIT;
+    });
+    return 0;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 // Switch buffer routines.
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -1608,7 +2360,6 @@ int SwitchBufferCommandStart(View *view){
     std::unordered_map<std::string, int> pathMap;
     AssertA(view != nullptr, "Invalid view pointer");
     LineBuffer *lineBuffer = nullptr;
-    List<FileBuffer> *list = nullptr;
     const char *header = "Switch Buffer";
     uint hlen = strlen(header);
     FileBufferList *fBuffers = FileProvider_GetBufferList();
@@ -1616,34 +2367,24 @@ int SwitchBufferCommandStart(View *view){
     lineBuffer = AllocatorGetN(LineBuffer, 1);
     LineBuffer_InitBlank(lineBuffer);
 
-    list = fBuffers->fList;
     view->bufferFlags = std::vector<char>();
 
-    auto filler = [&](FileBuffer *buf) -> int{
-        if(buf){
-            if(buf->lineBuffer){
-                char val = 0;
-                char *ptr = buf->lineBuffer->filePath;
-                uint len = buf->lineBuffer->filePathSize;
-                uint n = GetSimplifiedPathName(ptr, len);
-                char *simpl = &ptr[n];
+    // most recently used first, the active buffer is the first entry
+    for(LineBuffer *buf : FileBufferList_GetRecent(fBuffers)){
+        char val = 0;
+        char *ptr = buf->filePath;
+        uint len = buf->filePathSize;
+        uint n = GetSimplifiedPathName(ptr, len);
+        char *simpl = &ptr[n];
 
-                std::string name(simpl, len-n);
+        std::string name(simpl, len-n);
 
-                LineBuffer_InsertLine(lineBuffer, ptr, len);
-                if(pathMap.find(name) != pathMap.end()){
-                    val = 1;
-                }
-                pathMap[name] = val;
-                //uint n = GetSimplifiedPathName(ptr, len);
-                //LineBuffer_InsertLine(lineBuffer, &ptr[n], len - n);
-            }
+        LineBuffer_InsertLine(lineBuffer, ptr, len);
+        if(pathMap.find(name) != pathMap.end()){
+            val = 1;
         }
-
-        return 1;
-    };
-
-    List_Transverse<FileBuffer>(list, filler);
+        pathMap[name] = val;
+    }
 
     view->bufferFlags.resize(lineBuffer->lineCount);
     for(int i = 0; i < lineBuffer->lineCount; i++){
@@ -1788,6 +2529,9 @@ int QueryBarCommandSearch(QueryBar *queryBar, LineBuffer *lineBuffer,
         QueryBar_GetWrittenContent(queryBar, &str, &slen);
     }
 
+    // keep all occurrences highlighted while the search is active
+    MatchSet_Set(lineBuffer, str, slen, AppGetSearchFlags());
+
     if(slen > 0){
         /*
         * We cannot use token comparation because we would be unable to
@@ -1797,26 +2541,30 @@ int QueryBarCommandSearch(QueryBar *queryBar, LineBuffer *lineBuffer,
         vec2ui cursor = dcursor->textPosition;
         uint line = cursor.x;
         uint start = cursor.y;
+        SearchQuery query;
         Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, line);
+        SearchQuery_Compile(&query, str, slen, AppGetSearchFlags());
         do{
             /* Grab buffer to search */
             if(buffer){
                 if(buffer->taken > 0){
                     int at = 0;
+                    uint matchLen = 0;
                     if(id == QUERY_BAR_CMD_SEARCH){
-                        at = StringSearch(str, &buffer->data[start], slen,
-                                          buffer->taken - start);
-                        if(at >= 0) at += start;
+                        at = SearchQuery_Find(&query, buffer->data, buffer->taken,
+                                              start, &matchLen);
                     }else{
-                        at = ReverseStringSearch(str, buffer->data, slen, start);
+                        at = SearchQuery_ReverseFind(&query, buffer->data,
+                                                     buffer->taken, start, &matchLen);
                     }
 
                     if(at >= 0){ // found
                         searchResult->lineNo = line;
                         searchResult->position = at;
-                        searchResult->length = slen;
+                        searchResult->length = matchLen;
                         searchResult->valid = 1;
                         //printf("[%u - %u]\n", searchResult->lineNo, searchResult->position);
+                        SearchQuery_Release(&query);
                         return 1;
                     }
                 }
@@ -1835,6 +2583,8 @@ int QueryBarCommandSearch(QueryBar *queryBar, LineBuffer *lineBuffer,
                 done = 1;
             }
         }while(done == 0);
+
+        SearchQuery_Release(&query);
     }
 
     //printf("Invalid\n");
@@ -19,6 +19,12 @@ struct FileEntry;
 #define OnInteractiveSearch std::function<int(QueryBar *bar, View *view, int accepted)>
 #define OnInteractiveList std::function<int(LineBuffer *titles)>
 
+/* Answers given to OnInteractiveSearch */
+#define INTERACTIVE_SEARCH_REJECT           0
+#define INTERACTIVE_SEARCH_ACCEPT           1
+#define INTERACTIVE_SEARCH_ACCEPT_REMAINING 2 // all matches until the end of the file
+#define INTERACTIVE_SEARCH_ACCEPT_ALL_FILES 3 // all matches in all opened files
+
 /*
 * NOTE: When defining help strings avoid using slashes '/' as this makes the
 * possible for the text to be interpreted as a path in some parts. We should
@@ -67,6 +73,18 @@ struct FileEntry;
 #define CMD_SEARCH_STR "search "
 #define CMD_SEARCH_HELP "Perform a full search on all opened files (usage: search <value>)."
 
+#define CMD_REGEX_SEARCH_STR "regex-search"
+#define CMD_REGEX_SEARCH_HELP "Toogles regular expressions for search, replace and search on all files."
+
+#define CMD_PROJECT_SEARCH_STR "project-search "
+#define CMD_PROJECT_SEARCH_HELP "Search all files under the root directory, including files not opened (usage: project-search <value>)."
+
+#define CMD_BENCH_SEARCH_STR "bench-search "
+#define CMD_BENCH_SEARCH_HELP "Measures the search throughput over all opened files (usage: bench-search <value>)."
+
+#define CMD_BENCH_QUEUE_STR "bench-queue"
+#define CMD_BENCH_QUEUE_HELP "Measures the throughput of the queues used between threads (debug builds only)."
+
 #define CMD_ENCODING_STR "encoding"
 #define CMD_ENCODING_HELP "Changes the encoding for the given file"
 
@@ -74,7 +92,7 @@ struct FileEntry;
 #define CMD_GLOBAL_ENCODING_HELP "Change the global encoding sets for default buffers."
 
 #define CMD_FUNCTIONS_STR "functions"
-#define CMD_FUNCTIONS_HELP "List all functions found on all opened files."
+#define CMD_FUNCTIONS_HELP "List all functions, structs, classes, enums and defines found on all opened files."
 
 #define CMD_HSPLIT_STR "hsplit"
 #define CMD_HSPLIT_HELP "Split the current view horizontally."
@@ -97,6 +115,18 @@ struct FileEntry;
 #define CMD_KILLBUFFER_STR "kill-buffer"
 #define CMD_KILLBUFFER_HELP "Closes the file opened in the current view (if any)."
 
+#define CMD_SESSION_STR "session "
+#define CMD_SESSION_HELP "Runs a command on a session so that it does not wait for the others, without a command shows its output (usage: session <name> [command])."
+
+#define CMD_SESSION_KILL_STR "session-kill"
+#define CMD_SESSION_KILL_HELP "Terminates the command running on a session, the one displayed if not given (usage: session-kill [name])."
+
+#define CMD_SESSION_LIMIT_STR "session-limit "
+#define CMD_SESSION_LIMIT_HELP "Keeps only the last lines(bytes) of the output of a session, 0 is unlimited (usage: session-limit <name> <lines> [bytes])."
+
+#define CMD_SESSION_SPILL_STR "session-spill "
+#define CMD_SESSION_SPILL_HELP "Writes the full output of a session to a temporary file (usage: session-spill <name> on(off))."
+
 #define CMD_HISTORY_CLEAR_STR "history-clear"
 #define CMD_HISTORY_CLEAR_HELP "Clears the current history stack and file."
 
@@ -150,16 +180,38 @@ struct CmdInformation{
     std::function<int(char *, uint, View *)> fn;
 };
 
-#define MAX_THREADS 16
+/*
+* Global searches split files into shards of at most this many lines so that
+* a single huge buffer is scanned by several threads.
+*/
+#define GLOBAL_SEARCH_SHARD_LINES 8192
+
 struct GlobalSearchResult{
     LineBuffer *lineBuffer;
     uint line;
     uint col;
+    // results of files that are not loaded, see project-search, have no
+    // lineBuffer, the file is given by 'fileId' and 'text' holds its line
+    int fileId = -1;
+    std::string text;
 };
 
+/*
+* Results of a single shard, i.e.: the range [lineStart, lineEnd) of 'lineBuffer'.
+* Shards are created in file order so walking them in sequence gives the results
+* sorted by file and line regardless of which thread scanned them.
+*/
 struct GlobalSearch{
+    LineBuffer *lineBuffer;
+    int fileId;
+    uint lineStart;
+    uint lineEnd;
     std::vector<GlobalSearchResult> results;
     uint count;
+    // copy of the lines searched in background, the line lineStart + i is
+    // [offsets[i], offsets[i+1]) of 'text'
+    std::string text;
+    std::vector<uint> offsets;
 };
 
 /* Commands are pre-defined by their enum id */
@@ -189,11 +241,16 @@ typedef struct QueryBarCmdSearch{
 
 typedef struct QueryBarCmdSearchAndReplace{
     QueryBarSearchAndReplaceState state;
-    char toLocate[128];
+    char *toLocate;
     uint toLocateLen;
+    uint toLocateSize;
 
-    char toReplace[128];
+    char *toReplace;
     uint toReplaceLen;
+    uint toReplaceSize;
+
+    /* Amount of bytes inserted by the last accepted replace */
+    uint replacedLen;
 
     /* Callback when user confirms/denies a search value */
     OnInteractiveSearch searchCallback;
@@ -218,6 +275,12 @@ int QueryBarCommandSearch(QueryBar *queryBar, LineBuffer *lineBuffer,
 */
 int FileOpenerCommandStart(View *view, char *basePath, ushort len,
                            OnFileOpenCallback onOpenFile);
+
+/*
+* Performs setup to start a command that opens any file of the project by fuzzy
+* matching its path, see FileIndex.
+*/
+int ProjectFileCommandStart(View *view, OnFileOpenCallback onOpenFile);
 /*
 * Performs setup to start a command of buffer switch.
 */
@@ -246,13 +309,26 @@ int BaseCommand_AddFileEntryIntoAutoLoader(char *entry, uint size);
 /*
 * Gets the current global search result. You are not allowed to touch this data,
 * it is only available for reading in order to render or interact with user.
-* It returns the amount of entries in the search list, this value is hardcoded
-* to MAX_THREADS, unless it is not possible to return the value, in which case
-* 0 is returned instead. In order to inspect how many entries are available it
-* is required to loop the list and check each individual 'count' value.
+* It returns the amount of shards in the search list, unless it is not possible
+* to return the value, in which case 0 is returned instead. In order to inspect
+* how many entries are available it is required to loop the list and check each
+* individual 'count' value, shards are sorted by file and line.
 */
 uint BaseCommand_FetchGlobalSearchData(GlobalSearch **gSearch);
 
+/*
+* Cancels the search in all files running in background, if any, and waits for it
+* to stop. Must be called before exiting.
+*/
+void BaseCommand_CancelGlobalSearch();
+
+/*
+* Drops the search results that refer to 'lineBuffer', must be called before it
+* is freed. Searches running in background work on a copy of the lines so they
+* do not need to stop.
+*/
+void BaseCommand_GlobalSearchDropBuffer(LineBuffer *lineBuffer);
+
 /*
 * Searches for a functions, exposing for app to be able
 * to implement 'AppCommandListFunctions'.
@@ -11,6 +11,7 @@
 #include <log.h>
 #include <aes.h>
 #include <cryptoutil.h>
+#include <algorithm>
 
 #define MODULE_NAME "Buffer"
 
@@ -44,6 +45,76 @@ inline void CopyToken(Token *dst, Token *src){
     dst->reserved = src->reserved;
 }
 
+static int Buffer_NextTokenIdentifier(Buffer *buffer, int tokenId, int dir){
+    for(int i = tokenId + dir; i >= 0 && i < (int)buffer->tokenCount; i += dir){
+        TokenId id = buffer->tokens[i].identifier;
+        if(id != TOKEN_ID_SPACE && id != TOKEN_ID_COMMENT){
+            return (int)id;
+        }
+    }
+
+    return -1;
+}
+
+DeclarationKind Buffer_GetDeclarationKind(Buffer *buffer, uint tokenId){
+    TokenId keyword = TOKEN_ID_IGNORE;
+    DeclarationKind kind = DECLARATION_NONE;
+    if(!buffer || tokenId >= buffer->tokenCount) return DECLARATION_NONE;
+
+    switch(buffer->tokens[tokenId].identifier){
+        case TOKEN_ID_FUNCTION_DECLARATION: return DECLARATION_FUNCTION;
+        case TOKEN_ID_PREPROCESSOR_DEFINITION:{
+            keyword = TOKEN_ID_PREPROCESSOR_DEFINE;
+            kind = DECLARATION_DEFINE;
+        } break;
+        case TOKEN_ID_DATATYPE_USER_STRUCT:{
+            keyword = TOKEN_ID_DATATYPE_STRUCT_DEF;
+            kind = DECLARATION_STRUCT;
+        } break;
+        case TOKEN_ID_DATATYPE_USER_CLASS:{
+            keyword = TOKEN_ID_DATATYPE_CLASS_DEF;
+            kind = DECLARATION_CLASS;
+        } break;
+        case TOKEN_ID_DATATYPE_USER_ENUM:{
+            keyword = TOKEN_ID_DATATYPE_ENUM_DEF;
+            kind = DECLARATION_ENUM;
+        } break;
+        case TOKEN_ID_DATATYPE_USER_DATATYPE:{
+            // typedef struct{ ... }A; the keyword is lines above, the closing brace
+            // right before the name is what tells it apart from other typedefs
+            if(Buffer_NextTokenIdentifier(buffer, (int)tokenId, -1) == TOKEN_ID_BRACE_CLOSE){
+                return DECLARATION_TYPEDEF;
+            }
+        } return DECLARATION_NONE;
+        default: return DECLARATION_NONE;
+    }
+
+    if(Buffer_NextTokenIdentifier(buffer, (int)tokenId, -1) != (int)keyword){
+        return DECLARATION_NONE;
+    }
+
+    if(kind != DECLARATION_DEFINE){
+        // forward declarations and usages such as 'struct A *a'
+        int next = Buffer_NextTokenIdentifier(buffer, (int)tokenId, 1);
+        if(next == TOKEN_ID_SEMICOLON || next == TOKEN_ID_ASTERISK ||
+           next == TOKEN_ID_COMMA || next == TOKEN_ID_PARENTHESE_CLOSE)
+        {
+            return DECLARATION_NONE;
+        }
+    }
+
+    return kind;
+}
+
+static void Buffer_CountDeclarations(Buffer *buffer){
+    buffer->declarations = 0;
+    for(uint i = 0; i < buffer->tokenCount; i++){
+        if(Buffer_GetDeclarationKind(buffer, i) != DECLARATION_NONE){
+            buffer->declarations++;
+        }
+    }
+}
+
 void Buffer_SoftClear(Buffer *buffer, EncoderDecoder *encoder){
     Buffer_RemoveRangeRaw(buffer,  0, buffer->taken, encoder);
     for(uint i = 0; i < buffer->tokenCount; i++){
@@ -59,7 +130,15 @@ void Buffer_SoftClear(Buffer *buffer, EncoderDecoder *encoder){
         buffer->tokens = nullptr;
     }
 
+    if(buffer->matches){
+        AllocatorFree(buffer->matches);
+        buffer->matches = nullptr;
+    }
+
     buffer->tokenCount = 0;
+    buffer->declarations = 0;
+    buffer->matchCount = 0;
+    buffer->matchGeneration = 0;
 }
 
 void Buffer_RemoveExcessSpace(Buffer *buffer, EncoderDecoder *encoder){
@@ -101,6 +180,10 @@ void Buffer_CopyReferences(Buffer *dst, Buffer *src){
         dst->size = src->size;
         dst->tokenCount = src->tokenCount;
         dst->tokens = src->tokens;
+        dst->declarations = src->declarations;
+        dst->matches = src->matches;
+        dst->matchCount = src->matchCount;
+        dst->matchGeneration = src->matchGeneration;
         dst->stateContext = src->stateContext;
         dst->is_ours = src->is_ours;
         dst->erased = src->erased;
@@ -158,6 +241,8 @@ void Buffer_CopyDeep(Buffer *dst, Buffer *src){
         dst->count = src->count;
         dst->taken = src->taken;
         dst->tokenCount = src->tokenCount;
+        dst->declarations = src->declarations;
+        dst->matchGeneration = 0;
         dst->stateContext = src->stateContext;
     }
 }
@@ -338,12 +423,15 @@ void Buffer_RemoveLastToken(Buffer *buffer, EncoderDecoder *encoder){
             buffer->tokens = nullptr;
         }
         buffer->tokenCount -= 1;
+        Buffer_CountDeclarations(buffer);
     }
 }
 
 void Buffer_UpdateTokens(Buffer *buffer, Token *tokens, uint size){
     if(buffer){
         bool release = true;
+        // the line was edited, its matches need to be computed again
+        buffer->matchGeneration = 0;
         if(buffer->tokenCount < size){
             if(buffer->tokens){
                 buffer->tokens = AllocatorExpand(Token, buffer->tokens,
@@ -371,6 +459,7 @@ void Buffer_UpdateTokens(Buffer *buffer, Token *tokens, uint size){
             AllocatorFree(buffer->tokens);
             buffer->tokens = nullptr;
             buffer->tokenCount = 0;
+            buffer->declarations = 0;
         }else{
             if(size < buffer->tokenCount){
                 buffer->tokens = AllocatorExpand(Token, buffer->tokens,
@@ -384,6 +473,8 @@ void Buffer_UpdateTokens(Buffer *buffer, Token *tokens, uint size){
                 CopyToken(dstToken, srcToken);
                 srcToken->reserved = nullptr;
             }
+
+            Buffer_CountDeclarations(buffer);
         }
     }
 }
@@ -396,6 +487,10 @@ void Buffer_Init(Buffer *buffer, uint size){
     buffer->taken = 0;
     buffer->tokens = nullptr;
     buffer->tokenCount = 0;
+    buffer->declarations = 0;
+    buffer->matches = nullptr;
+    buffer->matchCount = 0;
+    buffer->matchGeneration = 0;
     buffer->stateContext.state = TOKENIZER_STATE_CLEAN;
     buffer->stateContext.activeWorkProcessor = -1;
     buffer->stateContext.backTrack = 0;
@@ -428,6 +523,10 @@ void Buffer_InitSet(Buffer *buffer, char *head, uint leno, EncoderDecoder *encod
     buffer->taken = ic;
     buffer->tokens = nullptr;
     buffer->tokenCount = 0;
+    buffer->declarations = 0;
+    buffer->matches = nullptr;
+    buffer->matchCount = 0;
+    buffer->matchGeneration = 0;
     buffer->stateContext.state = TOKENIZER_STATE_CLEAN;
     buffer->stateContext.activeWorkProcessor = -1;
     buffer->stateContext.backTrack = 0;
@@ -646,6 +745,10 @@ void Buffer_Release(Buffer *buffer){
     buffer->taken = 0;
     buffer->tokens = nullptr;
     buffer->tokenCount = 0;
+    buffer->declarations = 0;
+    buffer->matches = nullptr;
+    buffer->matchCount = 0;
+    buffer->matchGeneration = 0;
     buffer->stateContext.state = TOKENIZER_STATE_CLEAN;
     buffer->stateContext.activeWorkProcessor = -1;
     buffer->stateContext.backTrack = 0;
@@ -720,6 +823,7 @@ void Buffer_Free(Buffer *buffer){
             }
             AllocatorFree(buffer->tokens);
         }
+        if(buffer->matches) AllocatorFree(buffer->matches);
         Buffer_Release(buffer);
     }
 }
@@ -801,6 +905,24 @@ void LineBuffer_RemoveLineAt(LineBuffer *lineBuffer, uint at){
     }
 }
 
+uint LineBuffer_RemoveLines(LineBuffer *lineBuffer, uint at, uint n){
+    uint count = lineBuffer->lineCount;
+    if(at + 1 >= count || n == 0) return 0;
+    if(n > count - 1 - at){
+        n = count - 1 - at;
+    }
+
+    // the removed buffers go after the last line and are reused as free lines
+    Buffer **lines = lineBuffer->lines;
+    for(uint i = at; i < at + n; i++){
+        Buffer_Free(lines[i]);
+    }
+
+    std::rotate(&lines[at], &lines[at + n], &lines[count]);
+    lineBuffer->lineCount -= n;
+    return n;
+}
+
 void LineBuffer_MergeConsecutiveLines(LineBuffer *lineBuffer, uint base){
     EncoderDecoder *encoder = &lineBuffer->props.encoder;
     if(base+1 < lineBuffer->lineCount){
@@ -904,15 +1026,21 @@ void LineBuffer_InitBlank(LineBuffer *lineBuffer){
 struct LineBufferTokenizer{
     Tokenizer *tokenizer;
     LineBuffer *lineBuffer;
+    TaskGroup *group; // remaining lines are skipped once cancelled
     int lineBacktrack;
     std::function<void(int)> func;
 };
 
 
-static LineBuffer *activeLineBuffer = nullptr;
-static uint current = 0;
-static uint totalSize = 0;
-static char *content = nullptr;
+/*
+* State of the fetch callbacks given to the tokenizer, they cannot receive it as an
+* argument. It is per thread as files loading in the pool are tokenized while the
+* main thread re-tokenizes the buffers being edited.
+*/
+static thread_local LineBuffer *activeLineBuffer = nullptr;
+static thread_local uint current = 0;
+static thread_local uint totalSize = 0;
+static thread_local char *content = nullptr;
 
 
 uint LineBuffer_TokenizerFileFetcher(char **p, uint fet){
@@ -933,6 +1061,7 @@ static void LineBuffer_LineProcessor(char **p, uint size, uint lineNr,
     Tokenizer *tokenizer = lineBufferTokenizer->tokenizer;
     LineBuffer *lineBuffer = lineBufferTokenizer->lineBuffer;
     TokenizerWorkContext *workContext = tokenizer->workContext;
+    if(TaskGroup_IsCancelled(lineBufferTokenizer->group)) return;
 
     TokenizerStateContext tokenizerContext;
     Lex_TokenizerGetCurrentState(tokenizer, &tokenizerContext);
@@ -1010,7 +1139,7 @@ static void LineBuffer_LineProcessor(char **p, uint size, uint lineNr,
     buffer->erased = false;
 }
 
-static uint currentID;
+static thread_local uint currentID;
 uint LineBuffer_BufferFetcher(char **p, uint fet){
     Buffer *b = LineBuffer_GetBufferAt(activeLineBuffer, currentID+1);
     currentID++;
@@ -1187,82 +1316,76 @@ void LineBuffer_ReTokenizeFromBuffer(LineBuffer *lineBuffer, Tokenizer *tokenize
     Lex_TokenizerSetFetchCallback(tokenizer, nullptr);
 }
 
-void LineBuffer_Init(LineBuffer *lineBuffer, Tokenizer *tokenizer,
-                     char *fileContents, uint filesize, bool synchronous)
+void LineBuffer_InitTokenized(LineBuffer *lineBuffer, Tokenizer *tokenizer,
+                              char *fileContents, uint filesize, TaskGroup *group,
+                              std::function<void(int)> onLine)
 {
-    AssertA(lineBuffer != nullptr && fileContents != nullptr && filesize > 0,
-            "Invalid line buffer initialization");
+    LineBufferTokenizer lineBufferTokenizer;
+    LineBuffer_InitBlank(lineBuffer);
+    // it might be displayed while the lines are added
+    LineBuffer_SetWrittable(lineBuffer, false);
 
-    if(synchronous){
-        LineBufferTokenizer lineBufferTokenizer;
-        LineBuffer_InitBlank(lineBuffer);
+    lineBufferTokenizer.tokenizer = tokenizer;
+    lineBufferTokenizer.lineBuffer = lineBuffer;
+    lineBufferTokenizer.group = group;
+    lineBufferTokenizer.lineBacktrack = 0;
+    lineBufferTokenizer.func = onLine;
 
-        lineBufferTokenizer.tokenizer = tokenizer;
-        lineBufferTokenizer.lineBuffer = lineBuffer;
-        lineBufferTokenizer.lineBacktrack = 0;
-        lineBufferTokenizer.func = [&](int lineno) -> void{};
+    activeLineBuffer = lineBuffer;
+    current = 0;
+    totalSize = filesize;
+    content = fileContents;
+    Lex_TokenizerContextReset(tokenizer);
+    Lex_TokenizerSetFetchCallback(tokenizer, LineBuffer_TokenizerFileFetcher);
 
-        activeLineBuffer = lineBuffer;
-        current = 0;
-        totalSize = filesize;
-        content = fileContents;
-        Lex_TokenizerSetFetchCallback(tokenizer, LineBuffer_TokenizerFileFetcher);
+    Lex_LineProcess(fileContents, filesize, LineBuffer_LineProcessor,
+                    0, &lineBufferTokenizer, true);
 
-        Lex_LineProcess(fileContents, filesize, LineBuffer_LineProcessor,
-                        0, &lineBufferTokenizer, true);
+    activeLineBuffer = nullptr;
+    current = 0;
+    totalSize = 0;
+    content = nullptr;
 
-        activeLineBuffer = nullptr;
-        current = 0;
-        totalSize = 0;
-        content = nullptr;
+    Lex_TokenizerSetFetchCallback(tokenizer, nullptr);
+    LineBuffer_SetWrittable(lineBuffer, true);
+}
 
-        Lex_TokenizerSetFetchCallback(tokenizer, nullptr);
+void LineBuffer_Init(LineBuffer *lineBuffer, Tokenizer *tokenizer,
+                     char *fileContents, uint filesize, bool synchronous)
+{
+    // files opened one by one share the detached tokenizers so they cannot be
+    // tokenized at the same time, FileProvider_LoadMany builds one per file
+    static std::mutex tokenizerMutex;
+    AssertA(lineBuffer != nullptr && fileContents != nullptr && filesize > 0,
+            "Invalid line buffer initialization");
 
+    if(synchronous){
+        std::lock_guard<std::mutex> guard(tokenizerMutex);
+        LineBuffer_InitTokenized(lineBuffer, tokenizer, fileContents, filesize,
+                                 nullptr, [&](int lineno) -> void{});
     }else{ // Make the file tokenization run in a different thread
-        DispatchExecution([&](HostDispatcher *dispatcher){
-            // becarefull with pointers and variables as the parent
-            // context will dissolve once we dispatch the host.
+        // the rest of the file stops being tokenized if it gets closed
+        TaskGroup *group = LineBuffer_GetTaskGroup(lineBuffer);
+        Task_Run([lineBuffer, tokenizer, fileContents, filesize, group](TaskContext *task){
             const int kReleaseHostAt = 500;
-            LineBuffer *localLineBufferPtr = lineBuffer;
-            Tokenizer *localTokenizerPtr = tokenizer;
-
-            LineBufferTokenizer lineBufferTokenizer;
-            LineBuffer_InitBlank(localLineBufferPtr);
-            LineBuffer_SetWrittable(localLineBufferPtr, false);
-
-            lineBufferTokenizer.tokenizer = localTokenizerPtr;
-            lineBufferTokenizer.lineBuffer = localLineBufferPtr;
-            lineBufferTokenizer.lineBacktrack = 0;
-            lineBufferTokenizer.func = [&](int lineno) -> void{
-                if(lineno > kReleaseHostAt && !dispatcher->IsDispatched()){
+            std::lock_guard<std::mutex> guard(tokenizerMutex);
+            LineBuffer_InitTokenized(lineBuffer, tokenizer, fileContents, filesize, group,
+                                     [&](int lineno) -> void{
+                if(lineno > kReleaseHostAt && !task->IsCallerReleased()){
                     // we parsed enough, release the caller
-                    dispatcher->DispatchHost();
+                    task->ReleaseCaller();
                 }
-            };
-
-            activeLineBuffer = localLineBufferPtr;
-            current = 0;
-            totalSize = filesize;
-            content = fileContents;
-            Lex_TokenizerSetFetchCallback(localTokenizerPtr,
-                                        LineBuffer_TokenizerFileFetcher);
-
-            Lex_LineProcess(fileContents, filesize, LineBuffer_LineProcessor,
-                            0, &lineBufferTokenizer, true);
-
-            LineBuffer_SetWrittable(localLineBufferPtr, true);
-
-            activeLineBuffer = nullptr;
-            current = 0;
-            totalSize = 0;
-            content = nullptr;
-
-            Lex_TokenizerSetFetchCallback(localTokenizerPtr, nullptr);
+            });
+        }, TASK_PRIORITY_INTERACTIVE, group);
+    }
+}
 
-            // release the caller, just in case we haven't released it before
-            dispatcher->DispatchHost();
-        });
+TaskGroup *LineBuffer_GetTaskGroup(LineBuffer *lineBuffer){
+    if(!lineBuffer->tasks){
+        lineBuffer->tasks = TaskGroup_Create();
     }
+
+    return lineBuffer->tasks;
 }
 
 uint LineBuffer_InsertRawTextAt(LineBuffer *lineBuffer, char *text, uint size,
@@ -1458,6 +1581,12 @@ void LineBuffer_Free(LineBuffer *lineBuffer){
             AllocatorFree(lineBuffer->lines);
 
         UndoRedoCleanup(&lineBuffer->undoRedo);
+        MatchSet_Clear(lineBuffer);
+
+        if(lineBuffer->tasks){
+            TaskGroup_Release(lineBuffer->tasks);
+            lineBuffer->tasks = nullptr;
+        }
 
         AllocatorFree(lineBuffer->undoRedo.undoStack);
         AllocatorFree(lineBuffer->undoRedo.redoStack);
@@ -1478,6 +1607,23 @@ Buffer *LineBuffer_GetBufferAt(LineBuffer *lineBuffer, uint lineNo){
     return nullptr;
 }
 
+void LineBuffer_GetDeclarations(LineBuffer *lineBuffer, uint start, uint end,
+                                std::vector<LineBufferDeclaration> &out)
+{
+    end = end < lineBuffer->lineCount ? end : lineBuffer->lineCount;
+    for(uint i = start; i < end; i++){
+        Buffer *buffer = lineBuffer->lines[i];
+        if(buffer->declarations == 0) continue;
+
+        for(uint k = 0; k < buffer->tokenCount; k++){
+            DeclarationKind kind = Buffer_GetDeclarationKind(buffer, k);
+            if(kind != DECLARATION_NONE){
+                out.push_back({ .line = i, .tokenId = k, .kind = kind });
+            }
+        }
+    }
+}
+
 char *LineBuffer_GetStoragePath(LineBuffer *lineBuffer){
     return &lineBuffer->filePath[0];
 }
@@ -1678,9 +1824,8 @@ bool SaveToStorageImpl(char *filePath, uint filePathSize, uint8_t *bytes, uint32
     // Whenever we save remotely we need to make sure that any previous
     // writes are complete because the server is not asynchronous. And if
     // connection is slow it might happen that dispatching another save
-    // will corrupt the first one because dispatching spawns a different
-    // thread and the dispatching routine shares host dispatchers based on the
-    // the type of dispatch that is happening. So I'll wait at most 2 seconds
+    // will corrupt the first one because the write runs as a task in
+    // background. So I'll wait at most 2 seconds
     // to see if any previous dispatches finishes, if not we have no choice but
     // to refuse this write and force the user to request again later.
 
@@ -1713,18 +1858,12 @@ bool SaveToStorageImpl(char *filePath, uint filePathSize, uint8_t *bytes, uint32
 
         memcpy(ownMemory, bytes, size);
 
-        DispatchExecution([&](HostDispatcher *dispatcher){
-            uint8_t *localPtr = ownMemory;
-            uint32_t localSize = ownSize;
+        saveDispatchRunning = true;
+        Task_Spawn([ownMemory, ownSize, file, storage](){
             FileHandle localFile = file;
-            StorageDevice *localStorage = storage;
-            saveDispatchRunning = true;
-
-            dispatcher->DispatchHost();
-
-            localStorage->StreamWriteBytes(&localFile, (void *)localPtr, 1, localSize);
-            localStorage->StreamFinish(&localFile);
-            AllocatorFree(localPtr);
+            storage->StreamWriteBytes(&localFile, (void *)ownMemory, 1, ownSize);
+            storage->StreamFinish(&localFile);
+            AllocatorFree(ownMemory);
             saveDispatchRunning = false;
         });
     }else{
@@ -7,8 +7,12 @@
 #include <undo.h>
 #include <symbol.h>
 #include <vector>
+#include <functional>
 #include <encoding.h>
 #include <cryptoutil.h>
+#include <match_set.h>
+
+struct TaskGroup;
 
 /*
 * Basic data structure for lines. data holds the line pointer,
@@ -22,7 +26,11 @@
 * buffer is being used for printing or if you don't want to handle offsets
 * decoding UTF-8 you can loop using 'count' instead. Every time a update
 * happens in the buffer this variable is updated and shows the amount
-* of encoded UTF-8 characters available in the buffer.
+* of encoded UTF-8 characters available in the buffer. 'declarations' counts
+* the tokens of the line that declare something, see Buffer_GetDeclarationKind,
+* it is recomputed whenever the tokens change and moves together with them so
+* listing declarations only needs to visit tokens of lines where it is non zero.
+* The same way 'matches' holds the highlighted matches of the line.
 */
 struct Buffer{
     uint size;
@@ -31,9 +39,14 @@ struct Buffer{
     char *data;
     Token *tokens;
     uint tokenCount;
+    uint declarations;
     bool is_ours;
     bool erased;
     TokenizerStateContext stateContext;
+    // (position, length) pairs of the highlighted matches, see MatchSet
+    uint *matches;
+    uint matchCount;
+    uint matchGeneration;
 };
 
 
@@ -76,6 +89,19 @@ struct LineBufferProps{
     EncoderDecoder encoder;
 };
 
+/*
+* Kind of the declarations that are indexed for outlines and the functions listing.
+*/
+typedef enum{
+    DECLARATION_NONE = 0,
+    DECLARATION_FUNCTION,
+    DECLARATION_STRUCT,
+    DECLARATION_CLASS,
+    DECLARATION_ENUM,
+    DECLARATION_DEFINE,
+    DECLARATION_TYPEDEF, // name given after the body, i.e.: typedef struct{ ... }A;
+}DeclarationKind;
+
 /*
 * Basic description of a structured file. A list of lines with the available size and
 * current line count.
@@ -90,10 +116,12 @@ struct LineBuffer{
     UndoRedo undoRedo;
     vec2i activeBuffer;
     LineBufferProps props;
+    MatchSet *matchSet;
+    TaskGroup *tasks; // background work on this buffer, see LineBuffer_GetTaskGroup
 };
 
 /* For static initialization */
-#define BUFFER_INITIALIZER {.size = 0, .count = 0, .taken = 0, .data = nullptr, .tokens = nullptr, .tokenCount = 0, .is_ours = false }
+#define BUFFER_INITIALIZER {.size = 0, .count = 0, .taken = 0, .data = nullptr, .tokens = nullptr, .tokenCount = 0, .declarations = 0, .is_ours = false }
 #define LINE_BUFFER_INITIALIZER {.lines = nullptr, .lineCount = 0, .size = 0,}
 
 /*
@@ -154,6 +182,14 @@ uint Buffer_InsertRawStringAt(Buffer *buffer, uint at, char *str, uint len, Enco
 */
 void Buffer_UpdateTokens(Buffer *buffer, Token *tokens, uint size);
 
+/*
+* Gets the kind of declaration the token at 'tokenId' is. Functions are the ones
+* marked by the lexer as TOKEN_ID_FUNCTION_DECLARATION while structs, classes, enums
+* and defines are the names that directly follow their keyword, i.e.: 'struct A{'
+* but not 'struct A;' nor 'struct A *a'.
+*/
+DeclarationKind Buffer_GetDeclarationKind(Buffer *buffer, uint tokenId);
+
 /*
 * Removes a range of the given Buffer. Indexes are given by 'start' and 'end' such
 * that start < end. Range is given in UTF-8 positions.
@@ -287,6 +323,17 @@ void LineBuffer_InitEmpty(LineBuffer *lineBuffer);
 void LineBuffer_Init(LineBuffer *lineBuffer, Tokenizer *tokenizer,
                      char *fileContents, uint filesize, bool synchronous=true);
 
+/*
+* Initializes a LineBuffer from the contents of a file on the calling thread, like
+* the synchronous LineBuffer_Init, calling 'onLine' with the number of every line
+* added. The LineBuffer is read-only until it finishes and the remaining lines are
+* skipped if 'group' is cancelled. 'tokenizer' must not be in use by another
+* thread, loads running at the same time need their own tokenizer.
+*/
+void LineBuffer_InitTokenized(LineBuffer *lineBuffer, Tokenizer *tokenizer,
+                              char *fileContents, uint filesize, TaskGroup *group,
+                              std::function<void(int)> onLine);
+
 /*
 * Inserts a new line at the end of the LineBuffer. The line is specified by its contents
 * in 'line' with size 'size'.
@@ -329,11 +376,36 @@ void LineBuffer_CopyLineTokens(LineBuffer *lineBuffer, uint lineNr,
 */
 void LineBuffer_RemoveLineAt(LineBuffer *lineBuffer, uint at);
 
+/*
+* Removes 'n' lines starting at 'at' at once, only the line pointers are moved so
+* the cost does not depend on the size of the lines. The last line is never
+* removed. Returns the amount of lines removed.
+*/
+uint LineBuffer_RemoveLines(LineBuffer *lineBuffer, uint at, uint n);
+
 /*
 * Returns the buffer containing the line at 'lineNo' or nullptr if no one exists.
 */
 Buffer *LineBuffer_GetBufferAt(LineBuffer *lineBuffer, uint lineNo);
 
+/*
+* A declaration found inside a LineBuffer, the name is the token 'tokenId' of the
+* line 'line'.
+*/
+typedef struct{
+    uint line;
+    uint tokenId;
+    DeclarationKind kind;
+}LineBufferDeclaration;
+
+/*
+* Appends to 'out' the declarations of the lines in [start, end) in order. Only
+* lines with a non zero declaration count have their tokens inspected so this is
+* cheap enough to be called whenever an outline is needed.
+*/
+void LineBuffer_GetDeclarations(LineBuffer *lineBuffer, uint start, uint end,
+                                std::vector<LineBufferDeclaration> &out);
+
 /*
 * Forces the current tokenizer to re-compute tokens starting from base.
 * Depending on the Buffer located at 'base' the Tokenizer might work on
@@ -400,6 +472,14 @@ void LineBuffer_SetWrittable(LineBuffer *lineBuffer, bool isWrittable);
 */
 bool LineBuffer_IsWrittable(LineBuffer *lineBuffer);
 
+/*
+* Gets the task group of the background work done on the lineBuffer, i.e.: its
+* initial tokenization, creating it if needed. The group is released when the
+* lineBuffer is freed, closing a file should release it first with a callback that
+* frees the lineBuffer so that running tasks are not left with a dangling pointer.
+*/
+TaskGroup *LineBuffer_GetTaskGroup(LineBuffer *lineBuffer);
+
 /*
 * Saves the contents of the lineBuffer to storage.
 */
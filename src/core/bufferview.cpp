@@ -2,6 +2,7 @@
 #include <utilities.h>
 #include <app.h>
 #include <symbol.h>
+#include <file_provider.h>
 
 Float InterpolateValueCubic(Float dt, Float remaining,
                             Float *initialValue, Float finalValue,
@@ -81,8 +82,9 @@ void BufferView_Synchronize(BufferView *view){
         // 0 - check for locks
         int is_locked = 0;
         LockedLineBuffer *lockedBuffer = nullptr;
-        GetExecutorLockedLineBuffer(&lockedBuffer);
-        if(lockedBuffer->lineBuffer == view->lineBuffer){
+        CommandSession *session = CommandSession_FromLineBuffer(view->lineBuffer);
+        if(session){
+            lockedBuffer = CommandSession_GetOutput(session);
             lockedBuffer->mutex.lock();
             is_locked = 1;
         }
@@ -225,6 +227,9 @@ void BufferView_SwapBuffer(BufferView *view, LineBuffer *lineBuffer, ViewType ty
     BufferViewFileLocation_Register(view);
     Float lineHeight = view->sController.lineHeight;
     view->lineBuffer = lineBuffer;
+    if(lineBuffer){
+        FileBufferList_Touch(FileProvider_GetBufferList(), lineBuffer);
+    }
     view->scroll.currX = 0;
     view->activeNestPoint = -1;
     view->activeType = type;
@@ -70,14 +70,24 @@ int IsCursorAlive(){
     return IsCursorDisplayedWin32();
 }
 
-void PoolEvents(){
+int PoolEvents(){
+    // we cannot tell if anything happened, assume it did
     PollEventsWin32();
+    return 1;
 }
 
 void WaitForEvents(){
     WaitEventsWin32();
 }
 
+int WaitForEventsTimeout(double timeout){
+    return WaitEventsTimeoutWin32(timeout);
+}
+
+void PostEmptyEvent(){
+    PostEmptyEventWin32();
+}
+
 void TerminateDisplay(){
     TerminateWin32();
 }
@@ -151,14 +161,22 @@ int IsCursorAlive(){
     return IsCursorDisplayedX11();
 }
 
-void PoolEvents(){
-    PoolEventsX11();
+int PoolEvents(){
+    return PoolEventsX11();
 }
 
 void WaitForEvents(){
     WaitForEventsX11();
 }
 
+int WaitForEventsTimeout(double timeout){
+    return WaitForEventsTimeoutX11(timeout);
+}
+
+void PostEmptyEvent(){
+    PostEmptyEventX11();
+}
+
 void TerminateDisplay(){
     TerminateX11();
 }
@@ -23,10 +23,26 @@ void SwapInterval(DisplayWindow *window, int interval);
 
 void SetWindowIcon(DisplayWindow *window, unsigned char *png, unsigned int pngLen);
 
-void PoolEvents();
+/*
+* Processes the pending window events, returns the amount processed.
+*/
+int PoolEvents();
 
 void WaitForEvents();
 
+/*
+* Blocks until there are window events, someone calls PostEmptyEvent or 'timeout'
+* seconds pass, a negative 'timeout' waits forever. Processes the events and
+* returns 1 if the wait was not ended by the timeout, 0 otherwise.
+*/
+int WaitForEventsTimeout(double timeout);
+
+/*
+* Wakes the main loop from WaitForEvents/WaitForEventsTimeout. Can be called from
+* any thread, workers call this once they have something that must be displayed.
+*/
+void PostEmptyEvent();
+
 void MakeContextCurrent(DisplayWindow *window);
 
 int WindowShouldClose(DisplayWindow *window);
@@ -0,0 +1,253 @@
+#include <edit_batch.h>
+#include <buffers.h>
+#include <parallel.h>
+#include <file_provider.h>
+#include <lex.h>
+#include <undo.h>
+#include <string.h>
+#include <algorithm>
+
+// changed lines closer than this are re-tokenized as a single range
+#define EDIT_BATCH_RETOKENIZE_GAP 8
+
+void EditBatch_Begin(EditBatch *batch, LineBuffer *lineBuffer){
+    batch->lineBuffer = lineBuffer;
+    batch->edits.clear();
+    batch->lines.clear();
+    batch->prepared = false;
+}
+
+void EditBatch_Replace(EditBatch *batch, uint line, uint position, uint length,
+                       const char *text, uint size)
+{
+    batch->edits.push_back({
+        .line = line,
+        .position = position,
+        .length = length,
+        .text = std::string(text, size),
+    });
+    batch->prepared = false;
+}
+
+uint EditBatch_ReplaceMatches(EditBatch *batch, SearchQuery *query, const char *replace,
+                              uint rlen, uint line, uint position)
+{
+    uint added = 0;
+    std::string out;
+    LineBuffer *lineBuffer = batch->lineBuffer;
+    if(!lineBuffer || !query->valid) return 0;
+
+    for(uint i = line; i < lineBuffer->lineCount; i++){
+        Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, i);
+        uint from = i == line ? position : 0;
+        if(!buffer) continue;
+
+        while(from <= buffer->taken){
+            uint matchLen = 0;
+            int at = SearchQuery_Find(query, buffer->data, buffer->taken,
+                                      from, &matchLen);
+            if(at < 0) break;
+
+            out.clear();
+            SearchQuery_Expand(query, buffer->data, buffer->taken, (uint)at,
+                               matchLen, replace, rlen, out);
+            batch->edits.push_back({
+                .line = i,
+                .position = (uint)at,
+                .length = matchLen,
+                .text = out,
+            });
+
+            added++;
+            from = (uint)at + (matchLen > 0 ? matchLen : 1);
+        }
+    }
+
+    batch->prepared = false;
+    return added;
+}
+
+void EditBatch_Prepare(EditBatch *batch){
+    std::vector<EditBatchEdit> &edits = batch->edits;
+    LineBuffer *lineBuffer = batch->lineBuffer;
+    auto comparator = [](const EditBatchEdit &a, const EditBatchEdit &b) -> bool{
+        return a.line < b.line || (a.line == b.line && a.position < b.position);
+    };
+
+    batch->lines.clear();
+    batch->prepared = true;
+    if(!lineBuffer) return;
+
+    if(!std::is_sorted(edits.begin(), edits.end(), comparator)){
+        std::stable_sort(edits.begin(), edits.end(), comparator);
+    }
+
+    uint i = 0;
+    uint n = edits.size();
+    while(i < n){
+        uint line = edits[i].line;
+        Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, line);
+        if(!buffer){
+            while(i < n && edits[i].line == line) i++;
+            continue;
+        }
+
+        std::string data;
+        uint at = 0;
+        for(; i < n && edits[i].line == line; i++){
+            EditBatchEdit *edit = &edits[i];
+            if(edit->position < at || edit->position + edit->length > buffer->taken){
+                continue;
+            }
+
+            data.append(&buffer->data[at], edit->position - at);
+            data.append(edit->text);
+            at = edit->position + edit->length;
+        }
+
+        data.append(&buffer->data[at], buffer->taken - at);
+        if(data.size() == buffer->taken &&
+           memcmp(data.c_str(), buffer->data, buffer->taken) == 0)
+        {
+            continue;
+        }
+
+        batch->lines.push_back({ .line = line, .data = std::move(data) });
+    }
+}
+
+/*
+* Swaps the contents of 'lines', sorted by line, and re-tokenizes the ranges
+* containing them. This is shared by commit and undo.
+*/
+static void EditBatch_ApplyLines(LineBuffer *lineBuffer, Tokenizer *tokenizer,
+                                 std::vector<EditBatchLine> &lines)
+{
+    SymbolTable *symTable = tokenizer->symbolTable;
+    EncoderDecoder *encoder = LineBuffer_GetEncoderDecoder(lineBuffer);
+    for(EditBatchLine &line : lines){
+        Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, line.line);
+        Buffer_EraseSymbols(buffer, symTable);
+        Buffer_SoftClear(buffer, encoder);
+        if(line.data.size() > 0){
+            Buffer_InsertRawStringAt(buffer, 0, (char *)line.data.c_str(),
+                                     line.data.size(), encoder);
+        }
+        Buffer_Claim(buffer);
+    }
+
+    uint first = lines[0].line;
+    uint last = first;
+    for(uint i = 1; i < lines.size(); i++){
+        uint line = lines[i].line;
+        if(line - last > EDIT_BATCH_RETOKENIZE_GAP){
+            LineBuffer_ReTokenizeFromBuffer(lineBuffer, tokenizer, first, last - first);
+            first = line;
+        }
+        last = line;
+    }
+
+    LineBuffer_ReTokenizeFromBuffer(lineBuffer, tokenizer, first, last - first);
+    lineBuffer->is_dirty = 1;
+}
+
+uint EditBatch_Commit(EditBatch *batch, Tokenizer *tokenizer, vec2ui cursor){
+    LineBuffer *lineBuffer = batch->lineBuffer;
+    if(!batch->prepared){
+        EditBatch_Prepare(batch);
+    }
+
+    if(batch->lines.size() == 0) return 0;
+
+    // the undo entry is the list of original lines as: line | size | data
+    uint size = 0;
+    for(EditBatchLine &line : batch->lines){
+        Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, line.line);
+        size += 2 * sizeof(uint) + buffer->taken;
+    }
+
+    uint at = 0;
+    char *text = AllocatorGetN(char, size);
+    for(EditBatchLine &line : batch->lines){
+        Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, line.line);
+        Memcpy(&text[at], &line.line, sizeof(uint));
+        Memcpy(&text[at + sizeof(uint)], &buffer->taken, sizeof(uint));
+        if(buffer->taken > 0){
+            Memcpy(&text[at + 2 * sizeof(uint)], buffer->data, buffer->taken);
+        }
+        at += 2 * sizeof(uint) + buffer->taken;
+    }
+
+    UndoRedoUndoPushLines(&lineBuffer->undoRedo, cursor, text, size);
+
+    EditBatch_ApplyLines(lineBuffer, tokenizer, batch->lines);
+    return batch->lines.size();
+}
+
+void EditBatch_Undo(LineBuffer *lineBuffer, Tokenizer *tokenizer, char *text, uint size){
+    uint at = 0;
+    std::vector<EditBatchLine> lines;
+    while(at + 2 * sizeof(uint) <= size){
+        uint line = 0, len = 0;
+        Memcpy(&line, &text[at], sizeof(uint));
+        Memcpy(&len, &text[at + sizeof(uint)], sizeof(uint));
+        at += 2 * sizeof(uint);
+        AssertA(at + len <= size, "Invalid edit batch undo entry");
+
+        if(line < lineBuffer->lineCount){
+            lines.push_back({ .line = line, .data = std::string(&text[at], len) });
+        }
+        at += len;
+    }
+
+    if(lines.size() > 0){
+        EditBatch_ApplyLines(lineBuffer, tokenizer, lines);
+    }
+}
+
+uint EditBatch_ReplaceInBuffers(LineBuffer **lineBuffers, uint count, const char *query,
+                                uint qlen, int flags, const char *replace, uint rlen,
+                                std::vector<uint> *replaced)
+{
+    uint total = 0;
+    // regex queries are not reentrant so each worker needs its own copy
+    int workers = GetConcurrency();
+    std::vector<SearchQuery> queries(workers);
+    for(int i = 0; i < workers; i++){
+        SearchQuery_Compile(&queries[i], query, qlen, flags);
+    }
+
+    std::vector<EditBatch> batches(count);
+    std::vector<uint> found(count, 0);
+    ParallelForDynamic("Replace", 0, count, [&](uint i, int tid){
+        EditBatch_Begin(&batches[i], lineBuffers[i]);
+        if(!LineBuffer_IsWrittable(lineBuffers[i])) return;
+
+        found[i] = EditBatch_ReplaceMatches(&batches[i], &queries[tid], replace, rlen);
+        EditBatch_Prepare(&batches[i]);
+    });
+
+    for(SearchQuery &q : queries){
+        SearchQuery_Release(&q);
+    }
+
+    // tokenizers and symbol tables are shared between files of the same type
+    // so applying cannot be done in parallel
+    for(uint i = 0; i < count; i++){
+        EditBatch *batch = &batches[i];
+        if(batch->lines.size() == 0){
+            found[i] = 0;
+            continue;
+        }
+
+        Tokenizer *tokenizer = FileProvider_GetLineBufferTokenizer(lineBuffers[i]);
+        EditBatch_Commit(batch, tokenizer, vec2ui(batch->lines[0].line, 0));
+        total += found[i];
+    }
+
+    if(replaced){
+        *replaced = found;
+    }
+
+    return total;
+}
@@ -0,0 +1,91 @@
+/* date = October 19th 2026 19:10 */
+#pragma once
+#include <types.h>
+#include <geometry.h>
+#include <search.h>
+#include <string>
+#include <vector>
+
+struct LineBuffer;
+struct Tokenizer;
+
+/*
+* Edit transaction over a LineBuffer. Edits are only collected when added and are
+* applied together on commit: every line is rebuilt once with all of its edits,
+* the changed lines are re-tokenized as a few contiguous ranges instead of once per
+* edit and a single undo entry holding the original lines is pushed. This is what
+* replace-all uses, replacing thousands of matches through the regular edit path
+* would re-tokenize for every match and overflow the undo stack.
+*
+* Edits cannot insert line breaks, the amount of lines never changes.
+*/
+typedef struct EditBatchEdit{
+    uint line;
+    uint position; // raw position inside the line
+    uint length; // amount of raw bytes replaced
+    std::string text;
+}EditBatchEdit;
+
+typedef struct EditBatchLine{
+    uint line;
+    std::string data;
+}EditBatchLine;
+
+typedef struct EditBatch{
+    LineBuffer *lineBuffer;
+    std::vector<EditBatchEdit> edits;
+    std::vector<EditBatchLine> lines; // filled by EditBatch_Prepare
+    bool prepared;
+}EditBatch;
+
+/*
+* Starts a new transaction over 'lineBuffer'.
+*/
+void EditBatch_Begin(EditBatch *batch, LineBuffer *lineBuffer);
+
+/*
+* Adds an edit replacing 'length' raw bytes at raw position 'position' of the line
+* 'line' by 'text' with size 'size'. Edits that overlap a previous one of the same
+* line are dropped on commit.
+*/
+void EditBatch_Replace(EditBatch *batch, uint line, uint position, uint length,
+                       const char *text, uint size);
+
+/*
+* Adds an edit for every match of 'query' found at or after the raw position
+* 'position' of the line 'line' replacing it by 'replace', capture references are
+* expanded for regex queries, see SearchQuery_Expand. Returns the amount of edits
+* added.
+*/
+uint EditBatch_ReplaceMatches(EditBatch *batch, SearchQuery *query, const char *replace,
+                              uint rlen, uint line=0, uint position=0);
+
+/*
+* Computes the new contents of the edited lines. This only reads the LineBuffer so
+* batches of different LineBuffers can be prepared in parallel. Calling it is
+* optional, EditBatch_Commit prepares the batch if needed.
+*/
+void EditBatch_Prepare(EditBatch *batch);
+
+/*
+* Applies the batch, re-tokenizes the changed lines and pushes one undo entry that
+* puts the cursor back at 'cursor'. Must be called from the main thread as it
+* touches the tokenizer and the symbol table. Returns the amount of lines changed.
+*/
+uint EditBatch_Commit(EditBatch *batch, Tokenizer *tokenizer, vec2ui cursor);
+
+/*
+* Restores the lines saved in the undo entry of a batch given by 'text' and 'size'.
+*/
+void EditBatch_Undo(LineBuffer *lineBuffer, Tokenizer *tokenizer, char *text, uint size);
+
+/*
+* Replaces every match of 'query' by 'replace' in all the 'count' LineBuffers
+* given in 'lineBuffers', read only buffers are skipped. Matches are located and
+* the new lines computed in parallel while applying is done buffer by buffer.
+* Returns the amount of matches replaced, the ones of each LineBuffer are in
+* 'replaced' if given.
+*/
+uint EditBatch_ReplaceInBuffers(LineBuffer **lineBuffers, uint count, const char *query,
+                                uint qlen, int flags, const char *replace, uint rlen,
+                                std::vector<uint> *replaced=nullptr);
@@ -0,0 +1,407 @@
+#include <file_index.h>
+#include <project_search.h>
+#include <file_watcher.h>
+#include <storage.h>
+#include <display.h>
+#include <parallel.h>
+#include <utilities.h>
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+// score of every matched character and bonuses given by its position
+#define FILE_INDEX_SCORE_MATCH        16
+#define FILE_INDEX_SCORE_SEPARATOR    32 // first character of a path component
+#define FILE_INDEX_SCORE_BOUNDARY     24 // after '_', '-', '.' or ' '
+#define FILE_INDEX_SCORE_CAMEL        20 // upper case after lower case
+#define FILE_INDEX_SCORE_CONSECUTIVE  16
+#define FILE_INDEX_SCORE_NAME         48 // the whole query is inside the file name
+#define FILE_INDEX_PENALTY_GAP_START  3
+#define FILE_INDEX_PENALTY_GAP_EXTEND 1
+#define FILE_INDEX_PENALTY_GAP_MAX    24
+
+typedef struct FileIndexEntry{
+    uint offset; // of the path inside the arena
+    uint len;
+    uint name; // start of the file name inside the path
+    uint64 mask; // characters present in the path, see FileIndexCharMask
+}FileIndexEntry;
+
+struct FileIndexSnapshot{
+    std::string root;
+    char *arena; // all paths, NUL terminated
+    char *folded; // the same paths case folded, this is what queries scan
+    std::vector<FileIndexEntry> entries; // sorted by path
+};
+
+struct FileIndex{
+    std::mutex mutex;
+    std::string root;
+    std::shared_ptr<FileIndexSnapshot> snapshot;
+    bool stale; // the tree changed after the last walk started
+    bool updating;
+    std::atomic<uint> generation;
+};
+
+static FileIndex fileIndex = { .stale = false, .updating = false, .generation = 0 };
+
+static inline char FileIndexLower(char c){
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline uint64 FileIndexCharMask(char c){
+    uint8 u = (uint8)c;
+    if(u >= 'a' && u <= 'z') return 1ULL << (u - 'a');
+    if(u >= '0' && u <= '9') return 1ULL << (26 + u - '0');
+    return 1ULL << (36 + u % 28);
+}
+
+static void FileIndexSnapshotFree(FileIndexSnapshot *snapshot){
+    if(snapshot->arena){
+        AllocatorFree(snapshot->arena);
+        AllocatorFree(snapshot->folded);
+    }
+
+    delete snapshot;
+}
+
+/*
+* Packs the paths of 'files', absolute and sorted, relative to 'root'.
+*/
+static std::shared_ptr<FileIndexSnapshot> FileIndexBuild(const std::string &root,
+                                                         const std::vector<std::string> &files)
+{
+    // the walker joins paths with a separator even if the root ends with one
+    uint skip = root.size() + 1;
+    uint total = 1;
+    for(const std::string &file : files){
+        if(file.size() > skip) total += file.size() - skip + 1;
+    }
+
+    FileIndexSnapshot *snapshot = new FileIndexSnapshot;
+    snapshot->root = root;
+    snapshot->arena = AllocatorGetN(char, total);
+    snapshot->folded = AllocatorGetN(char, total);
+    snapshot->entries.reserve(files.size());
+
+    uint at = 0;
+    for(const std::string &file : files){
+        if(file.size() <= skip) continue;
+
+        uint len = file.size() - skip;
+        char *path = &snapshot->arena[at];
+        char *folded = &snapshot->folded[at];
+        uint64 mask = 0;
+        Memcpy(path, (char *)&file[skip], len);
+        path[len] = 0;
+        for(uint i = 0; i <= len; i++){
+            folded[i] = FileIndexLower(path[i]);
+            mask |= FileIndexCharMask(folded[i]);
+        }
+
+        snapshot->entries.push_back({
+            .offset = at,
+            .len = len,
+            .name = GetSimplifiedPathName(path, len),
+            .mask = mask,
+        });
+        at += len + 1;
+    }
+
+    return std::shared_ptr<FileIndexSnapshot>(snapshot, FileIndexSnapshotFree);
+}
+
+/*
+* Walks the tree until it stops changing, the first walk of a change is delayed so
+* that the changes that follow are picked by the same walk.
+*/
+static void FileIndexWalker(bool delayed){
+    while(1){
+        if(delayed){
+            std::chrono::duration<double> interval(FILE_INDEX_REFRESH_INTERVAL);
+            std::this_thread::sleep_for(interval);
+        }
+
+        std::string root;
+        {
+            std::lock_guard<std::mutex> guard(fileIndex.mutex);
+            root = fileIndex.root;
+            fileIndex.stale = false;
+        }
+
+        std::vector<std::string> files;
+        ProjectSearch_ListFiles(root.c_str(), files);
+        // directories created since the last walk must be watched as well
+        FileWatcher_WatchProject(root, files);
+        std::shared_ptr<FileIndexSnapshot> snapshot = FileIndexBuild(root, files);
+
+        bool again = false;
+        {
+            std::lock_guard<std::mutex> guard(fileIndex.mutex);
+            if(fileIndex.root == root){
+                fileIndex.snapshot = snapshot;
+                fileIndex.generation++;
+            }
+
+            again = fileIndex.stale || fileIndex.root != root;
+            if(!again){
+                fileIndex.updating = false;
+            }
+        }
+
+        PostEmptyEvent();
+        if(!again) return;
+
+        delayed = true;
+    }
+}
+
+/*
+* Must be called with the mutex held.
+*/
+static void FileIndexStartWalker(bool delayed){
+    if(fileIndex.updating) return;
+
+    fileIndex.updating = true;
+    std::thread(FileIndexWalker, delayed).detach();
+}
+
+void FileIndex_Refresh(const char *root){
+    StorageDevice *device = FetchStorageDevice();
+    if(!device || !device->IsLocallyStored()) return;
+
+    std::lock_guard<std::mutex> guard(fileIndex.mutex);
+    if(fileIndex.root != root){
+        fileIndex.root = root;
+        fileIndex.snapshot = nullptr;
+        fileIndex.stale = true;
+        fileIndex.generation++;
+    }
+
+    if(fileIndex.snapshot && !fileIndex.stale) return;
+    FileIndexStartWalker(false);
+}
+
+void FileIndex_MarkStale(){
+    std::lock_guard<std::mutex> guard(fileIndex.mutex);
+    if(fileIndex.root.size() == 0) return;
+
+    fileIndex.stale = true;
+    FileIndexStartWalker(true);
+}
+
+int FileIndex_GetFiles(const char *root, std::vector<std::string> &files){
+    std::shared_ptr<FileIndexSnapshot> snapshot;
+    {
+        std::lock_guard<std::mutex> guard(fileIndex.mutex);
+        if(fileIndex.root != root || fileIndex.stale || !fileIndex.snapshot) return 0;
+        snapshot = fileIndex.snapshot;
+    }
+
+    // paths were joined with a separator by the walker, see FileIndexBuild
+    std::string prefix = snapshot->root + SEPARATOR_STRING;
+    files.clear();
+    files.reserve(snapshot->entries.size());
+    for(const FileIndexEntry &entry : snapshot->entries){
+        files.push_back(prefix);
+        files.back().append(&snapshot->arena[entry.offset], entry.len);
+    }
+
+    return 1;
+}
+
+uint FileIndex_GetGeneration(){
+    return fileIndex.generation.load();
+}
+
+/*
+* Finds the shortest window of the case folded path 'folded', starting the search
+* at 'start', that holds the characters of 'query' in order. The position of each
+* character is returned in 'pos'. Returns false in case the path does not contain
+* the query.
+*/
+static bool FileIndexFindWindow(const char *folded, uint start, uint len,
+                                const char *query, uint qlen, uint *pos)
+{
+    uint i = start;
+    for(uint k = 0; k < qlen; k++){
+        const char *p = (const char *)memchr(&folded[i], query[k], len - i);
+        if(!p) return false;
+        i = (uint)(p - folded) + 1;
+    }
+
+    // walking back from the end of the first occurrence gives its tightest start
+    for(uint k = qlen; k > 0; i--){
+        if(folded[i-1] == query[k-1]){
+            pos[--k] = i - 1;
+        }
+    }
+
+    return true;
+}
+
+static int FileIndexScore(const char *path, const uint *pos, uint qlen){
+    int score = 0;
+    for(uint k = 0; k < qlen; k++){
+        uint p = pos[k];
+        char curr = path[p];
+        char prev = p > 0 ? path[p-1] : '/';
+        score += FILE_INDEX_SCORE_MATCH;
+        if(prev == '/' || prev == '\\'){
+            score += FILE_INDEX_SCORE_SEPARATOR;
+        }else if(prev == '_' || prev == '-' || prev == '.' || prev == ' '){
+            score += FILE_INDEX_SCORE_BOUNDARY;
+        }else if(prev >= 'a' && prev <= 'z' && curr >= 'A' && curr <= 'Z'){
+            score += FILE_INDEX_SCORE_CAMEL;
+        }
+
+        if(k > 0){
+            uint gap = p - pos[k-1] - 1;
+            if(gap == 0){
+                score += FILE_INDEX_SCORE_CONSECUTIVE;
+            }else{
+                int penalty = FILE_INDEX_PENALTY_GAP_START +
+                              (gap - 1) * FILE_INDEX_PENALTY_GAP_EXTEND;
+                score -= penalty < FILE_INDEX_PENALTY_GAP_MAX ?
+                         penalty : FILE_INDEX_PENALTY_GAP_MAX;
+            }
+        }
+    }
+
+    return score;
+}
+
+/*
+* Scores the file 'entry' for 'query', returns false in case it does not match.
+*/
+static bool FileIndexMatchEntry(FileIndexSnapshot *snapshot, const FileIndexEntry &entry,
+                                const char *query, uint qlen, uint64 qmask, int *score)
+{
+    uint pos[FILE_INDEX_MAX_QUERY];
+    const char *path = &snapshot->arena[entry.offset];
+    const char *folded = &snapshot->folded[entry.offset];
+    if((entry.mask & qmask) != qmask) return false;
+
+    if(FileIndexFindWindow(folded, entry.name, entry.len, query, qlen, pos)){
+        *score = FileIndexScore(path, pos, qlen) + FILE_INDEX_SCORE_NAME;
+    }else if(FileIndexFindWindow(folded, 0, entry.len, query, qlen, pos)){
+        *score = FileIndexScore(path, pos, qlen);
+    }else{
+        return false;
+    }
+
+    // between equal matches the shorter path is the likely one
+    *score -= (int)(entry.len >> 3);
+    return true;
+}
+
+uint FileIndex_Query(FileIndexQuery *query, const char *str, uint len,
+                     std::vector<FileIndexMatch> &results)
+{
+    std::shared_ptr<FileIndexSnapshot> snapshot;
+    results.clear();
+    {
+        std::lock_guard<std::mutex> guard(fileIndex.mutex);
+        snapshot = fileIndex.snapshot;
+    }
+
+    if(!snapshot){
+        FileIndex_QueryRelease(query);
+        return 0;
+    }
+
+    std::string folded;
+    uint64 qmask = 0;
+    for(uint i = 0; i < len && folded.size() < FILE_INDEX_MAX_QUERY; i++){
+        char c = FileIndexLower(str[i]);
+        folded.push_back(c);
+        qmask |= FileIndexCharMask(c);
+    }
+
+    std::vector<FileIndexEntry> &entries = snapshot->entries;
+    if(folded.size() == 0){
+        uint count = entries.size() < FILE_INDEX_MAX_RESULTS ?
+                     entries.size() : FILE_INDEX_MAX_RESULTS;
+        for(uint i = 0; i < count; i++){
+            results.push_back({ .path = &snapshot->arena[entries[i].offset],
+                                .len = entries[i].len, .score = 0 });
+        }
+
+        query->snapshot = snapshot;
+        query->str.clear();
+        query->candidates.clear();
+        return entries.size();
+    }
+
+    // files not matching a query do not match anything that extends it
+    bool narrow = query->snapshot == snapshot && query->str.size() > 0 &&
+                  folded.compare(0, query->str.size(), query->str) == 0;
+    uint n = narrow ? query->candidates.size() : entries.size();
+    const char *qstr = folded.c_str();
+    uint qlen = folded.size();
+
+    // scores are stored by position so the candidates stay sorted without sorting
+    std::vector<int> scores(n);
+    auto match = [&](uint j, int){
+        uint id = narrow ? query->candidates[j] : j;
+        if(!FileIndexMatchEntry(snapshot.get(), entries[id], qstr, qlen, qmask, &scores[j])){
+            scores[j] = INT_MIN;
+        }
+    };
+
+    if(n < FILE_INDEX_PARALLEL_MIN){
+        for(uint j = 0; j < n; j++){
+            match(j, 0);
+        }
+    }else{
+        ParallelFor("FileIndex Query", 0, n, match);
+    }
+
+    std::vector<std::pair<int, uint>> matched;
+    for(uint j = 0; j < n; j++){
+        if(scores[j] != INT_MIN){
+            matched.push_back({ scores[j], narrow ? query->candidates[j] : j });
+        }
+    }
+
+    query->snapshot = snapshot;
+    query->str = folded;
+    query->candidates.clear();
+    for(std::pair<int, uint> &m : matched){
+        query->candidates.push_back(m.second);
+    }
+
+    uint count = matched.size() < FILE_INDEX_MAX_RESULTS ?
+                 matched.size() : FILE_INDEX_MAX_RESULTS;
+    std::partial_sort(matched.begin(), matched.begin() + count, matched.end(),
+    [&](const std::pair<int, uint> &a, const std::pair<int, uint> &b) -> bool{
+        if(a.first != b.first) return a.first > b.first;
+        if(entries[a.second].len != entries[b.second].len){
+            return entries[a.second].len < entries[b.second].len;
+        }
+        return a.second < b.second;
+    });
+
+    for(uint i = 0; i < count; i++){
+        FileIndexEntry &entry = entries[matched[i].second];
+        results.push_back({ .path = &snapshot->arena[entry.offset],
+                            .len = entry.len, .score = matched[i].first });
+    }
+
+    return matched.size();
+}
+
+std::string FileIndex_GetRoot(FileIndexQuery *query){
+    if(!query->snapshot) return std::string();
+    return query->snapshot->root;
+}
+
+void FileIndex_QueryRelease(FileIndexQuery *query){
+    query->snapshot = nullptr;
+    query->str.clear();
+    query->candidates.clear();
+}
@@ -0,0 +1,99 @@
+/* date = October 19th 2026 23:50 */
+#pragma once
+#include <types.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+// amount of results given back by a query, the best ones first
+#define FILE_INDEX_MAX_RESULTS 256
+// queries are cut at this length, nobody types that much to find a file
+#define FILE_INDEX_MAX_QUERY 128
+// queries over less files than this are not worth splitting across the pool
+#define FILE_INDEX_PARALLEL_MIN 16384
+// seconds waited before walking the tree again after it changed, so that bursts
+// of changes, i.e.: a git checkout, cost a single walk
+#define FILE_INDEX_REFRESH_INTERVAL 1.0
+
+/*
+* Index of the files of the project used to open any of them with a few keystrokes.
+* The tree under the root directory is walked in background with
+* ProjectSearch_ListFiles, so .gitignore rules and hidden entries are respected, and
+* the relative paths are packed into a single arena together with a mask of the
+* characters each one contains. Queries are matched fuzzily: the characters typed
+* must appear in order, matches at the start of path components, after '_', '-' or
+* '.', on camel case humps or next to each other score higher, and matches inside
+* the file name are preferred over the ones in the directories. Paths missing any
+* character of the query are rejected by the mask without being scanned and a
+* query that extends the previous one only scans what the previous one matched.
+*
+* The directories of the tree are watched with the FileWatcher, whenever entries
+* are added or removed the tree is walked again and the new index replaces the
+* current one, which keeps answering queries meanwhile. Only local storage is
+* indexed.
+*/
+
+struct FileIndexSnapshot;
+
+typedef struct FileIndexMatch{
+    const char *path; // relative to the root, valid while the query is not released
+    uint len;
+    int score;
+}FileIndexMatch;
+
+/*
+* State of the queries of a single user session, i.e.: while the list is open. It
+* keeps the index that answered the last query alive so the results can be used.
+*/
+typedef struct FileIndexQuery{
+    std::shared_ptr<FileIndexSnapshot> snapshot;
+    std::string str; // last query, case folded
+    std::vector<uint> candidates; // files matching 'str', sorted
+}FileIndexQuery;
+
+/*
+* Starts indexing the files under 'root' in background, does nothing in case the
+* index of 'root' is up to date or being built. Changing the root drops the
+* current index.
+*/
+void FileIndex_Refresh(const char *root);
+
+/*
+* Notifies that entries were added or removed somewhere in the tree, it is walked
+* again after FILE_INDEX_REFRESH_INTERVAL. Can be called from any thread.
+*/
+void FileIndex_MarkStale();
+
+/*
+* Gets in 'files' the absolute paths of the indexed files of 'root', sorted as
+* given by ProjectSearch_ListFiles. Returns 0 in case there is no index of 'root'
+* or the tree changed since it was walked, in which case the tree must be walked.
+* Can be called from any thread.
+*/
+int FileIndex_GetFiles(const char *root, std::vector<std::string> &files);
+
+/*
+* Gets a counter that changes whenever a new index is available, so that lists
+* showing results know they must query again.
+*/
+uint FileIndex_GetGeneration();
+
+/*
+* Matches 'str' against the indexed files, 'results' gets the best
+* FILE_INDEX_MAX_RESULTS sorted by decreasing score. An empty query gives the first
+* files in path order. Returns the total amount of files matched, 0 in case there
+* is no index yet.
+*/
+uint FileIndex_Query(FileIndexQuery *query, const char *str, uint len,
+                     std::vector<FileIndexMatch> &results);
+
+/*
+* Gets the root directory of the index used by the last call to FileIndex_Query,
+* empty if there was none.
+*/
+std::string FileIndex_GetRoot(FileIndexQuery *query);
+
+/*
+* Releases the index held by 'query', the results can no longer be used.
+*/
+void FileIndex_QueryRelease(FileIndexQuery *query);
@@ -1688,6 +1688,33 @@ void Lex_BuildTokenizer(Tokenizer *tokenizer, SymbolTable *symTable,
     tokenizer->support = *support;
 }
 
+void Lex_ReleaseTokenizer(Tokenizer *tokenizer){
+    AssertA(tokenizer != nullptr, "Invalid tokenizer context given");
+    for(int i = 0; i < tokenizer->contextCount; i++){
+        TokenLookupTable *lookup = tokenizer->contexts[i].lookup;
+        for(int k = 0; k < lookup->nSize; k++){
+            AllocatorFree(lookup->table[k]);
+        }
+
+        AllocatorFree(lookup->table);
+        AllocatorFree(lookup->sizes);
+    }
+
+    if(tokenizer->contextCount > 0){
+        // the lookup tables were taken in a single block
+        AllocatorFree(tokenizer->contexts[0].lookup);
+    }
+
+    AllocatorFree(tokenizer->contexts);
+    AllocatorFree(tokenizer->workContext->workTokenList);
+    AllocatorFree(tokenizer->workContext);
+    AllocatorFree(tokenizer->procStack);
+    tokenizer->contexts = nullptr;
+    tokenizer->contextCount = 0;
+    tokenizer->workContext = nullptr;
+    tokenizer->procStack = nullptr;
+}
+
 void Lex_TokenizerContextReset(Tokenizer *tokenizer){
     tokenizer->unfinishedContext = 0;
     tokenizer->linesAggregated = 0;
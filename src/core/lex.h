@@ -298,6 +298,12 @@ void Lex_BuildTokenizer(Tokenizer *tokenizer, SymbolTable *symTable,
                         std::vector<std::vector<std::vector<GToken>> *> refTables,
                         TokenizerSupport *support);
 
+/*
+* Releases the memory taken by a tokenizer created with Lex_BuildTokenizer, the
+* symbol table is not touched.
+*/
+void Lex_ReleaseTokenizer(Tokenizer *tokenizer);
+
 /*
 * Pushes a new token into the given lookup table.
 */
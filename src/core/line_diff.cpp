@@ -0,0 +1,262 @@
+#include <line_diff.h>
+#include <buffers.h>
+#include <lex.h>
+#include <undo.h>
+#include <string.h>
+#include <algorithm>
+
+static uint64_t LineDiffHash(const char *data, uint size){
+    uint64_t hash = 14695981039346656037ULL;
+    for(uint i = 0; i < size; i++){
+        hash ^= (uint8_t)data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static bool LineDiffEqual(const LineDiffLine &a, const LineDiffLine &b){
+    return a.hash == b.hash && a.size == b.size &&
+           (a.size == 0 || memcmp(a.data, b.data, a.size) == 0);
+}
+
+static void LineDiffCollect(char **p, uint size, uint lineNr, uint at,
+                            uint total, void *prv)
+{
+    std::vector<LineDiffLine> *lines = (std::vector<LineDiffLine> *)prv;
+    lines->push_back({
+        .data = *p,
+        .size = size - 1,
+        .hash = LineDiffHash(*p, size - 1),
+    });
+}
+
+void LineDiff_Split(char *content, uint size, std::vector<LineDiffLine> &lines){
+    lines.clear();
+    if(content && size > 0){
+        Lex_LineProcess(content, size, LineDiffCollect, 0, &lines, false);
+    }
+
+    if(lines.size() == 0){
+        lines.push_back({ .data = nullptr, .size = 0, .hash = LineDiffHash(nullptr, 0) });
+    }
+}
+
+/*
+* Myers' diff of a[aStart, aStart+n) against b[bStart, bStart+m). Only the furthest
+* reaching paths of each step are kept, so the memory is quadratic in the amount of
+* edits and not in the size of the texts. Returns false if more than
+* LINE_DIFF_MAX_EDITS are needed.
+*/
+static bool LineDiffMyers(const std::vector<LineDiffLine> &a, uint aStart, int n,
+                          const std::vector<LineDiffLine> &b, uint bStart, int m,
+                          std::vector<LineDiffHunk> &hunks)
+{
+    std::vector<std::vector<int>> trace;
+    int maxD = n + m < LINE_DIFF_MAX_EDITS ? n + m : LINE_DIFF_MAX_EDITS;
+    int found = -1;
+    // furthest x on diagonal k after step d is trace[d][k + d]
+    auto furthest = [&](int d, int k) -> int{
+        if(d < 0) return 0;
+        return trace[d][k + d];
+    };
+
+    for(int d = 0; d <= maxD && found < 0; d++){
+        std::vector<int> v(2 * d + 1, 0);
+        for(int k = -d; k <= d; k += 2){
+            int x = 0;
+            if(d == 0){
+                x = 0;
+            }else if(k == -d || (k != d && furthest(d-1, k-1) < furthest(d-1, k+1))){
+                x = furthest(d-1, k+1);
+            }else{
+                x = furthest(d-1, k-1) + 1;
+            }
+
+            int y = x - k;
+            while(x < n && y < m && LineDiffEqual(a[aStart + x], b[bStart + y])){
+                x++;
+                y++;
+            }
+
+            v[k + d] = x;
+            if(x >= n && y >= m){
+                found = d;
+            }
+        }
+
+        trace.push_back(std::move(v));
+    }
+
+    if(found < 0) return false;
+
+    // walk back collecting the matched lines, the gaps between them are the hunks
+    std::vector<std::pair<int, int>> matches;
+    int x = n, y = m;
+    for(int d = found; d > 0; d--){
+        int k = x - y;
+        bool down = k == -d || (k != d && furthest(d-1, k-1) < furthest(d-1, k+1));
+        int pk = down ? k + 1 : k - 1;
+        int px = furthest(d-1, pk);
+        // the position right after the insertion or deletion of this step
+        int sx = down ? px : px + 1;
+        while(x > sx && y > sx - k){
+            x--;
+            y--;
+            matches.push_back({x, y});
+        }
+
+        x = px;
+        y = px - pk;
+    }
+
+    while(x > 0 && y > 0){
+        x--;
+        y--;
+        matches.push_back({x, y});
+    }
+
+    std::reverse(matches.begin(), matches.end());
+    matches.push_back({n, m});
+
+    int i = 0, j = 0;
+    for(std::pair<int, int> &match : matches){
+        if(match.first > i || match.second > j){
+            hunks.push_back({
+                .oldLine = aStart + i,
+                .oldCount = (uint)(match.first - i),
+                .newLine = bStart + j,
+                .newCount = (uint)(match.second - j),
+            });
+        }
+
+        i = match.first + 1;
+        j = match.second + 1;
+    }
+
+    return true;
+}
+
+void LineDiff_Compute(const std::vector<LineDiffLine> &a, const std::vector<LineDiffLine> &b,
+                      std::vector<LineDiffHunk> &hunks)
+{
+    uint n = a.size(), m = b.size();
+    uint prefix = 0, suffix = 0;
+    hunks.clear();
+
+    while(prefix < n && prefix < m && LineDiffEqual(a[prefix], b[prefix])){
+        prefix++;
+    }
+
+    while(suffix < n - prefix && suffix < m - prefix &&
+          LineDiffEqual(a[n - 1 - suffix], b[m - 1 - suffix]))
+    {
+        suffix++;
+    }
+
+    int dn = (int)(n - prefix - suffix);
+    int dm = (int)(m - prefix - suffix);
+    if(dn == 0 && dm == 0) return;
+
+    if(!LineDiffMyers(a, prefix, dn, b, prefix, dm, hunks)){
+        hunks.clear();
+        hunks.push_back({
+            .oldLine = prefix,
+            .oldCount = (uint)dn,
+            .newLine = prefix,
+            .newCount = (uint)dm,
+        });
+    }
+}
+
+/*
+* Replaces the old lines of 'hunk' by the new ones. Lines present in both are
+* rewritten in place, extra lines are appended and rotated into position and
+* missing ones removed, so the cost does not depend on the amount of lines moved.
+*/
+static void LineDiffApplyHunk(LineBuffer *lineBuffer, SymbolTable *symTable,
+                              const LineDiffHunk &hunk, const std::vector<LineDiffLine> &b)
+{
+    EncoderDecoder *encoder = LineBuffer_GetEncoderDecoder(lineBuffer);
+    uint at = hunk.oldLine;
+    uint common = hunk.oldCount < hunk.newCount ? hunk.oldCount : hunk.newCount;
+    for(uint i = 0; i < common; i++){
+        Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, at + i);
+        const LineDiffLine &line = b[hunk.newLine + i];
+        Buffer_EraseSymbols(buffer, symTable);
+        Buffer_SoftClear(buffer, encoder);
+        if(line.size > 0){
+            Buffer_InsertRawStringAt(buffer, 0, (char *)line.data, line.size, encoder);
+        }
+        Buffer_Claim(buffer);
+    }
+
+    at += common;
+    if(hunk.newCount > hunk.oldCount){
+        uint count = lineBuffer->lineCount;
+        for(uint i = common; i < hunk.newCount; i++){
+            const LineDiffLine &line = b[hunk.newLine + i];
+            LineBuffer_InsertLine(lineBuffer, (char *)line.data, line.size);
+        }
+
+        Buffer **lines = lineBuffer->lines;
+        std::rotate(&lines[at], &lines[count], &lines[lineBuffer->lineCount]);
+    }else if(hunk.oldCount > hunk.newCount){
+        uint n = hunk.oldCount - common;
+        for(uint i = at; i < at + n; i++){
+            Buffer_EraseSymbols(LineBuffer_GetBufferAt(lineBuffer, i), symTable);
+        }
+
+        // the last line is never removed, when it goes away the line that ends up
+        // last is swapped into its place first
+        if(at + n == lineBuffer->lineCount){
+            AssertA(at > 0, "Invalid removal of every line");
+            Buffer **lines = lineBuffer->lines;
+            std::swap(lines[at - 1], lines[lineBuffer->lineCount - 1]);
+            at -= 1;
+        }
+
+        LineBuffer_RemoveLines(lineBuffer, at, n);
+    }
+}
+
+uint LineDiff_Apply(LineBuffer *lineBuffer, Tokenizer *tokenizer, char *content, uint size){
+    std::vector<LineDiffLine> a, b;
+    std::vector<LineDiffHunk> hunks;
+    SymbolTable *symTable = tokenizer->symbolTable;
+    for(uint i = 0; i < lineBuffer->lineCount; i++){
+        Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, i);
+        a.push_back({
+            .data = buffer->data,
+            .size = buffer->taken,
+            .hash = LineDiffHash(buffer->data, buffer->taken),
+        });
+    }
+
+    LineDiff_Split(content, size, b);
+    LineDiff_Compute(a, b, hunks);
+    if(hunks.size() == 0) return 0;
+
+    // the first line always starts from the initial state of the tokenizer, keep
+    // it in case the line is replaced by a new one
+    TokenizerStateContext initial = lineBuffer->lines[0]->stateContext;
+
+    // bottom up so that the positions of the hunks above remain valid, hunks are
+    // sorted so after all of them the new positions are the actual ones
+    for(uint i = hunks.size(); i > 0; i--){
+        LineDiffApplyHunk(lineBuffer, symTable, hunks[i-1], b);
+    }
+
+    lineBuffer->lines[0]->stateContext = initial;
+
+    for(LineDiffHunk &hunk : hunks){
+        // start at the line before so the state flowing into the hunk is restored
+        uint base = hunk.newLine > 0 ? hunk.newLine - 1 : 0;
+        uint offset = hunk.newLine - base + hunk.newCount;
+        if(base >= lineBuffer->lineCount) base = lineBuffer->lineCount - 1;
+        LineBuffer_ReTokenizeFromBuffer(lineBuffer, tokenizer, base, offset);
+    }
+
+    UndoRedoCleanup(&lineBuffer->undoRedo);
+    return hunks.size();
+}
@@ -0,0 +1,54 @@
+/* date = October 19th 2026 22:10 */
+#pragma once
+#include <types.h>
+#include <string>
+#include <vector>
+
+struct LineBuffer;
+struct Tokenizer;
+
+// edit distance up to which the changed region is split into separate hunks,
+// past it the whole region is replaced as a single hunk
+#define LINE_DIFF_MAX_EDITS 512
+
+/*
+* A line view of some text, the pointers refer to storage owned by someone else.
+*/
+typedef struct LineDiffLine{
+    const char *data;
+    uint size;
+    uint64_t hash;
+}LineDiffLine;
+
+/*
+* Replaces the lines [oldLine, oldLine + oldCount) of the old text by the lines
+* [newLine, newLine + newCount) of the new text.
+*/
+typedef struct LineDiffHunk{
+    uint oldLine;
+    uint oldCount;
+    uint newLine;
+    uint newCount;
+}LineDiffHunk;
+
+/*
+* Splits 'content' into lines exactly as it is done when loading a file into a
+* LineBuffer. Empty contents give a single empty line.
+*/
+void LineDiff_Split(char *content, uint size, std::vector<LineDiffLine> &lines);
+
+/*
+* Computes in 'hunks', sorted, the changes that turn 'a' into 'b'. Common leading
+* and trailing lines are skipped and the remaining region is diffed with Myers'
+* algorithm over the line hashes, see LINE_DIFF_MAX_EDITS.
+*/
+void LineDiff_Compute(const std::vector<LineDiffLine> &a, const std::vector<LineDiffLine> &b,
+                      std::vector<LineDiffHunk> &hunks);
+
+/*
+* Updates 'lineBuffer' to hold 'content', as read from its file, changing only the
+* lines that differ and re-tokenizing only around them. The undo history is
+* dropped as it no longer matches the contents. Must be called from the main
+* thread. Returns the amount of hunks applied, 0 if nothing changed.
+*/
+uint LineDiff_Apply(LineBuffer *lineBuffer, Tokenizer *tokenizer, char *content, uint size);
@@ -72,6 +72,17 @@ class LRUCache{
         cache.insert(std::make_pair(key, std::make_pair(item, order.begin())));
     }
 
+    void erase(KeyType key){
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(key);
+        if(it == cache.end()) return;
+
+        lru_print("[LRU-erase] Erasing key '" << printKey(key) << "'");
+        cleanup(it->second.first);
+        order.erase(it->second.second);
+        cache.erase(it);
+    }
+
 #if defined(LRU_CACHE_DEBUG)
     void set_dbg_functions(std::function<std::string(ItemType)> itemPrnt,
                            std::function<std::string(KeyType)> keyPrnt)
@@ -0,0 +1,89 @@
+#include <match_set.h>
+#include <buffers.h>
+#include <string.h>
+
+// lines with more matches than this only display the first ones
+#define MATCH_SET_MAX_PER_LINE 32
+
+// generation 0 is never used so that fresh buffers are always stale
+static uint matchSetGeneration = 0;
+
+void MatchSet_Clear(LineBuffer *lineBuffer){
+    MatchSet *set = lineBuffer ? lineBuffer->matchSet : nullptr;
+    if(!set) return;
+
+    SearchQuery_Release(&set->query);
+    AllocatorFree(set->str);
+    AllocatorFree(set);
+    lineBuffer->matchSet = nullptr;
+}
+
+void MatchSet_Set(LineBuffer *lineBuffer, const char *str, uint len, int flags){
+    if(!lineBuffer) return;
+
+    MatchSet *set = lineBuffer->matchSet;
+    if(set && set->len == len && set->flags == flags && memcmp(set->str, str, len) == 0){
+        return;
+    }
+
+    MatchSet_Clear(lineBuffer);
+    if(len == 0) return;
+
+    set = AllocatorGetN(MatchSet, 1);
+    set->str = AllocatorGetN(char, len + 1);
+    memcpy(set->str, str, len);
+    set->str[len] = 0;
+    set->len = len;
+    set->flags = flags;
+    set->generation = ++matchSetGeneration;
+    if(set->generation == 0){
+        set->generation = ++matchSetGeneration;
+    }
+
+    SearchQuery_Compile(&set->query, str, len, flags);
+    lineBuffer->matchSet = set;
+}
+
+uint MatchSet_GetLine(LineBuffer *lineBuffer, uint line, uint **matches){
+    MatchSet *set = lineBuffer ? lineBuffer->matchSet : nullptr;
+    Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, line);
+    *matches = nullptr;
+    if(!set || !buffer || !set->query.valid) return 0;
+
+    if(buffer->matchGeneration != set->generation){
+        uint found[2 * MATCH_SET_MAX_PER_LINE];
+        uint count = 0;
+        uint from = 0;
+        uint matchLen = 0;
+        int at = 0;
+        while(count < 2 * MATCH_SET_MAX_PER_LINE &&
+              (at = SearchQuery_Find(&set->query, buffer->data, buffer->taken,
+                                     from, &matchLen)) >= 0)
+        {
+            // empty matches cannot be displayed
+            if(matchLen > 0){
+                found[count++] = (uint)at;
+                found[count++] = matchLen;
+            }
+
+            from = (uint)at + (matchLen > 0 ? matchLen : 1);
+            if(from > buffer->taken) break;
+        }
+
+        if(buffer->matches){
+            AllocatorFree(buffer->matches);
+            buffer->matches = nullptr;
+        }
+
+        if(count > 0){
+            buffer->matches = AllocatorGetN(uint, count);
+            memcpy(buffer->matches, found, count * sizeof(uint));
+        }
+
+        buffer->matchCount = count / 2;
+        buffer->matchGeneration = set->generation;
+    }
+
+    *matches = buffer->matches;
+    return buffer->matchCount;
+}
@@ -0,0 +1,42 @@
+/* date = October 19th 2026 18:20 */
+#pragma once
+#include <types.h>
+#include <search.h>
+
+struct LineBuffer;
+
+/*
+* Incremental set of the matches of a query inside a LineBuffer, used to highlight
+* every occurrence of the current search. Matches are not kept in a global list,
+* each Buffer stores the matches of its own line together with the generation of
+* the set that computed them. When a line is re-tokenized after an edit
+* (Buffer_UpdateTokens) its matches are dropped, so only the lines the tokenizer
+* touched are scanned again and only when someone asks for them, i.e.: when they
+* become visible. Since the matches travel with the Buffer inserting or removing
+* lines requires no bookkeeping.
+*/
+typedef struct MatchSet{
+    SearchQuery query;
+    char *str;
+    uint len;
+    int flags;
+    uint generation;
+}MatchSet;
+
+/*
+* Sets the query highlighted in 'lineBuffer'. Does nothing if the same query is
+* already active. An empty query clears the set.
+*/
+void MatchSet_Set(LineBuffer *lineBuffer, const char *str, uint len, int flags);
+
+/*
+* Releases the match set of 'lineBuffer', if any.
+*/
+void MatchSet_Clear(LineBuffer *lineBuffer);
+
+/*
+* Gets the matches of the line 'line', returned in 'matches' as pairs of raw
+* (position, length). The line is scanned only if it changed since the last call.
+* Returns the amount of matches, 0 if there is no active set.
+*/
+uint MatchSet_GetLine(LineBuffer *lineBuffer, uint line, uint **matches);
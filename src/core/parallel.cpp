@@ -4,10 +4,34 @@
 #include <symbol.h>
 #include <file_provider.h>
 #include <sstream>
+#include <deque>
 #include <storage.h>
+#include <display.h>
 
 #define CMD_EXIT "__internal_exit__"
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#if !defined(_WIN32)
+#include <spawn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <string.h>
+extern char **environ;
+#endif
+
+// output of commands is read in chunks of this size
+#define EXECUTOR_READ_SIZE (64 * 1024)
+#define EXECUTOR_PIPE_SIZE (1024 * 1024)
+#define EXECUTOR_STDOUT 0
+#define EXECUTOR_STDERR 1
+
 #if defined(_WIN32)
 #include <Windows.h>
 #include <cstdio>
@@ -85,113 +109,295 @@ struct BuildParseCtx{
 };
 
 struct BuildErrorInformation{
-    std::vector<BuildError> errors;
+    BuildErrorSet set;
     int visited;
     std::mutex mutex;
 };
 
-ConcurrentQueue<std::string> commandQ;
-LockedLineBuffer lockedBuffer;
+struct CommandSession{
+    std::string name;
+    LockedLineBuffer output;
+    // commands are only pushed by the main thread and run by the session thread
+    ConcurrentQueue<std::string, SPSCRing<std::string>> commands;
+    std::atomic<int> running; // commands queued or running
+    std::atomic<int> exitStatus;
+    std::atomic<long> pid; // process group of the running command, 0 if none
+    std::atomic<int> killed;
+    std::atomic<int> finished; // the session thread exited
+    // output limits, only used by the main thread
+    uint maxLines;
+    uint64_t maxBytes;
+    // file receiving the full output, empty if disabled
+    std::mutex spillMutex;
+    std::string spillPath;
+};
+
+// sessions are created by the main thread and never destroyed before exit
+static std::vector<CommandSession *> commandSessions;
+static CommandSession *lastSession = nullptr;
 BuildErrorInformation buildErrors;
 
+static void BuildErrorSet_Clear(BuildErrorSet *set, uint generation){
+    set->errors.clear();
+    set->files.clear();
+    set->generation = generation;
+    set->version++;
+}
+
+/*
+* Adds 'err' to the set unless its line already has an error, returns true if it
+* was added.
+*/
+static bool BuildErrorSet_Push(BuildErrorSet *set, const BuildError &err){
+    uint line = err.line > 0 ? (uint)err.line - 1 : 0;
+    BuildErrorLines &lines = set->files[err.file];
+    if(!lines.emplace(line, (uint)set->errors.size()).second){
+        return false;
+    }
+
+    set->errors.push_back(err);
+    set->version++;
+    return true;
+}
+
+const BuildErrorLines *BuildErrorSet_GetFile(const BuildErrorSet *set,
+                                             const std::string &path)
+{
+    auto it = set->files.find(path);
+    return it != set->files.end() ? &it->second : nullptr;
+}
+
+const BuildError *BuildErrorSet_Get(const BuildErrorSet *set, const BuildErrorLines *lines,
+                                    uint line)
+{
+    if(!lines) return nullptr;
+    auto it = lines->find(line);
+    return it != lines->end() ? &set->errors[it->second] : nullptr;
+}
+
 void ClearBuildErrors(){
     std::unique_lock<std::mutex> guard(buildErrors.mutex);
-    buildErrors.errors.clear();
+    BuildErrorSet_Clear(&buildErrors.set, buildErrors.set.generation + 1);
     buildErrors.visited = -1;
 }
 
 std::optional<BuildError> NextBuildError(){
+    std::unique_lock<std::mutex> guard(buildErrors.mutex);
+    std::vector<BuildError> &errors = buildErrors.set.errors;
     std::optional<BuildError> err = {};
-    if(buildErrors.errors.size() > 0){
+    if(errors.size() > 0){
         if(buildErrors.visited < 0){
             buildErrors.visited = 0;
         }else{
-            buildErrors.visited = (buildErrors.visited+1) % buildErrors.errors.size();
+            buildErrors.visited = (buildErrors.visited+1) % errors.size();
         }
 
-        err = std::optional<BuildError>(buildErrors.errors[buildErrors.visited]);
+        err = std::optional<BuildError>(errors[buildErrors.visited]);
     }
     return err;
 }
 
 std::optional<BuildError> PreviousBuildError(){
+    std::unique_lock<std::mutex> guard(buildErrors.mutex);
+    std::vector<BuildError> &errors = buildErrors.set.errors;
     std::optional<BuildError> err = {};
-    if(buildErrors.errors.size() > 0){
+    if(errors.size() > 0){
         if(buildErrors.visited > 0){
             buildErrors.visited -= 1;
         }else{
-            buildErrors.visited = buildErrors.errors.size();
+            buildErrors.visited = errors.size() - 1;
         }
-        printf("Looking for %d\n", buildErrors.visited);
-        err = std::optional<BuildError>(buildErrors.errors[buildErrors.visited]);
+
+        err = std::optional<BuildError>(errors[buildErrors.visited]);
     }
     return err;
 }
 
-static void BuildBufferSoftClear(int is_build){
-    std::unique_lock<std::mutex> guard(lockedBuffer.mutex);
-    LineBuffer_Free(lockedBuffer.lineBuffer);
-    LineBuffer_AllocateInternal(lockedBuffer.lineBuffer);
+static void SessionBufferSoftClear(CommandSession *session, int is_build){
+    LockedLineBuffer *output = &session->output;
+    {
+        // output of the previous command that was not displayed yet
+        std::lock_guard<std::mutex> guard(output->pendingMutex);
+        output->pending.clear();
+        output->pendingDone = 0;
+    }
+
+    std::unique_lock<std::mutex> guard(output->mutex);
+    LineBuffer_Free(output->lineBuffer);
+    LineBuffer_AllocateInternal(output->lineBuffer);
+    output->bytes = 0;
+    output->dropped = 0;
     if(is_build){
         ClearBuildErrors();
     }
 }
 
-static int execution_done = 1;
 int ExecuteCommandDone(){
-    return execution_done;
+    for(CommandSession *session : commandSessions){
+        if(session->running > 0) return 0;
+    }
+
+    return 1;
 }
 
-template<typename Fn> int ExecuteCommand(std::string cmd, const Fn &callback){
+#if defined(_WIN32)
+/*
+* Runs 'cmd' calling callback(data, size, stream) with its output, stderr is merged
+* into stdout. Returns the exit status of the command once it finishes, -1 if it
+* could not run. Commands started with popen cannot be killed.
+*/
+template<typename Fn> static int ExecutorRun(CommandSession *, std::string cmd,
+                                             const Fn &callback)
+{
     int rv = -1;
-    char buffer[64];
+    std::vector<char> buffer(EXECUTOR_READ_SIZE);
     cmd += " 2>&1";
     FILE *fp = popen(cmd.c_str(), "r");
     if(!fp){
         return rv;
     }
 
-    execution_done = 0;
     try{
-        memset(buffer, 0, sizeof(buffer));
-        while(fgets(buffer, sizeof(buffer), fp) != NULL){
-            callback(StringReplace(std::string(buffer), "\\n", "\n"), 0);
+        size_t n = 0;
+        while((n = fread(buffer.data(), 1, buffer.size(), fp)) > 0){
+            callback(buffer.data(), (uint)n, EXECUTOR_STDOUT);
         }
-
-        callback(std::string(), 1);
-        rv = 0;
     }catch(...){
         pclose(fp);
         fp = NULL;
     }
 
     if(fp){
-        pclose(fp);
+        rv = pclose(fp);
     }
 
-    execution_done = 1;
     return rv;
 }
+#else
+/*
+* Runs 'cmd' through the shell with stdout and stderr on separate non-blocking
+* pipes, both are drained in large reads as soon as poll says they have data and
+* callback(data, size, stream) is called for each read. The command gets its own
+* process group, stored in the session, so that killing it also kills whatever it
+* started. Returns the exit status of the command once it finishes, -1 if it could
+* not run.
+*/
+template<typename Fn> static int ExecutorRun(CommandSession *session, std::string cmd,
+                                             const Fn &callback)
+{
+    int pipes[2][2] = { { -1, -1 }, { -1, -1 } };
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    std::vector<char> buffer(EXECUTOR_READ_SIZE);
+    pid_t pid = 0;
+    int status = 0;
+    int open = 0;
+    char *argv[] = { (char *)"sh", (char *)"-c", (char *)cmd.c_str(), nullptr };
 
-void FetchBuildErrors(std::vector<BuildError> &errors){
-    std::unique_lock<std::mutex> guard(buildErrors.mutex);
-    for(BuildError &err : buildErrors.errors){
-        errors.push_back(err);
+    for(int i = 0; i < 2; i++){
+        if(pipe2(pipes[i], O_CLOEXEC) != 0){
+            for(int k = 0; k < i; k++){
+                close(pipes[k][0]);
+                close(pipes[k][1]);
+            }
+            return -1;
+        }
     }
-}
 
-void PushBuildErrors(BuildError *err){
-    std::unique_lock<std::mutex> guard(buildErrors.mutex);
-    bool insert = true;
-    for(BuildError &e : buildErrors.errors){
-        if(e.file == err->file && e.line == err->line){
-            insert = false;
+    // dup2 clears close-on-exec so the child only keeps 1 and 2, it does not get
+    // our stdin either
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, pipes[EXECUTOR_STDOUT][1], 1);
+    posix_spawn_file_actions_adddup2(&actions, pipes[EXECUTOR_STDERR][1], 2);
+
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+
+    int rc = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    struct pollfd fds[2];
+    for(int i = 0; i < 2; i++){
+        close(pipes[i][1]);
+        fcntl(pipes[i][0], F_SETFL, fcntl(pipes[i][0], F_GETFL) | O_NONBLOCK);
+#if defined(F_SETPIPE_SZ)
+        // a larger pipe lets verbose commands run ahead of us, might be refused
+        fcntl(pipes[i][0], F_SETPIPE_SZ, EXECUTOR_PIPE_SIZE);
+#endif
+        fds[i] = { .fd = pipes[i][0], .events = POLLIN, .revents = 0 };
+    }
+
+    if(rc != 0){
+        close(pipes[0][0]);
+        close(pipes[1][0]);
+        return -1;
+    }
+
+    session->pid = (long)pid;
+    open = 2;
+    while(open > 0){
+        if(poll(fds, 2, -1) < 0){
+            if(errno == EINTR) continue;
             break;
         }
+
+        for(int i = 0; i < 2; i++){
+            if(fds[i].fd < 0 || fds[i].revents == 0) continue;
+
+            ssize_t n = 0;
+            while((n = read(fds[i].fd, buffer.data(), buffer.size())) > 0){
+                callback(buffer.data(), (uint)n, i);
+            }
+
+            if(n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)){
+                close(fds[i].fd);
+                fds[i].fd = -1; // poll ignores negative descriptors
+                open--;
+            }
+        }
+    }
+
+    for(int i = 0; i < 2; i++){
+        if(fds[i].fd >= 0) close(fds[i].fd);
+    }
+
+    // the group id cannot be reused before the child is reaped so killing is
+    // safe up to here
+    session->pid = 0;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR){}
+
+    if(WIFEXITED(status)) return WEXITSTATUS(status);
+    if(WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+}
+#endif
+
+int FetchBuildErrors(BuildErrorSet *set){
+    std::unique_lock<std::mutex> guard(buildErrors.mutex);
+    BuildErrorSet *src = &buildErrors.set;
+    if(set->version == src->version && set->generation == src->generation){
+        return 0;
+    }
+
+    if(set->generation != src->generation){
+        BuildErrorSet_Clear(set, src->generation);
+    }
+
+    // errors are only appended until the set is cleared
+    for(uint i = set->errors.size(); i < src->errors.size(); i++){
+        BuildErrorSet_Push(set, src->errors[i]);
     }
 
-    if(insert){
-        buildErrors.errors.push_back(*err);
+    set->version = src->version;
+    return 1;
+}
+
+void PushBuildErrors(BuildError *err){
+    std::unique_lock<std::mutex> guard(buildErrors.mutex);
+    if(BuildErrorSet_Push(&buildErrors.set, *err)){
 #if defined(DEBUG_BUILD)
         printf("%s:%d => %s\n", err->file.c_str(), err->line, err->message.c_str());
 #endif
@@ -299,7 +505,7 @@ void print_state(std::string &msg, BuildParseCtx &parseCtx){
 }
 
 // TODO: This routine is really terrible, re-do!
-void build_process_line(std::string line, BuildParseCtx &parseCtx){
+void build_process_line(const std::string &line, BuildParseCtx &parseCtx){
     if(parseCtx.pstate == 0){
         if(line.find(": error:") != std::string::npos){
             parseCtx.currMessage += line;
@@ -363,98 +569,860 @@ void build_process_line(std::string line, BuildParseCtx &parseCtx){
     }
 }
 
-static int state = 1;
-void ExecutorMainLoop(){
+/*
+* Splits the output of one stream of a command in lines, incomplete lines are kept
+* until the rest arrives so that the streams never get mixed in the middle of a line.
+*/
+struct ExecutorStream{
+    std::string line;
+    BuildParseCtx parseCtx;
+};
+
+/*
+* Feeds the output 'data' of 'stream' to the build parser, if 'is_build', and moves
+* its complete lines to the pending output, see ExecutorFlushOutput.
+*/
+static void ExecutorStreamPush(ExecutorStream *stream, const char *data, uint size,
+                               bool is_build, std::string &out)
+{
+    uint where = 0;
+    std::string &line = stream->line;
+    for(uint i = 0; i < size; i++){
+        if(data[i] == '\n'){
+            line.append(&data[where], i - where);
+            if(is_build){
+                build_process_line(line, stream->parseCtx);
+            }
+
+            out.append(line);
+            out.push_back('\n');
+            line.clear();
+            where = i + 1;
+        }
+    }
+
+    if(where < size){
+        line.append(&data[where], size - where);
+    }
+}
+
+static void ExecutorStreamFinish(ExecutorStream *stream, bool is_build, std::string &out){
+    if(stream->line.size() > 0){
+        if(is_build){
+            build_process_line(stream->line, stream->parseCtx);
+        }
+
+        out.append(stream->line);
+        stream->line.clear();
+    }
+
+    if(is_build){
+        // the last message is only parsed once the next one starts
+        print_state(stream->parseCtx.currMessage, stream->parseCtx);
+    }
+}
+
+/*
+* Appends 'out' to the pending output of the command and wakes the UI in case it
+* was not woken since the last flush, so it is woken at most once per frame.
+*/
+static void ExecutorPublish(LockedLineBuffer *output, FILE *spill, std::string &out,
+                            bool done)
+{
+    bool wake = false;
+    if(out.size() == 0 && !done) return;
+
+    if(spill && out.size() > 0){
+        fwrite(out.c_str(), 1, out.size(), spill);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(output->pendingMutex);
+        wake = output->pending.size() == 0 && !output->pendingDone;
+        output->pending.append(out);
+        output->pendingDone |= done ? 1 : 0;
+    }
+
+    out.clear();
+    if(wake || done){
+        PostEmptyEvent();
+    }
+}
+
+static void ExecutorMainLoop(CommandSession *session){
+    LockedLineBuffer *output = &session->output;
     while(1){
-        std::string cmd = commandQ.pop();
+        std::string cmd = session->commands.pop();
         if(cmd.size() > 0){
             if(cmd == std::string(CMD_EXIT)) break;
-            std::string runningLine;
-            BuildParseCtx parseCtx = {
-                .currMessage = std::string(),
-                .lastState = 0,
-                .pstate = 0,
-                .depends = 0,
-                .lastFile = std::string()
-            };
+            ExecutorStream streams[2] = {};
+            std::string out;
+            std::string replaced;
 
             bool is_build = IsBuildCommand(cmd);
 
-            BuildBufferSoftClear(is_build);
-
-            ExecuteCommand(cmd, [&](std::string msg, int done) -> void{
-                LineBuffer *lineBuffer = lockedBuffer.lineBuffer;
-                char *text = (char *)msg.c_str();
-                uint size = msg.size();
-                uint start = lineBuffer->lineCount-1;
-                if(is_build){
-                    uint where = 0;
-                    for(uint i = 0; i < msg.size(); i++){
-                        if(msg[i] == '\n'){
-                            int d = i - where;
-                            if(d > 0){
-                                runningLine += msg.substr(where, i);
-                                where = i+1;
-                            }else{
-                                where = msg.size();
-                            }
-                            build_process_line(runningLine, parseCtx);
-                            runningLine.clear();
-                        }
-                    }
+            session->killed = 0;
+            session->exitStatus = -1;
+            SessionBufferSoftClear(session, is_build);
 
-                    if(where < msg.size()){
-                        runningLine += msg.substr(where);
-                    }
+            FILE *spill = nullptr;
+            {
+                std::lock_guard<std::mutex> guard(session->spillMutex);
+                if(session->spillPath.size() > 0){
+                    spill = fopen(session->spillPath.c_str(), "wb");
                 }
+            }
 
-                lockedBuffer.mutex.lock();
-                uint n = LineBuffer_InsertRawText(lineBuffer, text, size);
-                // the fast gen is in-place and does not require a tokenizer
-                LineBuffer_FastTokenGen(lineBuffer, start, n);
-                if(done){
-                    lockedBuffer.render_state = 1;
-                    if(is_build && runningLine.size() > 0){
-                        build_process_line(runningLine, parseCtx);
-                    }
-                }else{
-                    lockedBuffer.render_state = 0;
+            int status = ExecutorRun(session, cmd,
+                            [&](const char *data, uint size, int stream) -> void{
+                // escaped line breaks are displayed as line breaks
+                if(memchr(data, '\\', size)){
+                    replaced = StringReplace(std::string(data, size), "\\n", "\n");
+                    data = replaced.c_str();
+                    size = replaced.size();
                 }
 
-                lockedBuffer.mutex.unlock();
+                ExecutorStreamPush(&streams[stream], data, size, is_build, out);
+                ExecutorPublish(output, spill, out, false);
             });
+
+            for(ExecutorStream &stream : streams){
+                ExecutorStreamFinish(&stream, is_build, out);
+            }
+
+            // successful commands keep their output untouched
+            if(session->killed){
+                out += "\n[" + session->name + "] killed\n";
+            }else if(status != 0){
+                out += "\n[" + session->name + "] exited with status " +
+                        std::to_string(status) + "\n";
+            }
+
+            session->exitStatus = status;
+            ExecutorPublish(output, spill, out, true);
+            if(spill){
+                fclose(spill);
+            }
+
+            session->running--;
+            // let the UI drop the running indicator
+            PostEmptyEvent();
         }else{
             printf("Got empty cmd\n");
         }
     }
 
-    state = 1;
+    session->finished = 1;
 }
 
-int ExecuteCommand(std::string cmd){
-    commandQ.push(cmd);
+/*
+* Drops the oldest lines of the output of 'session' if it went over its limits,
+* must be called with the output locked. The first line is replaced by a note of
+* how many lines were dropped.
+*/
+static void SessionOutputTrim(CommandSession *session){
+    LockedLineBuffer *output = &session->output;
+    LineBuffer *lineBuffer = output->lineBuffer;
+    uint maxLines = session->maxLines;
+    uint64_t maxBytes = session->maxBytes;
+    // the note is at line 0 after the first drop
+    uint first = output->dropped > 0 ? 1 : 0;
+    uint drop = 0;
+
+    // the last line is the one receiving output, it is never dropped
+    if(lineBuffer->lineCount < first + 2) return;
+    uint available = lineBuffer->lineCount - 1 - first;
+    auto line_bytes = [&](uint i) -> uint64_t{
+        return LineBuffer_GetBufferAt(lineBuffer, i)->taken + 1;
+    };
+
+    if(maxLines > 0 && lineBuffer->lineCount > maxLines + maxLines / 8){
+        drop = lineBuffer->lineCount - maxLines;
+        drop = drop < available ? drop : available;
+    }
+
+    if(maxBytes > 0 && output->bytes > maxBytes + maxBytes / 8){
+        uint64_t bytes = output->bytes;
+        for(uint i = first; i < first + drop; i++){
+            bytes -= line_bytes(i) < bytes ? line_bytes(i) : bytes;
+        }
+
+        while(bytes > maxBytes && drop < available){
+            bytes -= line_bytes(first + drop) < bytes ? line_bytes(first + drop) : bytes;
+            drop++;
+        }
+    }
+
+    if(drop == 0) return;
+
+    for(uint i = first; i < first + drop; i++){
+        uint64_t n = line_bytes(i);
+        output->bytes -= n < output->bytes ? n : output->bytes;
+    }
+
+    LineBuffer_RemoveLines(lineBuffer, first, drop);
+    output->dropped += drop;
+
+    std::string note = "[" + std::to_string(output->dropped) + " lines dropped";
+    {
+        std::lock_guard<std::mutex> guard(session->spillMutex);
+        if(session->spillPath.size() > 0){
+            note += ", full output in " + session->spillPath;
+        }
+    }
+    note += "]";
+
+    EncoderDecoder *encoder = LineBuffer_GetEncoderDecoder(lineBuffer);
+    if(first == 0){
+        LineBuffer_InsertLineAt(lineBuffer, 0, (char *)note.c_str(), note.size());
+    }else{
+        Buffer *buffer = LineBuffer_GetBufferAt(lineBuffer, 0);
+        Buffer_SoftClear(buffer, encoder);
+        Buffer_InsertRawStringAt(buffer, 0, (char *)note.c_str(), note.size(), encoder);
+    }
+
+    LineBuffer_FastTokenGen(lineBuffer, 0, 1);
+}
+
+int ExecutorFlushOutput(){
+    int changed = 0;
+    for(CommandSession *session : commandSessions){
+        std::string data;
+        int done = 0;
+        LockedLineBuffer *output = &session->output;
+        {
+            std::lock_guard<std::mutex> guard(output->pendingMutex);
+            data.swap(output->pending);
+            done = output->pendingDone;
+            output->pendingDone = 0;
+        }
+
+        if(data.size() == 0 && !done) continue;
+
+        std::lock_guard<std::mutex> guard(output->mutex);
+        LineBuffer *lineBuffer = output->lineBuffer;
+        if(data.size() > 0){
+            uint start = lineBuffer->lineCount-1;
+            uint n = LineBuffer_InsertRawText(lineBuffer, (char *)data.c_str(),
+                                              data.size());
+            // the fast gen is in-place and does not require a tokenizer
+            LineBuffer_FastTokenGen(lineBuffer, start, n);
+            output->bytes += data.size();
+            SessionOutputTrim(session);
+        }
+
+        output->render_state = done ? 1 : 0;
+        changed = 1;
+    }
+
+    return changed;
+}
+
+CommandSession *CommandSession_Get(std::string name){
+    for(CommandSession *session : commandSessions){
+        if(session->name == name) return session;
+    }
+
+    CommandSession *session = new CommandSession;
+    session->name = name;
+    session->output.lineBuffer = LineBuffer_AllocateInternal(nullptr);
+    session->output.render_state = -1;
+    session->output.pendingDone = 0;
+    session->output.bytes = 0;
+    session->output.dropped = 0;
+    session->maxLines = EXECUTOR_OUTPUT_MAX_LINES;
+    session->maxBytes = EXECUTOR_OUTPUT_MAX_BYTES;
+    session->running = 0;
+    session->exitStatus = -1;
+    session->pid = 0;
+    session->killed = 0;
+    session->finished = 0;
+    commandSessions.push_back(session);
+
+    std::thread(ExecutorMainLoop, session).detach();
+    return session;
+}
+
+CommandSession *CommandSession_Find(std::string name){
+    for(CommandSession *session : commandSessions){
+        if(session->name == name) return session;
+    }
+
+    return nullptr;
+}
+
+CommandSession *CommandSession_FromLineBuffer(LineBuffer *lineBuffer){
+    if(lineBuffer == nullptr) return nullptr;
+    for(CommandSession *session : commandSessions){
+        if(session->output.lineBuffer == lineBuffer) return session;
+    }
+
+    return nullptr;
+}
+
+uint CommandSession_Count(){
+    return commandSessions.size();
+}
+
+CommandSession *CommandSession_At(uint i){
+    return i < commandSessions.size() ? commandSessions[i] : nullptr;
+}
+
+CommandSession *CommandSession_Last(){
+    return lastSession;
+}
+
+std::string CommandSession_GetName(CommandSession *session){
+    return session->name;
+}
+
+LockedLineBuffer *CommandSession_GetOutput(CommandSession *session){
+    return &session->output;
+}
+
+int CommandSession_Execute(CommandSession *session, std::string cmd){
+    // marked here so the UI sees it running before the session thread picks it
+    session->running++;
+    session->output.render_state = 0;
+    session->commands.push(cmd);
+    lastSession = session;
     return 0;
 }
 
+int CommandSession_IsRunning(CommandSession *session){
+    return session->running > 0 ? 1 : 0;
+}
+
+int CommandSession_GetExitStatus(CommandSession *session){
+    return session->exitStatus;
+}
+
+void CommandSession_SetOutputLimit(CommandSession *session, uint maxLines, uint64_t maxBytes){
+    session->maxLines = maxLines;
+    session->maxBytes = maxBytes;
+
+    std::lock_guard<std::mutex> guard(session->output.mutex);
+    SessionOutputTrim(session);
+}
+
+std::string CommandSession_SetSpill(CommandSession *session, bool enabled){
+    std::lock_guard<std::mutex> guard(session->spillMutex);
+    if(enabled && session->spillPath.size() == 0){
+        session->spillPath = FileProvider_MakeTemporaryFile();
+    }else if(!enabled){
+        session->spillPath = std::string();
+    }
+
+    return session->spillPath;
+}
+
+bool CommandSession_Kill(CommandSession *session){
+#if !defined(_WIN32)
+    long pid = session->pid;
+    if(pid > 0){
+        session->killed = 1;
+        return kill(-(pid_t)pid, SIGTERM) == 0;
+    }
+#endif
+    return false;
+}
+
+int ExecuteCommand(std::string cmd){
+    return CommandSession_Execute(CommandSession_Get(EXECUTOR_DEFAULT_SESSION), cmd);
+}
+
 void FinishExecutor(){
     // cleanup of threaded queue is generating errors if we terminate before cleanup
     // so we are just going to sleep and wait for it
-    state = 0;
     std::string lExit(CMD_EXIT);
-    commandQ.push(lExit);
-    while(state == 0){
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for(CommandSession *session : commandSessions){
+        CommandSession_Kill(session);
+        session->commands.push(lExit);
+    }
+
+    for(CommandSession *session : commandSessions){
+        while(session->finished == 0){
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
     }
 }
 
 void GetExecutorLockedLineBuffer(LockedLineBuffer **ptr){
     if(ptr){
-        *ptr = &lockedBuffer;
+        CommandSession *session = lastSession;
+        if(!session){
+            session = CommandSession_Get(EXECUTOR_DEFAULT_SESSION);
+        }
+        *ptr = &session->output;
     }
 }
 
 void CommandExecutorInit(){
-    lockedBuffer.lineBuffer = LineBuffer_AllocateInternal(nullptr);
-    lockedBuffer.render_state = -1;
-    std::thread(ExecutorMainLoop).detach();
+    lastSession = CommandSession_Get(EXECUTOR_DEFAULT_SESSION);
+}
+
+struct ParallelWorkerQueue{
+    std::mutex mutex;
+    std::deque<ParallelTask> tasks;
+};
+
+struct ParallelPool{
+    // one queue of loop tasks per loop worker, queue 0 belongs to the threads
+    // that start loops and is never used
+    ParallelWorkerQueue *queues;
+    uint count; // workers + 1
+    uint loopCount; // workers that take loop tasks + 1, never above GetConcurrency()
+    std::atomic<uint> pending; // queued loop tasks not yet taken by anyone
+    std::atomic<uint> nextQueue;
+
+    // submitted functions, guarded by 'submitMutex'
+    std::mutex submitMutex;
+    std::deque<ParallelTask> submitted[TASK_PRIORITY_COUNT];
+    uint idleRunning;
+    uint idleLimit;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+static ParallelPool *parallelPool = nullptr;
+static std::once_flag parallelPoolOnce;
+
+static void TaskGroupLeave(TaskGroup *group){
+    std::function<void()> onRelease;
+    bool destroy = false;
+    {
+        std::lock_guard<std::mutex> guard(group->mutex);
+        group->pending -= 1;
+        if(group->pending == 0){
+            group->cond.notify_all();
+            if(group->released){
+                std::swap(onRelease, group->onRelease);
+                destroy = true;
+            }
+        }
+    }
+
+    if(destroy){
+        delete group;
+        if(onRelease){
+            ParallelPool_Submit(onRelease, TASK_PRIORITY_IDLE);
+        }
+    }
+}
+
+static void ParallelPoolExecute(ParallelTask *task, int tid){
+    ParallelJob *job = task->job;
+    if(!job){
+        (*task->call)();
+        delete task->call;
+        if(task->group){
+            TaskGroupLeave(task->group);
+        }
+        return;
+    }
+
+    job->run(job->fn, task->start, task->end, tid);
+
+    // the starting thread owns the job and releases it as soon as it sees the
+    // count reach zero, so notify while holding the lock
+    std::lock_guard<std::mutex> guard(job->mutex);
+    job->remaining -= 1;
+    if(job->remaining == 0){
+        job->cond.notify_all();
+    }
+}
+
+/*
+* Gets the most urgent submitted function that can run now, idle ones are only
+* given while the amount of them running is below the limit.
+*/
+static bool ParallelPoolTakeSubmitted(ParallelPool *pool, ParallelTask *task){
+    std::lock_guard<std::mutex> guard(pool->submitMutex);
+    for(uint p = 0; p < TASK_PRIORITY_COUNT; p++){
+        std::deque<ParallelTask> *queue = &pool->submitted[p];
+        if(queue->empty()) continue;
+        if(p == TASK_PRIORITY_IDLE && pool->idleRunning >= pool->idleLimit) break;
+
+        *task = queue->front();
+        queue->pop_front();
+        if(p == TASK_PRIORITY_IDLE){
+            pool->idleRunning += 1;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+* Checks if the worker 'id' waking up would find something to do, must be called
+* with 'submitMutex' held.
+*/
+static bool ParallelPoolHasWork(ParallelPool *pool, uint id){
+    if(id < pool->loopCount && pool->pending > 0) return true;
+
+    for(uint p = 0; p < TASK_PRIORITY_IDLE; p++){
+        if(!pool->submitted[p].empty()) return true;
+    }
+
+    return pool->idleRunning < pool->idleLimit &&
+            !pool->submitted[TASK_PRIORITY_IDLE].empty();
+}
+
+/*
+* Gets a task for the worker 'id', loop tasks come first: either the newest of its
+* own queue or the oldest one of another worker. Then the submitted functions.
+*/
+static bool ParallelPoolTake(ParallelPool *pool, uint id, ParallelTask *task){
+    uint loopWorkers = pool->loopCount - 1;
+    for(uint i = 0; id < pool->loopCount && i < loopWorkers; i++){
+        uint k = 1 + (id - 1 + i) % loopWorkers;
+        ParallelWorkerQueue *queue = &pool->queues[k];
+        std::lock_guard<std::mutex> guard(queue->mutex);
+        if(queue->tasks.empty()) continue;
+
+        if(k == id){
+            *task = queue->tasks.back();
+            queue->tasks.pop_back();
+        }else{
+            *task = queue->tasks.front();
+            queue->tasks.pop_front();
+        }
+
+        pool->pending -= 1;
+        return true;
+    }
+
+    return ParallelPoolTakeSubmitted(pool, task);
+}
+
+/*
+* Gets a task of the job 'job'. This is what the thread that started a loop uses, it
+* cannot run tasks of other loops as they might be using the same tid.
+*/
+static bool ParallelPoolTakeFrom(ParallelPool *pool, ParallelJob *job, ParallelTask *task){
+    for(uint k = 1; k < pool->loopCount; k++){
+        ParallelWorkerQueue *queue = &pool->queues[k];
+        std::lock_guard<std::mutex> guard(queue->mutex);
+        for(auto it = queue->tasks.begin(); it != queue->tasks.end(); it++){
+            if(it->job == job){
+                *task = *it;
+                queue->tasks.erase(it);
+                pool->pending -= 1;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static void ParallelPoolWorker(ParallelPool *pool, uint id){
+    ParallelTask task;
+    while(1){
+        if(ParallelPoolTake(pool, id, &task)){
+            bool idle = !task.job && task.priority == TASK_PRIORITY_IDLE;
+            ParallelPoolExecute(&task, (int)id);
+            if(idle){
+                {
+                    std::lock_guard<std::mutex> guard(pool->submitMutex);
+                    pool->idleRunning -= 1;
+                }
+
+                // an idle task might be waiting for this slot
+                std::lock_guard<std::mutex> guard(pool->mutex);
+                pool->cond.notify_one();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> locker(pool->mutex);
+        pool->cond.wait(locker, [&]{
+            std::lock_guard<std::mutex> guard(pool->submitMutex);
+            return ParallelPoolHasWork(pool, id);
+        });
+    }
+}
+
+void ParallelPool_Init(){
+    std::call_once(parallelPoolOnce, [](){
+        // the pool lives until the process exits
+        ParallelPool *pool = new ParallelPool;
+        // tasks need at least two workers so that one is left when the other is
+        // running idle work, the extra ones created on small machines never take
+        // loop tasks so that tids stay below GetConcurrency()
+        uint concurrency = (uint)GetConcurrency();
+        pool->count = concurrency > 2 ? concurrency : 3;
+        pool->loopCount = concurrency;
+        pool->queues = new ParallelWorkerQueue[pool->count];
+        pool->pending = 0;
+        pool->nextQueue = 0;
+        pool->idleRunning = 0;
+        pool->idleLimit = pool->count - 2;
+        for(uint i = 1; i < pool->count; i++){
+            std::thread(ParallelPoolWorker, pool, i).detach();
+        }
+
+        parallelPool = pool;
+    });
+}
+
+void ParallelPool_Run(ParallelJob *job, uint start, uint end, uint grain){
+    ParallelPool_Init();
+    ParallelPool *pool = parallelPool;
+    uint workers = pool->loopCount - 1;
+    uint tasks = (end - start + grain - 1) / grain;
+
+    if(workers == 0){
+        job->run(job->fn, start, end, 0);
+        return;
+    }
+
+    job->remaining = tasks;
+
+    // counted before pushing so that takers never see it underflow
+    pool->pending += tasks;
+
+    // spread the tasks so workers start on their own queue
+    uint queue = pool->nextQueue.fetch_add(1) % workers;
+    for(uint i = start; i < end; i += grain){
+        ParallelWorkerQueue *q = &pool->queues[1 + queue];
+        ParallelTask task = { job, i, end - i > grain ? i + grain : end, nullptr,
+                              nullptr, TASK_PRIORITY_INTERACTIVE };
+        {
+            std::lock_guard<std::mutex> guard(q->mutex);
+            q->tasks.push_back(task);
+        }
+        queue = (queue + 1) % workers;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pool->mutex);
+        pool->cond.notify_all();
+    }
+
+    ParallelTask task;
+    while(ParallelPoolTakeFrom(pool, job, &task)){
+        ParallelPoolExecute(&task, 0);
+    }
+
+    std::unique_lock<std::mutex> locker(job->mutex);
+    job->cond.wait(locker, [&]{ return job->remaining == 0; });
+}
+
+void ParallelPool_Submit(const std::function<void()> &fn, TaskPriority priority,
+                         TaskGroup *group)
+{
+    ParallelPool_Init();
+    ParallelPool *pool = parallelPool;
+    ParallelTask task = { nullptr, 0, 0, new std::function<void()>(fn),
+                          group, priority };
+
+    if(group){
+        std::lock_guard<std::mutex> guard(group->mutex);
+        group->pending += 1;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pool->submitMutex);
+        pool->submitted[priority].push_back(task);
+    }
+
+    std::lock_guard<std::mutex> guard(pool->mutex);
+    pool->cond.notify_one();
+}
+
+TaskGroup *TaskGroup_Create(){
+    TaskGroup *group = new TaskGroup;
+    group->cancelled = false;
+    group->pending = 0;
+    group->released = false;
+    return group;
+}
+
+void TaskGroup_Cancel(TaskGroup *group){
+    ParallelPool_Init();
+    ParallelPool *pool = parallelPool;
+    std::vector<ParallelTask> dropped;
+    group->cancelled = true;
+
+    {
+        std::lock_guard<std::mutex> guard(pool->submitMutex);
+        for(uint p = 0; p < TASK_PRIORITY_COUNT; p++){
+            std::deque<ParallelTask> *queue = &pool->submitted[p];
+            for(auto it = queue->begin(); it != queue->end();){
+                if(it->group == group){
+                    dropped.push_back(*it);
+                    it = queue->erase(it);
+                }else{
+                    it++;
+                }
+            }
+        }
+    }
+
+    // the functions see the cancelled group and only finish their futures
+    for(ParallelTask &task : dropped){
+        ParallelPoolExecute(&task, 0);
+    }
+}
+
+void TaskGroup_Wait(TaskGroup *group){
+    std::unique_lock<std::mutex> locker(group->mutex);
+    group->cond.wait(locker, [&]{ return group->pending == 0; });
+}
+
+void TaskGroup_Release(TaskGroup *group, const std::function<void()> &fn){
+    // keep the group alive while cancelling, dropped tasks leave it
+    {
+        std::lock_guard<std::mutex> guard(group->mutex);
+        group->pending += 1;
+    }
+
+    TaskGroup_Cancel(group);
+
+    {
+        std::lock_guard<std::mutex> guard(group->mutex);
+        group->released = true;
+        group->onRelease = fn;
+    }
+
+    TaskGroupLeave(group);
+}
+
+#if defined(__linux__)
+void ParallelEvent::Wait(uint32_t key, long timeout_ms){
+    struct timespec ts;
+    struct timespec *timeout = nullptr;
+    if(timeout_ms >= 0){
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+        timeout = &ts;
+    }
+
+    // returns right away in case the epoch is no longer 'key'
+    syscall(SYS_futex, (uint32_t *)&epoch, FUTEX_WAIT_PRIVATE, key, timeout, nullptr, 0);
+    waiters.fetch_sub(1);
+}
+
+void ParallelEvent::Notify(){
+    // pairs with PrepareWait, either the waiter sees the new state or we see it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiters.load(std::memory_order_relaxed) > 0){
+        epoch.fetch_add(1);
+        syscall(SYS_futex, (uint32_t *)&epoch, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+}
+#else
+void ParallelEvent::Wait(uint32_t key, long timeout_ms){
+    std::unique_lock<std::mutex> locker(mutex);
+    auto changed = [&]{ return epoch.load() != key; };
+    if(timeout_ms >= 0){
+        cond.wait_for(locker, std::chrono::milliseconds(timeout_ms), changed);
+    }else{
+        cond.wait(locker, changed);
+    }
+    waiters.fetch_sub(1);
+}
+
+void ParallelEvent::Notify(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiters.load(std::memory_order_relaxed) > 0){
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            epoch.fetch_add(1);
+        }
+        cond.notify_one();
+    }
+}
+#endif
+
+/*
+* The queue as it was before the lock-free rings, kept as the benchmark reference.
+*/
+template<typename T> class BenchLockedQueue{
+    public:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::queue<T> itemQ;
+
+    T pop(){
+        std::unique_lock<std::mutex> locker(mutex);
+        while(itemQ.empty()){
+            cv.wait(locker);
+        }
+        T val = itemQ.front();
+        itemQ.pop();
+        return val;
+    }
+
+    void push(T &item){
+        std::unique_lock<std::mutex> locker(mutex);
+        itemQ.push(item);
+        locker.unlock();
+        cv.notify_all();
+    }
+};
+
+template<typename Queue>
+static double ParallelQueueBenchmarkRun(uint producers, uint consumers, uint items){
+    Queue queue;
+    std::vector<std::thread> threads;
+    std::atomic<uint64> checksum(0);
+    uint perProducer = items / producers;
+    uint perConsumer = perProducer * producers / consumers;
+
+    // wall time, clock() based MeasureInterval adds up the time of all threads
+    auto start = std::chrono::steady_clock::now();
+    for(uint i = 0; i < consumers; i++){
+        threads.push_back(std::thread([&](){
+            uint64 sum = 0;
+            for(uint j = 0; j < perConsumer; j++){
+                sum += queue.pop();
+            }
+            checksum += sum;
+        }));
+    }
+
+    for(uint i = 0; i < producers; i++){
+        threads.push_back(std::thread([&](){
+            for(uint j = 0; j < perProducer; j++){
+                uint64 v = j;
+                queue.push(v);
+            }
+        }));
+    }
+
+    for(std::thread &t : threads){
+        t.join();
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start).count();
+    uint64 expected = (uint64)producers * ((uint64)perProducer * (perProducer - 1) / 2);
+    if(checksum != expected){
+        printf("[PERF] Queue benchmark lost items\n");
+    }
+
+    return (double)(perProducer * producers) / (ms * 1000.0);
+}
+
+void ParallelQueue_Benchmark(uint items){
+    typedef BenchLockedQueue<uint64> Locked;
+    typedef ConcurrentQueue<uint64> MPMC;
+    typedef ConcurrentQueue<uint64, SPSCRing<uint64>> SPSC;
+    uint n = GetConcurrency() > 4 ? GetConcurrency() / 2 : 2;
+
+    printf("[PERF] Queue 1x1 locked: %g M/s\n",
+           ParallelQueueBenchmarkRun<Locked>(1, 1, items));
+    printf("[PERF] Queue 1x1 mpmc: %g M/s\n",
+           ParallelQueueBenchmarkRun<MPMC>(1, 1, items));
+    printf("[PERF] Queue 1x1 spsc: %g M/s\n",
+           ParallelQueueBenchmarkRun<SPSC>(1, 1, items));
+    printf("[PERF] Queue %ux%u locked: %g M/s\n", n, n,
+           ParallelQueueBenchmarkRun<Locked>(n, n, items));
+    printf("[PERF] Queue %ux%u mpmc: %g M/s\n", n, n,
+           ParallelQueueBenchmarkRun<MPMC>(n, n, items));
 }
@@ -1,14 +1,17 @@
 /* date = July 27th 2021 20:46 */
 #pragma once
 #include <thread>
+#include <atomic>
+#include <vector>
 #include <geometry.h>
 #include <buffers.h>
 #include <mutex>
 #include <queue>
 #include <condition_variable>
 #include <functional>
-#include <typeindex>
 #include <map>
+#include <unordered_map>
+#include <memory>
 #include <optional>
 #include <chrono>
 #include <iostream>
@@ -19,6 +22,14 @@ struct LockedLineBuffer{
     LineBuffer *lineBuffer;
     std::mutex mutex;
     int render_state;
+    // output produced by the executor that was not moved into lineBuffer yet
+    std::mutex pendingMutex;
+    std::string pending;
+    int pendingDone;
+    // approximate size of lineBuffer and amount of its oldest lines that were
+    // dropped to keep it under the limits of its session
+    uint64_t bytes;
+    uint dropped;
 };
 
 struct BuildError{
@@ -28,11 +39,39 @@ struct BuildError{
     std::string message;
 };
 
+/*
+* Build errors of the last build command. Errors are only appended while the build
+* runs and are indexed by file and line, the line is 0-based as in the LineBuffer.
+* Only the first error reported for a line is kept. The version changes whenever
+* the set does so that copies can be updated only when needed.
+*/
+typedef std::unordered_map<uint, uint> BuildErrorLines; // line -> error
+struct BuildErrorSet{
+    uint version = 0;
+    uint generation = 0; // changes when the set is cleared
+    std::vector<BuildError> errors; // in the order they were reported
+    std::unordered_map<std::string, BuildErrorLines> files;
+};
+
+/*
+* Returns the lines with errors of the file 'path' or nullptr if it has none.
+*/
+const BuildErrorLines *BuildErrorSet_GetFile(const BuildErrorSet *set,
+                                             const std::string &path);
+
+/*
+* Returns the error reported for the line 'line' of the file with the given
+* lines, see BuildErrorSet_GetFile, or nullptr if there is none.
+*/
+const BuildError *BuildErrorSet_Get(const BuildErrorSet *set, const BuildErrorLines *lines,
+                                    uint line);
+
 ///////////// Out of place routines ///////////////////
 /*
-* Returns the list of build errors for the last build command.
+* Updates 'set' to the build errors for the last build command. Only the errors
+* added since the last call are copied. Returns 1 in case 'set' changed.
 */
-void FetchBuildErrors(std::vector<BuildError> &errors);
+int FetchBuildErrors(BuildErrorSet *set);
 
 /*
 * Get the next build error.
@@ -94,16 +133,235 @@ inline void ConditionVariableTriggerOne(std::condition_variable &cv, std::mutex
     cv.notify_one();
 }
 
+#define PARALLEL_QUEUE_CAPACITY 256
+
+#define PARALLEL_QUEUE_SPIN 64
+
+/*
+* Event count used to block on lock-free structures without losing wakeups.
+* A waiter announces itself with PrepareWait, checks its condition once more and
+* only then calls Wait, or CancelWait in case the condition holds. Notify is cheap
+* when nobody waits, it only touches the shared counter for real waiters.
+* On linux this is a futex over the epoch, elsewhere a condition variable.
+*/
+class ParallelEvent{
+    public:
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<uint32_t> waiters{0};
+#if !defined(__linux__)
+    std::mutex mutex;
+    std::condition_variable cond;
+#endif
+
+    uint32_t PrepareWait(){
+        waiters.fetch_add(1);
+        return epoch.load();
+    }
+
+    void CancelWait(){ waiters.fetch_sub(1); }
+
+    /*
+    * Blocks while no Notify happened since PrepareWait returned 'key', for at most
+    * 'timeout_ms' in case it is not negative.
+    */
+    void Wait(uint32_t key, long timeout_ms=-1);
+
+    /*
+    * Wakes one waiter.
+    */
+    void Notify();
+};
+
+/*
+* Calls 'fn' until it returns true, first spinning a bit and then blocking on 'event'.
+* Gives up once 'deadline' is reached, returning false.
+*/
+template<typename Fn>
+inline bool ParallelEventAwait(ParallelEvent &event, Fn fn,
+        std::chrono::steady_clock::time_point deadline=std::chrono::steady_clock::time_point::max())
+{
+    for(int i = 0; i < PARALLEL_QUEUE_SPIN; i++){
+        if(fn()) return true;
+        std::this_thread::yield();
+    }
+
+    while(1){
+        uint32_t key = event.PrepareWait();
+        if(fn()){
+            event.CancelWait();
+            return true;
+        }
+
+        if(deadline == std::chrono::steady_clock::time_point::max()){
+            event.Wait(key);
+        }else{
+            auto now = std::chrono::steady_clock::now();
+            long remaining = (long)std::chrono::duration_cast<
+                                std::chrono::milliseconds>(deadline - now).count();
+            if(remaining <= 0){
+                event.CancelWait();
+                return fn();
+            }
+            event.Wait(key, remaining);
+        }
+    }
+}
+
+/*
+* Bounded lock-free multiple producer multiple consumer ring. Each cell carries a
+* sequence number telling if it is ready to be written or read in the current lap,
+* producers and consumers claim positions with a CAS on their own counter and never
+* touch each other's cache lines. Capacity is rounded up to a power of 2.
+*/
+template<typename T> class MPMCRing{
+    public:
+    struct Cell{
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    Cell *cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+
+    MPMCRing(size_t capacity=PARALLEL_QUEUE_CAPACITY){
+        size_t size = 2;
+        while(size < capacity) size <<= 1;
+        cells = new Cell[size];
+        mask = size - 1;
+        for(size_t i = 0; i < size; i++){
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    ~MPMCRing(){ delete[] cells; }
+
+    bool try_push(const T &item){
+        Cell *cell = nullptr;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while(1){
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0){
+                if(enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                    std::memory_order_relaxed))
+                    break;
+            }else if(diff < 0){
+                return false; // full
+            }else{
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item){
+        Cell *cell = nullptr;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while(1){
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0){
+                if(dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                                    std::memory_order_relaxed))
+                    break;
+            }else if(diff < 0){
+                return false; // empty
+            }else{
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        item = std::move(cell->data);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size(){
+        size_t e = enqueuePos.load(std::memory_order_relaxed);
+        size_t d = dequeuePos.load(std::memory_order_relaxed);
+        return e > d ? e - d : 0;
+    }
+};
+
+/*
+* Bounded lock-free ring for a single producer and a single consumer. Each side
+* owns its index and keeps a cached copy of the other one so it only reads the
+* shared one when the ring looks full (or empty).
+*/
+template<typename T> class SPSCRing{
+    public:
+    T *items;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head; // next read, owned by the consumer
+    size_t cachedTail;
+    alignas(64) std::atomic<size_t> tail; // next write, owned by the producer
+    size_t cachedHead;
+
+    SPSCRing(size_t capacity=PARALLEL_QUEUE_CAPACITY){
+        size_t size = 2;
+        while(size < capacity) size <<= 1;
+        items = new T[size];
+        mask = size - 1;
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        cachedHead = 0;
+        cachedTail = 0;
+    }
+
+    ~SPSCRing(){ delete[] items; }
+
+    bool try_push(const T &item){
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - cachedHead > mask){
+            cachedHead = head.load(std::memory_order_acquire);
+            if(t - cachedHead > mask) return false;
+        }
+
+        items[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item){
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h == cachedTail){
+            cachedTail = tail.load(std::memory_order_acquire);
+            if(h == cachedTail) return false;
+        }
+
+        item = std::move(items[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size(){
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+};
+
 /*
 * Blocking Queue with timeout. Calling pop() blocks for 'max_timeout_ms'
 * if an item is detected than it is returned otherwise an empty std::optional<T>
-* is returned instead.
+* is returned instead. Items are kept in a bounded lock-free ring, push() blocks
+* while it is full. clear() must be called from a consumer.
 */
-template<typename T> class ConcurrentTimedQueue{
+template<typename T, typename Ring=MPMCRing<T>> class ConcurrentTimedQueue{
     public:
-    std::mutex mutex;
-    std::condition_variable cv;
-    std::queue<T> itemQ;
+    Ring ring;
+    ParallelEvent notEmpty;
+    ParallelEvent notFull;
     uint max_timeout_ms;
 
     ConcurrentTimedQueue(uint ms=PARALLEL_QUEUE_TIMEOUT_MS) : max_timeout_ms(ms){}
@@ -111,221 +369,563 @@ template<typename T> class ConcurrentTimedQueue{
     void set_interval(uint ms){ max_timeout_ms = ms; }
 
     std::optional<T> pop(){
-        std::unique_lock<std::mutex> locker(mutex);
-        auto max_ms = std::chrono::milliseconds(max_timeout_ms);
-        bool done = false;
-        auto start = std::chrono::system_clock::now();
-        while(itemQ.empty() && !done){
-            cv.wait_until(locker, start + max_ms, [&]{ return !itemQ.empty(); });
-            auto end = std::chrono::system_clock::now();
-            auto elapsed =
-                std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-
-            done = elapsed >= max_timeout_ms;
-        }
-
-        if(itemQ.empty()){
+        T val;
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(max_timeout_ms);
+        if(!ParallelEventAwait(notEmpty, [&]{ return ring.try_pop(val); }, deadline)){
             return {};
         }
 
-        T val = itemQ.front();
-        itemQ.pop();
-        return std::optional<T>(val);
+        notFull.Notify();
+        return std::optional<T>(std::move(val));
     }
 
-    uint size(){
-        std::unique_lock<std::mutex> locker(mutex);
-        return itemQ.size();
-    }
+    uint size(){ return (uint)ring.size(); }
 
     void push(T &item){
-        std::unique_lock<std::mutex> locker(mutex);
-        itemQ.push(item);
-        locker.unlock();
-        cv.notify_one();
+        ParallelEventAwait(notFull, [&]{ return ring.try_push(item); });
+        notEmpty.Notify();
     }
 
     void clear(){
-        std::unique_lock<std::mutex> locker(mutex);
-        std::queue<T> empty;
-        std::swap(itemQ, empty);
+        T val;
+        while(ring.try_pop(val)){
+            notFull.Notify();
+        }
     }
 };
 
 /*
-* Blocking Queue. Calling pop() blocks untill a item is available.
+* Blocking Queue. Calling pop() blocks untill a item is available. Items are kept
+* in a bounded lock-free ring, push() blocks while it is full. clear() must be
+* called from a consumer.
 */
-template<typename T> class ConcurrentQueue{
+template<typename T, typename Ring=MPMCRing<T>> class ConcurrentQueue{
     public:
-
-    std::mutex mutex;
-    std::condition_variable cv;
-    std::queue<T> itemQ;
+    Ring ring;
+    ParallelEvent notEmpty;
+    ParallelEvent notFull;
 
     ConcurrentQueue() = default;
     T pop(){
-        std::unique_lock<std::mutex> locker(mutex);
-        while(itemQ.empty()){
-            cv.wait(locker);
-        }
-        T val = itemQ.front();
-        itemQ.pop();
-        locker.unlock();
-
+        T val;
+        ParallelEventAwait(notEmpty, [&]{ return ring.try_pop(val); });
+        notFull.Notify();
         return val;
     }
 
     void push(T &item){
-        std::unique_lock<std::mutex> locker(mutex);
-        itemQ.push(item);
-        locker.unlock();
-        cv.notify_all();
+        ParallelEventAwait(notFull, [&]{ return ring.try_push(item); });
+        notEmpty.Notify();
     }
 
-    int size(){
-        std::unique_lock<std::mutex> locker(mutex);
-        return itemQ.size();
-    }
+    int size(){ return (int)ring.size(); }
 
     void clear(){
-        std::unique_lock<std::mutex> locker(mutex);
-        std::queue<T> empty;
-        std::swap(itemQ, empty);
+        T val;
+        while(ring.try_pop(val)){
+            notFull.Notify();
+        }
     }
 };
 
+/*
+* Measures push/pop throughput of the queues against the previous mutex based
+* implementation and prints it, this is mostly for debug.
+*/
+void ParallelQueue_Benchmark(uint items);
+
+#define EXECUTOR_DEFAULT_SESSION "default"
+// default limits for the output of a session, 0 is unlimited
+#define EXECUTOR_OUTPUT_MAX_LINES 100000
+#define EXECUTOR_OUTPUT_MAX_BYTES (64 * 1024 * 1024)
+
+/*
+* Commands run in sessions, each one has its own executor thread, output LineBuffer
+* and exit status so that a long running command, i.e.: a test suite or a server,
+* does not block building on another session. Commands given to the same session
+* run one after the other and each clears the output of the previous one.
+* Sessions are created and queried only by the main thread and live until exit.
+*/
+struct CommandSession;
+
+/*
+* Returns the session with the given name, creating it if it does not exist.
+*/
+CommandSession *CommandSession_Get(std::string name);
+
+/*
+* Returns the session with the given name or nullptr if it does not exist.
+*/
+CommandSession *CommandSession_Find(std::string name);
+
+/*
+* Returns the session whose output is 'lineBuffer' or nullptr if it is not the
+* output of a session.
+*/
+CommandSession *CommandSession_FromLineBuffer(LineBuffer *lineBuffer);
+
+/*
+* Iterates the sessions in the order they were created.
+*/
+uint CommandSession_Count();
+CommandSession *CommandSession_At(uint i);
+
+/*
+* Returns the session that was given the last command.
+*/
+CommandSession *CommandSession_Last();
+
+std::string CommandSession_GetName(CommandSession *session);
+LockedLineBuffer *CommandSession_GetOutput(CommandSession *session);
+
+/*
+* Queues 'cmd' to run on the session after the commands it already has.
+*/
+int CommandSession_Execute(CommandSession *session, std::string cmd);
+
+/*
+* Checks if the session has a command running or queued.
+*/
+int CommandSession_IsRunning(CommandSession *session);
+
+/*
+* Returns the exit status of the last command of the session, -1 while it did not
+* finish or if it could not run. Commands killed by a signal report 128 + signal.
+*/
+int CommandSession_GetExitStatus(CommandSession *session);
+
+/*
+* Limits the output of the session to the last 'maxLines' lines and 'maxBytes'
+* bytes, 0 disables a limit. The oldest lines are dropped in batches once the
+* output goes over a limit by a fraction of it so that the cost per line is
+* constant. Applies to the current output as well.
+*/
+void CommandSession_SetOutputLimit(CommandSession *session, uint maxLines, uint64_t maxBytes);
+
+/*
+* Enables writing the full output of the commands of the session to a temporary
+* file, the path is shown in the output once lines are dropped. Takes effect on
+* the next command. Returns the path of the file, empty if disabled.
+*/
+std::string CommandSession_SetSpill(CommandSession *session, bool enabled);
+
+/*
+* Terminates the command running on the session, including the processes it
+* started. Returns false if there is nothing to kill or it cannot be killed, the
+* popen fallback used on Windows cannot.
+*/
+bool CommandSession_Kill(CommandSession *session);
+
+/*
+* Runs 'cmd' on the default session.
+*/
 int ExecuteCommand(std::string cmd);
 void CommandExecutorInit();
 void FinishExecutor();
+
+/*
+* Gets the output of the session that was given the last command.
+*/
 void GetExecutorLockedLineBuffer(LockedLineBuffer **ptr);
+
+/*
+* Checks if no session has commands running.
+*/
 int ExecuteCommandDone();
 
+/*
+* Moves the output the sessions produced since the last call into their
+* LineBuffers. Output is published by the executors in large batches and applied
+* here at most once per frame. Must be called from the main thread, returns 1 in
+* case anything changed.
+*/
+int ExecutorFlushOutput();
+
 inline int GetConcurrency(){
     return (int)Max((Float)1, (Float)std::thread::hardware_concurrency());
 }
 
 /*
-* NOTE: Whenever DispatchHost is called by the parallel routine
-*       the host (who called DispatchExecution) is allowed to continue.
-*       If the routine finishes, make sure the variables are still present
-*       within the body of the function that was dispatched otherwise garbage
-*       may be used instead creating some annoying bugs. For this you might
-*       want to do something like:
+* Process wide work-stealing pool used by the parallel loops and tasks. It holds
+* GetConcurrency() - 1 workers, at least one, created once at startup, see
+* ParallelPool_Init, each with its own deque of tasks. A task is either a chunk of
+* indices of a loop or a function submitted with ParallelPool_Submit. Workers take
+* tasks from the back of their own deque and steal from the front of the others when
+* it is empty. The thread that starts a loop does not wait idle, it runs the tasks
+* of its own loop until they are all done and is always given tid 0. Loops can be
+* nested and started from any thread.
 *
-*        void my_parallel_dispatcher(var_type1 var0, var_type2 var1){
-*            DispatchExecution([&](HostDispatcher *dispatcher){
-*                var_type1 local_var0 = var0;
-*                var_type2 local_var1 = var1;
-*                    ...
-*               < can use both var0/1 and local_var0/1 here >
-*                    ...
-*                dispatcher->DispatchHost();
-*                    ...
-*               < using var0/1 here might cause a bug because their storage
-*                 might have been requested again in the stack, use local_var0/1 instead >
-*                    ...
-*            });
-*        }
-*
-*      some examples are: QueryBarHistory_DetachedLoad/Store and LineBuffer_Init.
+* Submitted functions do not go to the worker deques, they are kept in one queue
+* per priority and are only taken by workers that have no loop tasks, the most
+* urgent priority first. Idle work never takes all the workers: one of them is
+* always left for interactive and normal tasks so that whoever blocks on those,
+* i.e.: the main thread in Task_Run, never waits behind it.
 */
-class HostDispatcher{
-    public:
-    std::mutex *mutex;
-    std::condition_variable *cond;
-    int dispatchFlag;
+typedef void(*ParallelTaskFn)(const void *fn, uint start, uint end, int tid);
 
-    HostDispatcher(){}
+typedef enum{
+    TASK_PRIORITY_INTERACTIVE=0, // someone is waiting for it, i.e.: the visible lines
+    TASK_PRIORITY_NORMAL,
+    TASK_PRIORITY_IDLE, // prefetching and cleanup, runs only on spare workers
+    TASK_PRIORITY_COUNT,
+}TaskPriority;
 
-    int IsDispatched(){ return dispatchFlag; }
+/*
+* Set of tasks that work on the same object and that must be dropped when it goes
+* away, i.e.: the tokenization of a LineBuffer that gets closed. Cancelling a group
+* removes its tasks that did not start yet from the pool, the running ones are
+* expected to poll TaskGroup_IsCancelled and return early.
+*/
+struct TaskGroup{
+    std::atomic<bool> cancelled;
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint pending; // tasks queued or running, guarded by 'mutex'
+    bool released;
+    std::function<void()> onRelease;
+};
 
-    void Init(std::mutex *m, std::condition_variable *c){
-        mutex = m;
-        cond = c;
-        dispatchFlag = 0;
+struct ParallelJob{
+    ParallelTaskFn run;
+    const void *fn;
+    uint remaining; // tasks not finished, guarded by 'mutex'
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+struct ParallelTask{
+    ParallelJob *job; // nullptr for submitted functions
+    uint start;
+    uint end;
+    std::function<void()> *call;
+    TaskGroup *group;
+    TaskPriority priority;
+};
+
+/*
+* Starts the workers of the pool, calling it more than once does nothing. The pool is
+* also started by the first parallel loop in case this was not called.
+*/
+void ParallelPool_Init();
+
+/*
+* Splits [start, end) in tasks of 'grain' indices, runs them in the pool and
+* returns once all of them finished.
+*/
+void ParallelPool_Run(ParallelJob *job, uint start, uint end, uint grain);
+
+/*
+* Queues 'fn' to run once in the pool with the given priority and returns
+* immediately. If 'group' is given the task is counted in it and 'fn' is called
+* right away by TaskGroup_Cancel in case it did not start yet, so 'fn' must check
+* the group itself. Prefer the Task_* routines which do that and allow waiting for
+* the result.
+*/
+void ParallelPool_Submit(const std::function<void()> &fn,
+                         TaskPriority priority=TASK_PRIORITY_NORMAL,
+                         TaskGroup *group=nullptr);
+
+/*
+* Creates an empty task group.
+*/
+TaskGroup *TaskGroup_Create();
+
+/*
+* Checks if the group was cancelled, a null group is never cancelled.
+*/
+inline bool TaskGroup_IsCancelled(TaskGroup *group){
+    return group && group->cancelled.load(std::memory_order_relaxed);
+}
+
+/*
+* Cancels all tasks of the group: the ones still queued are dropped and no new
+* task of the group will run. Does not wait for the running ones.
+*/
+void TaskGroup_Cancel(TaskGroup *group);
+
+/*
+* Blocks until no task of the group is queued or running. Only meant for cancelled
+* groups, where it waits at most for the running tasks to notice it.
+*/
+void TaskGroup_Wait(TaskGroup *group);
+
+/*
+* Cancels the group and, once its last task returns, runs 'fn' in the pool with
+* idle priority and frees the group. This is how objects that tasks might still be
+* using are released without blocking the caller. The group cannot be used after
+* this call.
+*/
+void TaskGroup_Release(TaskGroup *group, const std::function<void()> &fn=nullptr);
+
+template<typename Function>
+void ParallelTaskInvoke(const void *fn, uint start, uint end, int tid){
+    const Function &func = *(const Function *)fn;
+    for(uint j = start; j < end; j++){
+        func(j, tid);
+    }
+}
+
+/*
+* Runs fn(j, tid) for all j in [start, end) using the pool. Indices are grouped in
+* chunks of 'grain' indices, by default a few chunks per worker are created so
+* that faster workers can steal the chunks of the slower ones. The 'tid' given to
+* 'fn' is always < GetConcurrency() and no two chunks run at the same time with the
+* same 'tid' so it can be used to index per worker data.
+*/
+template<typename Function>
+void ParallelFor(const char *desc, uint start, uint end, const Function &fn,
+                 uint grain=0)
+{
+    if(start >= end) return;
+
+    uint n = end - start;
+    uint numThreads = (uint)GetConcurrency();
+    if(grain == 0){
+        grain = n / (numThreads * 4);
+        grain = grain > 0 ? grain : 1;
     }
 
-    void DispatchHost(){
-        std::lock_guard<std::mutex> guard(*mutex);
-        dispatchFlag = 1;
-        cond->notify_one();
+    if(numThreads == 1 || n <= grain){
+        for(uint j = start; j < end; j++){
+            fn(j, 0);
+        }
+        return;
     }
-};
 
-template<typename T> class Dispatcher{
-    public:
+    ParallelJob job;
+    job.run = ParallelTaskInvoke<Function>;
+    job.fn = &fn;
+    ParallelPool_Run(&job, start, end, grain);
+}
+
+/*
+* Same as ParallelFor but every index is its own chunk. Use this when the cost of each
+* index is very different, i.e.: searching files of different sizes.
+*/
+template<typename Function>
+void ParallelForDynamic(const char *desc, uint start, uint end, const Function &fn){
+    ParallelFor(desc, start, end, fn, 1);
+}
+
+/*
+* Tasks run a function once in the pool and give back a TaskFuture to get its
+* result. The function is moved into the task so everything it needs must be
+* captured by value, the caller can return while it runs. Tasks are not meant to
+* block for long as they take a worker of the pool while running.
+*/
+struct TaskVoid{};
+
+template<typename T> struct TaskResultType{ typedef T type; };
+template<> struct TaskResultType<void>{ typedef TaskVoid type; };
+
+struct TaskStateBase{
     std::mutex mutex;
     std::condition_variable cond;
-    HostDispatcher hostDisp;
+    bool done = false;
+    bool cancelled = false; // done without running, there is no value
+    bool released = false; // caller of Task_Run may continue
+};
+
+template<typename T> struct TaskState : public TaskStateBase{
+    std::optional<T> value;
+    std::vector<std::function<void()>> continuations;
+};
+
+/*
+* Given to the functions started with Task_Run so they can let the caller continue
+* before they finish.
+*/
+class TaskContext{
+    public:
+    TaskStateBase *state;
 
-    Dispatcher() = default;
+    TaskContext(TaskStateBase *s) : state(s){}
 
-    void DispatchFunction(const T &func){
-        hostDisp.Init(&mutex, &cond);
+    bool IsCallerReleased(){
+        std::lock_guard<std::mutex> guard(state->mutex);
+        return state->released;
+    }
 
-        std::unique_lock<std::mutex> guard(mutex);
-        std::thread(func, &hostDisp).detach();
-        cond.wait(guard, [this]{ return hostDisp.dispatchFlag == 1; });
+    void ReleaseCaller(){
+        std::lock_guard<std::mutex> guard(state->mutex);
+        state->released = true;
+        state->cond.notify_all();
     }
 };
 
-template<typename Function>
-void DispatchExecution(const Function &fn){
-    static std::map<std::type_index, void *> dispatcherMap;
-    std::type_index index = std::type_index(typeid(Function));
-    Dispatcher<Function> *dispatcher = nullptr;
+template<typename R> struct TaskInvoke{
+    template<typename Function, typename... Args>
+    static R Call(Function &fn, Args&&... args){
+        return fn(std::forward<Args>(args)...);
+    }
+};
 
-    if(dispatcherMap.find(index) == dispatcherMap.end()){
-        dispatcher = new Dispatcher<Function>();
-        dispatcherMap[index] = (void *)dispatcher;
-    }else{
-        dispatcher = (Dispatcher<Function> *)dispatcherMap[index];
+template<> struct TaskInvoke<TaskVoid>{
+    template<typename Function, typename... Args>
+    static TaskVoid Call(Function &fn, Args&&... args){
+        fn(std::forward<Args>(args)...);
+        return TaskVoid();
+    }
+};
+
+template<typename T>
+inline void TaskComplete(std::shared_ptr<TaskState<T>> state, T value){
+    std::vector<std::function<void()>> continuations;
+    {
+        std::lock_guard<std::mutex> guard(state->mutex);
+        state->value = std::move(value);
+        state->done = true;
+        state->released = true;
+        std::swap(continuations, state->continuations);
+        state->cond.notify_all();
     }
 
-    dispatcher->DispatchFunction(fn);
+    for(std::function<void()> &fn : continuations){
+        ParallelPool_Submit(fn);
+    }
 }
 
-template<typename Function>
-void ParallelFor(const char *desc, uint start, uint end, const Function &fn){
-    if(start >= end) return;
+/*
+* Finishes a task that was dropped, continuations are cancelled as well.
+*/
+template<typename T>
+inline void TaskCancel(std::shared_ptr<TaskState<T>> state){
+    std::vector<std::function<void()>> continuations;
+    {
+        std::lock_guard<std::mutex> guard(state->mutex);
+        state->done = true;
+        state->cancelled = true;
+        state->released = true;
+        std::swap(continuations, state->continuations);
+        state->cond.notify_all();
+    }
 
-    if(end - start == 1){
-        for(uint j = start; j < end; j++){
-            fn(j, 0);
-        }
-    }else{
-        int it = 0;
-        std::thread threads[128];
-        int numThreads = GetConcurrency();
-
-        uint n = end - start + 1;
-        uint slice = (uint)std::round(n / (double)numThreads);
-        slice = Max(slice, uint(1));
-
-        auto helper = [&fn](uint j1, uint j2, int id){
-            for(uint j = j1; j < j2; j++){
-                fn(j, id);
+    // continuations see the cancelled state and cancel their own task
+    for(std::function<void()> &fn : continuations){
+        fn();
+    }
+}
+
+template<typename T> class TaskFuture{
+    public:
+    std::shared_ptr<TaskState<T>> state;
+
+    TaskFuture() = default;
+    TaskFuture(std::shared_ptr<TaskState<T>> s) : state(s){}
+
+    bool IsValid(){ return state != nullptr; }
+
+    bool IsReady(){
+        std::lock_guard<std::mutex> guard(state->mutex);
+        return state->done;
+    }
+
+    /*
+    * Checks if the task was dropped because its group was cancelled, in which case
+    * there is no result.
+    */
+    bool IsCancelled(){
+        std::lock_guard<std::mutex> guard(state->mutex);
+        return state->cancelled;
+    }
+
+    void Wait(){
+        std::unique_lock<std::mutex> locker(state->mutex);
+        state->cond.wait(locker, [&]{ return state->done; });
+    }
+
+    /*
+    * Waits for the task and gets its result, the task must not be cancelled.
+    */
+    T &Get(){
+        Wait();
+        AssertA(!state->cancelled, "Result of a cancelled task");
+        return *state->value;
+    }
+
+    /*
+    * Runs fn(result) in the pool once the task finishes. If the task is cancelled
+    * fn is not called and the returned task is cancelled too.
+    */
+    template<typename Function>
+    auto Then(Function fn) -> TaskFuture<typename TaskResultType<
+                                decltype(fn(std::declval<T &>()))>::type>
+    {
+        typedef typename TaskResultType<decltype(fn(std::declval<T &>()))>::type R;
+        std::shared_ptr<TaskState<T>> from = state;
+        std::shared_ptr<TaskState<R>> next = std::make_shared<TaskState<R>>();
+        std::function<void()> continuation = [from, next, fn]() mutable{
+            if(from->cancelled){
+                TaskCancel<R>(next);
+            }else{
+                TaskComplete<R>(next, TaskInvoke<R>::Call(fn, *from->value));
             }
         };
 
-        uint i0 = start;
-        uint i1 = Min(start + slice, end);
-        for(int i = 0; i + 1 < numThreads && i0 < end; i++){
-            threads[it] = std::thread(helper, i0, i1, it);
-            i0 = i1;
-            i1 = Min(i1 + slice, end);
-            it++;
+        std::unique_lock<std::mutex> locker(state->mutex);
+        if(state->done){
+            locker.unlock();
+            if(state->cancelled){
+                continuation();
+            }else{
+                ParallelPool_Submit(continuation);
+            }
+        }else{
+            state->continuations.push_back(continuation);
         }
 
-        if(i0 < end){
-            threads[it] = std::thread(helper, i0, end, it);
-            it++;
+        return TaskFuture<R>(next);
+    }
+};
+
+/*
+* Starts fn() in the pool and returns immediately. Tasks of a 'group' that gets
+* cancelled before they start are dropped, fn should poll the group if it runs for
+* long.
+*/
+template<typename Function>
+auto Task_Spawn(Function fn, TaskPriority priority=TASK_PRIORITY_NORMAL,
+                TaskGroup *group=nullptr)
+    -> TaskFuture<typename TaskResultType<decltype(fn())>::type>
+{
+    typedef typename TaskResultType<decltype(fn())>::type R;
+    std::shared_ptr<TaskState<R>> state = std::make_shared<TaskState<R>>();
+    ParallelPool_Submit([state, fn, group]() mutable{
+        if(TaskGroup_IsCancelled(group)){
+            TaskCancel<R>(state);
+        }else{
+            TaskComplete<R>(state, TaskInvoke<R>::Call(fn));
         }
+    }, priority, group);
 
-        for(int i = 0; i < it; i++){
-            if(threads[i].joinable()){
-                threads[i].join();
-            }
+    return TaskFuture<R>(state);
+}
+
+/*
+* Starts fn(TaskContext *) in the pool and blocks until it either finishes or calls
+* ReleaseCaller, i.e.: LineBuffer_Init tokenizes the first lines of a file before
+* letting the caller display it while the rest is done in background. Since the
+* caller is blocked these run as interactive by default.
+*/
+template<typename Function>
+auto Task_Run(Function fn, TaskPriority priority=TASK_PRIORITY_INTERACTIVE,
+              TaskGroup *group=nullptr)
+    -> TaskFuture<typename TaskResultType<
+                    decltype(fn(std::declval<TaskContext *>()))>::type>
+{
+    typedef typename TaskResultType<decltype(fn(std::declval<TaskContext *>()))>::type R;
+    std::shared_ptr<TaskState<R>> state = std::make_shared<TaskState<R>>();
+    ParallelPool_Submit([state, fn, group]() mutable{
+        if(TaskGroup_IsCancelled(group)){
+            TaskCancel<R>(state);
+        }else{
+            TaskContext context(state.get());
+            TaskComplete<R>(state, TaskInvoke<R>::Call(fn, &context));
         }
-    }
+    }, priority, group);
+
+    std::unique_lock<std::mutex> locker(state->mutex);
+    state->cond.wait(locker, [&]{ return state->released; });
+    return TaskFuture<R>(state);
 }
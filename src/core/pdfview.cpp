@@ -24,7 +24,7 @@ struct PdfViewState{
     int dummy;
 };
 
-bool PdfView_IsDispatchRunning(){ return false; }
+bool PdfView_IsDispatchRunning(PdfViewState *){ return false; }
 bool PdfView_IsEnabled(){ return false; }
 bool PdfView_IsScrolling(PdfViewState *){ return false; }
 bool PdfView_OpenDocument(PdfViewState **, const char *, uint,
@@ -96,6 +96,11 @@ struct PdfViewState{
     PdfViewGraphics graphics;
     PdfScrollState scroll;
     LRUCache<int, PdfPagePixels> cache;
+    // background rendering of the pages around 'prefetchPage', cancelled as soon
+    // as a different page is requested
+    TaskGroup *prefetch;
+    TaskFuture<TaskVoid> prefetchTask;
+    int prefetchPage;
 };
 
 void lru_cache_clear(PdfPagePixels pagePixel){
@@ -130,11 +135,27 @@ PdfScrollState *PdfView_GetScroll(PdfViewState *pdfView){
     return &pdfView->scroll;
 }
 
+static
+void PdfView_CancelPrefetch(PdfViewState *pdfView){
+    if(pdfView->prefetch){
+        TaskGroup_Release(pdfView->prefetch);
+        pdfView->prefetch = nullptr;
+    }
+}
+
 static
 void PdfView_Cleanup(PdfViewState **pdfView){
     if(pdfView && *pdfView){
         LOG_PDF_CLOSE((*pdfView)->document);
 
+        // the prefetch uses the document and the cache, it stops before the
+        // next page so this waits for at most one page
+        if((*pdfView)->prefetchTask.IsValid()){
+            PdfView_CancelPrefetch(*pdfView);
+            (*pdfView)->prefetchTask.Wait();
+            (*pdfView)->prefetchTask = TaskFuture<TaskVoid>();
+        }
+
         if((*pdfView)->document){
             delete (*pdfView)->document;
             (*pdfView)->document = nullptr;
@@ -169,6 +190,7 @@ bool PdfView_OpenDocument(PdfViewState **pdfView, const char *pdf, uint len,
         view = *pdfView;
     }else{
         view = new PdfViewState;
+        view->prefetch = nullptr;
     }
 
     view->docPath = std::string(path, pathLen);
@@ -427,8 +449,9 @@ int select_one(int x, int total, int &dRight, int &dLeft,
     }
 }
 
-static std::atomic<bool> loadDispatchRunning{false};
-bool PdfView_IsDispatchRunning(){ return loadDispatchRunning; }
+bool PdfView_IsDispatchRunning(PdfViewState *pdfView){
+    return pdfView->prefetchTask.IsValid() && !pdfView->prefetchTask.IsReady();
+}
 
 bool PdfView_FetchPage(PdfViewState *pdfView, int pageIndex,
                        bool enforceBoundaries, bool allowDeatch)
@@ -483,39 +506,43 @@ bool PdfView_FetchPage(PdfViewState *pdfView, int pageIndex,
         }
     }
 
-    if(!loadDispatchRunning && allowDeatch){
-        DispatchExecution([&](HostDispatcher *dispatcher){
-            int rangeNum = 0;
-            int local_dpi = dpi;
-            int local_count = pageCount;
-            int local_index = pageIndex;
-            poppler::document *local_doc = pdfView->document;
-            LRUCache<int, PdfPagePixels> *local_cache = &pdfView->cache;
-
-            loadDispatchRunning = true;
+    // pages around one we already moved away from are not worth rendering
+    if(allowDeatch && pdfView->prefetch && pdfView->prefetchPage != pageIndex){
+        PdfView_CancelPrefetch(pdfView);
+    }
 
-            dispatcher->DispatchHost();
+    if(!PdfView_IsDispatchRunning(pdfView) && allowDeatch){
+        poppler::document *document = pdfView->document;
+        LRUCache<int, PdfPagePixels> *cache = &pdfView->cache;
+        if(!pdfView->prefetch){
+            pdfView->prefetch = TaskGroup_Create();
+            pdfView->prefetchPage = pageIndex;
+        }
 
+        TaskGroup *group = pdfView->prefetch;
+        pdfView->prefetchTask = Task_Spawn([document, cache, pageIndex, pageCount,
+                                            dpi, group]()
+        {
             int dRight = 1, dLeft = 1;
             bool should_continue = true;
             for(int s = 0; s < 8 && should_continue; s++){
                 should_continue = false;
-                int where = select_one(local_index, local_count,
-                                       dRight, dLeft, local_cache);
+                if(TaskGroup_IsCancelled(group))
+                    break;
+
+                int where = select_one(pageIndex, pageCount, dRight, dLeft, cache);
                 if(where >= 0){
-                    should_continue = std::abs(where - local_index) < 8;
+                    should_continue = std::abs(where - pageIndex) < 8;
                     if(!should_continue)
                         break;
 
-                    PdfPagePixels pRes = PdfView_RenderPage(local_doc, where, local_dpi);
+                    PdfPagePixels pRes = PdfView_RenderPage(document, where, dpi);
                     if(pRes.pixels){
-                        local_cache->put(where, pRes);
+                        cache->put(where, pRes);
                     }
                 }
             }
-
-            loadDispatchRunning = false;
-        });
+        }, TASK_PRIORITY_IDLE, group);
     }
 
     return rv;
@@ -553,7 +580,7 @@ bool PdfView_Reload(PdfViewState **pdfView){
     //       since it will likely corrupt the thread stack. This likely
     //       needs to be applied to other routines as well. But we'll handle
     //       them if we actually need to.
-    if(PdfView_IsDispatchRunning())
+    if(PdfView_IsDispatchRunning(*pdfView))
         return false;
 
     std::string path = (*pdfView)->docPath;
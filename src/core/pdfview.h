@@ -184,9 +184,9 @@ void PdfView_DisableZoom(PdfViewState *pdfView);
 void PdfView_ResetZoom(PdfViewState *pdfView);
 
 /*
-* Checks if the dispatcher is loading pages _right_now_
+* Checks if the dispatcher is loading pages of the given view _right_now_
 */
-bool PdfView_IsDispatchRunning();
+bool PdfView_IsDispatchRunning(PdfViewState *pdfView);
 
 /*
 * 
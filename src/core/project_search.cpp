@@ -0,0 +1,355 @@
+#include <project_search.h>
+#include <parallel.h>
+#include <utilities.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <algorithm>
+#include <memory>
+
+#if !defined(_WIN32)
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+struct ProjectIgnoreRule{
+    std::string base; // directory of the .gitignore relative to root, i.e.: "src/"
+    std::string pattern;
+    bool negate;
+    bool dirOnly;
+    bool anchored;
+};
+
+typedef std::shared_ptr<const std::vector<ProjectIgnoreRule>> ProjectIgnoreRules;
+
+struct ProjectWalkJob{
+    std::string path;
+    std::string relative;
+    ProjectIgnoreRules rules;
+};
+
+/*
+* Glob matching as used by .gitignore: '*' and '?' do not cross directories,
+* '**' does and a leading '**' followed by '/' also matches zero directories.
+*/
+static bool ProjectGlobMatch(const char *p, const char *s){
+    while(*p){
+        if(p[0] == '*' && p[1] == '*'){
+            p += 2;
+            if(*p == '/'){
+                p++;
+                do{
+                    if(ProjectGlobMatch(p, s)) return true;
+                    while(*s && *s != '/') s++;
+                }while(*s++);
+                return false;
+            }
+
+            do{
+                if(ProjectGlobMatch(p, s)) return true;
+            }while(*s++);
+            return false;
+        }else if(*p == '*'){
+            p++;
+            do{
+                if(ProjectGlobMatch(p, s)) return true;
+            }while(*s && *s++ != '/');
+            return false;
+        }else if(*p == '?'){
+            if(*s == 0 || *s == '/') return false;
+        }else if(*p == '['){
+            const char *q = p + 1;
+            bool negate = *q == '!' || *q == '^';
+            bool found = false;
+            if(negate) q++;
+            do{
+                if(q[1] == '-' && q[2] && q[2] != ']'){
+                    found |= *s >= q[0] && *s <= q[2];
+                    q += 3;
+                }else{
+                    found |= *s == *q;
+                    q++;
+                }
+            }while(*q && *q != ']');
+
+            if(*q == 0 || *s == 0 || *s == '/' || found == negate) return false;
+            p = q;
+        }else{
+            if(*p == '\\' && p[1]) p++;
+            if(*p != *s) return false;
+        }
+
+        p++;
+        s++;
+    }
+
+    return *s == 0;
+}
+
+static void ProjectParseIgnoreFile(const char *path, const std::string &base,
+                                   std::vector<ProjectIgnoreRule> &rules)
+{
+    uint size = 0;
+    char *content = GetFileContents(path, &size);
+    if(!content) return;
+
+    uint i = 0;
+    while(i < size){
+        uint s = i;
+        while(i < size && content[i] != '\n') i++;
+        uint e = i++;
+        while(e > s && (content[e-1] == '\r' || content[e-1] == ' ')) e--;
+        if(e == s || content[s] == '#') continue;
+
+        ProjectIgnoreRule rule;
+        rule.base = base;
+        rule.negate = content[s] == '!';
+        if(rule.negate) s++;
+        else if(content[s] == '\\') s++;
+
+        rule.dirOnly = e > s && content[e-1] == '/';
+        if(rule.dirOnly) e--;
+        if(e == s) continue;
+
+        rule.pattern = std::string(&content[s], e - s);
+        rule.anchored = rule.pattern.find('/') != std::string::npos;
+        if(rule.pattern[0] == '/'){
+            rule.pattern = rule.pattern.substr(1);
+        }
+
+        rules.push_back(rule);
+    }
+
+    AllocatorFree(content);
+}
+
+static bool ProjectIsIgnored(const std::vector<ProjectIgnoreRule> &rules,
+                             const std::string &relative, const char *name, bool isDir)
+{
+    bool ignored = false;
+    for(const ProjectIgnoreRule &rule : rules){
+        if(rule.dirOnly && !isDir) continue;
+        if(ignored != rule.negate) continue; // cannot change the outcome
+
+        bool matched = false;
+        if(rule.anchored){
+            if(relative.compare(0, rule.base.size(), rule.base) == 0){
+                matched = ProjectGlobMatch(rule.pattern.c_str(),
+                                           relative.c_str() + rule.base.size());
+            }
+        }else{
+            matched = ProjectGlobMatch(rule.pattern.c_str(), name);
+        }
+
+        if(matched) ignored = !rule.negate;
+    }
+
+    return ignored;
+}
+
+static void ProjectWalkDirectory(ProjectWalkJob &job, std::vector<ProjectWalkJob> &dirs,
+                                 std::vector<std::string> &files)
+{
+    std::vector<uint8_t> entries;
+    uint32_t count = 0;
+    if(ListFileEntriesLinear((char *)job.path.c_str(), entries, &count) < 0) return;
+
+    ProjectIgnoreRules rules = job.rules;
+    std::string ignorePath = job.path + SEPARATOR_STRING ".gitignore";
+    if(FileExists((char *)ignorePath.c_str())){
+        std::vector<ProjectIgnoreRule> *local = new std::vector<ProjectIgnoreRule>();
+        if(rules) *local = *rules;
+        ProjectParseIgnoreFile(ignorePath.c_str(), job.relative, *local);
+        rules = ProjectIgnoreRules(local);
+    }
+
+    uint at = 0;
+    for(uint32_t i = 0; i < count; i++){
+        uint8_t type = entries[at];
+        uint32_t len = 0;
+        memcpy(&len, &entries[at+1], sizeof(uint32_t));
+        std::string name((char *)&entries[at+1+sizeof(uint32_t)], len);
+        at += 1 + sizeof(uint32_t) + len;
+
+        // hidden entries, this also skips the .git folder
+        if(name[0] == '.') continue;
+
+        bool isDir = type == DescriptorDirectory;
+        std::string relative = job.relative + name;
+        if(rules && ProjectIsIgnored(*rules, relative, name.c_str(), isDir)) continue;
+
+        std::string path = job.path + SEPARATOR_STRING + name;
+        if(isDir){
+            dirs.push_back({ path, relative + "/", rules });
+        }else{
+            files.push_back(path);
+        }
+    }
+}
+
+void ProjectSearch_ListFiles(const char *root, std::vector<std::string> &files,
+                             std::atomic<int> *cancel)
+{
+    // the tree is walked a level at a time, the directories of a level are listed
+    // in the pool and each worker collects what it finds in its own lists
+    uint numThreads = (uint)GetConcurrency();
+    std::vector<std::vector<ProjectWalkJob>> dirs(numThreads);
+    std::vector<std::vector<std::string>> found(numThreads);
+    std::vector<ProjectWalkJob> level;
+    level.push_back({ std::string(root), std::string(), nullptr });
+
+    while(level.size() > 0 && !(cancel && *cancel)){
+        ParallelForDynamic("Project Walk", 0, level.size(), [&](int i, int tid){
+            if(cancel && *cancel) return;
+            ProjectWalkDirectory(level[i], dirs[tid], found[tid]);
+        });
+
+        level.clear();
+        for(uint i = 0; i < numThreads; i++){
+            level.insert(level.end(), dirs[i].begin(), dirs[i].end());
+            files.insert(files.end(), found[i].begin(), found[i].end());
+            dirs[i].clear();
+            found[i].clear();
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+}
+
+int ProjectSearch_MapFile(const char *path, ProjectMappedFile *file){
+    file->data = nullptr;
+    file->size = 0;
+    file->mapped = false;
+#if !defined(_WIN32)
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return 0;
+
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size >= (off_t)UINT_MAX){
+        close(fd);
+        return 0;
+    }
+
+    file->size = (uint)st.st_size;
+    if(file->size > 0){
+        void *ptr = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(ptr == MAP_FAILED){
+            close(fd);
+            return 0;
+        }
+
+    #if defined(MADV_SEQUENTIAL)
+        madvise(ptr, file->size, MADV_SEQUENTIAL);
+    #endif
+        file->data = (char *)ptr;
+        file->mapped = true;
+    }
+
+    close(fd);
+    return 1;
+#else
+    file->data = GetFileContents(path, &file->size);
+    return file->data != nullptr;
+#endif
+}
+
+void ProjectSearch_UnmapFile(ProjectMappedFile *file){
+#if !defined(_WIN32)
+    if(file->mapped){
+        munmap(file->data, file->size);
+    }
+#else
+    if(file->data){
+        AllocatorFree(file->data);
+    }
+#endif
+    file->data = nullptr;
+    file->size = 0;
+}
+
+bool ProjectSearch_IsBinary(const char *data, uint size){
+    uint probe = size < PROJECT_SEARCH_BINARY_PROBE ? size : PROJECT_SEARCH_BINARY_PROBE;
+    return probe > 0 && memchr(data, 0, probe) != nullptr;
+}
+
+static void ProjectReportLine(const char *data, uint size, uint lineStart, uint line,
+                              uint col, const ProjectSearchCallback &callback)
+{
+    const char *end = (const char *)memchr(&data[lineStart], '\n', size - lineStart);
+    uint lineEnd = end ? (uint)(end - data) : size;
+    if(lineEnd > lineStart && data[lineEnd-1] == '\r') lineEnd--;
+    callback(line, col, &data[lineStart], lineEnd - lineStart);
+}
+
+int ProjectSearch_File(const char *path, SearchQuery *query,
+                       const ProjectSearchCallback &callback,
+                       std::atomic<int> *cancel)
+{
+    ProjectMappedFile file;
+    if(!ProjectSearch_MapFile(path, &file)) return -1;
+
+    const char *data = file.data;
+    uint size = file.size;
+    int found = 0;
+    if(size == 0 || ProjectSearch_IsBinary(data, size)){
+        ProjectSearch_UnmapFile(&file);
+        return 0;
+    }
+
+    uint line = 0;
+    uint lineStart = 0;
+    if(query->regex){
+        // regexes can be anchored so they must see a single line at a time
+        while(lineStart < size && !(cancel && *cancel)){
+            const char *end = (const char *)memchr(&data[lineStart], '\n',
+                                                   size - lineStart);
+            uint lineEnd = end ? (uint)(end - data) : size;
+            uint len = lineEnd - lineStart;
+            if(len > 0 && data[lineEnd-1] == '\r') len--;
+
+            uint matchLen = 0;
+            int at = SearchQuery_Find(query, &data[lineStart], len, 0, &matchLen);
+            if(at >= 0){
+                callback(line, (uint)at, &data[lineStart], len);
+                found++;
+            }
+
+            lineStart = lineEnd + 1;
+            line++;
+        }
+    }else{
+        // literals cannot span lines so the whole file is scanned at once and
+        // lines are only counted up to each match
+        uint from = 0;
+        uint counted = 0;
+        while(from < size && !(cancel && *cancel)){
+            uint matchLen = 0;
+            int at = SearchQuery_Find(query, data, size, from, &matchLen);
+            if(at < 0) break;
+
+            const char *nl = nullptr;
+            while((nl = (const char *)memchr(&data[counted], '\n', at - counted))){
+                counted = (uint)(nl - data) + 1;
+                lineStart = counted;
+                line++;
+            }
+            counted = (uint)at;
+
+            ProjectReportLine(data, size, lineStart, line, (uint)at - lineStart, callback);
+            found++;
+
+            // a single entry is reported per line, continue on the next one
+            const char *end = (const char *)memchr(&data[at], '\n', size - at);
+            if(!end) break;
+
+            from = (uint)(end - data) + 1;
+            counted = from;
+            lineStart = from;
+            line++;
+        }
+    }
+
+    ProjectSearch_UnmapFile(&file);
+    return found;
+}
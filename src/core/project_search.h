@@ -0,0 +1,73 @@
+/* date = October 19th 2026 16:10 */
+#pragma once
+#include <types.h>
+#include <search.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+/*
+* Search over the files of a directory tree without loading them into LineBuffers.
+* The tree is walked with all available threads, entries matched by .gitignore
+* files, hidden entries and the .git folder are skipped. Files are memory mapped
+* and scanned with the search engine directly, so nothing is tokenized or copied
+* until the user actually opens a file.
+*/
+
+// size of the block inspected for NUL bytes when deciding if a file is binary
+#define PROJECT_SEARCH_BINARY_PROBE 4096
+
+/*
+* A file mapped into memory, on targets without mmap the contents are read instead.
+*/
+typedef struct ProjectMappedFile{
+    char *data;
+    uint size;
+    bool mapped;
+}ProjectMappedFile;
+
+/*
+* Maps the regular file at 'path' for reading. Returns 0 in case the file
+* cannot be read. Empty files are valid and have 'data' = nullptr.
+*/
+int ProjectSearch_MapFile(const char *path, ProjectMappedFile *file);
+
+/*
+* Releases a file mapped with ProjectSearch_MapFile.
+*/
+void ProjectSearch_UnmapFile(ProjectMappedFile *file);
+
+/*
+* Checks if the contents of a file look binary, i.e.: a NUL byte in the first
+* PROJECT_SEARCH_BINARY_PROBE bytes.
+*/
+bool ProjectSearch_IsBinary(const char *data, uint size);
+
+/*
+* Callback invoked for every line with a match, 'line' and 'col' locate the first
+* match in the line and 'text' with length 'len' is the content of the line
+* without the line terminator. The data pointed by 'text' is only valid during
+* the call.
+*/
+typedef std::function<void(uint line, uint col, const char *text, uint len)>
+        ProjectSearchCallback;
+
+/*
+* Lists all files under 'root' that should be searched, paths are absolute and
+* sorted so that results are always reported in the same order. The walk stops
+* early in case 'cancel' is given and becomes non zero.
+*/
+void ProjectSearch_ListFiles(const char *root, std::vector<std::string> &files,
+                             std::atomic<int> *cancel=nullptr);
+
+/*
+* Searches the file at 'path' for 'query' calling 'callback' once per line that
+* contains a match. Binary files, i.e.: files with a NUL byte in their first
+* block, are skipped. Returns the amount of lines reported or -1 in case the
+* file could not be read. It is safe to call this from multiple threads as long
+* as each one uses its own query, see SearchQuery.
+*/
+int ProjectSearch_File(const char *path, SearchQuery *query,
+                       const ProjectSearchCallback &callback,
+                       std::atomic<int> *cancel=nullptr);
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <utilities.h>
 #include <storage.h>
+#include <search.h>
 
 #define QUERY_BAR_HISTORY_PATH ".history"
 
@@ -28,6 +29,45 @@ std::string QueryBarHistory_GetPath(){
     return path;
 }
 
+static void QueryBar_StoreSearchValue(char **dst, uint *dstLen, uint *dstSize,
+                                      char *src, uint len)
+{
+    if(*dstSize < len + 1){
+        uint size = len + 1 + DefaultAllocatorSize;
+        if(*dst == nullptr){
+            *dst = AllocatorGetN(char, size);
+        }else{
+            *dst = AllocatorExpand(char, *dst, size, *dstSize);
+        }
+        *dstSize = size;
+    }
+
+    if(len > 0){
+        Memcpy(*dst, src, len);
+    }
+
+    (*dst)[len] = 0;
+    *dstLen = len;
+}
+
+static void QueryBar_ReleaseSearchValues(QueryBarCmdSearchAndReplace *replace){
+    if(replace->toLocate){
+        AllocatorFree(replace->toLocate);
+    }
+
+    if(replace->toReplace){
+        AllocatorFree(replace->toReplace);
+    }
+
+    replace->toLocate = nullptr;
+    replace->toReplace = nullptr;
+    replace->toLocateSize = 0;
+    replace->toReplaceSize = 0;
+    replace->toLocateLen = 0;
+    replace->toReplaceLen = 0;
+    replace->replacedLen = 0;
+}
+
 void AppQueryBarSearchJumpToResult(QueryBar *bar, View *view);
 // called when user pressed enter and the query bar is in SearchAndReplace mode
 static int QueryBar_SearchAndReplaceProcess(QueryBar *queryBar, View *view, int fromEnter=0){
@@ -40,39 +80,41 @@ static int QueryBar_SearchAndReplaceProcess(QueryBar *queryBar, View *view, int
 
     if(searchLen > 0 || fromEnter){
         if(replace->state == QUERY_BAR_SEARCH_AND_REPLACE_SEARCH && searchLen > 0){
-            AssertA(searchLen < sizeof(replace->toLocate), "Query is too big");
-
-            Memcpy(replace->toLocate, search, searchLen);
-            replace->toLocateLen = searchLen;
-            replace->toLocate[searchLen] = 0;
+            QueryBar_StoreSearchValue(&replace->toLocate, &replace->toLocateLen,
+                                      &replace->toLocateSize, search, searchLen);
 
             replace->state = QUERY_BAR_SEARCH_AND_REPLACE_REPLACE;
             QueryBar_StartCommand(queryBar, QUERY_BAR_CMD_SEARCH_AND_REPLACE);
 
         }else if(replace->state == QUERY_BAR_SEARCH_AND_REPLACE_REPLACE && searchLen > 0){
-            AssertA(searchLen < sizeof(replace->toReplace), "Query is too big");
-
-            Memcpy(replace->toReplace, search, searchLen);
-            replace->toReplaceLen = searchLen;
-            replace->toReplace[searchLen] = 0;
+            QueryBar_StoreSearchValue(&replace->toReplace, &replace->toReplaceLen,
+                                      &replace->toReplaceSize, search, searchLen);
 
             replace->state = QUERY_BAR_SEARCH_AND_REPLACE_EXECUTE;
         }else if(replace->state == QUERY_BAR_SEARCH_AND_REPLACE_REPLACE){
             // this is actually an erase
-            replace->toReplaceLen = 0;
-            replace->toReplace[0] = 0;
+            QueryBar_StoreSearchValue(&replace->toReplace, &replace->toReplaceLen,
+                                      &replace->toReplaceSize, nullptr, 0);
             replace->state = QUERY_BAR_SEARCH_AND_REPLACE_EXECUTE;
         }else if(replace->state == QUERY_BAR_SEARCH_AND_REPLACE_ASK){
             // TODO: This is a OK on the execute question we need to replace the content
             int toNext = 1;
+            replace->replacedLen = 0;
             if(fromEnter){
-                replace->searchCallback(queryBar, view, 1);
+                replace->searchCallback(queryBar, view, INTERACTIVE_SEARCH_ACCEPT);
             }else{
                 if(search[0] == 'y' || search[0] == 'Y'){
-                    replace->searchCallback(queryBar, view, 1);
+                    replace->searchCallback(queryBar, view, INTERACTIVE_SEARCH_ACCEPT);
                 }else if(search[0] == 'n' || search[0] == 'N'){
-                    replace->searchCallback(queryBar, view, 0);
-                    queryBar->searchCmd.position += Max(1, replace->toLocateLen);
+                    replace->searchCallback(queryBar, view, INTERACTIVE_SEARCH_REJECT);
+                    queryBar->searchCmd.position += Max(1, queryBar->searchCmd.length);
+                }else if(search[0] == 'a' || search[0] == 'A'){
+                    // replace everything at once, there is nothing left to ask
+                    replace->searchCallback(queryBar, view, search[0] == 'a' ?
+                                            INTERACTIVE_SEARCH_ACCEPT_REMAINING :
+                                            INTERACTIVE_SEARCH_ACCEPT_ALL_FILES);
+                    toNext = 0;
+                    r = 1;
                 }else{
                     toNext = 0;
                     r = 0;
@@ -89,8 +131,10 @@ static int QueryBar_SearchAndReplaceProcess(QueryBar *queryBar, View *view, int
             BufferView *bView = View_GetBufferView(view);
             if(queryBar->searchCmd.valid){
                 uint location = queryBar->searchCmd.position;
-                uint newSize  = queryBar->replaceCmd.toReplaceLen;
+                uint newSize  = queryBar->replaceCmd.replacedLen;
                 uint newPos = location + newSize;
+                // empty matches must still move forward
+                if(queryBar->searchCmd.length == 0 && newSize == 0) newPos++;
                 cursor.textPosition = vec2ui(queryBar->searchCmd.lineNo, newPos);
             }else{
                 cursor = bView->sController.cursor;
@@ -176,10 +220,16 @@ static void QueryBar_StartCommand(QueryBar *queryBar, QueryBarCommand cmd,
     queryBar->pendingFilter = INPUT_FILTER_INITIALIZER;
     switch(cmd){
         case QUERY_BAR_CMD_SEARCH:{
-            len = snprintf(title, sizeof(title), "Search: ");
+            if(AppGetSearchFlags() & SEARCH_FLAG_REGEX)
+                len = snprintf(title, sizeof(title), "Regex-Search: ");
+            else
+                len = snprintf(title, sizeof(title), "Search: ");
         } break;
         case QUERY_BAR_CMD_REVERSE_SEARCH:{
-            len = snprintf(title, sizeof(title), "Rev-Search: ");
+            if(AppGetSearchFlags() & SEARCH_FLAG_REGEX)
+                len = snprintf(title, sizeof(title), "Regex-Rev-Search: ");
+            else
+                len = snprintf(title, sizeof(title), "Rev-Search: ");
         } break;
         case QUERY_BAR_CMD_JUMP_TO_LINE:{
             len = snprintf(title, sizeof(title), "Goto Line: ");
@@ -200,7 +250,7 @@ static void QueryBar_StartCommand(QueryBar *queryBar, QueryBarCommand cmd,
             }else if(replace->state == QUERY_BAR_SEARCH_AND_REPLACE_REPLACE){
                 len = snprintf(title, sizeof(title), "Search and Replace (Replace): ");
             }else if(replace->state == QUERY_BAR_SEARCH_AND_REPLACE_ASK){
-                len = snprintf(title, sizeof(title), "Replace (y/n) ? ");
+                len = snprintf(title, sizeof(title), "Replace (y/n/a/A) ? ");
             }else{
                 AssertA(0, "Invalid state");
             }
@@ -268,8 +318,7 @@ void QueryBar_Free(QueryBar *queryBar){
     queryBar->cancelCallback = nullptr;
     queryBar->commitCallback = nullptr;
     queryBar->cmd = QUERY_BAR_CMD_NONE;
-    replace->toLocateLen = 0;
-    replace->toReplaceLen = 0;
+    QueryBar_ReleaseSearchValues(replace);
     replace->searchCallback = QueryBar_EmptySearchReplaceCallback;
 }
 
@@ -294,8 +343,9 @@ void QueryBar_Initialize(QueryBar *queryBar){
     queryBar->cancelCallback = nullptr;
     queryBar->commitCallback = nullptr;
     queryBar->cmd = QUERY_BAR_CMD_NONE;
-    replace->toLocateLen = 0;
-    replace->toReplaceLen = 0;
+    replace->toLocate = nullptr;
+    replace->toReplace = nullptr;
+    QueryBar_ReleaseSearchValues(replace);
     replace->searchCallback = QueryBar_EmptySearchReplaceCallback;
     queryBar->filter.toHistory = false;
     queryBar->filter.allowCursorJump = false;
@@ -473,6 +523,21 @@ void QueryBar_GetTitle(QueryBar *queryBar, char **ptr, uint *len){
     *len = queryBar->writePos;
 }
 
+void QueryBar_SetTitle(QueryBar *queryBar, char *title, uint titlelen){
+    AssertA(queryBar != nullptr, "Invalid QueryBar pointer");
+    char str[64];
+    uint lastp = queryBar->cursor.textPosition.y - queryBar->writePosU8;
+    uint len = snprintf(str, sizeof(str), "%.*s: ", (int)titlelen, title);
+    len = len < sizeof(str) ? len : sizeof(str) - 1;
+
+    Buffer_RemoveRange(&queryBar->buffer, 0, queryBar->writePosU8, &queryBar->encoder);
+    queryBar->writePos = Buffer_InsertStringAt(&queryBar->buffer, 0, str, len, &queryBar->encoder);
+    queryBar->writePosU8 =
+            Buffer_Utf8RawPositionToPosition(&queryBar->buffer, queryBar->writePos,
+                                             &queryBar->encoder);
+    queryBar->cursor.textPosition.y = queryBar->writePosU8 + lastp;
+}
+
 void QueryBar_SetEntry(QueryBar *queryBar, View *view, char *str, uint len){
     if(QueryBar_AcceptInput(queryBar, str, len, 1)){
         uint p = queryBar->writePosU8;
@@ -646,6 +711,13 @@ void QueryBar_GetSearchResult(QueryBar *queryBar, QueryBarCmdSearch **result){
 int QueryBar_Reset(QueryBar *queryBar, View *view, int commit){
     BufferView *bView = View_GetBufferView(view);
     int r = 1;
+    if(queryBar->cmd == QUERY_BAR_CMD_SEARCH ||
+       queryBar->cmd == QUERY_BAR_CMD_REVERSE_SEARCH ||
+       queryBar->cmd == QUERY_BAR_CMD_SEARCH_AND_REPLACE)
+    {
+        MatchSet_Clear(bView->lineBuffer);
+    }
+
     if(commit == 0){
         if(queryBar->cmd == QUERY_BAR_CMD_CUSTOM ||
            queryBar->cmd == QUERY_BAR_CMD_INTERACTIVE)
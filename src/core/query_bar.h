@@ -185,6 +185,12 @@ uint QueryBar_GetRenderContent(QueryBar *queryBar, std::string &str);
 */
 void QueryBar_GetTitle(QueryBar *queryBar, char **ptr, uint *len);
 
+/*
+* Replaces the title of an active custom QueryBar keeping the content written
+* after it and the cursor position, i.e.: to display a live counter.
+*/
+void QueryBar_SetTitle(QueryBar *queryBar, char *title, uint titlelen);
+
 /*
 * Inserts a string into the a QueryBar. Returns 1 in case a change was made
 * into the view according to the active command, 0 otherwise.
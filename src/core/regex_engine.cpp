@@ -0,0 +1,1123 @@
+#include <regex_engine.h>
+#include <utilities.h>
+#include <string.h>
+#include <algorithm>
+
+/*
+* Limits: the amount of instructions bounds the recursion used when expanding
+* threads of the NFA and the amount of DFA states bounds the memory of the cache,
+* when it is reached the cache is flushed and states are computed again.
+*/
+#define REGEX_MAX_PROGRAM    4096
+#define REGEX_MAX_REPEAT     256
+#define REGEX_MAX_DFA_STATES 2048
+
+// programs start with a ".*?" loop so the DFA can also run unanchored, the
+// pattern itself starts after it
+#define REGEX_PROGRAM_START  3
+
+#define REGEX_CLOSURE_BEGIN  (1 << 0)
+#define REGEX_CLOSURE_END    (1 << 1)
+#define REGEX_CLOSURE_ASSUME (1 << 2)
+
+typedef enum{
+    REGEX_NODE_EMPTY = 0,
+    REGEX_NODE_CLASS,
+    REGEX_NODE_CONCAT,
+    REGEX_NODE_ALTERNATE,
+    REGEX_NODE_REPEAT,
+    REGEX_NODE_GROUP,
+    REGEX_NODE_ASSERT,
+}RegexNodeType;
+
+struct RegexNode{
+    RegexNodeType type;
+    int value; // class id, group id (-1 for non-capturing) or assertion op
+    int literal; // byte this class was created from, -1 if not a literal
+    int min, max; // repeat boundaries, max < 0 is unbounded
+    bool greedy;
+    std::vector<int> kids;
+};
+
+struct RegexParser{
+    const char *p;
+    const char *end;
+    const char *error;
+    int flags;
+    uint groups;
+    bool lazy;
+    Regex *regex;
+    std::vector<RegexNode> nodes;
+};
+
+/*
+* Bytes >= 0x80 are part of UTF-8 sequences and are considered part of words, this
+* is used both by \w and by word boundaries so that they agree with each other.
+*/
+static inline int RegexIsWordChar(uint8 c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static inline void RegexClassSet(RegexClass *cls, uint8 c){
+    cls->bits[c >> 5] |= (1u << (c & 31));
+}
+
+static inline int RegexClassHas(const RegexClass *cls, uint8 c){
+    return (cls->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static void RegexClassSetRange(RegexClass *cls, uint8 a, uint8 b){
+    for(uint c = a; c <= b; c++){
+        RegexClassSet(cls, (uint8)c);
+    }
+}
+
+static void RegexClassFold(RegexClass *cls){
+    for(uint c = 'a'; c <= 'z'; c++){
+        uint8 u = (uint8)(c - ('a' - 'A'));
+        if(RegexClassHas(cls, (uint8)c) || RegexClassHas(cls, u)){
+            RegexClassSet(cls, (uint8)c);
+            RegexClassSet(cls, u);
+        }
+    }
+}
+
+static void RegexClassInvert(RegexClass *cls){
+    for(uint i = 0; i < 8; i++){
+        cls->bits[i] = ~cls->bits[i];
+    }
+}
+
+static void RegexClassMerge(RegexClass *dst, const RegexClass *src){
+    for(uint i = 0; i < 8; i++){
+        dst->bits[i] |= src->bits[i];
+    }
+}
+
+/*
+* Fills 'cls' for the shorthand classes \d \w \s and their negations,
+* returns 0 in case 'c' is not a shorthand.
+*/
+static int RegexShorthandClass(char c, RegexClass *cls){
+    RegexClass tmp;
+    memset(&tmp, 0, sizeof(RegexClass));
+    switch(c){
+        case 'd': case 'D':{
+            RegexClassSetRange(&tmp, '0', '9');
+        } break;
+        case 'w': case 'W':{
+            for(uint b = 0; b < 256; b++){
+                if(RegexIsWordChar((uint8)b)) RegexClassSet(&tmp, (uint8)b);
+            }
+        } break;
+        case 's': case 'S':{
+            const char *spaces = " \t\n\r\f\v";
+            for(const char *s = spaces; *s; s++){
+                RegexClassSet(&tmp, (uint8)*s);
+            }
+        } break;
+        default: return 0;
+    }
+
+    if(c == 'D' || c == 'W' || c == 'S'){
+        RegexClassInvert(&tmp);
+    }
+
+    RegexClassMerge(cls, &tmp);
+    return 1;
+}
+
+static uint8 RegexEscapedByte(char c){
+    switch(c){
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        default: return (uint8)c;
+    }
+}
+
+static int RegexNewNode(RegexParser *parser, RegexNodeType type, int value=0){
+    RegexNode node;
+    node.type = type;
+    node.value = value;
+    node.literal = -1;
+    node.min = 0;
+    node.max = 0;
+    node.greedy = true;
+    parser->nodes.push_back(node);
+    return (int)parser->nodes.size() - 1;
+}
+
+static int RegexNewClassNode(RegexParser *parser, RegexClass *cls, int literal){
+    if(parser->flags & SEARCH_FLAG_CASE_INSENSITIVE){
+        RegexClassFold(cls);
+    }
+
+    parser->regex->classes.push_back(*cls);
+    int id = RegexNewNode(parser, REGEX_NODE_CLASS,
+                          (int)parser->regex->classes.size() - 1);
+    parser->nodes[id].literal = literal;
+    return id;
+}
+
+static int RegexParseAlternate(RegexParser *parser);
+
+static int RegexParseBracket(RegexParser *parser){
+    RegexClass cls;
+    bool negate = false;
+    memset(&cls, 0, sizeof(RegexClass));
+
+    if(parser->p < parser->end && *parser->p == '^'){
+        negate = true;
+        parser->p++;
+    }
+
+    bool first = true;
+    while(parser->p < parser->end && (*parser->p != ']' || first)){
+        first = false;
+        uint8 lo = (uint8)*parser->p++;
+        if(lo == '\\'){
+            if(parser->p >= parser->end){
+                parser->error = "Trailing backslash";
+                return -1;
+            }
+
+            char e = *parser->p++;
+            if(RegexShorthandClass(e, &cls)){
+                continue;
+            }
+            lo = RegexEscapedByte(e);
+        }
+
+        uint8 hi = lo;
+        if(parser->p + 1 < parser->end && *parser->p == '-' && parser->p[1] != ']'){
+            parser->p++;
+            hi = (uint8)*parser->p++;
+            if(hi == '\\'){
+                if(parser->p >= parser->end){
+                    parser->error = "Trailing backslash";
+                    return -1;
+                }
+                hi = RegexEscapedByte(*parser->p++);
+            }
+
+            if(hi < lo){
+                parser->error = "Invalid class range";
+                return -1;
+            }
+        }
+
+        RegexClassSetRange(&cls, lo, hi);
+    }
+
+    if(parser->p >= parser->end){
+        parser->error = "Missing ]";
+        return -1;
+    }
+
+    parser->p++;
+    if(parser->flags & SEARCH_FLAG_CASE_INSENSITIVE){
+        RegexClassFold(&cls);
+    }
+
+    if(negate){
+        RegexClassInvert(&cls);
+    }
+
+    // folding was already done before negation
+    parser->regex->classes.push_back(cls);
+    return RegexNewNode(parser, REGEX_NODE_CLASS, (int)parser->regex->classes.size() - 1);
+}
+
+static int RegexParseAtom(RegexParser *parser){
+    RegexClass cls;
+    memset(&cls, 0, sizeof(RegexClass));
+    char c = *parser->p++;
+    switch(c){
+        case '(':{
+            int capture = -1;
+            if(parser->p + 1 < parser->end && parser->p[0] == '?' && parser->p[1] == ':'){
+                parser->p += 2;
+            }else{
+                if(parser->groups >= REGEX_MAX_GROUPS){
+                    parser->error = "Too many groups";
+                    return -1;
+                }
+                capture = (int)parser->groups++;
+            }
+
+            int sub = RegexParseAlternate(parser);
+            if(sub < 0) return -1;
+            if(parser->p >= parser->end || *parser->p != ')'){
+                parser->error = "Missing )";
+                return -1;
+            }
+
+            parser->p++;
+            int id = RegexNewNode(parser, REGEX_NODE_GROUP, capture);
+            parser->nodes[id].kids.push_back(sub);
+            return id;
+        }
+        case '[': return RegexParseBracket(parser);
+        case '.':{
+            RegexClassSetRange(&cls, 0, 255);
+            cls.bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+            return RegexNewClassNode(parser, &cls, -1);
+        }
+        case '^': return RegexNewNode(parser, REGEX_NODE_ASSERT, REGEX_OP_BOL);
+        case '$': return RegexNewNode(parser, REGEX_NODE_ASSERT, REGEX_OP_EOL);
+        case '*': case '+': case '?':{
+            parser->error = "Nothing to repeat";
+            return -1;
+        }
+        case '\\':{
+            if(parser->p >= parser->end){
+                parser->error = "Trailing backslash";
+                return -1;
+            }
+
+            char e = *parser->p++;
+            if(e == 'b'){
+                return RegexNewNode(parser, REGEX_NODE_ASSERT, REGEX_OP_WORD_BOUNDARY);
+            }else if(e == 'B'){
+                return RegexNewNode(parser, REGEX_NODE_ASSERT, REGEX_OP_NOT_WORD_BOUNDARY);
+            }else if(RegexShorthandClass(e, &cls)){
+                return RegexNewClassNode(parser, &cls, -1);
+            }
+
+            uint8 b = RegexEscapedByte(e);
+            RegexClassSet(&cls, b);
+            return RegexNewClassNode(parser, &cls, b);
+        }
+        default:{
+            RegexClassSet(&cls, (uint8)c);
+            return RegexNewClassNode(parser, &cls, (uint8)c);
+        }
+    }
+}
+
+/*
+* Parses the contents of a {n,m} quantifier, returns 0 and leaves the parser
+* untouched in case it is not a valid quantifier so that '{' is taken as literal.
+*/
+static int RegexParseBraces(RegexParser *parser, int *min, int *max){
+    const char *p = parser->p + 1;
+    int lo = 0, hi = 0;
+    bool digits = false;
+    while(p < parser->end && *p >= '0' && *p <= '9'){
+        lo = lo * 10 + (*p++ - '0');
+        digits = true;
+        if(lo > REGEX_MAX_REPEAT) return 0;
+    }
+
+    if(!digits || p >= parser->end) return 0;
+    hi = lo;
+    if(*p == ','){
+        p++;
+        hi = -1;
+        if(p < parser->end && *p >= '0' && *p <= '9'){
+            hi = 0;
+            while(p < parser->end && *p >= '0' && *p <= '9'){
+                hi = hi * 10 + (*p++ - '0');
+                if(hi > REGEX_MAX_REPEAT) return 0;
+            }
+        }
+    }
+
+    if(p >= parser->end || *p != '}') return 0;
+    if(hi >= 0 && hi < lo) return 0;
+
+    parser->p = p + 1;
+    *min = lo;
+    *max = hi;
+    return 1;
+}
+
+static int RegexParseRepeat(RegexParser *parser){
+    int atom = RegexParseAtom(parser);
+    if(atom < 0) return -1;
+
+    while(parser->p < parser->end){
+        int min = 0, max = 0;
+        char c = *parser->p;
+        if(c == '*'){
+            min = 0; max = -1;
+            parser->p++;
+        }else if(c == '+'){
+            min = 1; max = -1;
+            parser->p++;
+        }else if(c == '?'){
+            min = 0; max = 1;
+            parser->p++;
+        }else if(c == '{'){
+            if(!RegexParseBraces(parser, &min, &max)) break;
+        }else{
+            break;
+        }
+
+        if(parser->nodes[atom].type == REGEX_NODE_ASSERT){
+            parser->error = "Nothing to repeat";
+            return -1;
+        }
+
+        int id = RegexNewNode(parser, REGEX_NODE_REPEAT);
+        parser->nodes[id].min = min;
+        parser->nodes[id].max = max;
+        parser->nodes[id].kids.push_back(atom);
+        if(parser->p < parser->end && *parser->p == '?'){
+            parser->nodes[id].greedy = false;
+            parser->lazy = true;
+            parser->p++;
+        }
+
+        atom = id;
+    }
+
+    return atom;
+}
+
+static int RegexParseConcat(RegexParser *parser){
+    int id = RegexNewNode(parser, REGEX_NODE_CONCAT);
+    while(parser->p < parser->end && *parser->p != '|' && *parser->p != ')'){
+        int kid = RegexParseRepeat(parser);
+        if(kid < 0) return -1;
+        parser->nodes[id].kids.push_back(kid);
+    }
+
+    return id;
+}
+
+static int RegexParseAlternate(RegexParser *parser){
+    int first = RegexParseConcat(parser);
+    if(first < 0) return -1;
+    if(parser->p >= parser->end || *parser->p != '|') return first;
+
+    int id = RegexNewNode(parser, REGEX_NODE_ALTERNATE);
+    parser->nodes[id].kids.push_back(first);
+    while(parser->p < parser->end && *parser->p == '|'){
+        parser->p++;
+        int kid = RegexParseConcat(parser);
+        if(kid < 0) return -1;
+        parser->nodes[id].kids.push_back(kid);
+    }
+
+    return id;
+}
+
+static int RegexEmit(Regex *regex, RegexOp op, int x=0, int y=0){
+    RegexInst inst = { op, x, y };
+    regex->program.push_back(inst);
+    return (int)regex->program.size() - 1;
+}
+
+static int RegexCodegen(RegexParser *parser, int id){
+    Regex *regex = parser->regex;
+    if(regex->program.size() > REGEX_MAX_PROGRAM){
+        parser->error = "Pattern is too large";
+        return 0;
+    }
+
+    RegexNode *node = &parser->nodes[id];
+    switch(node->type){
+        case REGEX_NODE_EMPTY: break;
+        case REGEX_NODE_CLASS:{
+            RegexEmit(regex, REGEX_OP_CLASS, node->value);
+        } break;
+        case REGEX_NODE_ASSERT:{
+            RegexEmit(regex, (RegexOp)node->value);
+        } break;
+        case REGEX_NODE_CONCAT:{
+            for(int kid : node->kids){
+                if(!RegexCodegen(parser, kid)) return 0;
+            }
+        } break;
+        case REGEX_NODE_GROUP:{
+            if(node->value >= 0){
+                RegexEmit(regex, REGEX_OP_SAVE, 2 * node->value);
+            }
+
+            if(!RegexCodegen(parser, node->kids[0])) return 0;
+
+            if(node->value >= 0){
+                RegexEmit(regex, REGEX_OP_SAVE, 2 * node->value + 1);
+            }
+        } break;
+        case REGEX_NODE_ALTERNATE:{
+            std::vector<int> jumps;
+            uint n = node->kids.size();
+            for(uint i = 0; i < n; i++){
+                int split = -1;
+                if(i + 1 < n){
+                    split = RegexEmit(regex, REGEX_OP_SPLIT);
+                    regex->program[split].x = split + 1;
+                }
+
+                if(!RegexCodegen(parser, parser->nodes[id].kids[i])) return 0;
+
+                if(i + 1 < n){
+                    jumps.push_back(RegexEmit(regex, REGEX_OP_JMP));
+                    regex->program[split].y = (int)regex->program.size();
+                }
+            }
+
+            for(int j : jumps){
+                regex->program[j].x = (int)regex->program.size();
+            }
+        } break;
+        case REGEX_NODE_REPEAT:{
+            int min = node->min, max = node->max;
+            bool greedy = node->greedy;
+            int kid = node->kids[0];
+            for(int i = 0; i < min; i++){
+                if(!RegexCodegen(parser, kid)) return 0;
+            }
+
+            if(max < 0){
+                int split = RegexEmit(regex, REGEX_OP_SPLIT);
+                if(!RegexCodegen(parser, kid)) return 0;
+                RegexEmit(regex, REGEX_OP_JMP, split);
+                int out = (int)regex->program.size();
+                regex->program[split].x = greedy ? split + 1 : out;
+                regex->program[split].y = greedy ? out : split + 1;
+            }else{
+                std::vector<int> splits;
+                for(int i = min; i < max; i++){
+                    splits.push_back(RegexEmit(regex, REGEX_OP_SPLIT));
+                    if(!RegexCodegen(parser, kid)) return 0;
+                }
+
+                int out = (int)regex->program.size();
+                for(int split : splits){
+                    regex->program[split].x = greedy ? split + 1 : out;
+                    regex->program[split].y = greedy ? out : split + 1;
+                }
+            }
+        } break;
+    }
+
+    return regex->program.size() <= REGEX_MAX_PROGRAM ? 1 : 0;
+}
+
+/*
+* Collects the literal bytes that every match must contain. 'prefix' receives
+* the literals that start all matches and 'required' the longest literal run
+* found in the top-level sequence.
+*/
+static void RegexExtractLiterals(RegexParser *parser, int root, std::string &prefix,
+                                 std::string &required, bool *anchoredBegin)
+{
+    RegexNode *node = &parser->nodes[root];
+    while(node->type == REGEX_NODE_GROUP){
+        node = &parser->nodes[node->kids[0]];
+    }
+
+    std::vector<int> seq;
+    if(node->type == REGEX_NODE_CONCAT){
+        seq = node->kids;
+    }else{
+        seq.push_back((int)(node - &parser->nodes[0]));
+    }
+
+    std::string run;
+    bool leading = true;
+    uint i = 0;
+    if(seq.size() > 0 && parser->nodes[seq[0]].type == REGEX_NODE_ASSERT &&
+       parser->nodes[seq[0]].value == REGEX_OP_BOL)
+    {
+        *anchoredBegin = true;
+        i = 1;
+    }
+
+    for(; i < seq.size(); i++){
+        RegexNode *kid = &parser->nodes[seq[i]];
+        if(kid->type == REGEX_NODE_CLASS && kid->literal >= 0){
+            run.push_back((char)kid->literal);
+        }else{
+            if(leading) prefix = run;
+            if(run.size() > required.size()) required = run;
+            run.clear();
+            leading = false;
+        }
+    }
+
+    if(leading) prefix = run;
+    if(run.size() > required.size()) required = run;
+}
+
+static void RegexClosure(Regex *regex, int pc, int flags, std::vector<int> &set){
+    std::vector<int> stack;
+    stack.push_back(pc);
+    while(stack.size() > 0){
+        int at = stack.back();
+        stack.pop_back();
+        if(regex->marks[at] == regex->markGen) continue;
+        regex->marks[at] = regex->markGen;
+
+        RegexInst *inst = &regex->program[at];
+        switch(inst->op){
+            case REGEX_OP_JMP: stack.push_back(inst->x); break;
+            case REGEX_OP_SPLIT:{
+                stack.push_back(inst->y);
+                stack.push_back(inst->x);
+            } break;
+            case REGEX_OP_SAVE: stack.push_back(at + 1); break;
+            case REGEX_OP_BOL:{
+                if(flags & (REGEX_CLOSURE_BEGIN | REGEX_CLOSURE_ASSUME))
+                    stack.push_back(at + 1);
+            } break;
+            case REGEX_OP_EOL:{
+                if(flags & REGEX_CLOSURE_END)
+                    stack.push_back(at + 1);
+                else
+                    set.push_back(at); // pending until we know we are at the end
+            } break;
+            case REGEX_OP_WORD_BOUNDARY:
+            case REGEX_OP_NOT_WORD_BOUNDARY:{
+                if(flags & REGEX_CLOSURE_ASSUME)
+                    stack.push_back(at + 1);
+            } break;
+            case REGEX_OP_CLASS:
+            case REGEX_OP_MATCH: set.push_back(at); break;
+        }
+    }
+}
+
+static inline void RegexNextMark(Regex *regex){
+    regex->markGen++;
+    if(regex->markGen == 0){
+        std::fill(regex->marks.begin(), regex->marks.end(), 0);
+        regex->markGen = 1;
+    }
+}
+
+static int RegexDFAIntern(Regex *regex, std::vector<int> &set){
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+
+    auto it = regex->dfaMap.find(set);
+    if(it != regex->dfaMap.end()) return it->second;
+
+    RegexDFAState state;
+    state.insts = set;
+    state.match = false;
+    state.matchAtEnd = false;
+    for(uint i = 0; i < 256; i++) state.next[i] = -1;
+
+    for(int pc : set){
+        if(regex->program[pc].op == REGEX_OP_MATCH){
+            state.match = true;
+        }
+    }
+
+    state.matchAtEnd = state.match;
+    if(!state.matchAtEnd){
+        std::vector<int> endSet;
+        RegexNextMark(regex);
+        for(int pc : set){
+            if(regex->program[pc].op == REGEX_OP_EOL){
+                RegexClosure(regex, pc + 1, REGEX_CLOSURE_END, endSet);
+            }
+        }
+
+        for(int pc : endSet){
+            if(regex->program[pc].op == REGEX_OP_MATCH){
+                state.matchAtEnd = true;
+            }
+        }
+    }
+
+    regex->dfa.push_back(state);
+    int id = (int)regex->dfa.size() - 1;
+    regex->dfaMap[set] = id;
+    return id;
+}
+
+static void RegexDFAReset(Regex *regex){
+    std::vector<int> set;
+    regex->dfa.clear();
+    regex->dfaMap.clear();
+
+    // dead state is always 0
+    RegexDFAIntern(regex, set);
+    for(uint i = 0; i < 256; i++) regex->dfa[0].next[i] = 0;
+
+    // anchored starts skip the ".*?" loop
+    int entries[2] = { REGEX_PROGRAM_START, 0 };
+    for(uint i = 0; i < 2; i++){
+        set.clear();
+        RegexNextMark(regex);
+        RegexClosure(regex, entries[i], 0, set);
+        regex->dfaStart[2 * i] = RegexDFAIntern(regex, set);
+
+        set.clear();
+        RegexNextMark(regex);
+        RegexClosure(regex, entries[i], REGEX_CLOSURE_BEGIN, set);
+        regex->dfaStart[2 * i + 1] = RegexDFAIntern(regex, set);
+    }
+}
+
+static int RegexDFANext(Regex *regex, int d, uint8 c){
+    int n = regex->dfa[d].next[c];
+    if(n >= 0) return n;
+
+    if(regex->dfa.size() >= REGEX_MAX_DFA_STATES){
+        std::vector<int> current = regex->dfa[d].insts;
+        RegexDFAReset(regex);
+        d = RegexDFAIntern(regex, current);
+    }
+
+    std::vector<int> set;
+    RegexNextMark(regex);
+    for(int pc : regex->dfa[d].insts){
+        RegexInst *inst = &regex->program[pc];
+        if(inst->op == REGEX_OP_CLASS && RegexClassHas(&regex->classes[inst->x], c)){
+            RegexClosure(regex, pc + 1, 0, set);
+        }
+    }
+
+    n = RegexDFAIntern(regex, set);
+    regex->dfa[d].next[c] = n;
+    return n;
+}
+
+/*
+* Runs the DFA anchored at 's' and returns the end of the longest match
+* that finishes at or before 'end', -1 if there is none.
+*/
+static int RegexDFAMatchAt(Regex *regex, const char *text, uint len, uint s, uint end){
+    int d = regex->dfaStart[s == 0 ? 1 : 0];
+    int best = regex->dfa[d].match ? (int)s : -1;
+    for(uint i = s; i < end; i++){
+        d = RegexDFANext(regex, d, (uint8)text[i]);
+        if(d == 0) return best;
+        if(regex->dfa[d].match) best = (int)i + 1;
+    }
+
+    if(end == len && regex->dfa[d].matchAtEnd) best = (int)end;
+    return best;
+}
+
+/*
+* Runs the DFA unanchored from 's', i.e.: following matches that start at any
+* position at once, and returns the end of the match that finishes first, -1 if
+* there is none. This is a single pass over the text but it says nothing about
+* where the match starts.
+*/
+static int RegexDFASearch(Regex *regex, const char *text, uint len, uint s){
+    int d = regex->dfaStart[s == 0 ? 3 : 2];
+    if(regex->dfa[d].match) return (int)s;
+    for(uint i = s; i < len; i++){
+        d = RegexDFANext(regex, d, (uint8)text[i]);
+        if(regex->dfa[d].match) return (int)i + 1;
+    }
+
+    return regex->dfa[d].matchAtEnd ? (int)len : -1;
+}
+
+/*
+* Gets the first position at or after 's' where a match could start according to
+* the prefilters, -1 if there is none.
+*/
+static int RegexNextStart(Regex *regex, const char *text, uint len, uint s){
+    if(regex->hasPrefix){
+        return SearchPattern_Find(&regex->prefix, text, len, s);
+    }else if(regex->hasFirstBytes){
+        while(s < len && !regex->firstBytes[(uint8)text[s]]) s++;
+        return s < len ? (int)s : -1;
+    }
+
+    return s <= len ? (int)s : -1;
+}
+
+struct RegexThreadList{
+    std::vector<int> pcs;
+    std::vector<int> caps;
+};
+
+static void RegexAddThread(Regex *regex, RegexThreadList *list, int pc, int *caps,
+                           const char *text, uint len, uint pos)
+{
+    if(regex->marks[pc] == regex->markGen) return;
+    regex->marks[pc] = regex->markGen;
+
+    RegexInst *inst = &regex->program[pc];
+    switch(inst->op){
+        case REGEX_OP_JMP:{
+            RegexAddThread(regex, list, inst->x, caps, text, len, pos);
+        } break;
+        case REGEX_OP_SPLIT:{
+            RegexAddThread(regex, list, inst->x, caps, text, len, pos);
+            RegexAddThread(regex, list, inst->y, caps, text, len, pos);
+        } break;
+        case REGEX_OP_SAVE:{
+            int old = caps[inst->x];
+            caps[inst->x] = (int)pos;
+            RegexAddThread(regex, list, pc + 1, caps, text, len, pos);
+            caps[inst->x] = old;
+        } break;
+        case REGEX_OP_BOL:{
+            if(pos == 0) RegexAddThread(regex, list, pc + 1, caps, text, len, pos);
+        } break;
+        case REGEX_OP_EOL:{
+            if(pos == len) RegexAddThread(regex, list, pc + 1, caps, text, len, pos);
+        } break;
+        case REGEX_OP_WORD_BOUNDARY:
+        case REGEX_OP_NOT_WORD_BOUNDARY:{
+            int before = pos > 0 && RegexIsWordChar((uint8)text[pos-1]);
+            int after = pos < len && RegexIsWordChar((uint8)text[pos]);
+            int boundary = before != after;
+            if(boundary == (inst->op == REGEX_OP_WORD_BOUNDARY)){
+                RegexAddThread(regex, list, pc + 1, caps, text, len, pos);
+            }
+        } break;
+        case REGEX_OP_CLASS:
+        case REGEX_OP_MATCH:{
+            list->pcs.push_back(pc);
+            list->caps.insert(list->caps.end(), caps, caps + 2 * REGEX_MAX_GROUPS);
+        } break;
+    }
+}
+
+/*
+* Simulates the NFA from 's', returns the end of the longest match that finishes at
+* or before 'end' and fills 'groups' with the captures of the thread with highest
+* priority for that match. For leftmost-first patterns the match of the thread
+* with highest priority is taken instead, threads are kept in priority order so
+* once one matches the ones after it are dropped.
+*
+* When not 'anchored' a thread is started at every position after the ones
+* already running until a match is found, threads that started after the match
+* are dropped, so the leftmost match is found in a single pass.
+*/
+static int RegexNFASearch(Regex *regex, const char *text, uint len, uint s,
+                          uint end, bool anchored, int *groups)
+{
+    RegexThreadList lists[2];
+    int caps[2 * REGEX_MAX_GROUPS];
+    int best = -1;
+    int cur = 0;
+    for(uint i = 0; i < 2 * REGEX_MAX_GROUPS; i++) caps[i] = -1;
+
+    RegexNextMark(regex);
+    RegexAddThread(regex, &lists[cur], REGEX_PROGRAM_START, caps, text, len, s);
+
+    for(uint pos = s; ; pos++){
+        RegexThreadList *clist = &lists[cur];
+        RegexThreadList *nlist = &lists[1 - cur];
+        nlist->pcs.clear();
+        nlist->caps.clear();
+        RegexNextMark(regex);
+
+        for(uint t = 0; t < clist->pcs.size(); t++){
+            int pc = clist->pcs[t];
+            int *tcaps = &clist->caps[t * 2 * REGEX_MAX_GROUPS];
+            RegexInst *inst = &regex->program[pc];
+            if(best >= 0 && tcaps[0] > groups[0]) continue;
+
+            if(inst->op == REGEX_OP_MATCH){
+                if(best < (int)pos || tcaps[0] < groups[0] || regex->leftmostFirst){
+                    best = (int)pos;
+                    Memcpy(groups, tcaps, sizeof(int) * 2 * REGEX_MAX_GROUPS);
+                }
+
+                if(regex->leftmostFirst) break;
+            }else if(pos < end && RegexClassHas(&regex->classes[inst->x], (uint8)text[pos])){
+                RegexAddThread(regex, nlist, pc + 1, tcaps, text, len, pos + 1);
+            }
+        }
+
+        if(pos >= end) break;
+        if(!anchored && best < 0){
+            if(nlist->pcs.size() > 0){
+                RegexAddThread(regex, nlist, REGEX_PROGRAM_START, caps, text, len, pos + 1);
+            }else{
+                // nothing running, jump to where the next match could start
+                int at = (int)pos;
+                while(nlist->pcs.size() == 0){
+                    at = RegexNextStart(regex, text, len, (uint)at + 1);
+                    if(at < 0 || (uint)at > end) break;
+                    RegexNextMark(regex);
+                    RegexAddThread(regex, nlist, REGEX_PROGRAM_START, caps, text, len, (uint)at);
+                }
+
+                if(nlist->pcs.size() == 0) break;
+                pos = (uint)at - 1;
+            }
+        }
+
+        if(nlist->pcs.size() == 0) break;
+        cur = 1 - cur;
+    }
+
+    return best;
+}
+
+static int RegexMatchAt(Regex *regex, const char *text, uint len, uint s, uint end){
+    if(regex->needsNFA){
+        int groups[2 * REGEX_MAX_GROUPS];
+        return RegexNFASearch(regex, text, len, s, end, true, groups);
+    }
+
+    return RegexDFAMatchAt(regex, text, len, s, end);
+}
+
+int Regex_Compile(Regex *regex, const char *pattern, uint len, int flags,
+                  const char **error)
+{
+    AssertA(regex != nullptr, "Invalid regex pointer");
+    RegexParser parser;
+    parser.p = pattern;
+    parser.end = pattern + len;
+    parser.error = nullptr;
+    parser.flags = flags;
+    parser.groups = 1;
+    parser.lazy = false;
+    parser.regex = regex;
+
+    regex->program.clear();
+    regex->classes.clear();
+    regex->dfa.clear();
+    regex->dfaMap.clear();
+    regex->flags = flags;
+    regex->needsNFA = false;
+    regex->leftmostFirst = false;
+    regex->anchoredBegin = false;
+    regex->hasFirstBytes = false;
+    regex->hasPrefix = false;
+    regex->hasRequired = false;
+    regex->prefix.data = nullptr;
+    regex->required.data = nullptr;
+    regex->markGen = 0;
+
+    int root = RegexParseAlternate(&parser);
+    if(root >= 0 && parser.p < parser.end){
+        parser.error = "Unmatched )";
+        root = -1;
+    }
+
+    if(root >= 0){
+        RegexClass any;
+        memset(&any, 0, sizeof(RegexClass));
+        RegexClassSetRange(&any, 0, 255);
+        regex->classes.push_back(any);
+
+        RegexEmit(regex, REGEX_OP_SPLIT, REGEX_PROGRAM_START, 1);
+        RegexEmit(regex, REGEX_OP_CLASS, (int)regex->classes.size() - 1);
+        RegexEmit(regex, REGEX_OP_JMP, 0);
+        RegexEmit(regex, REGEX_OP_SAVE, 0);
+        if(flags & SEARCH_FLAG_WHOLE_WORD){
+            RegexEmit(regex, REGEX_OP_WORD_BOUNDARY);
+        }
+
+        if(!RegexCodegen(&parser, root)){
+            if(!parser.error) parser.error = "Pattern is too large";
+            root = -1;
+        }else{
+            if(flags & SEARCH_FLAG_WHOLE_WORD){
+                RegexEmit(regex, REGEX_OP_WORD_BOUNDARY);
+            }
+            RegexEmit(regex, REGEX_OP_SAVE, 1);
+            RegexEmit(regex, REGEX_OP_MATCH);
+        }
+    }
+
+    if(root < 0){
+        regex->program.clear();
+        regex->classes.clear();
+        if(error) *error = parser.error;
+        return 0;
+    }
+
+    regex->groups = parser.groups;
+    regex->marks.assign(regex->program.size(), 0);
+    regex->markGen = 0;
+
+    // the DFA does not know which thread reached a state first, so it
+    // cannot give preference to the shorter match of lazy quantifiers
+    regex->leftmostFirst = parser.lazy;
+    regex->needsNFA = parser.lazy;
+    for(RegexInst &inst : regex->program){
+        if(inst.op == REGEX_OP_WORD_BOUNDARY || inst.op == REGEX_OP_NOT_WORD_BOUNDARY){
+            regex->needsNFA = true;
+        }
+    }
+
+    std::string prefix, required;
+    int searchFlags = flags & SEARCH_FLAG_CASE_INSENSITIVE;
+    RegexExtractLiterals(&parser, root, prefix, required, &regex->anchoredBegin);
+    if(prefix.size() > 0){
+        regex->hasPrefix = true;
+        SearchPattern_Compile(&regex->prefix, prefix.c_str(), prefix.size(), searchFlags);
+    }
+
+    if(required.size() > prefix.size()){
+        regex->hasRequired = true;
+        SearchPattern_Compile(&regex->required, required.c_str(),
+                              required.size(), searchFlags);
+    }
+
+    // bytes that can start a match, only usable if the regex cannot match empty
+    std::vector<int> start;
+    bool nullable = false;
+    RegexNextMark(regex);
+    RegexClosure(regex, REGEX_PROGRAM_START, REGEX_CLOSURE_ASSUME, start);
+    memset(regex->firstBytes, 0, sizeof(regex->firstBytes));
+    for(int pc : start){
+        RegexInst *inst = &regex->program[pc];
+        if(inst->op == REGEX_OP_CLASS){
+            for(uint c = 0; c < 256; c++){
+                if(RegexClassHas(&regex->classes[inst->x], (uint8)c))
+                    regex->firstBytes[c] = true;
+            }
+        }else{
+            nullable = true;
+        }
+    }
+
+    regex->hasFirstBytes = !nullable;
+    if(!regex->needsNFA){
+        RegexDFAReset(regex);
+    }
+
+    return 1;
+}
+
+void Regex_Release(Regex *regex){
+    if(!regex) return;
+    if(regex->hasPrefix) SearchPattern_Release(&regex->prefix);
+    if(regex->hasRequired) SearchPattern_Release(&regex->required);
+    regex->hasPrefix = false;
+    regex->hasRequired = false;
+    regex->program.clear();
+    regex->classes.clear();
+    regex->dfa.clear();
+    regex->dfaMap.clear();
+    regex->marks.clear();
+}
+
+static void RegexFillMatch(RegexMatch *match, uint s, uint e){
+    match->start = s;
+    match->end = e;
+    for(uint i = 0; i < 2 * REGEX_MAX_GROUPS; i++) match->groups[i] = -1;
+    match->groups[0] = (int)s;
+    match->groups[1] = (int)e;
+}
+
+int Regex_Find(Regex *regex, const char *text, uint len, uint from, RegexMatch *match){
+    if(regex->program.size() == 0 || from > len) return 0;
+    if(regex->anchoredBegin && from > 0) return 0;
+
+    if(regex->hasRequired && SearchPattern_Find(&regex->required, text, len, from) < 0)
+        return 0;
+
+    int s = RegexNextStart(regex, text, len, from);
+    if(s < 0) return 0;
+
+    if(regex->anchoredBegin){
+        int e = s == 0 ? RegexMatchAt(regex, text, len, 0, len) : -1;
+        if(e < 0) return 0;
+        RegexFillMatch(match, 0, (uint)e);
+        return 1;
+    }
+
+    if(!regex->needsNFA){
+        // discards texts without a match in a single pass, which is the common
+        // case when searching many files
+        if(RegexDFASearch(regex, text, len, (uint)s) < 0) return 0;
+
+        // most of the time the match starts at the first candidate
+        int e = RegexDFAMatchAt(regex, text, len, (uint)s, len);
+        if(e >= 0){
+            RegexFillMatch(match, (uint)s, (uint)e);
+            return 1;
+        }
+
+        s = RegexNextStart(regex, text, len, (uint)s + 1);
+        if(s < 0) return 0;
+    }
+
+    int groups[2 * REGEX_MAX_GROUPS];
+    if(RegexNFASearch(regex, text, len, (uint)s, len, false, groups) < 0) return 0;
+
+    RegexFillMatch(match, (uint)groups[0], (uint)groups[1]);
+    return 1;
+}
+
+int Regex_ReverseFind(Regex *regex, const char *text, uint len, int end,
+                      RegexMatch *match)
+{
+    uint limit = (end < 0 || (uint)end > len) ? len : (uint)end;
+    if(regex->program.size() == 0) return 0;
+
+    if(regex->hasRequired &&
+       SearchPattern_ReverseFind(&regex->required, text, len, limit) < 0)
+    {
+        return 0;
+    }
+
+    int s = regex->anchoredBegin ? 0 : (int)limit;
+    while(s >= 0){
+        if(regex->hasPrefix){
+            uint bound = (uint)s + regex->prefix.length;
+            if(bound > limit) bound = limit;
+            int at = SearchPattern_ReverseFind(&regex->prefix, text, len, (int)bound);
+            if(at < 0) return 0;
+            s = at;
+        }else if(regex->hasFirstBytes){
+            while(s >= 0 && ((uint)s >= limit || !regex->firstBytes[(uint8)text[s]])) s--;
+            if(s < 0) return 0;
+        }
+
+        int e = RegexMatchAt(regex, text, len, (uint)s, limit);
+        if(e >= 0){
+            RegexFillMatch(match, (uint)s, (uint)e);
+            return 1;
+        }
+
+        s--;
+    }
+
+    return 0;
+}
+
+void Regex_Captures(Regex *regex, const char *text, uint len, RegexMatch *match){
+    int groups[2 * REGEX_MAX_GROUPS];
+    if(regex->groups <= 1) return;
+
+    int e = RegexNFASearch(regex, text, len, match->start, match->end, true, groups);
+    if(e == (int)match->end){
+        Memcpy(match->groups, groups, sizeof(groups));
+    }
+}
+
+void Regex_Expand(Regex *regex, const char *text, uint len, RegexMatch *match,
+                  const char *replace, uint rlen, std::string &out)
+{
+    (void)len;
+    for(uint i = 0; i < rlen; i++){
+        char c = replace[i];
+        if(c != '\\' || i + 1 >= rlen){
+            out.push_back(c);
+            continue;
+        }
+
+        char e = replace[++i];
+        if(e >= '0' && e <= '9'){
+            uint g = e - '0';
+            if(g < regex->groups){
+                int s0 = match->groups[2 * g];
+                int s1 = match->groups[2 * g + 1];
+                if(s0 >= 0 && s1 >= s0){
+                    out.append(&text[s0], s1 - s0);
+                }
+            }
+        }else if(e == 't'){
+            out.push_back('\t');
+        }else{
+            out.push_back(e);
+        }
+    }
+}
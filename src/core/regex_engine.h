@@ -0,0 +1,139 @@
+/* date = October 19th 2026 15:10 */
+#pragma once
+#include <types.h>
+#include <search.h>
+#include <vector>
+#include <map>
+#include <string>
+
+/*
+* Small regular expression engine used by the search commands. The pattern is
+* parsed and compiled into a Thompson NFA (a pike program), matching is done
+* with a DFA built lazily from the NFA while scanning so that each state is
+* only computed once it is actually reached. Searches run the DFA unanchored
+* over the text once, texts without a match are discarded in that single pass,
+* the start of a match is then found anchoring the DFA at the first candidate or
+* else by simulating the NFA, also in a single pass. Capture groups are resolved
+* by simulating the NFA but only over the range already matched.
+*
+* Supported syntax:
+*   .  [abc] [^a-z]  \d \w \s \D \W \S  \n \t  ^ $  \b \B
+*   (group) (?:non-capturing) a|b  * + ? {n} {n,} {n,m} and lazy variants.
+*
+* Matching is leftmost-longest, each text given is handled as a single line
+* so ^ and $ match at the start and end of the text. Patterns using lazy
+* quantifiers are matched leftmost-first instead, i.e.: alternatives and
+* quantifiers are tried in priority order as in Perl, so that ".*?" stops at the
+* first possible end. Patterns using word boundary assertions or lazy quantifiers
+* are not representable in the DFA and run on the NFA simulation. Bytes of UTF-8
+* sequences are word characters for both \w and \b.
+*
+* A Regex keeps its DFA cache internally so it cannot be shared between threads,
+* workers should compile their own copy of the pattern.
+*/
+#define REGEX_MAX_GROUPS 10
+
+typedef enum{
+    REGEX_OP_CLASS = 0, // consumes one byte contained in class 'x'
+    REGEX_OP_SPLIT, // forks execution into 'x' (preferred) and 'y'
+    REGEX_OP_JMP,
+    REGEX_OP_SAVE, // stores the current position into capture slot 'x'
+    REGEX_OP_BOL,
+    REGEX_OP_EOL,
+    REGEX_OP_WORD_BOUNDARY,
+    REGEX_OP_NOT_WORD_BOUNDARY,
+    REGEX_OP_MATCH,
+}RegexOp;
+
+typedef struct RegexInst{
+    RegexOp op;
+    int x, y;
+}RegexInst;
+
+typedef struct RegexClass{
+    uint bits[8];
+}RegexClass;
+
+typedef struct RegexDFAState{
+    std::vector<int> insts;
+    int next[256];
+    bool match;
+    bool matchAtEnd;
+}RegexDFAState;
+
+typedef struct RegexMatch{
+    uint start;
+    uint end;
+    // [2 * i, 2 * i + 1] are the boundaries of group i, -1 if it did not participate
+    int groups[2 * REGEX_MAX_GROUPS];
+}RegexMatch;
+
+struct Regex{
+    std::vector<RegexInst> program;
+    std::vector<RegexClass> classes;
+    uint groups;
+    int flags;
+    bool needsNFA;
+    bool leftmostFirst; // has lazy quantifiers
+    bool anchoredBegin;
+
+    // prefilters
+    bool hasFirstBytes;
+    bool firstBytes[256];
+    bool hasPrefix;
+    SearchPattern prefix;
+    bool hasRequired;
+    SearchPattern required;
+
+    // lazy DFA
+    std::vector<RegexDFAState> dfa;
+    std::map<std::vector<int>, int> dfaMap;
+    int dfaStart[4]; // [anchored, unanchored] x [not at begin, at begin]
+
+    // scratch memory for closures and the NFA simulation
+    std::vector<uint> marks;
+    uint markGen;
+};
+
+/*
+* Compiles 'pattern' with length 'len' into 'regex'. 'flags' accepts
+* SEARCH_FLAG_CASE_INSENSITIVE and SEARCH_FLAG_WHOLE_WORD. Returns 1 in case
+* the pattern is valid, otherwise returns 0 and sets 'error' if given.
+*/
+int Regex_Compile(Regex *regex, const char *pattern, uint len, int flags=0,
+                  const char **error=nullptr);
+
+/*
+* Releases the memory taken by a compiled regex.
+*/
+void Regex_Release(Regex *regex);
+
+/*
+* Find the leftmost match, longest or first by priority, that starts at or after 'from' inside
+* 'text' with length 'len'. Returns 1 and fills 'match' in case one is found,
+* 0 otherwise. Only the match boundaries are filled, see Regex_Captures.
+*/
+int Regex_Find(Regex *regex, const char *text, uint len, uint from, RegexMatch *match);
+
+/*
+* Find the match with the largest start that ends at or before 'end' inside
+* 'text' with length 'len', a negative 'end' means 'len'. Returns 1 and fills
+* 'match' in case one is found, 0 otherwise.
+*/
+int Regex_ReverseFind(Regex *regex, const char *text, uint len, int end,
+                      RegexMatch *match);
+
+/*
+* Fills the capture groups of a match previously returned by Regex_Find or
+* Regex_ReverseFind on the same text.
+*/
+void Regex_Captures(Regex *regex, const char *text, uint len, RegexMatch *match);
+
+/*
+* Expands the replacement string 'replace' for the given match, \0 to \9
+* are replaced by the respective group and \t and \\ are unescaped. Lines
+* are stored separately so new lines cannot be inserted. The result is
+* appended to 'out'.
+*/
+void Regex_Expand(Regex *regex, const char *text, uint len, RegexMatch *match,
+                  const char *replace, uint rlen, std::string &out);
@@ -0,0 +1,105 @@
+#include <scheduler.h>
+#include <timer.h>
+#include <vector>
+
+struct FrameJob{
+    uint handle;
+    FrameJobFn fn;
+    FrameJobState state;
+};
+
+struct FrameScheduler{
+    std::vector<FrameJob> jobs;
+    uint next; // job that runs first on the next frame
+    uint handles;
+};
+
+static FrameScheduler frameScheduler = { .next = 0, .handles = 0 };
+
+uint FrameScheduler_Add(FrameJobFn fn){
+    uint handle = ++frameScheduler.handles;
+    if(handle == 0){
+        handle = ++frameScheduler.handles;
+    }
+
+    frameScheduler.jobs.push_back({
+        .handle = handle,
+        .fn = fn,
+        .state = FRAME_JOB_CONTINUE,
+    });
+    return handle;
+}
+
+void FrameScheduler_Remove(uint handle){
+    std::vector<FrameJob> &jobs = frameScheduler.jobs;
+    for(uint i = 0; i < jobs.size(); i++){
+        if(jobs[i].handle == handle){
+            jobs.erase(jobs.begin() + i);
+            return;
+        }
+    }
+}
+
+bool FrameScheduler_HasWork(){
+    for(FrameJob &job : frameScheduler.jobs){
+        if(job.state == FRAME_JOB_CONTINUE) return true;
+    }
+
+    return false;
+}
+
+double FrameScheduler_GetBudget(double dt, double frameTime){
+    // the last frame was already late, only do the minimum so we can catch up
+    if(dt > 2.0 * FRAME_SCHEDULER_TARGET_INTERVAL){
+        return FRAME_SCHEDULER_MIN_BUDGET;
+    }
+
+    double budget = FRAME_SCHEDULER_TARGET_INTERVAL - frameTime;
+    if(budget < FRAME_SCHEDULER_MIN_BUDGET) return FRAME_SCHEDULER_MIN_BUDGET;
+    if(budget > FRAME_SCHEDULER_MAX_BUDGET) return FRAME_SCHEDULER_MAX_BUDGET;
+    return budget;
+}
+
+void FrameScheduler_Run(double dt, double frameTime){
+    std::vector<FrameJob> &jobs = frameScheduler.jobs;
+    std::vector<uint> order;
+    uint count = jobs.size();
+    if(count == 0) return;
+
+    // jobs might add or remove jobs so go through the handles taken now
+    uint start = frameScheduler.next % count;
+    for(uint i = 0; i < count; i++){
+        order.push_back(jobs[(start + i) % count].handle);
+    }
+
+    double deadline = GetElapsedTime() + FrameScheduler_GetBudget(dt, frameTime);
+    uint ran = 0;
+    for(uint handle : order){
+        FrameJobFn fn;
+        for(FrameJob &job : jobs){
+            if(job.handle == handle){
+                fn = job.fn;
+                break;
+            }
+        }
+
+        ran++;
+        if(!fn) continue;
+
+        FrameJobState state = fn(deadline);
+        if(state == FRAME_JOB_DONE){
+            FrameScheduler_Remove(handle);
+        }else{
+            for(FrameJob &job : jobs){
+                if(job.handle == handle){
+                    job.state = state;
+                    break;
+                }
+            }
+        }
+
+        if(GetElapsedTime() >= deadline) break;
+    }
+
+    frameScheduler.next = start + ran;
+}
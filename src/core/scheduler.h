@@ -0,0 +1,60 @@
+/* date = October 19th 2026 21:05 */
+#pragma once
+#include <types.h>
+#include <functional>
+
+// the frame rate the scheduler tries to keep while it has work
+#define FRAME_SCHEDULER_TARGET_INTERVAL (1.0 / 60.0)
+// jobs always get at least this much per frame so that they make progress
+#define FRAME_SCHEDULER_MIN_BUDGET 0.001
+#define FRAME_SCHEDULER_MAX_BUDGET 0.008
+
+/*
+* Main thread scheduler for incremental work, i.e.: pushing the results of a search
+* into the list. Instead of doing everything at once and dropping frames, jobs are
+* called once per frame, after rendering, with a deadline and are expected to do
+* small units of work until it is reached. The budget is whatever is left of the
+* frame after rendering it, given the measured frame time, so the work spreads
+* across idle frames. Jobs run in turns, the one that did not get time in a frame
+* is the first on the next one.
+*
+* Jobs that wait on background work, i.e.: a running search, return FRAME_JOB_WAIT
+* so the main loop can sleep, the worker then wakes it with PostEmptyEvent once it
+* has something for the job.
+*/
+typedef enum{
+    FRAME_JOB_DONE=0, // finished, the job is removed
+    FRAME_JOB_CONTINUE, // has work left, run it again on the next frame
+    FRAME_JOB_WAIT, // nothing to do until the main loop is woken up
+}FrameJobState;
+
+typedef std::function<FrameJobState(double deadline)> FrameJobFn;
+
+/*
+* Adds a job to run on the next frames. Returns a handle that can be used to
+* remove it, never 0.
+*/
+uint FrameScheduler_Add(FrameJobFn fn);
+
+/*
+* Removes the job with the given handle, if it is still queued.
+*/
+void FrameScheduler_Remove(uint handle);
+
+/*
+* Checks if any job has work to do right away, the main loop must not block while
+* there is.
+*/
+bool FrameScheduler_HasWork();
+
+/*
+* Computes the time jobs may take in the current frame, 'dt' is the interval
+* between the last two frames and 'frameTime' how long rendering the current
+* frame took.
+*/
+double FrameScheduler_GetBudget(double dt, double frameTime);
+
+/*
+* Runs the queued jobs for the current frame, see FrameScheduler_GetBudget.
+*/
+void FrameScheduler_Run(double dt, double frameTime);
@@ -0,0 +1,358 @@
+#include <search.h>
+#include <regex_engine.h>
+#include <utilities.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SEARCH_SSE2
+    #include <emmintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
+static inline uint8 SearchLower(uint8 c){
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline uint8 SearchUpper(uint8 c){
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+/*
+* Bytes >= 0x80 are part of UTF-8 sequences, consider them part of words
+* so that whole word search does not split a multi-byte character.
+*/
+static inline int SearchIsWordChar(uint8 c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static inline int SearchEqual(SearchPattern *pattern, const char *text){
+    if(pattern->flags & SEARCH_FLAG_CASE_INSENSITIVE){
+        for(uint i = 0; i < pattern->length; i++){
+            if(SearchLower((uint8)text[i]) != (uint8)pattern->data[i])
+                return 0;
+        }
+        return 1;
+    }
+
+    return memcmp(pattern->data, text, pattern->length) == 0;
+}
+
+static inline int SearchIsWordBounded(SearchPattern *pattern, const char *text,
+                                      uint len, uint at)
+{
+    uint end = at + pattern->length;
+    if(at > 0 && SearchIsWordChar((uint8)text[at-1]))
+        return 0;
+    if(end < len && SearchIsWordChar((uint8)text[end]))
+        return 0;
+    return 1;
+}
+
+static int SearchHorspool(SearchPattern *pattern, const char *text, uint len){
+    uint m = pattern->length;
+    uint8 last = (uint8)pattern->data[m-1];
+    bool folded = pattern->flags & SEARCH_FLAG_CASE_INSENSITIVE;
+    uint j = 0;
+    while(j + m <= len){
+        uint8 c = (uint8)text[j + m - 1];
+        uint8 k = folded ? SearchLower(c) : c;
+        if(k == last && SearchEqual(pattern, &text[j])){
+            return (int)j;
+        }
+
+        j += pattern->skip[c];
+    }
+
+    return -1;
+}
+
+static int SearchReverseHorspool(SearchPattern *pattern, const char *text, uint len){
+    uint m = pattern->length;
+    uint8 first = (uint8)pattern->data[0];
+    bool folded = pattern->flags & SEARCH_FLAG_CASE_INSENSITIVE;
+    int j = (int)len - (int)m;
+    while(j >= 0){
+        uint8 c = (uint8)text[j];
+        uint8 k = folded ? SearchLower(c) : c;
+        if(k == first && SearchEqual(pattern, &text[j])){
+            return j;
+        }
+
+        j -= (int)pattern->rskip[c];
+    }
+
+    return -1;
+}
+
+#if defined(SEARCH_SSE2)
+static inline uint SearchCountTrailingZeros(uint mask){
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, mask);
+    return (uint)index;
+#else
+    return (uint)__builtin_ctz(mask);
+#endif
+}
+
+/*
+* Generic SIMD filter: a candidate position 'i' is only verified if both
+* text[i] matches the first byte of the pattern and text[i+m-1] matches
+* the last one, this discards most positions 16 at a time. In case insensitive
+* mode each byte is compared against both its lower and upper variants.
+*/
+static int SearchSSE2(SearchPattern *pattern, const char *text, uint len){
+    uint m = pattern->length;
+    uint8 first = (uint8)pattern->data[0];
+    uint8 last  = (uint8)pattern->data[m-1];
+    const __m128i f0 = _mm_set1_epi8((char)first);
+    const __m128i f1 = _mm_set1_epi8((char)SearchUpper(first));
+    const __m128i l0 = _mm_set1_epi8((char)last);
+    const __m128i l1 = _mm_set1_epi8((char)SearchUpper(last));
+
+    uint i = 0;
+    for(; i + m - 1 + 16 <= len; i += 16){
+        __m128i bf = _mm_loadu_si128((const __m128i *)&text[i]);
+        __m128i bl = _mm_loadu_si128((const __m128i *)&text[i + m - 1]);
+        __m128i ef = _mm_or_si128(_mm_cmpeq_epi8(bf, f0), _mm_cmpeq_epi8(bf, f1));
+        __m128i el = _mm_or_si128(_mm_cmpeq_epi8(bl, l0), _mm_cmpeq_epi8(bl, l1));
+        uint mask = (uint)_mm_movemask_epi8(_mm_and_si128(ef, el));
+        while(mask != 0){
+            uint bit = SearchCountTrailingZeros(mask);
+            if(SearchEqual(pattern, &text[i + bit])){
+                return (int)(i + bit);
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    if(i + m > len) return -1;
+
+    int at = SearchHorspool(pattern, &text[i], len - i);
+    return at < 0 ? -1 : at + (int)i;
+}
+#endif
+
+static int SearchFindRaw(SearchPattern *pattern, const char *text, uint len){
+    if(len < pattern->length) return -1;
+#if defined(SEARCH_SSE2)
+    if(len >= pattern->length + 16){
+        return SearchSSE2(pattern, text, len);
+    }
+#endif
+    return SearchHorspool(pattern, text, len);
+}
+
+void SearchPattern_Compile(SearchPattern *pattern, const char *str,
+                           uint len, int flags)
+{
+    AssertA(pattern != nullptr, "Invalid search pattern");
+    bool folded = flags & SEARCH_FLAG_CASE_INSENSITIVE;
+    pattern->length = len;
+    pattern->flags = flags;
+    pattern->data = AllocatorGetN(char, len + 1);
+    for(uint i = 0; i < len; i++){
+        uint8 c = (uint8)str[i];
+        pattern->data[i] = (char)(folded ? SearchLower(c) : c);
+    }
+    pattern->data[len] = 0;
+
+    for(uint i = 0; i < 256; i++){
+        pattern->skip[i] = len > 0 ? len : 1;
+        pattern->rskip[i] = len > 0 ? len : 1;
+    }
+
+    if(len == 0) return;
+
+    for(uint i = 0; i < len - 1; i++){
+        uint8 c = (uint8)pattern->data[i];
+        pattern->skip[c] = len - 1 - i;
+        if(folded) pattern->skip[SearchUpper(c)] = len - 1 - i;
+    }
+
+    for(uint i = len - 1; i > 0; i--){
+        uint8 c = (uint8)pattern->data[i];
+        pattern->rskip[c] = i;
+        if(folded) pattern->rskip[SearchUpper(c)] = i;
+    }
+}
+
+void SearchPattern_Release(SearchPattern *pattern){
+    if(pattern && pattern->data){
+        AllocatorFree(pattern->data);
+        pattern->data = nullptr;
+        pattern->length = 0;
+    }
+}
+
+int SearchPattern_Find(SearchPattern *pattern, const char *text, uint len,
+                       uint from)
+{
+    uint m = pattern->length;
+    if(m == 0) return from <= len ? (int)from : -1;
+
+    while(from + m <= len){
+        int at = SearchFindRaw(pattern, &text[from], len - from);
+        if(at < 0) return -1;
+
+        uint pos = from + (uint)at;
+        if(!(pattern->flags & SEARCH_FLAG_WHOLE_WORD) ||
+           SearchIsWordBounded(pattern, text, len, pos))
+        {
+            return (int)pos;
+        }
+
+        from = pos + 1;
+    }
+
+    return -1;
+}
+
+int SearchPattern_ReverseFind(SearchPattern *pattern, const char *text, uint len,
+                              int end)
+{
+    uint m = pattern->length;
+    uint limit = (end < 0 || (uint)end > len) ? len : (uint)end;
+    if(m == 0) return (int)limit;
+
+    while(limit >= m){
+        int at = SearchReverseHorspool(pattern, text, limit);
+        if(at < 0) return -1;
+
+        if(!(pattern->flags & SEARCH_FLAG_WHOLE_WORD) ||
+           SearchIsWordBounded(pattern, text, len, (uint)at))
+        {
+            return at;
+        }
+
+        limit = (uint)at + m - 1;
+    }
+
+    return -1;
+}
+
+double SearchPattern_Benchmark(SearchPattern *pattern, const char *text,
+                               uint len, uint rounds, uint *matches)
+{
+    uint found = 0;
+    uint step = pattern->length > 0 ? pattern->length : 1;
+    double interval = MeasureInterval([&](){
+        for(uint r = 0; r < rounds; r++){
+            uint from = 0;
+            int at = 0;
+            found = 0;
+            while((at = SearchPattern_Find(pattern, text, len, from)) >= 0){
+                found++;
+                from = (uint)at + step;
+            }
+        }
+    });
+
+    if(matches) *matches = found;
+    if(interval <= 0) return 0;
+    return ((double)len * (double)rounds) / (interval * 1e9);
+}
+
+int SearchQuery_Compile(SearchQuery *query, const char *str, uint len, int flags){
+    AssertA(query != nullptr, "Invalid search query");
+    query->flags = flags;
+    query->regex = nullptr;
+    query->pattern.data = nullptr;
+    query->valid = 1;
+    if(flags & SEARCH_FLAG_REGEX){
+        query->regex = new Regex;
+        query->valid = Regex_Compile(query->regex, str, len, flags);
+    }else{
+        SearchPattern_Compile(&query->pattern, str, len, flags);
+    }
+
+    return query->valid;
+}
+
+void SearchQuery_Release(SearchQuery *query){
+    if(query->regex){
+        Regex_Release(query->regex);
+        delete query->regex;
+        query->regex = nullptr;
+    }else{
+        SearchPattern_Release(&query->pattern);
+    }
+
+    query->valid = 0;
+}
+
+int SearchQuery_Find(SearchQuery *query, const char *text, uint len, uint from,
+                     uint *matchLen)
+{
+    if(!query->valid) return -1;
+    if(query->regex){
+        RegexMatch match;
+        if(Regex_Find(query->regex, text, len, from, &match)){
+            *matchLen = match.end - match.start;
+            return (int)match.start;
+        }
+        return -1;
+    }
+
+    *matchLen = query->pattern.length;
+    return SearchPattern_Find(&query->pattern, text, len, from);
+}
+
+int SearchQuery_ReverseFind(SearchQuery *query, const char *text, uint len, int end,
+                            uint *matchLen)
+{
+    if(!query->valid) return -1;
+    if(query->regex){
+        RegexMatch match;
+        if(Regex_ReverseFind(query->regex, text, len, end, &match)){
+            *matchLen = match.end - match.start;
+            return (int)match.start;
+        }
+        return -1;
+    }
+
+    *matchLen = query->pattern.length;
+    return SearchPattern_ReverseFind(&query->pattern, text, len, end);
+}
+
+void SearchQuery_Expand(SearchQuery *query, const char *text, uint len, uint at,
+                        uint matchLen, const char *replace, uint rlen,
+                        std::string &out)
+{
+    if(query->regex && query->valid){
+        RegexMatch match;
+        match.start = at;
+        match.end = at + matchLen;
+        for(uint i = 0; i < 2 * REGEX_MAX_GROUPS; i++) match.groups[i] = -1;
+        match.groups[0] = (int)match.start;
+        match.groups[1] = (int)match.end;
+
+        Regex_Captures(query->regex, text, len, &match);
+        Regex_Expand(query->regex, text, len, &match, replace, rlen, out);
+        return;
+    }
+
+    out.append(replace, rlen);
+}
+
+void SearchQuery_Literals(SearchQuery *query, std::vector<std::string> &literals){
+    literals.clear();
+    if(!query->valid) return;
+    if(query->regex){
+        Regex *regex = query->regex;
+        if(regex->hasPrefix && regex->prefix.length > 0){
+            literals.push_back(std::string(regex->prefix.data, regex->prefix.length));
+        }
+        if(regex->hasRequired && regex->required.length > 0){
+            literals.push_back(std::string(regex->required.data, regex->required.length));
+        }
+        return;
+    }
+
+    if(query->pattern.length > 0){
+        literals.push_back(std::string(query->pattern.data, query->pattern.length));
+    }
+}
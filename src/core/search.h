@@ -0,0 +1,127 @@
+/* date = October 19th 2026 14:40 */
+#pragma once
+#include <types.h>
+#include <string>
+#include <vector>
+
+/*
+* Search engine for plain substrings. All state lives inside the compiled
+* SearchPattern so the same pattern can be shared between threads, i.e.:
+* compile once and call SearchPattern_Find from inside a ParallelFor.
+*
+* On x86 the forward search filters candidates 16 bytes at a time by comparing
+* the first and last bytes of the pattern, only positions where both match are
+* verified. Short inputs and targets without SSE2 use Horspool.
+*/
+#define SEARCH_FLAG_NONE             0
+#define SEARCH_FLAG_CASE_INSENSITIVE (1 << 0)
+#define SEARCH_FLAG_WHOLE_WORD       (1 << 1)
+#define SEARCH_FLAG_REGEX            (1 << 2)
+
+struct Regex;
+
+typedef struct SearchPattern{
+    // copy of the pattern, lowercased if SEARCH_FLAG_CASE_INSENSITIVE is set
+    char *data;
+    uint length;
+    int flags;
+    // Horspool shift tables, forward and reverse
+    uint skip[256];
+    uint rskip[256];
+}SearchPattern;
+
+/*
+* Compiles the pattern 'str' with length 'len' into 'pattern', flags is a
+* combination of SEARCH_FLAG_*. The pattern holds its own copy of 'str'.
+*/
+void SearchPattern_Compile(SearchPattern *pattern, const char *str,
+                           uint len, int flags=SEARCH_FLAG_NONE);
+
+/*
+* Releases the memory taken by a compiled pattern.
+*/
+void SearchPattern_Release(SearchPattern *pattern);
+
+/*
+* Find the first ocurrency of the pattern inside 'text' with length 'len' that
+* starts at or after 'from'. Returns the position relative to 'text' or -1 in
+* case no one is found. Whole word checks look at the bytes surrounding the match
+* so 'from' should be used instead of offsetting 'text'. This routine is reentrant.
+*/
+int SearchPattern_Find(SearchPattern *pattern, const char *text, uint len,
+                       uint from=0);
+
+/*
+* Find the last ocurrency of the pattern inside 'text' with length 'len' that
+* ends at or before 'end', a negative 'end' means 'len'. Returns -1 in case
+* no one is found. This routine is reentrant.
+*/
+int SearchPattern_ReverseFind(SearchPattern *pattern, const char *text, uint len,
+                              int end=-1);
+
+/*
+* Measures the throughput of SearchPattern_Find in GB/s by scanning 'text'
+* 'rounds' times looking for all ocurrencies of the pattern. The amount of
+* matches found in a single round is returned in 'matches' if given.
+* This is mostly for debug, see MeasureInterval.
+*/
+double SearchPattern_Benchmark(SearchPattern *pattern, const char *text,
+                               uint len, uint rounds, uint *matches=nullptr);
+
+/*
+* A search query is what the search commands use, it is either a plain
+* SearchPattern or a Regex in case SEARCH_FLAG_REGEX is given. Regex queries are
+* not reentrant, when searching from multiple threads each worker should compile
+* its own query.
+*/
+typedef struct SearchQuery{
+    SearchPattern pattern;
+    Regex *regex;
+    int flags;
+    int valid;
+}SearchQuery;
+
+/*
+* Compiles the query 'str' with length 'len', flags is a combination
+* of SEARCH_FLAG_*. Returns 0 in case the query is not valid, i.e.: an incomplete
+* regex, in which case all searches simply return no match.
+*/
+int SearchQuery_Compile(SearchQuery *query, const char *str, uint len, int flags);
+
+/*
+* Releases the memory taken by a compiled query.
+*/
+void SearchQuery_Release(SearchQuery *query);
+
+/*
+* Find the first match of the query inside 'text' with length 'len' that starts at
+* or after 'from'. Returns the position of the match or -1 if none is found, the
+* amount of bytes matched is returned in 'matchLen'.
+*/
+int SearchQuery_Find(SearchQuery *query, const char *text, uint len, uint from,
+                     uint *matchLen);
+
+/*
+* Find the last match of the query inside 'text' with length 'len' that ends at or
+* before 'end', a negative 'end' means 'len'. Returns the position of the match or
+* -1 if none is found, the amount of bytes matched is returned in 'matchLen'.
+*/
+int SearchQuery_ReverseFind(SearchQuery *query, const char *text, uint len, int end,
+                            uint *matchLen);
+
+/*
+* Appends to 'out' the text that replaces the match at 'at' with length 'matchLen'
+* of a previous search in 'text'. For regex queries capture references in
+* 'replace' are expanded, see Regex_Expand, otherwise it is copied as is.
+*/
+void SearchQuery_Expand(SearchQuery *query, const char *text, uint len, uint at,
+                        uint matchLen, const char *replace, uint rlen,
+                        std::string &out);
+
+/*
+* Collects into 'literals' byte strings that every match of the query must contain,
+* i.e.: the pattern itself for plain queries or the prefix and required run of
+* a regex. These are lowercased in case insensitive queries. An empty output means
+* nothing is known about the matches. Used to prefilter files, see TrigramIndex.
+*/
+void SearchQuery_Literals(SearchQuery *query, std::vector<std::string> &literals);
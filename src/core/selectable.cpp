@@ -1,5 +1,6 @@
 #include <selectable.h>
 #include <types.h>
+#include <search.h>
 
 static void SelectableListUpdateRange(SelectableList *list){
     uint mIndex = list->viewRange.x + list->currentLineRange;
@@ -51,11 +52,18 @@ void SelectableList_GetItem(SelectableList *list, uint i, Buffer **buffer){
     }
 }
 
-void SelectableList_Push(SelectableList *list, char *item, uint len){
+void SelectableList_Push(SelectableList *list, char *item, uint len,
+                         SearchPattern *filter)
+{
     if(len > 0){
         AssertA(list->selectable != nullptr && list->selectableSize > 0,
                 "Invalid selectable list");
 
+        LineBuffer_InsertLine(list->listBuffer, item, len);
+        if(filter && SearchPattern_Find(filter, item, len) < 0){
+            return;
+        }
+
         uint insertId = list->used;
         if(!(insertId+1 < list->selectableSize)){
             uint n = insertId + 1 - list->selectableSize + DefaultAllocatorSize;
@@ -64,27 +72,36 @@ void SelectableList_Push(SelectableList *list, char *item, uint len){
             list->selectableSize = n;
         }
 
-        LineBuffer_InsertLine(list->listBuffer, item, len);
         list->selectable[insertId] = list->listBuffer->lineCount-1;
         list->used++;
+
+        // grow the visible range while the list does not fill the view
+        uint maxRange = list->viewRange.x + list->currentLineRange;
+        if(list->viewRange.y < maxRange){
+            list->viewRange.y = list->used < maxRange ? list->used : maxRange;
+        }
+
+        if(list->active < 0) list->active = 0;
     }
 }
 
 void SelectableList_Filter(SelectableList *list, char *key, uint keylen){
     uint id = 0;
     if(key){
-        FastStringSearchInit(key, keylen);
+        SearchPattern pattern;
+        SearchPattern_Compile(&pattern, key, keylen);
 
         for(uint i = 0; i < list->listBuffer->lineCount; i++){
             Buffer *buffer = LineBuffer_GetBufferAt(list->listBuffer, i);
             if(buffer->taken >= keylen){
-                int fid = FastStringSearch(key, buffer->data, keylen, buffer->taken);
+                int fid = SearchPattern_Find(&pattern, buffer->data, buffer->taken);
                 if(fid >= 0){
                     list->selectable[id++] = i;
                 }
             }
         }
 
+        SearchPattern_Release(&pattern);
     }else{
         for(uint i = 0; i < list->listBuffer->lineCount; i++){
             list->selectable[id++] = i;
@@ -2,6 +2,8 @@
 #define SELECTABLE_H
 #include <buffers.h>
 
+struct SearchPattern;
+
 #define SELECTABLE_LIST_INITIALIZER { .listBuffer = nullptr, .viewRange = vec2ui(), .selectable = nullptr, .selectableSize = 0, .used = 0, .currentLineRange = 0, .currentDisplayRange = 0, .active = 0}
 
 struct SelectableList{
@@ -43,7 +45,13 @@ void SelectableList_PreviousItem(SelectableList *list, int minValue);
 
 void SelectableList_Filter(SelectableList *list, char *key, uint keylen);
 
-void SelectableList_Push(SelectableList *list, char *item, uint len);
+/*
+* Appends a new item to the list. In case 'filter' is given the item is only
+* made visible if it matches, so that lists filled while the user is typing
+* stay consistent with SelectableList_Filter.
+*/
+void SelectableList_Push(SelectableList *list, char *item, uint len,
+                         SearchPattern *filter=nullptr);
 
 void SelectableList_GetItem(SelectableList *list, uint i, Buffer **buffer);
 
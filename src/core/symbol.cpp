@@ -24,20 +24,23 @@ inline uint _symbol_table_hash(SymbolTable *symTable, char *label, uint labelLen
     return MurmurHash3(label, labelLen, symTable->seed);
 }
 
-void SymbolTable_Initialize(SymbolTable *symTable, bool duplicate){
-    symTable->table = AllocatorGetN(SymbolNode*, SYMBOL_TABLE_SIZE);
-    symTable->tableSize = SYMBOL_TABLE_SIZE;
+void SymbolTable_Initialize(SymbolTable *symTable, bool duplicate, uint size){
+    symTable->table = AllocatorGetN(SymbolNode*, size);
+    symTable->tableSize = size;
     symTable->seed = 0x811c9dc5; // TODO: rand
     symTable->allow_duplication = duplicate;
-    Memset(symTable->table, 0x00, sizeof(SymbolNode*) * SYMBOL_TABLE_SIZE);
+    Memset(symTable->table, 0x00, sizeof(SymbolNode*) * size);
 }
 
-int SymbolTable_Insert(SymbolTable *symTable, char *label, uint labelLen, TokenId id){
+/*
+* Inserts the symbol 'count' times, the lock must be held.
+*/
+static int _symbol_table_insert(SymbolTable *symTable, char *label, uint labelLen,
+                                TokenId id, uint count)
+{
     uint insert_id = 0;
     SymbolNode *newNode = nullptr;
 
-    if(!(labelLen > AutoCompleteMinInsertLen) || !symTable) return 1;
-
     uint hash = _symbol_table_hash(symTable, label, labelLen);
     uint index = hash % symTable->tableSize;
 
@@ -47,7 +50,7 @@ int SymbolTable_Insert(SymbolTable *symTable, char *label, uint labelLen, TokenI
     while(node != nullptr){
         if(_symbol_table_sym_node_matches(node, label, labelLen, id)){
             if(symTable->allow_duplication){
-                node->duplications++;
+                node->duplications += count;
                 return 1;
             }
             return 0;
@@ -65,7 +68,7 @@ int SymbolTable_Insert(SymbolTable *symTable, char *label, uint labelLen, TokenI
     newNode->id = id;
     newNode->next = nullptr;
     newNode->prev = nullptr;
-    newNode->duplications = 0;
+    newNode->duplications = symTable->allow_duplication ? count - 1 : 0;
 
     if(insert_id > 0){
         prev->next = newNode;
@@ -78,10 +81,52 @@ int SymbolTable_Insert(SymbolTable *symTable, char *label, uint labelLen, TokenI
     return 1;
 }
 
+int SymbolTable_Insert(SymbolTable *symTable, char *label, uint labelLen, TokenId id){
+    if(!(labelLen > AutoCompleteMinInsertLen) || !symTable) return 1;
+
+    std::unique_lock<std::shared_mutex> guard(symTable->mutex);
+    return _symbol_table_insert(symTable, label, labelLen, id, 1);
+}
+
+void SymbolTable_Merge(SymbolTable *symTable, SymbolTable *other){
+    std::unique_lock<std::shared_mutex> guard(symTable->mutex);
+    std::unique_lock<std::shared_mutex> otherGuard(other->mutex);
+    for(uint i = 0; i < other->tableSize; i++){
+        SymbolNode *node = other->table[i];
+        while(node != nullptr){
+            SymbolNode *next = node->next;
+            _symbol_table_insert(symTable, node->label, node->labelLen, node->id,
+                                 node->duplications + 1);
+            AllocatorFree(node->label);
+            AllocatorFree(node);
+            node = next;
+        }
+
+        other->table[i] = nullptr;
+    }
+}
+
+void SymbolTable_Release(SymbolTable *symTable){
+    std::unique_lock<std::shared_mutex> guard(symTable->mutex);
+    for(uint i = 0; i < symTable->tableSize; i++){
+        SymbolNode *node = symTable->table[i];
+        while(node != nullptr){
+            SymbolNode *next = node->next;
+            AllocatorFree(node->label);
+            AllocatorFree(node);
+            node = next;
+        }
+    }
+
+    AllocatorFree(symTable->table);
+    symTable->tableSize = 0;
+}
+
 void SymbolTable_Remove(SymbolTable *symTable, char *label, uint labelLen, TokenId id){
     uint tableIndex;
     if(!(labelLen > AutoCompleteMinInsertLen) || !symTable) return;
 
+    std::unique_lock<std::shared_mutex> guard(symTable->mutex);
     SymbolNode *node = SymbolTable_GetEntry(symTable, label, labelLen, id, &tableIndex);
     if(node){
         if(symTable->allow_duplication){
@@ -110,6 +155,10 @@ void SymbolTable_Remove(SymbolTable *symTable, char *label, uint labelLen, Token
     }
 }
 
+std::shared_lock<std::shared_mutex> SymbolTable_ReadLock(SymbolTable *symTable){
+    return std::shared_lock<std::shared_mutex>(symTable->mutex);
+}
+
 SymbolNode *SymbolTable_GetEntry(SymbolTable *symTable, char *label, uint labelLen,
                                  TokenId id, uint *tableIndex)
 {
@@ -5,6 +5,7 @@
 #include <types.h>
 #include <geometry.h>
 #include <utilities.h>
+#include <shared_mutex>
 
 #define TOKEN_MAX_LENGTH 64
 #define SYMBOL_TABLE_SIZE 50000
@@ -157,11 +158,18 @@ typedef struct symbol_node_t{
     struct symbol_node_t *prev;
 }SymbolNode;
 
+/*
+* Files are tokenized by the pool while the main thread edits and renders so
+* the table has a lock, Insert and Remove take it exclusively. Lookups with
+* Search, GetEntry and SymNodeNext do not lock, callers must hold the lock
+* given by SymbolTable_ReadLock while they use the nodes returned.
+*/
 typedef struct{
     SymbolNode **table;
     uint tableSize;
     uint seed;
     bool allow_duplication;
+    std::shared_mutex mutex;
 }SymbolTable;
 
 /*
@@ -170,9 +178,23 @@ typedef struct{
 * have different meanings given by their ids. You can however make the
 * symbol table register how many times a token was inserted by setting
 * 'duplicate' = true. Might be usefull if you are using the symbol table
-* to keep track of how many times a token appeared.
+* to keep track of how many times a token appeared. 'size' is the amount of
+* entries of the hash table.
+*/
+void SymbolTable_Initialize(SymbolTable *symTable, bool duplicate=false,
+                            uint size=SYMBOL_TABLE_SIZE);
+
+/*
+* Releases all entries and the memory taken by a symbol table.
 */
-void SymbolTable_Initialize(SymbolTable *symTable, bool duplicate=false);
+void SymbolTable_Release(SymbolTable *symTable);
+
+/*
+* Moves all entries of 'other' into 'symTable' as if each of its insertions had
+* been done in 'symTable', 'other' is left empty. Allows symbols found by a file
+* being tokenized in background to be published at once.
+*/
+void SymbolTable_Merge(SymbolTable *symTable, SymbolTable *other);
 
 /*
 * Pushes a new symbol into the symbol table, returns 1 in case the symbol
@@ -188,6 +210,12 @@ int SymbolTable_Insert(SymbolTable *symTable, char *label, uint labelLen, TokenI
 */
 void SymbolTable_Remove(SymbolTable *symTable, char *label, uint labelLen, TokenId id);
 
+/*
+* Locks the symbol table for lookups, the lock is released when the returned
+* object goes out of scope.
+*/
+std::shared_lock<std::shared_mutex> SymbolTable_ReadLock(SymbolTable *symTable);
+
 /*
 * Queries a symbol table for the first matching hashed node.
 */
@@ -0,0 +1,596 @@
+#include <trigram_index.h>
+#include <project_search.h>
+#include <parallel.h>
+#include <utilities.h>
+#include <hash.h>
+#include <app.h>
+#include <file_watcher.h>
+#include <file_index.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <memory>
+
+#define TRIGRAM_INDEX_PATH ".trigrams_"
+// amount of files read at once when building, bounds the memory used for their sets
+#define TRIGRAM_INDEX_BATCH 1024
+// one bit per possible trigram
+#define TRIGRAM_SET_BYTES ((1 << 24) / 8)
+
+struct TrigramPostingBuilder{
+    std::vector<uint8> data;
+    uint count;
+    uint last;
+};
+
+struct ProjectIndexState{
+    std::mutex mutex;
+    std::string root;
+    std::shared_ptr<TrigramIndex> index;
+    // files written by the editor and the time they were written
+    std::map<std::string, time_t> dirty;
+    std::atomic<int> updating;
+    // next update to run, the files are taken from the FileIndex if not 'listed'
+    bool pending;
+    bool listed;
+    std::string pendingRoot;
+    std::vector<std::string> pendingFiles;
+};
+
+static ProjectIndexState projectIndex;
+
+static inline uint8 TrigramFold(uint8 c){
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline void TrigramPutVarint(std::vector<uint8> &out, uint value){
+    while(value >= 0x80){
+        out.push_back((uint8)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8)value);
+}
+
+static inline uint TrigramGetVarint(const uint8 **ptr){
+    const uint8 *p = *ptr;
+    uint value = 0;
+    uint shift = 0;
+    while(*p & 0x80){
+        value |= (uint)(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= (uint)(*p++) << shift;
+    *ptr = p;
+    return value;
+}
+
+static inline void TrigramPostingPush(TrigramPostingBuilder *posting, uint id){
+    TrigramPutVarint(posting->data, posting->count > 0 ? id - posting->last : id);
+    posting->last = id;
+    posting->count++;
+}
+
+static void TrigramDecode(const uint8 *ptr, uint count, std::vector<uint> &out){
+    uint id = 0;
+    out.clear();
+    out.reserve(count);
+    for(uint i = 0; i < count; i++){
+        uint delta = TrigramGetVarint(&ptr);
+        id = i > 0 ? id + delta : delta;
+        out.push_back(id);
+    }
+}
+
+/*
+* Collects the distinct trigrams of 'data' sorted in 'out'. Trigrams crossing lines
+* are never queried and are not stored. 'set' is a zeroed bitset with one bit per
+* trigram and is left zeroed on return.
+*/
+static void TrigramCollect(const char *data, uint size, uint8 *set, std::vector<uint> &out){
+    out.clear();
+    uint t = 0;
+    uint valid = 0;
+    for(uint i = 0; i < size; i++){
+        uint8 c = (uint8)data[i];
+        if(c == '\n' || c == '\r'){
+            valid = 0;
+            continue;
+        }
+
+        t = ((t << 8) | TrigramFold(c)) & 0xFFFFFF;
+        if(++valid < 3) continue;
+
+        uint8 bit = (uint8)(1 << (t & 7));
+        if(!(set[t >> 3] & bit)){
+            set[t >> 3] |= bit;
+            out.push_back(t);
+        }
+    }
+
+    for(uint trigram : out){
+        set[trigram >> 3] = 0;
+    }
+
+    std::sort(out.begin(), out.end());
+}
+
+static int TrigramComparePath(TrigramIndex *index, uint id, const std::string &path){
+    TrigramIndexFile *file = &index->files[id];
+    return -path.compare(0, std::string::npos, &index->paths[file->pathOffset],
+                         file->pathLen);
+}
+
+static TrigramIndexEntry *TrigramFindEntry(TrigramIndex *index, uint trigram){
+    TrigramIndexEntry *begin = index->table;
+    TrigramIndexEntry *end = &index->table[index->header->trigramCount];
+    TrigramIndexEntry *it = std::lower_bound(begin, end, trigram,
+    [](const TrigramIndexEntry &entry, uint value){
+        return entry.trigram < value;
+    });
+
+    if(it == end || it->trigram != trigram) return nullptr;
+    return it;
+}
+
+int TrigramIndex_Open(TrigramIndex *index, const char *path){
+    ProjectMappedFile file;
+    memset(index, 0, sizeof(TrigramIndex));
+    if(!ProjectSearch_MapFile(path, &file)) return 0;
+
+    index->data = file.data;
+    index->size = file.size;
+    index->mapped = file.mapped;
+
+    TrigramIndexHeader *header = (TrigramIndexHeader *)index->data;
+    uint64 size = index->size;
+    if(size < sizeof(TrigramIndexHeader) || header->magic != TRIGRAM_INDEX_MAGIC ||
+       header->version != TRIGRAM_INDEX_VERSION ||
+       sizeof(TrigramIndexHeader) + (uint64)header->fileCount *
+                                    sizeof(TrigramIndexFile) > header->pathsOffset ||
+       header->pathsOffset > header->tableOffset ||
+       header->tableOffset + (uint64)header->trigramCount *
+                             sizeof(TrigramIndexEntry) > header->postingsOffset ||
+       header->postingsOffset + header->postingsSize > size)
+    {
+        TrigramIndex_Close(index);
+        return 0;
+    }
+
+    index->header = header;
+    index->files = (TrigramIndexFile *)&index->data[sizeof(TrigramIndexHeader)];
+    index->paths = &index->data[header->pathsOffset];
+    index->table = (TrigramIndexEntry *)&index->data[header->tableOffset];
+    index->postings = (uint8 *)&index->data[header->postingsOffset];
+    return 1;
+}
+
+void TrigramIndex_Close(TrigramIndex *index){
+    ProjectMappedFile file;
+    file.data = index->data;
+    file.size = index->size;
+    file.mapped = index->mapped;
+    if(file.data){
+        ProjectSearch_UnmapFile(&file);
+    }
+
+    memset(index, 0, sizeof(TrigramIndex));
+}
+
+int TrigramIndex_FindFile(TrigramIndex *index, const char *path, uint len){
+    std::string target(path, len);
+    int lo = 0;
+    int hi = (int)index->header->fileCount - 1;
+    while(lo <= hi){
+        int mid = (lo + hi) / 2;
+        int c = TrigramComparePath(index, (uint)mid, target);
+        if(c == 0) return mid;
+        if(c < 0) lo = mid + 1;
+        else hi = mid - 1;
+    }
+
+    return -1;
+}
+
+int TrigramIndex_Build(const char *path, const std::vector<std::string> &files,
+                       TrigramIndex *previous, const std::vector<std::string> &forced,
+                       std::atomic<int> *cancel)
+{
+    uint n = files.size();
+    uint prevCount = previous ? previous->header->fileCount : 0;
+    std::vector<TrigramIndexFile> table(n);
+    std::vector<int> remap(prevCount, -1);
+    std::vector<uint> changed;
+    std::unordered_set<std::string> forcedSet(forced.begin(), forced.end());
+
+    uint64 pathOffset = 0;
+    uint j = 0;
+    for(uint i = 0; i < n; i++){
+        struct stat st;
+        TrigramIndexFile *file = &table[i];
+        file->mtime = 0;
+        file->size = 0;
+        file->pathOffset = pathOffset;
+        file->pathLen = files[i].size();
+        file->trigrams = 0;
+        pathOffset += files[i].size();
+        if(stat(files[i].c_str(), &st) == 0){
+            file->mtime = (uint64)st.st_mtime;
+            file->size = (uint64)st.st_size;
+        }
+
+        // both lists are sorted so files that are kept keep their relative order
+        while(j < prevCount && TrigramComparePath(previous, j, files[i]) < 0) j++;
+
+        if(j < prevCount && TrigramComparePath(previous, j, files[i]) == 0 &&
+           previous->files[j].mtime == file->mtime &&
+           previous->files[j].size == file->size && forcedSet.count(files[i]) == 0)
+        {
+            remap[j] = (int)i;
+            file->trigrams = previous->files[j].trigrams;
+        }else{
+            changed.push_back(i);
+        }
+    }
+
+    // nothing to do in case all files were kept
+    if(previous && changed.size() == 0 && prevCount == n) return 1;
+
+    // read the files that changed, sets are built in parallel and then appended
+    // in order so that postings are always sorted
+    std::unordered_map<uint, TrigramPostingBuilder> fresh;
+    std::vector<std::vector<uint8>> sets(GetConcurrency());
+    for(uint b = 0; b < changed.size(); b += TRIGRAM_INDEX_BATCH){
+        uint e = b + TRIGRAM_INDEX_BATCH;
+        e = e < changed.size() ? e : changed.size();
+        std::vector<std::vector<uint>> trigrams(e - b);
+        ParallelForDynamic("Trigram Index", b, e, [&](uint k, int tid){
+            ProjectMappedFile file;
+            if(cancel && *cancel) return;
+            if(!ProjectSearch_MapFile(files[changed[k]].c_str(), &file)) return;
+
+            if(file.size > 0 && !ProjectSearch_IsBinary(file.data, file.size)){
+                std::vector<uint8> &set = sets[tid];
+                if(set.size() == 0) set.resize(TRIGRAM_SET_BYTES, 0);
+                TrigramCollect(file.data, file.size, set.data(), trigrams[k - b]);
+            }
+
+            ProjectSearch_UnmapFile(&file);
+        });
+
+        if(cancel && *cancel) return 0;
+
+        for(uint k = b; k < e; k++){
+            uint id = changed[k];
+            table[id].trigrams = trigrams[k - b].size();
+            for(uint trigram : trigrams[k - b]){
+                auto it = fresh.find(trigram);
+                if(it == fresh.end()){
+                    it = fresh.insert({trigram, {std::vector<uint8>(), 0, 0}}).first;
+                }
+                TrigramPostingPush(&it->second, id);
+            }
+        }
+    }
+
+    std::vector<uint> keys;
+    keys.reserve(fresh.size());
+    for(auto &it : fresh){
+        keys.push_back(it.first);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // merge the postings of the previous index with the new ones
+    std::vector<TrigramIndexEntry> entries;
+    std::vector<uint8> postings;
+    std::vector<uint> oldIds, newIds, merged;
+    uint prevTrigrams = previous ? previous->header->trigramCount : 0;
+    uint a = 0, k = 0;
+    while(a < prevTrigrams || k < keys.size()){
+        uint trigram = 0;
+        oldIds.clear();
+        newIds.clear();
+        if(a < prevTrigrams && (k >= keys.size() ||
+                                previous->table[a].trigram <= keys[k]))
+        {
+            TrigramIndexEntry *entry = &previous->table[a++];
+            trigram = entry->trigram;
+            TrigramDecode(&previous->postings[entry->offset], entry->count, merged);
+            for(uint id : merged){
+                if(remap[id] >= 0) oldIds.push_back((uint)remap[id]);
+            }
+        }else{
+            trigram = keys[k];
+        }
+
+        if(k < keys.size() && keys[k] == trigram){
+            TrigramPostingBuilder *builder = &fresh[keys[k++]];
+            TrigramDecode(builder->data.data(), builder->count, newIds);
+        }
+
+        merged.clear();
+        std::merge(oldIds.begin(), oldIds.end(), newIds.begin(), newIds.end(),
+                   std::back_inserter(merged));
+        if(merged.size() == 0) continue;
+
+        TrigramIndexEntry entry = { trigram, (uint)merged.size(), postings.size() };
+        for(uint i = 0; i < merged.size(); i++){
+            TrigramPutVarint(postings, i > 0 ? merged[i] - merged[i-1] : merged[i]);
+        }
+        entries.push_back(entry);
+    }
+
+    TrigramIndexHeader header;
+    header.magic = TRIGRAM_INDEX_MAGIC;
+    header.version = TRIGRAM_INDEX_VERSION;
+    header.fileCount = n;
+    header.trigramCount = entries.size();
+    header.pathsOffset = sizeof(TrigramIndexHeader) + n * sizeof(TrigramIndexFile);
+    header.tableOffset = (header.pathsOffset + pathOffset + 7) & ~(uint64)7;
+    header.postingsOffset = header.tableOffset +
+                            entries.size() * sizeof(TrigramIndexEntry);
+    header.postingsSize = postings.size();
+    if(header.postingsOffset + header.postingsSize >= (uint64)UINT_MAX){
+        printf("Trigram index is too large\n");
+        return 0;
+    }
+
+    std::string tmp(path);
+    tmp += ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if(!fp) return 0;
+
+    const uint8 padding[8] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if(n > 0) ok &= fwrite(table.data(), sizeof(TrigramIndexFile), n, fp) == n;
+    for(const std::string &file : files){
+        ok &= fwrite(file.data(), 1, file.size(), fp) == file.size();
+    }
+
+    uint pad = header.tableOffset - header.pathsOffset - pathOffset;
+    if(pad > 0) ok &= fwrite(padding, 1, pad, fp) == pad;
+    if(entries.size() > 0){
+        ok &= fwrite(entries.data(), sizeof(TrigramIndexEntry), entries.size(), fp)
+                == entries.size();
+    }
+    if(postings.size() > 0){
+        ok &= fwrite(postings.data(), 1, postings.size(), fp) == postings.size();
+    }
+
+    ok &= fclose(fp) == 0;
+    if(!ok){
+        remove(tmp.c_str());
+        return 0;
+    }
+
+#if defined(_WIN32)
+    remove(path);
+#endif
+    return rename(tmp.c_str(), path) == 0;
+}
+
+int TrigramIndex_Candidates(TrigramIndex *index, const std::vector<std::string> &literals,
+                            std::vector<uint> &ids)
+{
+    std::vector<TrigramIndexEntry *> entries;
+    std::vector<uint> posting, intersection;
+    bool narrowed = false;
+    ids.clear();
+    for(const std::string &literal : literals){
+        if(literal.size() < 3) continue;
+
+        entries.clear();
+        for(uint i = 0; i + 3 <= literal.size(); i++){
+            uint trigram = ((uint)TrigramFold(literal[i]) << 16) |
+                           ((uint)TrigramFold(literal[i+1]) << 8) |
+                           (uint)TrigramFold(literal[i+2]);
+            TrigramIndexEntry *entry = TrigramFindEntry(index, trigram);
+            if(!entry){
+                ids.clear();
+                return 1;
+            }
+            entries.push_back(entry);
+        }
+
+        // start from the rarest trigram so the intersection shrinks quickly
+        std::sort(entries.begin(), entries.end(),
+        [](TrigramIndexEntry *a, TrigramIndexEntry *b){
+            return a->count < b->count;
+        });
+
+        for(TrigramIndexEntry *entry : entries){
+            TrigramDecode(&index->postings[entry->offset], entry->count, posting);
+            if(!narrowed){
+                ids.swap(posting);
+                narrowed = true;
+            }else{
+                intersection.clear();
+                std::set_intersection(ids.begin(), ids.end(), posting.begin(),
+                                      posting.end(), std::back_inserter(intersection));
+                ids.swap(intersection);
+            }
+
+            if(ids.size() == 0) return 1;
+        }
+    }
+
+    return narrowed ? 1 : 0;
+}
+
+static std::string ProjectIndexPath(const std::string &root){
+    char name[64];
+    std::string path(AppGetConfigDirectory());
+    if(path[path.size()-1] != '/' && path[path.size()-1] != '\\'){
+        path += SEPARATOR_STRING;
+    }
+
+    snprintf(name, sizeof(name), TRIGRAM_INDEX_PATH "%08x",
+             MurmurHash3((char *)root.c_str(), root.size(), 0));
+    return path + name;
+}
+
+static std::shared_ptr<TrigramIndex> ProjectIndexOpen(const std::string &path){
+    TrigramIndex *index = new TrigramIndex;
+    if(!TrigramIndex_Open(index, path.c_str())){
+        delete index;
+        return nullptr;
+    }
+
+    return std::shared_ptr<TrigramIndex>(index, [](TrigramIndex *ptr){
+        TrigramIndex_Close(ptr);
+        delete ptr;
+    });
+}
+
+// must be called with the state locked
+static void ProjectIndexSetRoot(const std::string &root){
+    if(projectIndex.root != root){
+        projectIndex.root = root;
+        projectIndex.index = ProjectIndexOpen(ProjectIndexPath(root));
+    }
+}
+
+int ProjectIndex_Filter(const char *root, SearchQuery *query,
+                        const std::vector<std::string> &files,
+                        std::vector<uint> &candidates)
+{
+    std::vector<std::string> literals;
+    std::shared_ptr<TrigramIndex> index;
+    std::unordered_set<std::string> dirty;
+    std::vector<uint> ids;
+
+    SearchQuery_Literals(query, literals);
+    if(literals.size() == 0) return 0;
+
+    {
+        std::lock_guard<std::mutex> guard(projectIndex.mutex);
+        ProjectIndexSetRoot(root);
+        index = projectIndex.index;
+        for(auto &it : projectIndex.dirty){
+            dirty.insert(it.first);
+        }
+    }
+
+    if(!index) return 0;
+    if(!TrigramIndex_Candidates(index.get(), literals, ids)) return 0;
+
+    std::vector<uint8> hit(index->header->fileCount, 0);
+    for(uint id : ids){
+        hit[id] = 1;
+    }
+
+    // files unknown to the index or written since it was built are always searched
+    candidates.clear();
+    uint j = 0;
+    uint count = index->header->fileCount;
+    for(uint i = 0; i < files.size(); i++){
+        while(j < count && TrigramComparePath(index.get(), j, files[i]) < 0) j++;
+        bool indexed = j < count && TrigramComparePath(index.get(), j, files[i]) == 0;
+        if(!indexed || hit[j] || dirty.count(files[i]) > 0){
+            candidates.push_back(i);
+        }
+    }
+
+    return 1;
+}
+
+/*
+* Runs the requested updates until there are none left, as an idle task in the
+* pool so it never holds workers needed by the editor.
+*/
+static void ProjectIndexUpdate(){
+    while(1){
+        std::string root;
+        std::vector<std::string> files;
+        bool listed = false;
+        {
+            std::lock_guard<std::mutex> guard(projectIndex.mutex);
+            if(!projectIndex.pending){
+                projectIndex.updating = 0;
+                return;
+            }
+
+            projectIndex.pending = false;
+            listed = projectIndex.listed;
+            root.swap(projectIndex.pendingRoot);
+            files.swap(projectIndex.pendingFiles);
+        }
+
+        if(!listed && !FileIndex_GetFiles(root.c_str(), files)) continue;
+
+        std::shared_ptr<TrigramIndex> previous;
+        std::vector<std::string> forced;
+        // files changing from now on are marked dirty, the build might miss them
+        FileWatcher_WatchProject(root, files);
+        {
+            std::lock_guard<std::mutex> guard(projectIndex.mutex);
+            ProjectIndexSetRoot(root);
+            previous = projectIndex.index;
+            for(auto &it : projectIndex.dirty){
+                forced.push_back(it.first);
+            }
+        }
+
+        std::string path = ProjectIndexPath(root);
+        std::shared_ptr<TrigramIndex> next;
+        if(TrigramIndex_Build(path.c_str(), files, previous.get(), forced)){
+            next = ProjectIndexOpen(path);
+        }
+
+        if(next){
+            std::lock_guard<std::mutex> guard(projectIndex.mutex);
+            if(projectIndex.root == root){
+                projectIndex.index = next;
+                // a save can still be running when the file is read, only forget
+                // files that were indexed with a timestamp past the save
+                for(auto it = projectIndex.dirty.begin(); it != projectIndex.dirty.end();){
+                    int id = TrigramIndex_FindFile(next.get(), it->first.c_str(),
+                                                   it->first.size());
+                    if(id >= 0 && (time_t)next->files[id].mtime >= it->second){
+                        it = projectIndex.dirty.erase(it);
+                    }else{
+                        ++it;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void ProjectIndexRequest(const char *root, const std::vector<std::string> *files){
+    {
+        std::lock_guard<std::mutex> guard(projectIndex.mutex);
+        projectIndex.pending = true;
+        projectIndex.listed = files != nullptr;
+        projectIndex.pendingRoot = root;
+        projectIndex.pendingFiles.clear();
+        if(files) projectIndex.pendingFiles = *files;
+    }
+
+    // a running update picks the request once it finishes
+    if(projectIndex.updating.exchange(1)) return;
+    ParallelPool_Submit(ProjectIndexUpdate, TASK_PRIORITY_IDLE);
+}
+
+void ProjectIndex_Refresh(const char *root, const std::vector<std::string> &files){
+    ProjectIndexRequest(root, &files);
+}
+
+void ProjectIndex_Update(const char *root){
+    {
+        std::lock_guard<std::mutex> guard(projectIndex.mutex);
+        if(projectIndex.root != root || !projectIndex.index) return;
+    }
+
+    ProjectIndexRequest(root, nullptr);
+}
+
+void ProjectIndex_MarkDirty(const char *path, uint len){
+    std::lock_guard<std::mutex> guard(projectIndex.mutex);
+    projectIndex.dirty[std::string(path, len)] = time(nullptr);
+}
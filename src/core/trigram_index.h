@@ -0,0 +1,131 @@
+/* date = October 19th 2026 17:05 */
+#pragma once
+#include <types.h>
+#include <search.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+/*
+* Trigram index over the files of a project, it is used to restrict project-search
+* to the files that can possibly match a query. Every file is reduced to the set of
+* case folded 3 byte sequences it contains and for each trigram the index keeps the
+* sorted list of files containing it (its posting list) delta encoded as varints.
+* A literal can only be inside a file if all of its trigrams are, so intersecting
+* their posting lists gives the candidates.
+*
+* The index is a single file that is memory mapped when opened, its layout is:
+*     header | file table | paths | trigram table | postings
+* Rebuilding is incremental: files with the same size and modification time as
+* the previous index keep their postings and only the others are read again.
+*/
+
+#define TRIGRAM_INDEX_MAGIC   0x58495254 // 'TRIX'
+#define TRIGRAM_INDEX_VERSION 1
+
+typedef struct TrigramIndexHeader{
+    uint magic;
+    uint version;
+    uint fileCount;
+    uint trigramCount;
+    uint64 pathsOffset;
+    uint64 tableOffset;
+    uint64 postingsOffset;
+    uint64 postingsSize;
+}TrigramIndexHeader;
+
+typedef struct TrigramIndexFile{
+    uint64 mtime;
+    uint64 size;
+    uint64 pathOffset; // relative to the paths section
+    uint pathLen;
+    uint trigrams; // amount of distinct trigrams in the file, informative
+}TrigramIndexFile;
+
+typedef struct TrigramIndexEntry{
+    uint trigram;
+    uint count;
+    uint64 offset; // relative to the postings section
+}TrigramIndexEntry;
+
+typedef struct TrigramIndex{
+    char *data;
+    uint size;
+    bool mapped;
+    TrigramIndexHeader *header;
+    TrigramIndexFile *files;
+    char *paths;
+    TrigramIndexEntry *table;
+    uint8 *postings;
+}TrigramIndex;
+
+/*
+* Maps the index stored at 'path'. Returns 0 in case the file does not exist or
+* is not a valid index.
+*/
+int TrigramIndex_Open(TrigramIndex *index, const char *path);
+
+/*
+* Unmaps an index opened with TrigramIndex_Open.
+*/
+void TrigramIndex_Close(TrigramIndex *index);
+
+/*
+* Builds the index for 'files', which must be sorted, and writes it to 'path'.
+* In case 'previous' is given files that did not change since it was built reuse
+* their postings, except the ones listed in 'forced'. Returns 0 in case the index
+* could not be written or 'cancel' was set.
+*/
+int TrigramIndex_Build(const char *path, const std::vector<std::string> &files,
+                       TrigramIndex *previous, const std::vector<std::string> &forced,
+                       std::atomic<int> *cancel=nullptr);
+
+/*
+* Gets the id of the file 'path' inside the index or -1 if it is not indexed.
+*/
+int TrigramIndex_FindFile(TrigramIndex *index, const char *path, uint len);
+
+/*
+* Computes in 'ids' the sorted ids of the indexed files that contain all strings
+* in 'literals'. Literals shorter than 3 bytes carry no information, in case none
+* is usable 0 is returned and 'ids' should be ignored.
+*/
+int TrigramIndex_Candidates(TrigramIndex *index, const std::vector<std::string> &literals,
+                            std::vector<uint> &ids);
+
+/*
+* The project index is the trigram index of the root directory, it is kept in the
+* configuration folder and refreshed in background, as an idle task of the pool,
+* after each project-search and after files are saved.
+* Files saved by the editor, or changed on disk while the project is watched, see
+* FileWatcher_WatchProject, are marked dirty and always searched until the index
+* catches up with them.
+*/
+
+/*
+* Computes in 'candidates' the positions inside 'files', sorted list of the files
+* under 'root', that may contain matches for 'query'. Returns 0 in case there is
+* no index for 'root' yet or the query cannot be narrowed, in which case all files
+* must be searched.
+*/
+int ProjectIndex_Filter(const char *root, SearchQuery *query,
+                        const std::vector<std::string> &files,
+                        std::vector<uint> &candidates);
+
+/*
+* Starts a background update of the index of 'root' with the list of files 'files'.
+* In case an update is already running this one runs once it finishes, only the
+* last request is kept.
+*/
+void ProjectIndex_Refresh(const char *root, const std::vector<std::string> &files);
+
+/*
+* Like ProjectIndex_Refresh but the files are taken from the FileIndex. Does
+* nothing in case 'root' was never indexed, i.e.: no project-search ran on it.
+*/
+void ProjectIndex_Update(const char *root);
+
+/*
+* Notifies that the file at 'path' was written by the editor.
+*/
+void ProjectIndex_MarkDirty(const char *path, uint len);
@@ -19,13 +19,20 @@ static UndoSystem uSystem = {
 };
 
 static void DoStack_ReleaseIfNeeded(BufferChange *item){
+    // text of popped entries is released by whoever applied them
     item->buffer = nullptr;
+    item->text = nullptr;
 }
 static void DoStack_FreeIfNeeded(BufferChange *item){
     if(item->buffer != nullptr){
         UndoSystemTakeBuffer(item->buffer);
         item->buffer = nullptr;
     }
+
+    if(item->text != nullptr){
+        AllocatorFree(item->text);
+        item->text = nullptr;
+    }
 }
 
 DoStack *DoStack_Create(){
@@ -83,6 +90,10 @@ void UndoSystemGetMemory(){
         buffer->data = nullptr;
         buffer->tokens = nullptr;
         buffer->tokenCount = 0;
+        buffer->declarations = 0;
+        buffer->matches = nullptr;
+        buffer->matchCount = 0;
+        buffer->matchGeneration = 0;
         uSystem.bufferPool[i] = buffer;
     }
     count += uSystem.size;
@@ -210,6 +221,19 @@ void UndoRedoUndoPushInsertBlock(UndoRedo *redo, vec2ui start, char *text, uint
     DoStack_Push(redo->undoStack, &bufferChange);
 }
 
+void UndoRedoUndoPushLines(UndoRedo *redo, vec2ui cursor, char *text, uint size){
+    BufferChange bufferChange = {
+        .bufferInfo = cursor,
+        .bufferInfoEnd = vec2ui(),
+        .buffer = nullptr,
+        .text = text,
+        .size = size,
+        .change = CHANGE_LINES_REPLACE,
+    };
+
+    DoStack_Push(redo->undoStack, &bufferChange);
+}
+
 void UndoRedoUndoPushNewLine(UndoRedo *redo, vec2ui baseU8){
     _UndoRedoUndoPushNewLine(redo, baseU8, 1);
 }
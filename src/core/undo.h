@@ -27,6 +27,7 @@ typedef enum{
     CHANGE_MERGE,
     CHANGE_BLOCK_REMOVE,
     CHANGE_BLOCK_INSERT,
+    CHANGE_LINES_REPLACE,
 }ChangeID;
 
 typedef struct{
@@ -61,6 +62,7 @@ inline const char *UndoRedo_GetStringID(ChangeID id){
         STR_CASE(CHANGE_MERGE);
         STR_CASE(CHANGE_BLOCK_REMOVE);
         STR_CASE(CHANGE_BLOCK_INSERT);
+        STR_CASE(CHANGE_LINES_REPLACE);
         default:return "Unknown";
     }
 #undef STR_CASE
@@ -138,6 +140,13 @@ void UndoRedoUndoPushRemoveBlock(UndoRedo *redo, vec2ui start, vec2ui end);
 */
 void UndoRedoUndoPushInsertBlock(UndoRedo *redo, vec2ui start, char *text, uint size);
 
+/*
+* Pushes into the stack a command to restore the contents of several lines at once,
+* see EditBatch. The text holds the original lines as written by the edit batch
+* and its ownership is given to the undo system.
+*/
+void UndoRedoUndoPushLines(UndoRedo *redo, vec2ui cursor, char *text, uint size);
+
 /*
 * Moves one entry of the undo stack to the redo stack.
 */
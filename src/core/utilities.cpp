@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <sstream>
 #include <encoding.h>
+#include <errno.h>
 #if !defined(_WIN32)
 #include <unistd.h>
 #include <dirent.h>
@@ -292,51 +293,117 @@ int GuessFileEntry(char *path, uint size, FileEntry *entry, char *folder){
     return r;
 }
 
-int ListFileEntriesLinear(char *basePath, std::vector<uint8_t> &out, uint32_t *size){
-    AssertA(basePath != nullptr, "Invalid query pointer");
+#if defined(__linux__)
+#include <sys/syscall.h>
+
+// size of the block the kernel fills with entries on each getdents64 call
+#define DIRECTORY_READ_SIZE (256 * 1024)
+
+struct LinuxDirent64{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+/*
+* Calls 'fn' with the name, its length and the type of every entry of 'basePath'
+* that should be listed. On Linux the directory is read with getdents64 in large
+* blocks, so even huge directories take a handful of system calls, and symlinks
+* are resolved relative to the directory itself.
+*/
+template<typename Fn>
+static int ForEachDirectoryEntry(char *basePath, Fn fn){
+    auto listed = [](const char *p, uint reclen) -> bool{
+        if(reclen == 1) return p[0] != '.';
+        if(reclen == 2) return !(p[0] == '.' && p[1] == '.');
+        return true;
+    };
+#if defined(__linux__)
+    int fd = open(basePath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) return -1;
+
+    char *block = AllocatorGetN(char, DIRECTORY_READ_SIZE);
+    while(1){
+        long r = syscall(SYS_getdents64, fd, block, DIRECTORY_READ_SIZE);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) break;
+
+        for(long at = 0; at < r;){
+            struct LinuxDirent64 *entry = (struct LinuxDirent64 *)&block[at];
+            at += entry->d_reclen;
+
+            char *p = entry->d_name;
+            uint reclen = strlen(p);
+            if(!listed(p, reclen)) continue;
+
+            if(entry->d_type == DT_DIR){
+                fn(p, reclen, DescriptorDirectory);
+            }else if(entry->d_type == DT_REG){
+                fn(p, reclen, DescriptorFile);
+            }else if(entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN){
+                struct stat st;
+                if(fstatat(fd, p, &st, 0) != 0){
+                    if(entry->d_type == DT_LNK) fn(p, reclen, DescriptorFile);
+                }else if(S_ISDIR(st.st_mode)){
+                    fn(p, reclen, DescriptorDirectory);
+                }else if(S_ISREG(st.st_mode) || entry->d_type == DT_LNK){
+                    fn(p, reclen, DescriptorFile);
+                }
+            }
+        }
+    }
+
+    AllocatorFree(block);
+    close(fd);
+#else
     DIR *dir = opendir(basePath);
     struct dirent *entry = nullptr;
     if(dir == nullptr) return -1;
 
-    uint8_t mem[32];
-    if(size) *size = 0;
     do{
         entry = readdir(dir);
         if(entry != nullptr){
             if(entry->d_type == DT_DIR || entry->d_type == DT_REG ||
                entry->d_type == DT_LNK)
             {
-                int keep = 1;
                 char *p = entry->d_name;
                 uint reclen = strlen(p);
-                if(reclen == 1){
-                    keep = p[0] != '.' ? 1 : 0;
-                }else if(reclen == 2){
-                    keep = (p[0] == '.' && p[1] == '.') ? 0 : 1;
-                }
-
-                if(keep){
-                    uint8_t id = DescriptorFile;
+                if(listed(p, reclen)){
+                    FileType type = DescriptorFile;
                     if(entry->d_type == DT_DIR){
-                        id = DescriptorDirectory;
+                        type = DescriptorDirectory;
                     }else if(entry->d_type == DT_LNK){
-                        id = SymlinkGetType(p);
+                        type = SymlinkGetType(p);
                     }
-                    memcpy(mem, &reclen, sizeof(uint32_t));
 
-                    out.push_back(id);
-                    out.insert(out.end(), &mem[0], &mem[sizeof(uint32_t)]);
-                    out.insert(out.end(), &p[0], &p[reclen]);
-                    if(size) *size += 1;
+                    fn(p, reclen, type);
                 }
             }
         }
     }while(entry != nullptr);
     closedir(dir);
-
+#endif
     return 1;
 }
 
+int ListFileEntriesLinear(char *basePath, std::vector<uint8_t> &out, uint32_t *size){
+    AssertA(basePath != nullptr, "Invalid query pointer");
+    uint8_t mem[32];
+    if(size) *size = 0;
+    return ForEachDirectoryEntry(basePath, [&](char *p, uint reclen, FileType type){
+        uint8_t id = (uint8_t)type;
+        memcpy(mem, &reclen, sizeof(uint32_t));
+
+        out.push_back(id);
+        out.insert(out.end(), &mem[0], &mem[sizeof(uint32_t)]);
+        out.insert(out.end(), &p[0], &p[reclen]);
+        if(size) *size += 1;
+    });
+}
+
 int ListFileEntries(char *basePath, FileEntry **entries, uint *n, uint *size){
     AssertA(n != nullptr && entries != nullptr && basePath != nullptr,
             "Invalid query pointers");
@@ -344,10 +411,6 @@ int ListFileEntries(char *basePath, FileEntry **entries, uint *n, uint *size){
     uint base = 8;
     uint count = 0;
     uint currSize = 0;
-    DIR *dir = opendir(basePath);
-    struct dirent *entry = nullptr;
-
-    if(dir == nullptr) return -1;
 
     if(*n == 0 || *entries == nullptr){
         lEntries = AllocatorGetN(FileEntry, base);
@@ -357,49 +420,28 @@ int ListFileEntries(char *basePath, FileEntry **entries, uint *n, uint *size){
         currSize = *n;
     }
 
-    do{
-        entry = readdir(dir);
-        if(entry != nullptr){
-            if(entry->d_type == DT_DIR || entry->d_type == DT_REG ||
-               entry->d_type == DT_LNK)
-            {
-                int keep = 1;
-                char *p = entry->d_name;
-                uint reclen = strlen(p);
-                if(reclen == 1){
-                    keep = p[0] != '.' ? 1 : 0;
-                }else if(reclen == 2){
-                    keep = (p[0] == '.' && p[1] == '.') ? 0 : 1;
-                }
-
-                if(keep){
-                    if(!(currSize > count + 1)){
-                        lEntries = AllocatorExpand(FileEntry, lEntries,
-                                                   currSize+base, currSize);
-                        currSize += base;
-                    }
+    int r = ForEachDirectoryEntry(basePath, [&](char *p, uint reclen, FileType type){
+        // grow geometrically, large directories would copy the list over and over
+        if(!(currSize > count + 1)){
+            uint newSize = currSize < base ? base : 2 * currSize;
+            lEntries = AllocatorExpand(FileEntry, lEntries, newSize, currSize);
+            currSize = newSize;
+        }
 
-                    if(entry->d_type == DT_DIR){
-                        lEntries[count].type = DescriptorDirectory;
-                        //printf("Directory %s (len = %d)\n", entry->d_name, (int) reclen);
-                    }else if(entry->d_type == DT_LNK){
-                        lEntries[count].type = SymlinkGetType(p);
-                        //printf("File %s\n", entry->d_name);
-                    }else{
-                        lEntries[count].type = DescriptorFile;
-                        //printf("File %s\n", entry->d_name);
-                    }
+        lEntries[count].type = type;
+        Memcpy(lEntries[count].path, p, reclen);
+        lEntries[count].path[reclen] = 0;
+        lEntries[count].pLen = reclen;
+        lEntries[count].isLoaded = 0;
+        count++;
+    });
 
-                    Memcpy(lEntries[count].path, p, reclen);
-                    lEntries[count].path[reclen] = 0;
-                    lEntries[count].pLen = reclen;
-                    lEntries[count].isLoaded = 0;
-                    count++;
-                }
-            }
+    if(r < 0){
+        if(lEntries != *entries){
+            AllocatorFree(lEntries);
         }
-    }while(entry != nullptr);
-    closedir(dir);
+        return -1;
+    }
 
     *entries = lEntries;
     *n = count;
@@ -813,70 +855,6 @@ vec4i ColorFromRGBA(vec4f color){
                  (uint)(ColorClamp(color.w) * 256.0f));
 }
 
-const int XSIZE = 255;
-int mpNext[XSIZE];
-void FastStringSearchInit(char *x, uint m){
-    int i, j;
-    i = 0;
-    j = mpNext[0] = -1;
-    while(i < (int)m){
-        while(j > -1 && x[i] != x[j])
-            j = mpNext[j];
-        mpNext[++i] = ++j;
-    }
-}
-
-int MP(char *x, int m, char *y, int n){
-    int i, j;
-    i = j = 0;
-    while(j < n){
-        while(i > -1 && x[i] != y[j])
-            i = mpNext[i];
-        i++;
-        j++;
-        if(i >= m){
-            return j-i;
-        }
-    }
-
-    return -1;
-}
-
-int QS(char *x, int m, char *y, int n) {
-    int j = 0;
-    while (j <= n - m) {
-        if(StringEqual(x, y + j, m)){
-            return j;
-        }
-        j++;
-    }
-
-    return -1;
-}
-
-int RQS(char *x, int m, char *y, int n){
-    int j = n - m;
-    while(j >= 0){
-        if(StringEqual(x, y + j, m)){
-            return j;
-        }
-        j--;
-    }
-    return -1;
-}
-
-int ReverseStringSearch(char *s0, char *s1, uint s0len, uint s1len){
-    return RQS(s0, s0len, s1, s1len);
-}
-
-int StringSearch(char *s0, char *s1, uint s0len, uint s1len){
-    return QS(s0, s0len, s1, s1len);
-}
-
-int FastStringSearch(char *s0, char *s1, uint s0len, uint s1len){
-    return MP(s0, s0len, s1, s1len);
-}
-
 int StringIsDigits(char *s0, uint len){
     for(uint i = 0; i < len; i++){
         char v = s0[i] - '0';
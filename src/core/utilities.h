@@ -285,26 +285,6 @@ std::string ExpandFilePath(char *path, uint size, char *folder);
 */
 void GetCurrentWorkingDirectory(char *dir, uint len);
 
-/*
-* Find the first ocurrency of s0 into s1. Returns -1 in case no one is found.
-* (Brute-force)
-*/
-int StringSearch(char *s0, char *s1, uint s0len, uint s1len);
-
-/*
-* Find the last ocurrency of s0 into s1. Returns -1 in case no one is found.
-* (Brute-force)
-*/
-int ReverseStringSearch(char *s0, char *s1, uint s0len, uint s1len);
-
-/*
-* Perform an accelerated string search algorithm looking for string s0 inside s1.
-* Warning: This is currently using a 255 table size, it will not match all UTF-8 chars.
-*/
-//TODO: UTF-8
-void FastStringSearchInit(char *s0, uint s0len);
-int  FastStringSearch(char *s0, char *s1, uint s0len, uint s1len);
-
 /*
 * Gets the name path of the file without the full path.
 */
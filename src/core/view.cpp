@@ -102,8 +102,10 @@ void View_SelectableListFilterBy(View *view, char *key, uint keylen){
     SelectableList_Filter(list, key, keylen);
 }
 
-void View_SelectableListPush(View *view, char *item, uint len){
-    SelectableList_Push(&view->selectableList, item, len);
+void View_SelectableListPush(View *view, char *item, uint len,
+                             SearchPattern *filter)
+{
+    SelectableList_Push(&view->selectableList, item, len, filter);
 }
 
 void View_SelectableListSet(View *view, LineBuffer *sourceBuffer,
@@ -132,9 +132,11 @@ LineBuffer *View_GetBufferViewLineBuffer(View *view);
 
 /*
 * Pushes a new item into a view configured as a SelectableList, this function
-* does not trigger any callback set with 'View_SelectableListSet'.
+* does not trigger any callback set with 'View_SelectableListSet'. In case 'filter'
+* is given the item is only visible if it matches it, see SelectableList_Push.
 */
-void View_SelectableListPush(View *view, char *item, uint len);
+void View_SelectableListPush(View *view, char *item, uint len,
+                             SearchPattern *filter=nullptr);
 
 /*
 * Filters the views selectable list by a key value.
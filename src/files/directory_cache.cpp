@@ -0,0 +1,197 @@
+#include <directory_cache.h>
+#include <file_watcher.h>
+#include <storage.h>
+#include <utilities.h>
+#include <parallel.h>
+#include <lru_cache.h>
+#include <timer.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+struct DirectoryListing{
+    std::string dir;
+    std::vector<FileEntry> entries;
+    double time;
+    bool local;
+    bool watched; // kept until invalidated, otherwise expires
+};
+
+typedef std::shared_ptr<DirectoryListing> DirectoryListingPtr;
+
+struct DirectoryCache{
+    std::mutex mutex;
+    bool initialized;
+    LRUCache<std::string, DirectoryListingPtr> listings;
+    // bumped on every invalidation, a listing taken before one is not stored
+    std::unordered_map<std::string, uint> versions;
+};
+
+static DirectoryCache directoryCache = { .initialized = false };
+
+/*
+* Must be called with the mutex held.
+*/
+static void DirectoryCacheInitialize(){
+    if(directoryCache.initialized) return;
+
+    directoryCache.listings.init(DIRECTORY_CACHE_SIZE, [](DirectoryListingPtr listing){
+        if(listing->watched){
+            FileWatcher_UnwatchDirectory(listing->dir);
+        }
+    });
+    directoryCache.initialized = true;
+}
+
+static std::string DirectoryCacheKey(const char *path){
+    std::string dir(path);
+    while(dir.size() > 1 && (dir.back() == '/' || dir.back() == '\\')){
+        dir.pop_back();
+    }
+
+    return dir;
+}
+
+static std::string DirectoryCacheJoin(const std::string &dir, const char *name){
+    if(dir.back() == '/' || dir.back() == '\\') return dir + name;
+    return dir + SEPARATOR_STRING + name;
+}
+
+static bool DirectoryCacheValid(const DirectoryListingPtr &listing, bool local){
+    if(listing->local != local) return false;
+    if(listing->watched) return true;
+    return GetElapsedTime() - listing->time < DIRECTORY_CACHE_REMOTE_TTL;
+}
+
+static DirectoryListingPtr DirectoryCacheLookup(const std::string &dir, bool local){
+    std::lock_guard<std::mutex> guard(directoryCache.mutex);
+    DirectoryCacheInitialize();
+
+    std::optional<DirectoryListingPtr> listing = directoryCache.listings.get(dir);
+    if(!listing || !DirectoryCacheValid(*listing, local)) return nullptr;
+    return *listing;
+}
+
+/*
+* Lists 'dir' from the storage and stores it. The watch is added before listing so
+* that changes happening while the storage is read invalidate it.
+*/
+static DirectoryListingPtr DirectoryCacheFetch(StorageDevice *device, const std::string &dir){
+    bool local = device->IsLocallyStored();
+    uint version = 0;
+    {
+        std::lock_guard<std::mutex> guard(directoryCache.mutex);
+        DirectoryCacheInitialize();
+        version = directoryCache.versions[dir];
+    }
+
+    DirectoryListingPtr listing = std::make_shared<DirectoryListing>();
+    listing->dir = dir;
+    listing->local = local;
+    listing->watched = local ? FileWatcher_WatchDirectory(dir) : false;
+    listing->time = GetElapsedTime();
+
+    FileEntry *entries = nullptr;
+    uint n = 0, size = 0;
+    std::string path = DirectoryCacheJoin(dir, "");
+    if(device->ListFiles((char *)path.c_str(), &entries, &n, &size) < 0){
+        if(listing->watched){
+            FileWatcher_UnwatchDirectory(dir);
+        }
+        return nullptr;
+    }
+
+    listing->entries.assign(entries, entries + n);
+    AllocatorFree(entries);
+
+    bool stored = false;
+    {
+        std::lock_guard<std::mutex> guard(directoryCache.mutex);
+        if(directoryCache.versions[dir] == version){
+            // listings are never replaced in place as the LRUCache does not
+            // update keys
+            directoryCache.listings.erase(dir);
+            directoryCache.listings.put(dir, listing);
+            stored = true;
+        }
+    }
+
+    if(!stored && listing->watched){
+        FileWatcher_UnwatchDirectory(dir);
+    }
+
+    return listing;
+}
+
+/*
+* Lists ahead the first sub-directories of 'listing' that are not cached yet, in
+* the pool with idle priority. Only one level is prefetched.
+*/
+static void DirectoryCachePrefetch(const DirectoryListingPtr &listing){
+    uint count = 0;
+    for(const FileEntry &entry : listing->entries){
+        if(count >= DIRECTORY_CACHE_PREFETCH) break;
+        if(entry.type != DescriptorDirectory) continue;
+
+        std::string dir = DirectoryCacheJoin(listing->dir, entry.path);
+        if(DirectoryCacheLookup(dir, true)) continue;
+
+        ParallelPool_Submit([dir](){
+            StorageDevice *device = FetchStorageDevice();
+            if(device && device->IsLocallyStored()){
+                DirectoryCacheFetch(device, dir);
+            }
+        }, TASK_PRIORITY_IDLE);
+        count++;
+    }
+}
+
+int DirectoryCache_List(const char *path, FileEntry **entries, uint *n, uint *size){
+    AssertA(n != nullptr && entries != nullptr && path != nullptr,
+            "Invalid query pointers");
+    StorageDevice *device = FetchStorageDevice();
+    bool local = device->IsLocallyStored();
+    std::string dir = DirectoryCacheKey(path);
+
+    DirectoryListingPtr listing = DirectoryCacheLookup(dir, local);
+    if(!listing){
+        listing = DirectoryCacheFetch(device, dir);
+        if(!listing) return -1;
+
+        if(local){
+            DirectoryCachePrefetch(listing);
+        }
+    }
+
+    uint count = listing->entries.size();
+    uint base = 8;
+    FileEntry *lEntries = *entries;
+    uint currSize = *n;
+    if(currSize == 0 || lEntries == nullptr){
+        lEntries = AllocatorGetN(FileEntry, base);
+        currSize = base;
+    }
+
+    if(currSize < count){
+        uint newSize = count < base ? base : count;
+        lEntries = AllocatorExpand(FileEntry, lEntries, newSize, currSize);
+        currSize = newSize;
+    }
+
+    if(count > 0){
+        Memcpy(lEntries, listing->entries.data(), count * sizeof(FileEntry));
+    }
+
+    *entries = lEntries;
+    *n = count;
+    *size = currSize;
+    return 1;
+}
+
+void DirectoryCache_Invalidate(const std::string &dir){
+    std::lock_guard<std::mutex> guard(directoryCache.mutex);
+    DirectoryCacheInitialize();
+    directoryCache.versions[dir] += 1;
+    directoryCache.listings.erase(dir);
+}
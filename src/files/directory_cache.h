@@ -0,0 +1,38 @@
+/* date = October 19th 2026 23:20 */
+#pragma once
+#include <types.h>
+#include <string>
+
+struct FileEntry;
+
+// amount of directory listings kept, the least recently used ones are dropped
+#define DIRECTORY_CACHE_SIZE 128
+// seconds a listing of a remote directory is trusted before it is listed again
+#define DIRECTORY_CACHE_REMOTE_TTL 2.0
+// maximum amount of sub-directories listed ahead after a local directory is listed
+#define DIRECTORY_CACHE_PREFETCH 32
+
+/*
+* Caches the listings of directories so that navigating the file opener does not
+* hit the storage on every keystroke. Local listings are kept until the directory
+* changes, the DirectoryCache asks the FileWatcher to watch every directory it
+* lists and drops the listing once entries are added or removed. Remote storage
+* cannot be watched, its listings and the ones of directories the FileWatcher
+* could not watch are only trusted for DIRECTORY_CACHE_REMOTE_TTL. After a local
+* directory is listed its first sub-directories are listed in the pool with idle
+* priority, so that descending into them is already cached.
+*/
+
+/*
+* Lists the files and directories present in 'path' with the same contract of
+* StorageDevice::ListFiles, i.e.: *entries might be reallocated to fit the
+* listing, the amount of entries is returned in 'n' and the length of the list in
+* 'size'. Returns -1 in case 'path' could not be listed. Can be called from any
+* thread.
+*/
+int DirectoryCache_List(const char *path, FileEntry **entries, uint *n, uint *size);
+
+/*
+* Drops the listing of 'dir', if cached. Can be called from any thread.
+*/
+void DirectoryCache_Invalidate(const std::string &dir);
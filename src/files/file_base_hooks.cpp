@@ -4,6 +4,7 @@
 #include <sstream>
 #include <ctime>
 #include <buffers.h>
+#include <file_watcher.h>
 
 std::string months[] = {
     "January", "February", "March", "April", "May", "June",
@@ -46,6 +47,7 @@ static void CppHeaderCreate(LineBuffer *lineBuffer, Tokenizer *tokenizer){
 }
 
 static void Hook_OnCreate(char *path, uint len, LineBuffer *lineBuffer, Tokenizer *tokenizer){
+    FileWatcher_WatchFile(path, len);
     int p = GetFilePathExtension(path, len);
     if(p > 0){
         char *ext = &path[p];
@@ -59,6 +61,7 @@ static void Hook_OnCreate(char *path, uint len, LineBuffer *lineBuffer, Tokenize
 
 static void Hook_OnOpen(char *path, uint len, LineBuffer *lineBuffer, Tokenizer *tokenizer){
     //printf("[HOOK] Default file open hook: %s\n", path);
+    FileWatcher_WatchFile(path, len);
 }
 
 void FileHooks_RegisterDefault(){
@@ -1,39 +1,46 @@
 #include <file_buffer.h>
 #include <utilities.h>
 #include <types.h>
+#include <algorithm>
 
-static int FileBufferList_FindEntry(FileBufferList *list, FileBuffer **fBuffer,
-                                    char *key, uint keylen, int is_path)
-{
-    int found = 0;
-    FileBuffer *tmp = nullptr;
-    auto locate = [&](FileBuffer *buf) -> int{
-        int rv = 0;
-        if(buf){
-            if(buf->lineBuffer){
-                char *ptr = buf->lineBuffer->filePath;
-                uint len = buf->lineBuffer->filePathSize;
-                if(is_path == 0){
-                    uint k = GetSimplifiedPathName(ptr, len);
-                    len = len - k;
-                    ptr = &buf->lineBuffer->filePath[k];
-                }
-
-                if(len == keylen){
-                    rv = StringEqual(ptr, key, len);
-                }
+static std::string FileBufferList_NameOf(LineBuffer *lineBuffer){
+    char *ptr = lineBuffer->filePath;
+    uint len = lineBuffer->filePathSize;
+    uint k = GetSimplifiedPathName(ptr, len);
+    return std::string(&ptr[k], len - k);
+}
+
+/*
+* Drops 'lineBuffer' from the indexes, it must be in the list.
+*/
+static void FileBufferList_Unindex(FileBufferList *list, LineBuffer *lineBuffer){
+    std::string path(lineBuffer->filePath, lineBuffer->filePathSize);
+    auto it = list->paths.find(path);
+    if(it != list->paths.end() && it->second == lineBuffer){
+        list->paths.erase(it);
+    }
+
+    auto nit = list->names.find(FileBufferList_NameOf(lineBuffer));
+    if(nit != list->names.end()){
+        std::vector<LineBuffer *> &entries = nit->second;
+        entries.erase(std::remove(entries.begin(), entries.end(), lineBuffer),
+                      entries.end());
+
+        // in case the path was opened twice the other entry takes its place
+        for(LineBuffer *other : entries){
+            if(list->paths.find(path) != list->paths.end()) break;
+            if(path == std::string(other->filePath, other->filePathSize)){
+                list->paths[path] = other;
             }
         }
 
-        return rv;
-    };
-
-    tmp = List_Find<FileBuffer>(list->fList, locate);
-    if(tmp){
-        *fBuffer = tmp;
-        found = 1;
+        if(entries.size() == 0){
+            list->names.erase(nit);
+        }
     }
-    return found;
+
+    std::vector<LineBuffer *> &recent = list->recent;
+    recent.erase(std::remove(recent.begin(), recent.end(), lineBuffer), recent.end());
 }
 
 void FileBufferList_Init(FileBufferList *list){
@@ -48,6 +55,14 @@ void FileBufferList_Insert(FileBufferList *list, LineBuffer *lBuffer){
     };
 
     List_Push<FileBuffer>(list->fList, &fBuffer);
+
+    std::string path(lBuffer->filePath, lBuffer->filePathSize);
+    if(list->paths.find(path) == list->paths.end()){
+        list->paths[path] = lBuffer;
+    }
+
+    list->names[FileBufferList_NameOf(lBuffer)].push_back(lBuffer);
+    list->recent.push_back(lBuffer);
 }
 
 void FileBufferList_Remove(FileBufferList *list, LineBuffer *lineBuffer){
@@ -60,26 +75,18 @@ void FileBufferList_Remove(FileBufferList *list, LineBuffer *lineBuffer){
         return rv;
     };
 
+    auto it = std::find(list->recent.begin(), list->recent.end(), lineBuffer);
+    if(it == list->recent.end()) return;
+
+    FileBufferList_Unindex(list, lineBuffer);
     List_Erase<FileBuffer>(list->fList, finder);
 }
 
 void FileBufferList_Remove(FileBufferList *list, char *name, uint nameLen){
-    auto finder = [&](FileBuffer *buf) -> int{
-        int rv = 0;
-        if(buf){
-            if(buf->lineBuffer){
-                char *ptr = buf->lineBuffer->filePath;
-                uint len = buf->lineBuffer->filePathSize;
-                if(len == nameLen){
-                    rv = StringEqual(ptr, name, nameLen);
-                }
-            }
-        }
-
-        return rv;
-    };
-
-    List_Erase<FileBuffer>(list->fList, finder);
+    auto it = list->paths.find(std::string(name, nameLen));
+    if(it != list->paths.end()){
+        FileBufferList_Remove(list, it->second);
+    }
 }
 
 //TODO: This might need some work to detect duplicated files names
@@ -87,28 +94,32 @@ int FileBufferList_FindByName(FileBufferList *list, LineBuffer **lineBuffer,
                               char *name, uint nameLen)
 {
     AssertA(list != nullptr, "Invalid file buffers pointer");
-    FileBuffer *fBuffer = nullptr;
-    int found = 0;
-    if(FileBufferList_FindEntry(list, &fBuffer, name, nameLen, 0)){
-        AssertA(fBuffer != nullptr, "Invalid result on get entry");
-        if(lineBuffer) *lineBuffer = fBuffer->lineBuffer;
-        found = 1;
-    }
+    auto it = list->names.find(std::string(name, nameLen));
+    if(it == list->names.end()) return 0;
 
-    return found;
+    if(lineBuffer) *lineBuffer = it->second.front();
+    return 1;
 }
 
 int FileBufferList_FindByPath(FileBufferList *list, LineBuffer **lineBuffer,
                               char *path, uint pathLen)
 {
     AssertA(list != nullptr, "Invalid file buffers pointer");
-    FileBuffer *fBuffer = nullptr;
-    int found = 0;
-    if(FileBufferList_FindEntry(list, &fBuffer, path, pathLen, 1)){
-        AssertA(fBuffer != nullptr, "Invalid result on get entry");
-        if(lineBuffer) *lineBuffer = fBuffer->lineBuffer;
-        found = 1;
+    auto it = list->paths.find(std::string(path, pathLen));
+    if(it == list->paths.end()) return 0;
+
+    if(lineBuffer) *lineBuffer = it->second;
+    return 1;
+}
+
+void FileBufferList_Touch(FileBufferList *list, LineBuffer *lineBuffer){
+    std::vector<LineBuffer *> &recent = list->recent;
+    auto it = std::find(recent.begin(), recent.end(), lineBuffer);
+    if(it != recent.end()){
+        std::rotate(recent.begin(), it, it + 1);
     }
+}
 
-    return found;
+const std::vector<LineBuffer *> &FileBufferList_GetRecent(FileBufferList *list){
+    return list->recent;
 }
@@ -4,11 +4,16 @@
 #define FILE_BUFFER_H
 #include <buffers.h>
 #include <utilities.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
 
 /*
 * FileBuffers are storage reserved to maintain LineBuffers opened but
 * not necessarily in use. Helper structure for the App handling of things.
-* Basic a list.
+* Basic a list, with a hash index by full path and by file name so lookups do not
+* walk it and the order in which buffers were last used for the buffer switcher.
+* Paths of LineBuffers in the list must not change.
 */
 typedef struct file_buffer_t{
     LineBuffer *lineBuffer;
@@ -16,6 +21,10 @@ typedef struct file_buffer_t{
 
 typedef struct{
     List<FileBuffer> *fList;
+    std::unordered_map<std::string, LineBuffer *> paths;
+    // file names can repeat, entries are kept in insertion order
+    std::unordered_map<std::string, std::vector<LineBuffer *>> names;
+    std::vector<LineBuffer *> recent; // most recently used first
 }FileBufferList;
 
 /*
@@ -50,6 +59,18 @@ void FileBufferList_Remove(FileBufferList *list, char *name, uint nameLen);
 */
 void FileBufferList_Remove(FileBufferList *list, LineBuffer *lineBuffer);
 
+/*
+* Marks the LineBuffer as the most recently used, LineBuffers not in the list
+* are ignored.
+*/
+void FileBufferList_Touch(FileBufferList *list, LineBuffer *lineBuffer);
+
+/*
+* Gets the LineBuffers of the list from the most to the least recently used.
+* Newly inserted ones are the least recently used until touched.
+*/
+const std::vector<LineBuffer *> &FileBufferList_GetRecent(FileBufferList *list);
+
 /* Debug stuff */
 void FileBufferList_DebugList(FileBufferList *list);
 
@@ -10,7 +10,14 @@
 #include <cryptoutil.h>
 #include <aes.h>
 #include <audio.h>
+#include <file_watcher.h>
+#include <parallel.h>
+#include <scheduler.h>
+#include <display.h>
 #include <filesystem>
+#include <deque>
+#include <map>
+#include <memory>
 
 namespace fs = std::filesystem;
 
@@ -138,6 +145,39 @@ static void InitTokenizers(){
                        {&texReservedPreprocessor, &texReservedTable}, &texSupport);
 }
 
+/*
+* Builds a tokenizer for files of 'type', see FileProvider_GetLineBufferTokenizer,
+* used by loads that tokenize at the same time as others.
+*/
+static void FileProviderBuildTokenizer(Tokenizer *tokenizer, SymbolTable *symTable,
+                                       uint type)
+{
+    *tokenizer = TOKENIZER_INITIALIZER;
+    switch(type){
+        case 0: Lex_BuildTokenizer(tokenizer, symTable,
+                                   {&cppReservedPreprocessor, &cppReservedTable},
+                                   &cppSupport); break;
+        case 1: Lex_BuildTokenizer(tokenizer, symTable,
+                                   {&glslReservedPreprocessor, &glslReservedTable},
+                                   &glslSupport); break;
+        case 3: Lex_BuildTokenizer(tokenizer, symTable,
+                                   {&litReservedPreprocessor, &litReservedTable},
+                                   &litSupport); break;
+        case 4: Lex_BuildTokenizer(tokenizer, symTable,
+                                   {&cmakeReservedPreprocessor, &cmakeReservedTable},
+                                   &cmakeSupport); break;
+        case 5: Lex_BuildTokenizer(tokenizer, symTable,
+                                   {&pyReservedPreprocessor, &pyReservedTable},
+                                   &pythonSupport); break;
+        case 6: Lex_BuildTokenizer(tokenizer, symTable,
+                                   {&texReservedPreprocessor, &texReservedTable},
+                                   &texSupport); break;
+        default: Lex_BuildTokenizer(tokenizer, symTable,
+                                    {&noneReservedPreprocessor, &noneReservedTable},
+                                    &noneSupport); break;
+    }
+}
+
 void FileProvider_Initialize(){
     FileBufferList_Init(&fProvider.fileBuffer);
     SymbolTable_Initialize(&fProvider.symbolTable, true);
@@ -179,10 +219,20 @@ FileBufferList *FileProvider_GetBufferList(){
 }
 
 void FileProvider_Remove(LineBuffer *lineBuffer){
+    if(FileBufferList_FindByPath(&fProvider.fileBuffer, nullptr, lineBuffer->filePath,
+                                 lineBuffer->filePathSize))
+    {
+        FileWatcher_UnwatchFile(lineBuffer->filePath, lineBuffer->filePathSize);
+    }
+
     FileBufferList_Remove(&fProvider.fileBuffer, lineBuffer);
 }
 
 void FileProvider_Remove(char *ptr, uint pSize){
+    if(FileBufferList_FindByPath(&fProvider.fileBuffer, nullptr, ptr, pSize)){
+        FileWatcher_UnwatchFile(ptr, pSize);
+    }
+
     FileBufferList_Remove(&fProvider.fileBuffer, ptr, pSize);
 }
 
@@ -402,7 +452,6 @@ int FileProvider_LoadTemporary(char *pwd, uint pwdlen, int &fileType,
     *lBuffer = LINE_BUFFER_INITIALIZER;
 
     tokenizer = FileProvider_GuessTokenizer(targetPath, len, &props, 1);
-    Lex_TokenizerContextReset(tokenizer);
 
     LineBuffer_SetStoragePath(lBuffer, targetPath, len);
 
@@ -491,6 +540,10 @@ fs::path FileProvider_MakeTempFile(){
 #endif
 }
 
+std::string FileProvider_MakeTemporaryFile(){
+    return FileProvider_MakeTempFile().string();
+}
+
 int FileProvider_Load(char *targetPath, uint len, int &fileType,
                       LineBuffer **lineBuffer, bool mustFinish)
 {
@@ -560,7 +613,6 @@ int FileProvider_Load(char *targetPath, uint len, int &fileType,
     *lBuffer = LINE_BUFFER_INITIALIZER;
 
     tokenizer = FileProvider_GuessTokenizer(targetPath, len, &props, 1);
-    Lex_TokenizerContextReset(tokenizer);
 
     LineBuffer_SetStoragePath(lBuffer, targetPath, len);
 
@@ -601,6 +653,306 @@ int FileProvider_Load(char *targetPath, uint len, int &fileType,
     return FILE_LOAD_SUCCESS;
 }
 
+/*
+* A file going through FileProvider_LoadMany. The read stage fills the contents,
+* the tokenize stage the LineBuffer and the main thread hands it over.
+*/
+struct FileLoad{
+    uint64_t seq; // order in which files are tokenized
+    std::string path;
+    FileLoadCallback onLoad;
+    int status;
+    Tokenizer *tokenizer;
+    LineBufferProps props;
+    char *content;
+    uint size;
+    LineBuffer *lineBuffer;
+    bool opened; // the file was already opened, 'lineBuffer' is the opened one
+    bool handed; // the LineBuffer was published to the main thread
+};
+
+typedef std::shared_ptr<FileLoad> FileLoadPtr;
+
+struct FileLoadPipeline{
+    std::mutex mutex;
+    std::map<uint64_t, FileLoadPtr> reads;
+    std::map<uint64_t, FileLoadPtr> tokenizes;
+    std::deque<FileLoadPtr> published;
+    uint running; // read and tokenize tasks submitted
+    uint reading; // read tasks submitted
+    uint64_t seq;
+    // main thread only
+    uint outstanding; // files not handed over yet
+    uint job;
+};
+
+static FileLoadPipeline loadPipeline = { .running = 0, .reading = 0, .seq = 0,
+                                         .outstanding = 0, .job = 0 };
+
+// size of the tables holding the symbols of a file until its load finishes
+#define FILE_LOAD_SYMBOL_TABLE_SIZE 1024
+
+static void FileLoadPublish(FileLoadPtr load){
+    {
+        std::lock_guard<std::mutex> guard(loadPipeline.mutex);
+        loadPipeline.published.push_back(load);
+    }
+
+    PostEmptyEvent();
+}
+
+static void FileLoadSchedule();
+
+/*
+* Marks a read or tokenize task as done and starts the next ones.
+*/
+static void FileLoadTaskDone(bool read){
+    {
+        std::lock_guard<std::mutex> guard(loadPipeline.mutex);
+        loadPipeline.running--;
+        if(read) loadPipeline.reading--;
+    }
+
+    FileLoadSchedule();
+}
+
+/*
+* Tokenizes the file with its own tokenizer so that files are tokenized in
+* parallel. Symbols are kept aside and moved into the shared table at once when
+* it finishes, it runs in the task group of the LineBuffer so killing it waits
+* for that.
+*/
+static void FileLoadTokenize(FileLoadPtr load){
+    Tokenizer tokenizer;
+    SymbolTable symbols;
+    LineBuffer *lBuffer = load->lineBuffer;
+    TaskGroup *group = LineBuffer_GetTaskGroup(lBuffer);
+    SymbolTable_Initialize(&symbols, true, FILE_LOAD_SYMBOL_TABLE_SIZE);
+    FileProviderBuildTokenizer(&tokenizer, &symbols, load->props.type);
+
+    LineBuffer_InitTokenized(lBuffer, &tokenizer, load->content, load->size, group,
+                             [&](int lineno) -> void{
+        if(lineno > FILE_LOAD_FIRST_SCREEN_LINES && !load->handed){
+            load->handed = true;
+            FileLoadPublish(load);
+        }
+    });
+
+    SymbolTable_Merge(&fProvider.symbolTable, &symbols);
+    SymbolTable_Release(&symbols);
+    Lex_ReleaseTokenizer(&tokenizer);
+
+    AllocatorFree(load->content);
+    load->content = nullptr;
+    if(!load->handed){
+        load->handed = true;
+        FileLoadPublish(load);
+    }
+
+    FileLoadTaskDone(false);
+}
+
+/*
+* Creates the LineBuffer of a file that was read and starts tokenizing it.
+*/
+static void FileLoadStartTokenize(FileLoadPtr load){
+    LineBuffer *lBuffer = AllocatorGetN(LineBuffer, 1);
+    *lBuffer = LINE_BUFFER_INITIALIZER;
+    LineBuffer_SetStoragePath(lBuffer, (char *)load->path.c_str(), load->path.size());
+    LineBuffer_SetType(lBuffer, load->props.type);
+    LineBuffer_SetExtension(lBuffer, load->props.ext);
+    LineBuffer_SetWrittable(lBuffer, true);
+    lBuffer->props.isEncrypted = false;
+    load->lineBuffer = lBuffer;
+
+    if(load->size == 0 || load->content == nullptr){
+        AllocatorFree(load->content);
+        load->content = nullptr;
+        LineBuffer_InitEmpty(lBuffer);
+        load->handed = true;
+        FileLoadPublish(load);
+        FileLoadTaskDone(false);
+        return;
+    }
+
+    TaskGroup *group = LineBuffer_GetTaskGroup(lBuffer);
+    ParallelPool_Submit([load](){
+        FileLoadTokenize(load);
+    }, TASK_PRIORITY_NORMAL, group);
+}
+
+/*
+* Reads the file and decides if it can be opened as text, files that cannot are
+* reported right away.
+*/
+static void FileLoadRead(FileLoadPtr load, StorageDevice *device){
+    uint8_t *ptr = nullptr;
+    load->content = device->GetContentsOf((char *)load->path.c_str(), &load->size);
+    ptr = (uint8_t *)load->content;
+    if(ptr != nullptr){
+        if(FileProvider_VerifyEncryptedFile(ptr, (uint32_t)load->size)){
+            load->status = FILE_LOAD_REQUIRES_DECRYPT;
+        }else if(FileProvider_IsMp3File(ptr, (uint32_t)load->size)){
+            load->status = FILE_LOAD_FAILED;
+        }
+    }
+
+    if(load->status != FILE_LOAD_SUCCESS){
+        AllocatorFree(load->content);
+        load->content = nullptr;
+        FileLoadPublish(load);
+    }else{
+        std::lock_guard<std::mutex> guard(loadPipeline.mutex);
+        loadPipeline.tokenizes[load->seq] = load;
+    }
+
+    FileLoadTaskDone(true);
+}
+
+/*
+* Starts read and tokenize tasks for the queued files. Loads never take more than
+* the workers of the pool minus one, the main thread may be waiting on a Task_Run
+* and that must not queue behind them. Files that were read are tokenized before
+* more are read so that their contents are released early, remote devices are
+* read by a single task as they go through a single connection.
+*/
+static void FileLoadSchedule(){
+    StorageDevice *device = fProvider.storageDevice;
+    uint concurrency = (uint)GetConcurrency();
+    uint maxTasks = concurrency > 3 ? concurrency - 2 : 1;
+    uint maxReads = device->IsLocallyStored() ? maxTasks : 1;
+    std::vector<FileLoadPtr> reads, tokenizes;
+    {
+        std::lock_guard<std::mutex> guard(loadPipeline.mutex);
+        while(loadPipeline.running < maxTasks){
+            if(loadPipeline.tokenizes.size() > 0){
+                tokenizes.push_back(loadPipeline.tokenizes.begin()->second);
+                loadPipeline.tokenizes.erase(loadPipeline.tokenizes.begin());
+            }else if(loadPipeline.reads.size() > 0 && loadPipeline.reading < maxReads){
+                reads.push_back(loadPipeline.reads.begin()->second);
+                loadPipeline.reads.erase(loadPipeline.reads.begin());
+                loadPipeline.reading++;
+            }else{
+                break;
+            }
+
+            loadPipeline.running++;
+        }
+    }
+
+    for(FileLoadPtr &load : tokenizes){
+        FileLoadStartTokenize(load);
+    }
+
+    for(FileLoadPtr &load : reads){
+        ParallelPool_Submit([load, device](){
+            FileLoadRead(load, device);
+        }, TASK_PRIORITY_NORMAL);
+    }
+}
+
+/*
+* Hands a file over on the main thread, in case it was opened while it loaded the
+* copy is dropped.
+*/
+static void FileLoadHandOver(FileLoadPtr load){
+    LineBuffer *lBuffer = load->lineBuffer;
+    LineBuffer *opened = nullptr;
+    char *path = (char *)load->path.c_str();
+    uint len = load->path.size();
+    if(load->status != FILE_LOAD_SUCCESS){
+        load->onLoad(load->path, load->status, nullptr);
+        return;
+    }
+
+    if(load->opened || !FileProvider_FindByPath(&opened, path, len, nullptr)){
+        if(!load->opened){
+            FileBufferList_Insert(&fProvider.fileBuffer, lBuffer);
+            for(uint i = 0; i < fProvider.openHooksCount; i++){
+                if(fProvider.openHooks[i]){
+                    fProvider.openHooks[i](path, len, lBuffer, load->tokenizer);
+                }
+            }
+        }
+
+        load->onLoad(load->path, FILE_LOAD_SUCCESS, lBuffer);
+        return;
+    }
+
+    // the tokenization might still be running, free it once it returns
+    SymbolTable *symTable = load->tokenizer->symbolTable;
+    TaskGroup *tasks = LineBuffer_GetTaskGroup(lBuffer);
+    lBuffer->tasks = nullptr;
+    TaskGroup_Release(tasks, [lBuffer, symTable](){
+        for(uint i = 0; i < lBuffer->lineCount; i++){
+            Buffer *buffer = LineBuffer_GetBufferAt(lBuffer, i);
+            Buffer_EraseSymbols(buffer, symTable);
+        }
+
+        LineBuffer_Free(lBuffer);
+        AllocatorFree(lBuffer);
+    });
+
+    load->onLoad(load->path, FILE_LOAD_SUCCESS, opened);
+}
+
+static FrameJobState FileLoadJob(double deadline){
+    do{
+        FileLoadPtr load;
+        {
+            std::lock_guard<std::mutex> guard(loadPipeline.mutex);
+            if(loadPipeline.published.size() == 0) break;
+            load = loadPipeline.published.front();
+            loadPipeline.published.pop_front();
+        }
+
+        loadPipeline.outstanding--;
+        FileLoadHandOver(load);
+    }while(GetElapsedTime() < deadline);
+
+    std::lock_guard<std::mutex> guard(loadPipeline.mutex);
+    if(loadPipeline.published.size() > 0) return FRAME_JOB_CONTINUE;
+    if(loadPipeline.outstanding > 0) return FRAME_JOB_WAIT;
+
+    loadPipeline.job = 0;
+    return FRAME_JOB_DONE;
+}
+
+void FileProvider_LoadMany(const std::vector<std::string> &paths, FileLoadCallback onLoad){
+    for(const std::string &p : paths){
+        FileLoadPtr load = std::make_shared<FileLoad>();
+        char *path = (char *)p.c_str();
+        uint len = p.size();
+        load->path = p;
+        load->onLoad = onLoad;
+        load->status = FILE_LOAD_SUCCESS;
+        load->content = nullptr;
+        load->size = 0;
+        load->lineBuffer = nullptr;
+        load->handed = false;
+        load->opened = false;
+        load->tokenizer = FileProvider_GuessTokenizer(path, len, &load->props, 1);
+        load->seq = loadPipeline.seq++;
+        loadPipeline.outstanding++;
+
+        if(FileProvider_FindByPath(&load->lineBuffer, path, len, nullptr)){
+            load->opened = true;
+            FileLoadPublish(load);
+        }else if(FileProvider_GuessEntry(path, len) != FILE_TYPE_ON_LOAD_TEXT){
+            load->status = FILE_LOAD_REQUIRES_VIEWER;
+            FileLoadPublish(load);
+        }else{
+            std::lock_guard<std::mutex> guard(loadPipeline.mutex);
+            loadPipeline.reads[load->seq] = load;
+        }
+    }
+
+    FileLoadSchedule();
+    if(loadPipeline.job == 0 && loadPipeline.outstanding > 0){
+        loadPipeline.job = FrameScheduler_Add(FileLoadJob);
+    }
+}
+
 int FileProvider_IsLineBufferDirty(char *hint_name, uint len){
     LineBuffer *lineBuffer = nullptr;
     int r = FileBufferList_FindByName(&fProvider.fileBuffer, &lineBuffer,
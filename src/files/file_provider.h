@@ -2,6 +2,9 @@
 #include <types.h>
 #include <lex.h>
 #include <file_buffer.h>
+#include <functional>
+#include <string>
+#include <vector>
 
 /*
 * File provider controls how files are provided to the editor
@@ -16,6 +19,10 @@
 #define FILE_TYPE_ON_LOAD_TEXT  0
 #define FILE_TYPE_ON_LOAD_IMAGE 1
 
+// lines of a file opened by FileProvider_LoadMany that are tokenized before it is
+// handed over, enough to fill the screen
+#define FILE_LOAD_FIRST_SCREEN_LINES 256
+
 // Function pointer for file hooks
 typedef void(*file_hook)(char *filepath, uint len, LineBuffer *lineBuffer, Tokenizer *tokenizer);
 
@@ -105,6 +112,25 @@ int FileProvider_IsFileOpened(char *path, uint len);
 int FileProvider_Load(char *targetPath, uint len, int &type,
                       LineBuffer **lineBuffer=nullptr, bool mustFinish=true);
 
+/*
+* Called on the main thread for each file given to FileProvider_LoadMany with one of
+* the FILE_LOAD_* status and, on success, the LineBuffer holding the file.
+*/
+typedef std::function<void(const std::string &path, int status,
+                           LineBuffer *lineBuffer)> FileLoadCallback;
+
+/*
+* Opens the files in 'paths' without blocking the caller. Files are read and
+* tokenized in parallel in the pool, each with its own tokenizer, and each
+* LineBuffer is handed over, registered and with the open hooks executed, as soon
+* as its first FILE_LOAD_FIRST_SCREEN_LINES lines are ready, the rest of the file
+* is tokenized in the background. Files start tokenizing in the order given
+* whenever more than one was read. Encrypted files and files that require a viewer
+* are not opened, only reported, open them with FileProvider_Load. Files that are
+* already opened report their LineBuffer. Must be called from the main thread.
+*/
+void FileProvider_LoadMany(const std::vector<std::string> &paths, FileLoadCallback onLoad);
+
 /*
 * Loads an encrypted file that was stored as temporary during the file open operation.
 */
@@ -117,6 +143,11 @@ int FileProvider_LoadTemporary(char *pwd, uint pwdlen, int &type, LineBuffer **l
 */
 char *FileProvider_GetTemporary(uint *len);
 
+/*
+* Creates an empty file in the temporary directory and returns its path.
+*/
+std::string FileProvider_MakeTemporaryFile();
+
 /*
 * Erase the temporary data.
 */
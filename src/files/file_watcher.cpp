@@ -0,0 +1,358 @@
+#include <file_watcher.h>
+
+#if !defined(_WIN32)
+#include <file_provider.h>
+#include <storage.h>
+#include <buffers.h>
+#include <line_diff.h>
+#include <parallel.h>
+#include <display.h>
+#include <trigram_index.h>
+#include <directory_cache.h>
+#include <file_index.h>
+#include <utilities.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#define FILE_WATCHER_READ_SIZE 65536
+#define FILE_WATCHER_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM |\
+                           IN_CREATE)
+// events that change the contents of a file or the entries of a directory
+#define FILE_WATCHER_WRITE (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define FILE_WATCHER_ENTRY (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/*
+* Contents of a changed file read in the pool, waiting to be applied.
+*/
+struct FileWatcherRead{
+    std::string path;
+    char *content;
+    uint size;
+    uint64_t seq;
+    struct stat st; // taken before reading
+};
+
+struct FileWatcher{
+    std::mutex mutex;
+    int fd;
+    std::unordered_map<int, std::string> dirs; // watch -> directory
+    std::unordered_map<std::string, int> watches; // directory -> watch
+    std::unordered_map<std::string, uint> files; // opened files
+    std::unordered_map<std::string, uint> fileDirs; // directories of opened files
+    std::unordered_set<std::string> projectDirs;
+    std::unordered_map<std::string, uint> listedDirs; // listed by the DirectoryCache
+    std::unordered_set<std::string> changed;
+    std::vector<FileWatcherRead> reads;
+    // main thread only, the last read requested for each file, older ones that
+    // finish later are dropped
+    uint64_t readSeq;
+    std::unordered_map<std::string, uint64_t> latest;
+};
+
+static FileWatcher fileWatcher = { .fd = -1, .readSeq = 0 };
+
+static std::string FileWatcherDirectoryOf(const std::string &path){
+    size_t at = path.find_last_of('/');
+    if(at == std::string::npos) return std::string(".");
+    if(at == 0) return std::string("/");
+    return path.substr(0, at);
+}
+
+static void FileWatcherMainLoop(int fd){
+    alignas(struct inotify_event) char buffer[FILE_WATCHER_READ_SIZE];
+    while(1){
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return;
+        }
+
+        bool wake = false;
+        bool stale = false;
+        std::vector<std::string> dirty;
+        std::vector<std::string> invalid;
+        {
+            std::lock_guard<std::mutex> guard(fileWatcher.mutex);
+            for(char *p = buffer; p < buffer + n;){
+                struct inotify_event *event = (struct inotify_event *)p;
+                p += sizeof(struct inotify_event) + event->len;
+
+                // events were dropped, anything opened might have changed
+                if(event->mask & IN_Q_OVERFLOW){
+                    for(auto &it : fileWatcher.files){
+                        fileWatcher.changed.insert(it.first);
+                    }
+                    for(auto &it : fileWatcher.listedDirs){
+                        invalid.push_back(it.first);
+                    }
+                    stale = true;
+                    wake = true;
+                    continue;
+                }
+
+                auto it = fileWatcher.dirs.find(event->wd);
+                if(it == fileWatcher.dirs.end()) continue;
+
+                // the directory was removed
+                if(event->mask & IN_IGNORED){
+                    invalid.push_back(it->second);
+                    fileWatcher.watches.erase(it->second);
+                    fileWatcher.dirs.erase(it);
+                    continue;
+                }
+
+                if(event->len == 0) continue;
+
+                std::string dir = it->second;
+                std::string path = dir + "/" + std::string(event->name);
+                if((event->mask & FILE_WATCHER_WRITE) &&
+                   fileWatcher.files.find(path) != fileWatcher.files.end())
+                {
+                    fileWatcher.changed.insert(path);
+                    wake = true;
+                }
+
+                if((event->mask & FILE_WATCHER_ENTRY) &&
+                   fileWatcher.listedDirs.find(dir) != fileWatcher.listedDirs.end())
+                {
+                    invalid.push_back(dir);
+                }
+
+                if(fileWatcher.projectDirs.find(dir) != fileWatcher.projectDirs.end()){
+                    dirty.push_back(path);
+                    stale |= (event->mask & FILE_WATCHER_ENTRY) != 0;
+                }
+            }
+        }
+
+        for(std::string &path : dirty){
+            ProjectIndex_MarkDirty(path.c_str(), path.size());
+        }
+
+        for(std::string &dir : invalid){
+            DirectoryCache_Invalidate(dir);
+        }
+
+        if(stale){
+            FileIndex_MarkStale();
+        }
+
+        if(wake){
+            PostEmptyEvent();
+        }
+    }
+}
+
+/*
+* Adds a watch for 'dir', must be called with the mutex held. The first call also
+* creates the inotify instance and its thread.
+*/
+static void FileWatcherAddDirectory(const std::string &dir){
+    if(fileWatcher.watches.find(dir) != fileWatcher.watches.end()) return;
+
+    if(fileWatcher.fd < 0){
+        fileWatcher.fd = inotify_init1(IN_CLOEXEC);
+        if(fileWatcher.fd < 0) return;
+
+        std::thread(FileWatcherMainLoop, fileWatcher.fd).detach();
+    }
+
+    // fails if the limit of watches is reached, changes are then simply missed
+    int wd = inotify_add_watch(fileWatcher.fd, dir.c_str(), FILE_WATCHER_MASK);
+    if(wd < 0) return;
+
+    fileWatcher.watches[dir] = wd;
+    fileWatcher.dirs[wd] = dir;
+}
+
+/*
+* Drops the watch of 'dir' in case nothing needs it, must be called with the
+* mutex held.
+*/
+static void FileWatcherReleaseDirectory(const std::string &dir){
+    if(fileWatcher.fileDirs.find(dir) != fileWatcher.fileDirs.end()) return;
+    if(fileWatcher.projectDirs.find(dir) != fileWatcher.projectDirs.end()) return;
+    if(fileWatcher.listedDirs.find(dir) != fileWatcher.listedDirs.end()) return;
+
+    auto it = fileWatcher.watches.find(dir);
+    if(it == fileWatcher.watches.end()) return;
+
+    inotify_rm_watch(fileWatcher.fd, it->second);
+    fileWatcher.dirs.erase(it->second);
+    fileWatcher.watches.erase(it);
+}
+
+void FileWatcher_WatchFile(const char *path, uint len){
+    StorageDevice *device = FetchStorageDevice();
+    if(len == 0 || !device || !device->IsLocallyStored()) return;
+
+    std::string file(path, len);
+    std::string dir = FileWatcherDirectoryOf(file);
+    std::lock_guard<std::mutex> guard(fileWatcher.mutex);
+    fileWatcher.files[file] += 1;
+    fileWatcher.fileDirs[dir] += 1;
+    FileWatcherAddDirectory(dir);
+}
+
+void FileWatcher_UnwatchFile(const char *path, uint len){
+    std::string file(path, len);
+    std::string dir = FileWatcherDirectoryOf(file);
+    std::lock_guard<std::mutex> guard(fileWatcher.mutex);
+    auto it = fileWatcher.files.find(file);
+    if(it == fileWatcher.files.end()) return;
+
+    if(--it->second == 0){
+        fileWatcher.files.erase(it);
+    }
+
+    auto dit = fileWatcher.fileDirs.find(dir);
+    if(dit != fileWatcher.fileDirs.end() && --dit->second == 0){
+        fileWatcher.fileDirs.erase(dit);
+        FileWatcherReleaseDirectory(dir);
+    }
+}
+
+void FileWatcher_WatchProject(const std::string &root, const std::vector<std::string> &files){
+    StorageDevice *device = FetchStorageDevice();
+    if(!device || !device->IsLocallyStored()) return;
+
+    std::unordered_set<std::string> dirs;
+    dirs.insert(root);
+    for(const std::string &file : files){
+        dirs.insert(FileWatcherDirectoryOf(file));
+    }
+
+    std::lock_guard<std::mutex> guard(fileWatcher.mutex);
+    std::vector<std::string> previous(fileWatcher.projectDirs.begin(),
+                                      fileWatcher.projectDirs.end());
+    fileWatcher.projectDirs = dirs;
+    for(std::string &dir : previous){
+        FileWatcherReleaseDirectory(dir);
+    }
+
+    for(const std::string &dir : dirs){
+        FileWatcherAddDirectory(dir);
+    }
+}
+
+bool FileWatcher_WatchDirectory(const std::string &dir){
+    std::lock_guard<std::mutex> guard(fileWatcher.mutex);
+    FileWatcherAddDirectory(dir);
+    if(fileWatcher.watches.find(dir) == fileWatcher.watches.end()) return false;
+
+    fileWatcher.listedDirs[dir] += 1;
+    return true;
+}
+
+void FileWatcher_UnwatchDirectory(const std::string &dir){
+    std::lock_guard<std::mutex> guard(fileWatcher.mutex);
+    auto it = fileWatcher.listedDirs.find(dir);
+    if(it != fileWatcher.listedDirs.end() && --it->second == 0){
+        fileWatcher.listedDirs.erase(it);
+        FileWatcherReleaseDirectory(dir);
+    }
+}
+
+/*
+* Only files that the user did not touch are updated, the ones still loading,
+* encrypted or with pending edits are left alone.
+*/
+static LineBuffer *FileWatcherReloadable(const std::string &path){
+    LineBuffer *lineBuffer = nullptr;
+    if(!FileProvider_FindByPath(&lineBuffer, (char *)path.c_str(), path.size(), nullptr)){
+        return nullptr;
+    }
+
+    if(lineBuffer->is_dirty || !LineBuffer_IsWrittable(lineBuffer) ||
+       LineBuffer_IsEncrypted(lineBuffer))
+    {
+        return nullptr;
+    }
+
+    return lineBuffer;
+}
+
+static bool FileWatcherSameFile(const struct stat &a, const struct stat &b){
+    return a.st_size == b.st_size && a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+           a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+void FileWatcher_FileSaved(const char *path, uint len){
+    fileWatcher.latest.erase(std::string(path, len));
+}
+
+int FileWatcher_Flush(){
+    std::unordered_set<std::string> changed;
+    std::vector<FileWatcherRead> reads;
+    int updated = 0;
+    {
+        std::lock_guard<std::mutex> guard(fileWatcher.mutex);
+        if(fileWatcher.changed.size() == 0 && fileWatcher.reads.size() == 0) return 0;
+
+        changed.swap(fileWatcher.changed);
+        reads.swap(fileWatcher.reads);
+    }
+
+    for(const std::string &path : changed){
+        if(!FileWatcherReloadable(path)) continue;
+
+        uint64_t seq = ++fileWatcher.readSeq;
+        fileWatcher.latest[path] = seq;
+        ParallelPool_Submit([path, seq](){
+            struct stat st;
+            uint size = 0;
+            // removed or renamed away, keep what is opened
+            if(stat(path.c_str(), &st) != 0) return;
+            char *content = GetFileContents(path.c_str(), &size);
+            if(!content) return;
+            {
+                std::lock_guard<std::mutex> guard(fileWatcher.mutex);
+                fileWatcher.reads.push_back({ .path = path, .content = content,
+                                              .size = size, .seq = seq, .st = st });
+            }
+
+            PostEmptyEvent();
+        });
+    }
+
+    // reads finish in any order, only the last one requested for a file is applied
+    // and only if the file was not written since, i.e.: by the editor saving it
+    for(FileWatcherRead &read : reads){
+        struct stat st;
+        LineBuffer *lineBuffer = nullptr;
+        auto it = fileWatcher.latest.find(read.path);
+        if(it != fileWatcher.latest.end() && it->second == read.seq){
+            fileWatcher.latest.erase(it);
+            if(stat(read.path.c_str(), &st) == 0 && FileWatcherSameFile(st, read.st)){
+                lineBuffer = FileWatcherReloadable(read.path);
+            }
+        }
+
+        if(lineBuffer){
+            Tokenizer *tokenizer = FileProvider_GetLineBufferTokenizer(lineBuffer);
+            if(LineDiff_Apply(lineBuffer, tokenizer, read.content, read.size) > 0){
+                updated = 1;
+            }
+        }
+
+        AllocatorFree(read.content);
+    }
+
+    return updated;
+}
+
+#else
+void FileWatcher_WatchFile(const char *, uint){}
+void FileWatcher_UnwatchFile(const char *, uint){}
+void FileWatcher_WatchProject(const std::string &, const std::vector<std::string> &){}
+bool FileWatcher_WatchDirectory(const std::string &){ return false; }
+void FileWatcher_UnwatchDirectory(const std::string &){}
+void FileWatcher_FileSaved(const char *, uint){}
+int FileWatcher_Flush(){ return 0; }
+#endif
@@ -0,0 +1,60 @@
+/* date = October 19th 2026 22:40 */
+#pragma once
+#include <types.h>
+#include <string>
+#include <vector>
+
+/*
+* Detects files changed outside of the editor, i.e.: by a git checkout, a code
+* generator or a formatter. The directories of the opened files and of the indexed
+* project tree are watched with inotify by a background thread. Opened files that
+* were not modified in the editor are read again in the pool and updated on the
+* main thread with LineDiff_Apply, so only the lines that changed are replaced and
+* re-tokenized. Files of the project tree are marked dirty in the project index
+* and adding or removing them refreshes the FileIndex. Directories listed by the
+* DirectoryCache are watched as well so their listings are dropped once entries
+* are added or removed. Only local storage is watched and on targets without
+* inotify nothing is.
+*/
+
+/*
+* Starts watching the file at 'path', files are reference counted so the same file
+* can be watched more than once.
+*/
+void FileWatcher_WatchFile(const char *path, uint len);
+
+/*
+* Stops watching the file at 'path'.
+*/
+void FileWatcher_UnwatchFile(const char *path, uint len);
+
+/*
+* Watches the directories of 'files', the files of the project 'root', replacing
+* the ones of the previous project. Can be called from any thread.
+*/
+void FileWatcher_WatchProject(const std::string &root, const std::vector<std::string> &files);
+
+/*
+* Watches the entries of the directory 'dir', whenever one is added, removed or
+* renamed the listing of 'dir' is invalidated in the DirectoryCache. Directories
+* are reference counted like files. Returns false in case 'dir' could not be
+* watched, in which case it must not be unwatched.
+*/
+bool FileWatcher_WatchDirectory(const std::string &dir);
+
+/*
+* Stops watching the entries of the directory 'dir'.
+*/
+void FileWatcher_UnwatchDirectory(const std::string &dir);
+
+/*
+* Drops the reads of the file at 'path' that did not finish, must be called from
+* the main thread whenever the editor writes it as they are older than the buffer.
+*/
+void FileWatcher_FileSaved(const char *path, uint len);
+
+/*
+* Updates the opened files that changed since the last call, must be called from
+* the main thread once per frame. Returns 1 in case any LineBuffer changed.
+*/
+int FileWatcher_Flush();
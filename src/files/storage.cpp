@@ -153,9 +153,9 @@ int RemoteStorageDevice::ListFiles(char *basePath, FileEntry **entries,
         }
 
         if(!(currSize > count + 1)){
-            lEntries = AllocatorExpand(FileEntry, lEntries,
-                                       currSize+base, currSize);
-            currSize += base;
+            uint newSize = currSize < base ? base : 2 * currSize;
+            lEntries = AllocatorExpand(FileEntry, lEntries, newSize, currSize);
+            currSize = newSize;
         }
 
         lEntries[count].type = (FileType)id;
@@ -24,6 +24,9 @@
 #include <timer.h>
 #include <image_renderer.h>
 #include <audio.h>
+#include <scheduler.h>
+#include <file_watcher.h>
+#include <base_cmd.h>
 
 //NOTE: Since we already modified fontstash source to reduce draw calls
 //      we might as well embrace it
@@ -451,6 +454,7 @@ int Graphics_ComputeTokenColor(char *str, Token *token, SymbolTable *symTable,
     vec4i col = GetColor(theme, token->identifier);
     /* handle explicit overriden values, i.e.: functions and none */
     if(Symbol_IsTokenOverriden(token->identifier)){
+        auto guard = SymbolTable_ReadLock(symTable);
         SymbolNode *node = SymbolTable_Search(symTable, str, token->size);
         /* explicit search for user types for better rendering, better view */
         SymbolNode *res = node;
@@ -1623,68 +1627,70 @@ void Graphics_ToogleCursorBlinking(){
     }
 }
 
-void UpdateEventsAndHandleRequests(int animating, double frameInterval){
+/*
+* Waits for something to happen and runs the event handlers that are due. While
+* animating the pending window events are only collected. Otherwise the loop sleeps
+* on the window connection until there are events, a worker calls PostEmptyEvent or
+* the next event handler is due, so an idle editor does not consume CPU. Returns 1
+* if the next frame must be rendered.
+*/
+static int UpdateEventsAndHandleRequests(int animating){
     OpenGLState *state = &GlobalGLState;
-    // check if we are handling custom events outside
-    // the UI that require live update, for these we
-    // can pool but they will overconsume our CPU
-    // so cap at specific interval as they don't really need high fps
-    // but without it we would need to integrate x11 pooling
-    // with concurrent events, yikes...
-    if(state->eventHandlers.size() > 0 || animating){
-        // pool the UI first
+    int dirty = animating;
+    if(animating){
         PoolEvents();
+    }else{
+        double timeout = -1;
         if(state->eventHandlers.size() > 0){
-            double pTime = GetElapsedTime();
-            // check if we actually have to any work
-            if(pTime - state->lastEventTime < state->eventInterval){
-                // we sampled at a smaller interval, check against max sampling rate
-                // so we don't waste CPU on high frequency sampling
-                double dif = state->maxSamplingRate - frameInterval;
-                if(dif > 0){
-                    int idif = dif * 1000.0;
-                    //printf("FPS %g - Dif = %d ( %g )\n", 1.f / frameInterval, idif, dif);
-                    std::this_thread::sleep_for(std::chrono::milliseconds(idif));
-                }
-                return;
-            }
+            double wait = state->lastEventTime + state->eventInterval - GetElapsedTime();
+            timeout = wait > 0 ? wait : 0;
+        }
 
-            // pool the events and update next event interval in case anyone bails out
-            std::vector<EventHandler>::iterator it;
-            double expected_ival = Infinity;
-            bool any_rems = false;
-            state->lastEventTime = pTime;
-
-            for(it = state->eventHandlers.begin(); it != state->eventHandlers.end(); ){
-                EventHandler handler = *it;
-                double interval = pTime - handler.lastCalled;
-                if(interval > handler.interval){
-                    if(!handler.fn()){
-                        it = state->eventHandlers.erase(it);
-                        any_rems = true;
-                    }else{
-                        handler.lastCalled = pTime;
-                        *it = handler;
-                        it++;
-                    }
+        dirty |= WaitForEventsTimeout(timeout);
+    }
+
+    if(state->eventHandlers.size() > 0){
+        double pTime = GetElapsedTime();
+        // check if we actually have to any work
+        if(pTime - state->lastEventTime < state->eventInterval){
+            return dirty;
+        }
+
+        // pool the events and update next event interval in case anyone bails out
+        std::vector<EventHandler>::iterator it;
+        double expected_ival = Infinity;
+        bool any_rems = false;
+        state->lastEventTime = pTime;
+
+        for(it = state->eventHandlers.begin(); it != state->eventHandlers.end(); ){
+            EventHandler handler = *it;
+            double interval = pTime - handler.lastCalled;
+            if(interval > handler.interval){
+                // handlers update what is displayed, i.e.: the cursor blink
+                dirty = 1;
+                if(!handler.fn()){
+                    it = state->eventHandlers.erase(it);
+                    any_rems = true;
                 }else{
+                    handler.lastCalled = pTime;
+                    *it = handler;
                     it++;
                 }
-
-                expected_ival = Min(expected_ival, handler.interval);
+            }else{
+                it++;
             }
 
-            // in case someone exited we need to update the interval
-            // for the next one
-            if(any_rems && state->eventHandlers.size() > 0){
-                state->eventInterval = expected_ival;
-            }
+            expected_ival = Min(expected_ival, handler.interval);
+        }
+
+        // in case someone exited we need to update the interval
+        // for the next one
+        if(any_rems && state->eventHandlers.size() > 0){
+            state->eventInterval = expected_ival;
         }
-    }else{
-        // if we are not handling custom events than simply wait for the
-        // next UI event. This is fine because Cody is UI-driven
-        WaitForEvents();
     }
+
+    return dirty;
 }
 
 void Graphics_RequestClose(WidgetWindow *w){
@@ -1785,34 +1791,54 @@ void OpenGLEntry(){
     //_debugger_memory_usage();
     //state->widgetWindows.push_back(std::shared_ptr<WidgetWindow>(new PopupWindow));
 
+    int dirty = 1;
+    int wasAnimating = 0;
     while(!WindowShouldClose(state->window)){
         MakeContextCurrent(state->window);
         double currTime = GetElapsedTime();
         double dt = currTime - lastTime;
         int animating = 0;
-        wctx.dt = dt;
 
+        // time spent sleeping is not animation time
+        if(!wasAnimating && dt > FRAME_SCHEDULER_TARGET_INTERVAL){
+            dt = FRAME_SCHEDULER_TARGET_INTERVAL;
+        }
+
+        wctx.dt = dt;
         lastTime = currTime;
-        state->bErrors.clear();
-        FetchBuildErrors(state->bErrors);
 
-        // render main window
-        animating |= OpenGLRenderMainWindow(&wctx);
-        if(state->gWidgets.wwindow->WidgetCount() > 0){
-            animating |= state->gWidgets.wwindow->DispatchRender(&wctx);
-        }
+        // output of a running command is applied in one batch per frame
+        dirty |= ExecutorFlushOutput();
+        dirty |= FetchBuildErrors(&state->bErrors);
+        // files changed on disk are updated here as well
+        dirty |= FileWatcher_Flush();
+
+        // only render when something changed, nothing else can change the screen
+        if(dirty){
+            // render main window
+            animating |= OpenGLRenderMainWindow(&wctx);
+            if(state->gWidgets.wwindow->WidgetCount() > 0){
+                animating |= state->gWidgets.wwindow->DispatchRender(&wctx);
+            }
 
-        SwapBuffers(state->window);
+            SwapBuffers(state->window);
 
-        // render popups and other windows
-        for(std::shared_ptr<WidgetWindow> &sww : state->widgetWindows){
-            WidgetWindow *ptr = sww.get();
-            if(ptr){
-                animating |= ptr->DispatchRender(&wctx);
+            // render popups and other windows
+            for(std::shared_ptr<WidgetWindow> &sww : state->widgetWindows){
+                WidgetWindow *ptr = sww.get();
+                if(ptr){
+                    animating |= ptr->DispatchRender(&wctx);
+                }
             }
         }
 
-        UpdateEventsAndHandleRequests(animating, dt);
+        // incremental work gets whatever is left of this frame, keep the loop
+        // going while there is some so that it continues on the next frames
+        FrameScheduler_Run(dt, GetElapsedTime() - currTime);
+        animating |= FrameScheduler_HasWork();
+
+        wasAnimating = animating;
+        dirty = UpdateEventsAndHandleRequests(animating);
     }
 
     if(Dbg_IsRunning()){
@@ -1824,6 +1850,8 @@ void OpenGLEntry(){
         SLEEP(1);
     }
 
+    BaseCommand_CancelGlobalSearch();
+
     state->widgetWindows.clear();
     delete state->gWidgets.wdbgBt;
     delete state->gWidgets.wwindow;
@@ -203,7 +203,7 @@ struct OpenGLState{
     // does work really well.
     std::vector<std::shared_ptr<WidgetWindow>> widgetWindows;
 
-    std::vector<BuildError> bErrors;
+    BuildErrorSet bErrors;
 
     // TODO: Maybe don't use maps
     std::map<std::string, uint> textureMap;
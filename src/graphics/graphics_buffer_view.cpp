@@ -830,6 +830,51 @@ void Graphics_RenderSpacesHighlight(OpenGLState *state, View *vview, Transform *
         Graphics_QuadFlush(state);
 }
 
+/* Responsible for rendering the highlight of all matches of the active search */
+void Graphics_RenderMatchHighlight(OpenGLState *state, View *vview, Transform *projection,
+                                   Theme *theme)
+{
+    OpenGLFont *font = &state->font;
+    BufferView *view = View_GetBufferView(vview);
+    LineBuffer *lineBuffer = BufferView_GetLineBuffer(view);
+    if(!lineBuffer || !lineBuffer->matchSet) return;
+
+    vec4f color = GetUIColorf(theme, UISearchWord);
+
+    glEnable(GL_BLEND);
+    glUseProgram(font->cursorShader.id);
+    Shader_UniformMatrix4(font->cursorShader, "projection", &projection->m);
+    Shader_UniformMatrix4(font->cursorShader, "modelView", &state->model.m);
+
+    int added = 0;
+    Graphics_ForEachVisibleLine(vview, [&](vec2ui visibleLines, uint i,
+                                Buffer *buffer, EncoderDecoder *encoder)
+    {
+        uint *matches = nullptr;
+        uint count = MatchSet_GetLine(lineBuffer, i, &matches);
+        if(count == 0) return;
+
+        vec2f y = Graphics_GetLineYPos(state, visibleLines, i, vview);
+        for(uint k = 0; k < count; k++){
+            int previousGlyph = -1;
+            uint at = matches[2 * k];
+            uint len = matches[2 * k + 1];
+            if(at + len > buffer->taken) continue;
+
+            Float x0 = fonsComputeStringAdvance(font->fsContext, buffer->data, at,
+                                                &previousGlyph, encoder);
+            Float x1 = x0 + fonsComputeStringAdvance(font->fsContext, &buffer->data[at],
+                                                     len, &previousGlyph, encoder);
+            Graphics_QuadPush(state, vec2f(x0, y.x), vec2f(x1, y.y), color);
+            added += 1;
+        }
+    });
+
+    if(added > 0)
+        Graphics_QuadFlush(state);
+    glDisable(GL_BLEND);
+}
+
 static void Graphics_RenderDbgBreaks(OpenGLState *state, View *vview, Transform *projection,
                                      Float lineSpan, Theme *theme)
 {
@@ -888,6 +933,10 @@ void Graphics_RenderBuildErrors(OpenGLState *state, View *view, Float lineSpan,
     std::string path(str);
     if(path.size() == 0) return;
 
+    const BuildErrorSet *errors = &state->bErrors;
+    const BuildErrorLines *fileErrors = BuildErrorSet_GetFile(errors, path);
+    if(!fileErrors) return;
+
     EncoderDecoder *encoder = LineBuffer_GetEncoderDecoder(lineBuffer);
     vec2ui visibleLines = BufferView_GetViewRange(bufferView);
     vec4f col_err(0.8, 0.0, 0.0, 0.25);
@@ -901,15 +950,13 @@ void Graphics_RenderBuildErrors(OpenGLState *state, View *view, Float lineSpan,
     Float fontSize = currFontSize * 0.85;
     Float scale = currFontSize / fontSize;
     std::vector<vec3f> render_pts;
-    int counter = 0;
+    std::vector<const BuildError *> render_errs;
 
-    auto compute_render_pts = [&](BuildError &err) -> void{
+    auto compute_render_pts = [&](const BuildError *err, uint line) -> void{
         int pGlyph = -1;
-        if(path != err.file) return;
-
-        uint line = (uint)err.line > 0 ? err.line - 1 : 0;
-        if(visibleLines.x > line || visibleLines.y < line) return;
         Buffer *buf = LineBuffer_GetBufferAt(lineBuffer, line);
+        if(!buf) return;
+
         std::string str(buf->data, buf->taken);
         str += " ";
         Float x = fonsComputeStringAdvance(font->fsContext, (char *)str.c_str(),
@@ -917,15 +964,11 @@ void Graphics_RenderBuildErrors(OpenGLState *state, View *view, Float lineSpan,
 
         vec2f y = Graphics_GetLineYPos(state, visibleLines, line, view);
         render_pts.push_back(vec3f(x, y.x, y.y));
+        render_errs.push_back(err);
     };
 
-    auto render_lines_rects = [&](BuildError &err) -> void{
+    auto render_lines_rects = [&](const BuildError &err, vec3f p) -> void{
         int pGlyph = -1;
-        if(path != err.file) return;
-
-        uint line = (uint)err.line > 0 ? err.line - 1 : 0;
-        if(visibleLines.x > line || visibleLines.y < line) return;
-        vec3f p = render_pts[counter++];
         vec2f y = vec2f(p.y, p.z);
         Float x = p.x * scale;
         Float yx = y.x * scale + fontSize * 0.25;
@@ -957,15 +1000,23 @@ void Graphics_RenderBuildErrors(OpenGLState *state, View *view, Float lineSpan,
         Graphics_QuadPush(state, vec2f(2.0f, y.x), vec2f(lineSpan, y.y), col);
     };
 
-    for(BuildError &err : state->bErrors){
-        compute_render_pts(err);
+    // only the visible lines are looked up instead of going through all errors
+    uint lastLine = visibleLines.y < lineBuffer->lineCount ? visibleLines.y :
+                                                             lineBuffer->lineCount - 1;
+    for(uint line = visibleLines.x; line <= lastLine && lineBuffer->lineCount > 0; line++){
+        const BuildError *err = BuildErrorSet_Get(errors, fileErrors, line);
+        if(err){
+            compute_render_pts(err, line);
+        }
     }
 
+    if(render_errs.size() == 0) return;
+
     Graphics_SetFontSize(state, fontSize);
     Graphics_PrepareTextRendering(state, projection, &state->scale);
 
-    for(BuildError &err : state->bErrors){
-        render_lines_rects(err);
+    for(uint i = 0; i < render_errs.size(); i++){
+        render_lines_rects(*render_errs[i], render_pts[i]);
     }
 
     Graphics_FlushText(state);
@@ -1266,13 +1317,15 @@ int Graphics_RenderView(View *view, OpenGLState *state, Theme *theme, Float dt){
         int is_locked = 0;
         int is_running = 0;
         LockedLineBuffer *lockedBuffer = nullptr;
-        GetExecutorLockedLineBuffer(&lockedBuffer);
-        is_running = ExecuteCommandDone() == 0;
-        if(lockedBuffer->lineBuffer == bView->lineBuffer &&
-           bView->lineBuffer != nullptr)
-        {
+        CommandSession *session = CommandSession_FromLineBuffer(bView->lineBuffer);
+        if(session){
+            // the output of a session only shows its own command
+            is_running = CommandSession_IsRunning(session);
+            lockedBuffer = CommandSession_GetOutput(session);
             lockedBuffer->mutex.lock();
             is_locked = 1;
+        }else{
+            is_running = ExecuteCommandDone() == 0;
         }
 
         int r =  Graphics_RenderBufferView(view, state, theme, dt, is_running);
@@ -1282,16 +1335,17 @@ int Graphics_RenderView(View *view, OpenGLState *state, Theme *theme, Float dt){
                 if(r == 0){
                     lockedBuffer->render_state = -1;
                 }
-            }else if(lockedBuffer->render_state == -1){
-
-            }else{
-                r = 1;
+            }else if(lockedBuffer->render_state == 0){
+                // the new output is on screen, the next batch marks it again
+                // once ExecutorFlushOutput applies it
+                lockedBuffer->render_state = -1;
             }
 
             lockedBuffer->mutex.unlock();
         }
 
-        return r || is_running;
+        // new output of a running command wakes the loop, see PostEmptyEvent
+        return r;
     }else if(BufferView_GetViewType(bView) == ImageView){
         // NOTE: in case the query bar is calling this we need
         //       to not query the view state as it is going to be
@@ -1404,9 +1458,11 @@ int Graphics_RenderBufferView(View *vview, OpenGLState *state, Theme *theme,
         Graphics_RenderSpacesHighlight(state, vview, &state->projection, theme);
     }
 
+    Graphics_RenderMatchHighlight(state, vview, &state->projection, theme);
+
     Graphics_RenderDbgBreaks(state, vview, &state->projection, scaledWidth, theme);
 
-    if(state->bErrors.size() > 0){
+    if(state->bErrors.errors.size() > 0){
         Graphics_RenderBuildErrors(state, vview, scaledWidth, &state->projection,
                                    &state->model, theme);
     }
@@ -154,26 +154,22 @@ void Graphics_RenderQueryBarSelection(View *view, OpenGLState *state, Theme *the
        || cmd == QUERY_BAR_CMD_SEARCH_AND_REPLACE)
     {
         QueryBarCmdSearch *result = nullptr;
-        QueryBarCmdSearchAndReplace *replace = &bar->replaceCmd;
         QueryBar_GetSearchResult(bar, &result);
 
         if(result->valid == 0) return;
 
-        char *searched = nullptr;
-        uint slen = 0;
-        if(cmd == QUERY_BAR_CMD_SEARCH_AND_REPLACE){
-            searched = replace->toLocate;
-            slen = replace->toLocateLen;
-        }else{
-            QueryBar_GetWrittenContent(bar, &searched, &slen);
-        }
-
+        uint slen = result->length;
         if(slen == 0) return;
 
         // 1- Grab the buffer and position inside the buffer
         BufferView *bView = View_GetBufferView(view);
         vec2ui lines = BufferView_GetViewRange(bView);
         Buffer *buffer = BufferView_GetBufferAt(bView, result->lineNo);
+        if(!buffer || result->position + slen > buffer->taken) return;
+
+        // the match is not necessarily what was typed, i.e.: regex, take it
+        // from the buffer itself
+        char *searched = &buffer->data[result->position];
         EncoderDecoder *encoder = LineBuffer_GetEncoderDecoder(bView->lineBuffer);
         uint p8 = Buffer_Utf8RawPositionToPosition(buffer, result->position, encoder);
 
@@ -204,10 +200,6 @@ void Graphics_RenderQueryBarSelection(View *view, OpenGLState *state, Theme *the
 
         x0 += padding;
 
-        // since there is a match we don't actually need to compute the raw position
-        // for the searched string, we can simply copy the already filled string
-        // from the search context which is better since it starts at 0 and is null
-        // terminated
         x1 = x0 + fonsComputeStringAdvance(state->font.fsContext, &searched[0],
                                            result->length, &pGlyph, encoder);
 
@@ -6,6 +6,8 @@
 #include <string.h>
 #include <glx_helper.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
 #include <x11_keyboard.h>
 #include <climits>
@@ -139,32 +141,54 @@ double GetElapsedTime(){
     return (double)(GetTimerValue() - timer.offset) / GetTimerFrequency();
 }
 
+/*
+* Consumes the wakeups posted with PostEmptyEventX11.
+*/
+static void drainWakeups(){
+    uint64_t value = 0;
+    if(x11Helper.wakeupFd > 0){
+        while(read(x11Helper.wakeupFd, &value, sizeof(value)) > 0){}
+    }
+}
+
+/*
+* Waits until the X connection has data or PostEmptyEventX11 is called, returns
+* 0 if 'timeout' expired first. A null 'timeout' waits forever.
+*/
 int waitForEvent(double* timeout){
-    fd_set fds;
+    struct pollfd fds[2];
     const int fd = ConnectionNumber(x11Helper.display);
-    int count = fd + 1;
+    int count = x11Helper.wakeupFd > 0 ? 2 : 1;
 
-    for(;;){
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
+    fds[0] = { .fd = fd, .events = POLLIN, .revents = 0 };
+    fds[1] = { .fd = x11Helper.wakeupFd, .events = POLLIN, .revents = 0 };
 
+    for(;;){
+        int ms = -1;
+        const uint64_t base = GetTimerValue();
         if(timeout){
-            const long seconds = (long) *timeout;
-            const long microseconds = (long) ((*timeout - seconds) * 1e6);
-            struct timeval tv = { seconds, microseconds };
-            const uint64_t base = GetTimerValue();
+            // round up so we never wake before the deadline and spin
+            ms = *timeout > 0 ? (int)(*timeout * 1e3 + 0.999) : 0;
+        }
 
-            const int result = select(count, &fds, NULL, NULL, &tv);
-            const int error = errno;
+        const int result = poll(fds, count, ms);
+        const int error = errno;
 
+        if(timeout){
             *timeout -= (GetTimerValue() - base) / (double) GetTimerFrequency();
+        }
 
-            if(result > 0)
-                return 1;
-            if((result == -1 && error == EINTR) || *timeout <= 0.0)
-                return 0;
-        }else if (select(count, &fds, NULL, NULL, NULL) != -1 || errno != EINTR)
+        if(result > 0){
+            if(count > 1 && (fds[1].revents & POLLIN)){
+                drainWakeups();
+            }
             return 1;
+        }
+
+        if(result == 0 || error != EINTR)
+            return 0;
+        if(timeout && *timeout <= 0.0)
+            return 0;
     }
 }
 
@@ -261,6 +285,12 @@ void InitializeX11(){
     InitializeTimer();
     InitializeFramebuffer(&x11Framebuffer);
 
+    x11Helper.wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(x11Helper.wakeupFd < 0){
+        printf("Failed to create wakeup event, workers cannot wake the UI\n");
+        x11Helper.wakeupFd = 0;
+    }
+
     //TODO: Expose?
     x11GLContext.forward = 1;
     x11GLContext.profile = OPENGL_CORE_PROFILE;
@@ -579,6 +609,11 @@ WindowX11 *CreateWindowX11(int width, int height, const char *title){
 }
 
 void TerminateX11(){
+    if(x11Helper.wakeupFd > 0){
+        close(x11Helper.wakeupFd);
+        x11Helper.wakeupFd = 0;
+    }
+
     XCloseIM(x11Helper.im);
     XCloseDisplay(x11Helper.display);
     TerminateGLX();
@@ -969,24 +1004,42 @@ __ret:
 }
 
 void WaitForEventsX11(){
-    while(!XPending(x11Helper.display)){
-        waitForEvent(NULL);
+    WaitForEventsTimeoutX11(-1);
+}
+
+int WaitForEventsTimeoutX11(double timeout){
+    int rv = 1;
+    if(!XPending(x11Helper.display)){
+        // a wakeup also returns so the caller can render what workers produced
+        rv = waitForEvent(timeout < 0 ? NULL : &timeout);
     }
 
     PoolEventsX11();
+    return rv;
+}
+
+void PostEmptyEventX11(){
+    uint64_t value = 1;
+    if(x11Helper.wakeupFd > 0){
+        // the counter only saturates after 2^64 wakeups, nothing to do on failure
+        if(write(x11Helper.wakeupFd, &value, sizeof(value)) < 0){}
+    }
 }
 
-void PoolEventsX11(){
+int PoolEventsX11(){
+    int processed = 0;
     XPending(x11Helper.display);
 
     while(XQLength(x11Helper.display)){
         XEvent event;
         XNextEvent(x11Helper.display, &event);
         ProcessEventX11(&event);
+        processed++;
     }
 
     //TODO: Figure out this cursor thingy in glfw
     XFlush(x11Helper.display);
+    return processed;
 }
 
 void ProcessEventReparentX11(XEvent *event, WindowX11 *window, LibHelperX11 *x11){
@@ -199,6 +199,9 @@ typedef struct{
     unsigned int primarySelectionStringSize;
     unsigned int clipboardStringSize;
 
+    // eventfd written by PostEmptyEventX11 to wake up the event loop
+    int wakeupFd;
+
     struct{
         int available;
         int detectable;
@@ -219,12 +222,14 @@ int  WindowShouldCloseX11(WindowX11 *window);
 void SetWindowShouldCloseX11(WindowX11 *window);
 void SwapBuffersX11(WindowX11 *window);
 void SwapIntervalX11(WindowX11 *window, int interval);
-void PoolEventsX11();
+int  PoolEventsX11();
 void MakeContextX11(WindowX11 *window);
 void HideCursorX11(WindowX11 *window);
 void ShowCursorX11(WindowX11 *window);
 int IsCursorDisplayedX11();
 void WaitForEventsX11();
+int  WaitForEventsTimeoutX11(double timeout);
+void PostEmptyEventX11();
 WindowX11 *CreateWindowX11(int width, int height, const char *title);
 WindowX11 *CreateWindowX11Shared(int width, int height,
                                  const char *title, WindowX11 *share);
@@ -1229,6 +1229,23 @@ void WaitEventsWin32(){
     PollEventsWin32();
 }
 
+int WaitEventsTimeoutWin32(double timeout){
+    int rv = 1;
+    if(timeout < 0){
+        WaitMessage();
+    }else{
+        DWORD ms = (DWORD)(timeout * 1e3 + 0.999);
+        rv = MsgWaitForMultipleObjects(0, NULL, FALSE, ms, QS_ALLINPUT) != WAIT_TIMEOUT;
+    }
+
+    PollEventsWin32();
+    return rv;
+}
+
+void PostEmptyEventWin32(){
+    PostMessageW(win32Helper.helperWindowHandle, WM_NULL, 0, 0);
+}
+
 void MakeContextWin32(WindowWin32* window){
     MakeContextWGL(window);
 }
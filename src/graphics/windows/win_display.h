@@ -312,6 +312,8 @@ void DestroyWindowWin32(WindowWin32* window);
 void SetWindowTitleWin32(WindowWin32* window, const char* title);
 void TerminateWin32();
 void WaitEventsWin32();
+int WaitEventsTimeoutWin32(double timeout);
+void PostEmptyEventWin32();
 void PollEventsWin32();
 void HideCursorWin32(WindowWin32* window);
 void ShowCursorWin32(WindowWin32* window);